@@ -0,0 +1,98 @@
+/***********************************************************************
+ BenchmarkSuites - Runs the benchmarks and correctness checks of the
+ filter, codec and render modules outside the application.
+ ***********************************************************************/
+
+#include "BenchmarkSuites.h"
+#include "ofMain.h"
+#include "ColorMap.h"
+#include "FilterBenchmark.h"
+#include "CodecBenchmark.h"
+#include "RenderBenchmark.h"
+#include <algorithm>
+
+namespace BenchmarkSuites {
+
+bool runFilterSuite(const std::string& recordingFileName)
+{
+    bool passed=true;
+    // compare the temporal filter modes on synthetic frames, at the default window and at a longer one
+    FilterBenchmark::compareFilterModes(640, 480, 20, 10, 2, 0.1f, 100, 0);
+    FilterBenchmark::compareFilterModes(640, 480, 400, 10, 2, 0.1f, 100, 0);
+    // SSE4.1 and AVX2 temporal kernels against the scalar reference, at the defaults, on odd sizes running the scalar tails,
+    // with the longest averaging buffer and the largest 8-bit maximum variance, and on a recording if one was given
+    passed=FilterBenchmark::compareKernelIsas(640, 480, 20, 10, 2, 0.1f, 60)&&passed;
+    passed=FilterBenchmark::compareKernelIsas(641, 479, 20, 10, 1535, 0.5f, 60)&&passed;
+    passed=FilterBenchmark::compareKernelIsas(161, 119, 255, 10, 1535, 0.1f, 600)&&passed;
+    if (!recordingFileName.empty()) {
+        passed=FilterBenchmark::compareKernelIsasOnRecording(recordingFileName, 750.0f, 950.0f, 20, 10, 2, 0.1f, 300)&&passed;
+        passed=FilterBenchmark::compareKernelIsasOnRecording(recordingFileName, 750.0f, 950.0f, 255, 10, 1535, 0.1f, 300)&&passed;
+    }
+    // stability criterion of fused sensors across clip range changes
+    passed=FilterBenchmark::checkSensorStability()&&passed;
+    // whole filter on 1 to one thread per core
+    FilterBenchmark::measureThreadScaling(640, 480, 100, 0);
+    // spatial filter at the kinect resolution and at larger synthetic ones
+    passed=FilterBenchmark::compareSpatialFilters(640, 480, 100, 0)&&passed;
+    passed=FilterBenchmark::compareSpatialFilters(1920, 1080, 20, 0)&&passed;
+    passed=FilterBenchmark::compareSpatialFilters(3840, 2160, 10, 0)&&passed;
+    // ROI detection of the calibration, threshold sweep and single pass
+    FilterBenchmark::compareRoiDetection(640, 480, 10);
+    return passed;
+}
+
+bool runCodecSuite(void)
+{
+    // lossless depth codec of compressed recordings
+    return CodecBenchmark::measureCodec(640, 480, 120, 2, 0);
+}
+
+bool runRenderSuite(void)
+{
+    bool passed=true;
+    // CPU colormap and contour line rendering at projector resolutions, with the application's color map
+    ColorMap colormap;
+    colormap.load("HeightColorMap.yml");
+    passed=RenderBenchmark::measureColorMapRenderer(colormap, 1024, 768, 60, 0)&&passed;
+    passed=RenderBenchmark::measureColorMapRenderer(colormap, 1920, 1080, 60, 0)&&passed;
+    passed=RenderBenchmark::measureColorMapRenderer(colormap, 3840, 2160, 20, 0)&&passed;
+    // projector ray marching, every ray and only the ones crossing changed tiles
+    passed=RenderBenchmark::measureRayMarcher(800, 600, 60, 0)&&passed;
+    passed=RenderBenchmark::measureRayMarcher(1920, 1080, 30, 0)&&passed;
+    // terrain mesh updates, under moving hands and under noise changing every tile
+    passed=RenderBenchmark::measureTerrainMesh(640, 480, 2, 120, 0)&&passed;
+    return passed;
+}
+
+int run(const std::vector<std::string>& args)
+{
+    std::vector<std::string> suites;
+    std::string recordingFileName;
+    for(size_t i=0;i<args.size();++i)
+    {
+        if(args[i]=="--recording"&&i+1<args.size())
+            recordingFileName=args[++i];
+        else if(args[i]=="filter"||args[i]=="codec"||args[i]=="render")
+            suites.push_back(args[i]);
+        else
+        {
+            ofLog(OF_LOG_ERROR, "BenchmarkSuites: unknown argument "+args[i]+", expected filter, codec, render or --recording <file>");
+            return 2;
+        }
+    }
+    bool all=suites.empty();
+    std::vector<std::string> failed;
+
+    if((all||std::find(suites.begin(),suites.end(),"filter")!=suites.end())&&!runFilterSuite(recordingFileName))
+        failed.push_back("filter");
+    if((all||std::find(suites.begin(),suites.end(),"codec")!=suites.end())&&!runCodecSuite())
+        failed.push_back("codec");
+    if((all||std::find(suites.begin(),suites.end(),"render")!=suites.end())&&!runRenderSuite())
+        failed.push_back("render");
+
+    for(size_t i=0;i<failed.size();++i)
+        ofLog(OF_LOG_ERROR, "BenchmarkSuites: a check of the "+failed[i]+" suite FAILED");
+    return failed.empty()?0:1;
+}
+
+}
@@ -0,0 +1,20 @@
+/***********************************************************************
+ BenchmarkSuites - Runs the benchmarks and correctness checks of the
+ filter, codec and render modules outside the application, from the
+ --benchmark command line flag, so they neither freeze the windows nor
+ compete with the grabber thread. Each suite returns false if one of
+ its checks failed.
+ ***********************************************************************/
+
+#pragma once
+#include <string>
+#include <vector>
+
+namespace BenchmarkSuites {
+    bool runFilterSuite(const std::string& recordingFileName); // Temporal filter modes and kernels, also on a recording unless the name is empty, thread scaling, spatial filter and ROI detection
+    bool runCodecSuite(void); // Lossless depth codec of compressed recordings
+    bool runRenderSuite(void); // CPU colormap renderer, projector ray marcher and terrain mesh
+
+    /* Runs the named suites (filter, codec, render), all of them if none is named, given --recording <file> checks the kernels on that recording too; returns the process exit status, non-zero if a check failed or an argument is unknown: */
+    int run(const std::vector<std::string>& args);
+}
@@ -0,0 +1,112 @@
+/***********************************************************************
+ CodecBenchmark - Measures the lossless depth codec used for compressed
+ recordings on frames of the synthetic sandbox.
+ ***********************************************************************/
+
+#include "CodecBenchmark.h"
+#include "ofMain.h"
+#include "DepthCodec.h"
+#include "DepthRecording.h"
+#include "SyntheticDepthSource.h"
+#include "WorkerPool.h"
+#include <vector>
+
+namespace CodecBenchmark {
+
+/* Returns true if frames whose samples differ from their neighbors and from the previous frame by up to +-32768 survive a round trip, as a key and as a delta frame: */
+static bool checkExtremeResiduals(void)
+{
+    const unsigned int width=8,height=2;
+    const uint16_t values[4]={1000,33768,1,32769};
+    std::vector<uint16_t> frames[2];
+    for(int f=0;f<2;++f)
+    {
+        frames[f].resize(width*height);
+        for(unsigned int i=0;i<width*height;++i)
+            frames[f][i]=values[(i+i/width+f)%4];
+    }
+    std::vector<unsigned char> encoded;
+    std::vector<uint16_t> decoded[2]={std::vector<uint16_t>(width*height), std::vector<uint16_t>(width*height)};
+    bool identical=true;
+    for(int f=0;f<2;++f)
+    {
+        size_t size=DepthCodec::encode(&frames[f][0], f>0?&frames[f-1][0]:0, width, height, 1, encoded, 0);
+        identical=DepthCodec::decode(&encoded[0], size, f>0?&decoded[f-1][0]:0, width, height, &decoded[f][0], 0)&&identical;
+        identical=identical&&decoded[f]==frames[f];
+    }
+    return identical;
+}
+
+bool measureCodec(unsigned int width, unsigned int height, int numFrames, int numHands, int numThreads)
+{
+    /* Generate the frames before timing, as fast as the source can: */
+    SyntheticDepthSource source;
+    source.setNumHands(numHands);
+    source.setNumThreads(numThreads);
+    source.open(width, height, 0.0f);
+    size_t numPixels=size_t(width)*height;
+    std::vector<std::vector<uint16_t> > frames(numFrames);
+    for(int f=0;f<numFrames;++f)
+    {
+        source.update();
+        const uint16_t* depth=source.getRawDepthPixels().getData();
+        frames[f].assign(depth, depth+numPixels);
+    }
+    double rawBytes=double(numPixels*sizeof(uint16_t));
+
+    /* One frame after the other on one thread, keeping the encoded frames: */
+    std::vector<std::vector<unsigned char> > encoded(numFrames);
+    std::vector<size_t> sizes(numFrames);
+    double keyBytes=0.0, deltaBytes=0.0;
+    int numKeyFrames=0;
+    uint64_t start=ofGetElapsedTimeMicros();
+    for(int f=0;f<numFrames;++f)
+    {
+        bool keyFrame=f%DepthRecording::keyFrameInterval==0;
+        sizes[f]=DepthCodec::encode(&frames[f][0], keyFrame?0:&frames[f-1][0], width, height, DepthRecording::numCodecBands, encoded[f], 0);
+        if(keyFrame)
+        {
+            keyBytes+=double(sizes[f]);
+            ++numKeyFrames;
+        }
+        else
+            deltaBytes+=double(sizes[f]);
+    }
+    double encodeMicros=double(ofGetElapsedTimeMicros()-start)/numFrames;
+
+    /* Independent frames on all threads, as the recorder's encoder threads run: */
+    WorkerPool pool;
+    pool.setNumThreads(numThreads);
+    std::vector<std::vector<unsigned char> > scratch(numFrames);
+    start=ofGetElapsedTimeMicros();
+    pool.run(numFrames, [&](int f){
+        bool keyFrame=f%DepthRecording::keyFrameInterval==0;
+        DepthCodec::encode(&frames[f][0], keyFrame?0:&frames[f-1][0], width, height, DepthRecording::numCodecBands, scratch[f], 0);
+    });
+    double parallelEncodeMicros=double(ofGetElapsedTimeMicros()-start)/numFrames;
+
+    /* Decode in order as playback does, with the bands in parallel: */
+    std::vector<uint16_t> decoded[2]={std::vector<uint16_t>(numPixels), std::vector<uint16_t>(numPixels)};
+    bool identical=true;
+    start=ofGetElapsedTimeMicros();
+    for(int f=0;f<numFrames;++f)
+    {
+        identical=DepthCodec::decode(&encoded[f][0], sizes[f], &decoded[(f+1)%2][0], width, height, &decoded[f%2][0], &pool)&&identical;
+        identical=identical&&decoded[f%2]==frames[f];
+    }
+    double decodeMicros=double(ofGetElapsedTimeMicros()-start)/numFrames;
+
+    int numDeltaFrames=numFrames-numKeyFrames;
+    std::cout<< "Depth codec on " << numFrames << " synthetic frames of " << width << "x" << height << " with " << numHands << " hands:" <<std::endl;
+    std::cout<< "  compression " << rawBytes*numFrames/(keyBytes+deltaBytes) << ":1 (key frames " << rawBytes*numKeyFrames/keyBytes << ":1";
+    if(numDeltaFrames>0)
+        std::cout<< ", delta frames " << rawBytes*numDeltaFrames/deltaBytes << ":1";
+    std::cout<< ")" <<std::endl;
+    std::cout<< "  encoding " << encodeMicros << " us/frame, " << rawBytes/encodeMicros << " MB/s (1 thread), " << parallelEncodeMicros << " us/frame (pool)" <<std::endl;
+    std::cout<< "  decoding " << decodeMicros << " us/frame, " << 1.0e6/decodeMicros/30.0 << "x real time at 30 fps, " << (identical?"lossless":"DIFFERENT") << " output" <<std::endl;
+    bool extremeIdentical=checkExtremeResiduals();
+    std::cout<< "  residuals of +-32768 " << (extremeIdentical?"lossless":"DIFFERENT") <<std::endl;
+    return identical&&extremeIdentical;
+}
+
+}
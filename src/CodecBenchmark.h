@@ -0,0 +1,13 @@
+/***********************************************************************
+ CodecBenchmark - Measures the lossless depth codec used for compressed
+ recordings on frames of the synthetic sandbox: compression ratio of key
+ and delta frames, encoding throughput on one thread and across frames
+ on the encoder threads, and decoding speed against real time.
+ ***********************************************************************/
+
+#pragma once
+
+namespace CodecBenchmark {
+    /* Encodes numFrames synthetic frames as a compressed recording would, decodes them back, checks they match, as well as frames with differences of +-32768, prints the results and returns true if all round trips were lossless: */
+    bool measureCodec(unsigned int width, unsigned int height, int numFrames, int numHands, int numThreads);
+}
@@ -0,0 +1,208 @@
+/***********************************************************************
+ ColorMapRenderer - CPU implementation of the projector shader.
+ ***********************************************************************/
+
+#include "ColorMapRenderer.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=2)
+#define COLORMAPRENDERER_SSE2 1
+#include <emmintrin.h>
+#endif
+
+/*********************************
+ Methods of class ColorMapRenderer:
+ *********************************/
+
+ColorMapRenderer::ColorMapRenderer()
+:width(0), height(0), depthWidth(0), depthHeight(0), intervalFactor(-1.0f), lastRenderTime(0)
+{
+    for(int v=0;v<256;++v)
+        colors[v][0]=colors[v][1]=colors[v][2]=(unsigned char)(v);
+    workerPool.setNumThreads(1);
+}
+
+void ColorMapRenderer::setColorMap(const ColorMap& colormap)
+{
+    /* The shader looks depth value v up at x=v of the colormap texture, halfway between the centers of texels v-1 and v: */
+    int lastEntry=std::max(colormap.getNumEntries()-1,0);
+    for(int v=0;v<256;++v)
+    {
+        ColorMap::Color c0=colormap(std::min(std::max(v-1,0),lastEntry));
+        ColorMap::Color c1=colormap(std::min(v,lastEntry));
+        colors[v][0]=(unsigned char)((int(c0.r)+int(c1.r)+1)>>1);
+        colors[v][1]=(unsigned char)((int(c0.g)+int(c1.g)+1)>>1);
+        colors[v][2]=(unsigned char)((int(c0.b)+int(c1.b)+1)>>1);
+    }
+}
+
+void ColorMapRenderer::setNumThreads(int newNumThreads)
+{
+    workerPool.setNumThreads(newNumThreads);
+}
+
+void ColorMapRenderer::setupScaling(unsigned int newDepthWidth, unsigned int newDepthHeight)
+{
+    depthWidth=newDepthWidth;
+    depthHeight=newDepthHeight;
+
+    /* Output pixel centers map to texel coordinates (o+0.5)*size/outputSize-0.5, clamped to the edge texels; weights are quantized to 8 bits as GPUs filter: */
+    texelX.resize(width);
+    weightX.resize(width);
+    for(unsigned int x=0;x<width;++x)
+    {
+        float u=(float(x)+0.5f)*float(depthWidth)/float(width)-0.5f;
+        float u0=std::floor(u);
+        texelX[x]=(unsigned int)(std::min(std::max(u0,0.0f),float(depthWidth-1)));
+        weightX[x]=u0<0.0f||u0>=float(depthWidth-1)?0:(unsigned int)((u-u0)*256.0f+0.5f);
+    }
+    texelY.resize(height);
+    weightY.resize(height);
+    for(unsigned int y=0;y<height;++y)
+    {
+        float v=(float(y)+0.5f)*float(depthHeight)/float(height)-0.5f;
+        float v0=std::floor(v);
+        texelY[y]=(unsigned int)(std::min(std::max(v0,0.0f),float(depthHeight-1)));
+        weightY[y]=v0<0.0f||v0>=float(depthHeight-1)?0:(unsigned int)((v-v0)*256.0f+0.5f);
+    }
+}
+
+void ColorMapRenderer::scaleRows(const ofPixels& depth, unsigned int y0, unsigned int y1)
+{
+    const unsigned char* data=depth.getData();
+    for(unsigned int y=y0;y<y1;++y)
+    {
+        const unsigned char* row0=data+size_t(texelY[y])*depthWidth;
+        const unsigned char* row1=weightY[y]!=0?row0+depthWidth:row0;
+        unsigned int wy=weightY[y];
+        unsigned char* fbPtr=&frameBuffer[size_t(y)*width];
+        for(unsigned int x=0;x<width;++x)
+        {
+            /* Interpolate like linear texture filtering and round into the 8-bit frame buffer: */
+            unsigned int tx=texelX[x];
+            unsigned int tx1=weightX[x]!=0?tx+1:tx;
+            unsigned int wx=weightX[x];
+            unsigned int top=row0[tx]*(256-wx)+row0[tx1]*wx;
+            unsigned int bottom=row1[tx]*(256-wx)+row1[tx1]*wx;
+            fbPtr[x]=(unsigned char)((top*(256-wy)+bottom*wy+32768)>>16);
+        }
+    }
+}
+
+void ColorMapRenderer::computeIntervals(unsigned int row, short* intervals) const
+{
+    /* A corner on row boundary r and column boundary c averages the frame buffer pixels around it, clamped to the edge: */
+    const unsigned char* above=&frameBuffer[size_t(row>0?row-1:0)*width];
+    const unsigned char* below=&frameBuffer[size_t(row<height?row:height-1)*width];
+    const short* table=&intervalTable[0];
+    intervals[0]=table[2*(above[0]+below[0])];
+    for(unsigned int c=1;c<width;++c)
+        intervals[c]=table[above[c-1]+above[c]+below[c-1]+below[c]];
+    intervals[width]=table[2*(above[width-1]+below[width-1])];
+}
+
+void ColorMapRenderer::renderRows(unsigned char* rgb, unsigned int y0, unsigned int y1)
+{
+    std::vector<short> intervalRows(2*(width+8));
+    short* top=&intervalRows[0];
+    short* bottom=top+width+8;
+    std::vector<unsigned char> contour(width+8);
+    computeIntervals(y0,top);
+    for(unsigned int y=y0;y<y1;++y)
+    {
+        computeIntervals(y+1,bottom);
+
+        /* Classify the pixels by which of their four corners lie in different contour intervals: */
+        unsigned int x=0;
+#if defined(COLORMAPRENDERER_SSE2)
+        __m128i minusTwo=_mm_set1_epi16(-2);
+        __m128i even=y&1?_mm_set_epi16(-1,0,-1,0,-1,0,-1,0):_mm_set_epi16(0,-1,0,-1,0,-1,0,-1);
+        for(;x+8<=width;x+=8)
+        {
+            __m128i c0=_mm_loadu_si128((const __m128i*)(top+x));
+            __m128i c1=_mm_loadu_si128((const __m128i*)(top+x+1));
+            __m128i c2=_mm_loadu_si128((const __m128i*)(bottom+x));
+            __m128i c3=_mm_loadu_si128((const __m128i*)(bottom+x+1));
+
+            /* Equal corner pairs are -1, so their sum is minus the number of edges that do not cross a contour: */
+            __m128i same1=_mm_cmpeq_epi16(c0,c1);
+            __m128i same2=_mm_cmpeq_epi16(c2,c3);
+            __m128i same4=_mm_cmpeq_epi16(c0,c2);
+            __m128i same8=_mm_cmpeq_epi16(c1,c3);
+            __m128i numSame=_mm_add_epi16(_mm_add_epi16(same1,same2),_mm_add_epi16(same4,same8));
+
+            /* More than two crossed edges, or two of them that are opposite or on an even pixel: */
+            __m128i opposite=_mm_or_si128(_mm_andnot_si128(_mm_or_si128(same1,same2),_mm_set1_epi16(-1)),_mm_andnot_si128(_mm_or_si128(same4,same8),_mm_set1_epi16(-1)));
+            __m128i twoEdges=_mm_and_si128(_mm_cmpeq_epi16(numSame,minusTwo),_mm_or_si128(opposite,even));
+            __m128i line=_mm_or_si128(_mm_cmpgt_epi16(numSame,minusTwo),twoEdges);
+            _mm_storel_epi64((__m128i*)(&contour[x]),_mm_packs_epi16(line,line));
+        }
+#endif
+        for(;x<width;++x)
+        {
+            int edgeMask=0;
+            if(top[x]!=top[x+1])
+                edgeMask|=1;
+            if(bottom[x]!=bottom[x+1])
+                edgeMask|=2;
+            if(top[x]!=bottom[x])
+                edgeMask|=4;
+            if(top[x+1]!=bottom[x+1])
+                edgeMask|=8;
+            int numEdges=(edgeMask&1)+((edgeMask>>1)&1)+((edgeMask>>2)&1)+((edgeMask>>3)&1);
+            bool line=numEdges>2||edgeMask==3||edgeMask==12||(numEdges==2&&((x+y)&1)==0);
+            contour[x]=line?0xff:0x00;
+        }
+
+        /* Color the row: */
+        const unsigned char* fbPtr=&frameBuffer[size_t(y)*width];
+        unsigned char* rgbPtr=rgb+size_t(y)*width*3;
+        for(x=0;x<width;++x,rgbPtr+=3)
+        {
+            const unsigned char* color=colors[fbPtr[x]];
+            unsigned char keep=(unsigned char)(~contour[x]);
+            rgbPtr[0]=color[0]&keep;
+            rgbPtr[1]=color[1]&keep;
+            rgbPtr[2]=color[2]&keep;
+        }
+        std::swap(top,bottom);
+    }
+}
+
+void ColorMapRenderer::render(const ofPixels& depth, unsigned int newWidth, unsigned int newHeight, float contourLineFactor, ofPixels& rgb)
+{
+    uint64_t startTime=ofGetElapsedTimeMicros();
+    if(depth.getWidth()==0||depth.getHeight()==0||newWidth==0||newHeight==0)
+        return;
+
+    /* Recompute the tables if the sizes or the contour line spacing changed: */
+    if(newWidth!=width||newHeight!=height||depth.getWidth()!=depthWidth||depth.getHeight()!=depthHeight)
+    {
+        width=newWidth;
+        height=newHeight;
+        frameBuffer.resize(size_t(width)*height);
+        setupScaling(depth.getWidth(),depth.getHeight());
+    }
+    if(contourLineFactor!=intervalFactor)
+    {
+        /* The shader floors the corner's texel average, in [0, 1], times the contour line factor: */
+        intervalFactor=contourLineFactor;
+        intervalTable.resize(4*255+1);
+        for(int sum=0;sum<=4*255;++sum)
+            intervalTable[sum]=short(std::floor(float(sum)*0.25f/255.0f*contourLineFactor));
+    }
+    if(rgb.getWidth()!=width||rgb.getHeight()!=height||rgb.getNumChannels()!=3)
+        rgb.allocate(width,height,3);
+
+    /* Scale the frame into the frame buffer, then color it, each in horizontal bands; coloring reads one row beyond its band: */
+    int numBands=workerPool.getNumThreads();
+    workerPool.run(numBands,[&](int band){
+        scaleRows(depth,band*height/numBands,(band+1)*height/numBands);
+    });
+    unsigned char* rgbData=rgb.getData();
+    workerPool.run(numBands,[&](int band){
+        renderRows(rgbData,band*height/numBands,(band+1)*height/numBands);
+    });
+    lastRenderTime=ofGetElapsedTimeMicros()-startTime;
+}
@@ -0,0 +1,54 @@
+/***********************************************************************
+ ColorMapRenderer - CPU implementation of the projector shader
+ (shaderFrag.c) for headless rendering, regression tests and machines
+ whose GPU cannot keep up. The filtered depth is scaled to the output
+ size as drawn into the frame buffer object, with linear filtering and
+ 8-bit storage, then each pixel takes the colormap color of its depth,
+ sampled halfway between two colormap texels as the shader does, and
+ is painted black where the contour intervals of its four corners
+ (averages of the four surrounding depth values) mark a contour line,
+ following the shader's edge mask cases. Rows are rendered in bands by
+ a WorkerPool, and the edge masks eight pixels at a time with SSE2.
+ ***********************************************************************/
+
+#pragma once
+#include "ofMain.h"
+#include "ColorMap.h"
+#include "WorkerPool.h"
+#include <stdint.h>
+#include <vector>
+
+class ColorMapRenderer {
+public:
+    ColorMapRenderer();
+
+    void setColorMap(const ColorMap& colormap); // Takes the colors of a color map, as the shader samples its texture
+    void setNumThreads(int newNumThreads); // Sets the number of threads rendering bands of each frame (default 1, 0 = one per core)
+
+    /* Renders an 8-bit depth frame scaled to width x height with contour lines every 1/contourLineFactor of the depth range into an RGB frame: */
+    void render(const ofPixels& depth, unsigned int width, unsigned int height, float contourLineFactor, ofPixels& rgb);
+    uint64_t getLastRenderTime(void) const // Returns the time spent rendering the last frame, in microseconds
+    {
+        return lastRenderTime;
+    }
+
+private:
+    ColorMapRenderer(const ColorMapRenderer&); // Prohibit copy constructor
+    ColorMapRenderer& operator=(const ColorMapRenderer&); // Prohibit assignment operator
+
+    void setupScaling(unsigned int depthWidth, unsigned int depthHeight); // Computes the texel pairs and weights of linear filtering for the output size
+    void scaleRows(const ofPixels& depth, unsigned int y0, unsigned int y1); // Scales rows [y0, y1) of the frame buffer from the depth frame
+    void computeIntervals(unsigned int row, short* intervals) const; // Computes the contour intervals of the pixel corners on a row boundary
+    void renderRows(unsigned char* rgb, unsigned int y0, unsigned int y1); // Colors rows [y0, y1) of the output frame
+
+    unsigned char colors[256][3]; // Color of each depth value
+    unsigned int width, height; // Size of the output frame
+    unsigned int depthWidth, depthHeight; // Size of the depth frames the scaling was computed for
+    std::vector<unsigned int> texelX, texelY; // First texel sampled by each output column and row; the second one follows unless at the edge
+    std::vector<unsigned int> weightX, weightY; // Weight of the second texel of each output column and row, in 1/256 like the texture units' filtering
+    std::vector<unsigned char> frameBuffer; // Depth scaled to the output size
+    float intervalFactor; // Contour line factor of intervalTable
+    std::vector<short> intervalTable; // Contour interval of each sum of the four depth values around a pixel corner
+    WorkerPool workerPool; // Threads rendering horizontal bands of each frame
+    uint64_t lastRenderTime; // Time spent rendering the last frame, in microseconds
+};
@@ -0,0 +1,442 @@
+/***********************************************************************
+ DepthCodec - Lossless codec for raw depth frames in millimeters.
+ ***********************************************************************/
+
+#include "DepthCodec.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace DepthCodec {
+
+namespace {
+
+const unsigned int escapeLimit=24; // Quotients from this value on are sent as escape code plus raw bits
+const unsigned int maxValueK=15;
+const unsigned int maxRunK=24;
+const unsigned int valueBits=17; // Raw bits of an escaped symbol in regular mode, up to 65536 for a difference of +-32768
+const size_t maxBitsPerSample=(escapeLimit+1+32)+(escapeLimit+1+valueBits); // A run code and a value code
+
+inline int countLeadingZeros(uint64_t v) // v must not be 0
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index,v);
+    return 63-int(index);
+#else
+    return __builtin_clzll(v);
+#endif
+}
+
+struct RiceState // Adapts the Rice parameter to the running mean of the coded values
+{
+    uint32_t sum, count;
+    unsigned int k, maxK;
+
+    RiceState(uint32_t initialMean, unsigned int sMaxK)
+    :sum(initialMean), count(1), k(0), maxK(sMaxK)
+    {
+        adapt();
+    }
+    unsigned int getK(void) const
+    {
+        return k;
+    }
+    void update(uint32_t value)
+    {
+        sum+=value;
+        if(++count==64)
+        {
+            /* Forget old statistics to follow changes across the frame: */
+            sum>>=1;
+            count>>=1;
+        }
+        adapt();
+    }
+    void adapt(void) // Moves k to the smallest value with count*2^k>=sum
+    {
+        while(k<maxK&&(uint64_t(count)<<k)<sum)
+            ++k;
+        while(k>0&&(uint64_t(count)<<(k-1))>=sum)
+            --k;
+    }
+};
+
+class BitWriter // MSB-first bit stream into a buffer large enough for the band
+{
+public:
+    BitWriter(unsigned char* sOut)
+    :out(sOut), pos(0), acc(0), numBits(0)
+    {
+    }
+    void put(uint32_t value, unsigned int n) // n<=32
+    {
+        /* Keep fewer than 32 bits pending, and write 32 bits at a time: */
+        acc=(acc<<n)|value;
+        numBits+=n;
+        if(numBits>=32)
+        {
+            numBits-=32;
+            uint32_t word=uint32_t(acc>>numBits);
+            out[pos]=(unsigned char)(word>>24);
+            out[pos+1]=(unsigned char)(word>>16);
+            out[pos+2]=(unsigned char)(word>>8);
+            out[pos+3]=(unsigned char)word;
+            pos+=4;
+        }
+    }
+    void putRice(uint32_t value, unsigned int k, unsigned int rawBits)
+    {
+        uint32_t q=value>>k;
+        if(q<escapeLimit)
+        {
+            put(1U,q+1); // q zeros and a one
+            if(k!=0)
+                put(value&((1U<<k)-1U),k);
+        }
+        else
+        {
+            put(1U,escapeLimit+1);
+            put(value,rawBits);
+        }
+    }
+    size_t finish(void) // Flushes the pending bits and returns the stream size
+    {
+        while(numBits>=8)
+        {
+            numBits-=8;
+            out[pos++]=(unsigned char)(acc>>numBits);
+        }
+        if(numBits!=0)
+            out[pos++]=(unsigned char)(acc<<(8-numBits));
+        numBits=0;
+        return pos;
+    }
+
+private:
+    unsigned char* out;
+    size_t pos;
+    uint64_t acc;
+    unsigned int numBits;
+};
+
+class BitReader // MSB-first bit stream reader; reads zeros past the end and counts them
+{
+public:
+    BitReader(const unsigned char* sData, size_t sSize)
+    :ptr(sData), end(sData+sSize), bits(0), numBits(0), numPadding(0), corrupt(false)
+    {
+        refill();
+    }
+    uint32_t get(unsigned int n) // 1<=n<=32
+    {
+        refill();
+        uint32_t v=uint32_t(bits>>(64-n));
+        bits<<=n;
+        numBits-=n;
+        return v;
+    }
+    uint32_t getRice(unsigned int k, unsigned int rawBits)
+    {
+        /* The unary prefix never exceeds escapeLimit, so it lies in the refilled buffer: */
+        refill();
+        if(bits==0)
+        {
+            corrupt=true;
+            return 0;
+        }
+        unsigned int q=(unsigned int)countLeadingZeros(bits);
+        if(q>escapeLimit)
+        {
+            corrupt=true;
+            return 0;
+        }
+        bits<<=q+1;
+        numBits-=q+1;
+        if(q==escapeLimit)
+            return get(rawBits);
+        return k!=0?(q<<k)|get(k):q;
+    }
+    bool isValid(void) const // True if no corrupt code was read and the stream was not overrun
+    {
+        return !corrupt&&numPadding*8<=numBits;
+    }
+
+private:
+    void refill(void)
+    {
+        if(numBits<=56&&end-ptr>=8)
+        {
+            /* Load eight bytes at once; the bits below the ones taken are the next ones anyway: */
+            uint64_t word=0;
+            for(int i=0;i<8;++i)
+                word=(word<<8)|ptr[i];
+            bits|=word>>numBits;
+            unsigned int numBytes=(63-numBits)>>3;
+            ptr+=numBytes;
+            numBits+=numBytes*8;
+            return;
+        }
+        while(numBits<=56)
+        {
+            uint64_t byte=0;
+            if(ptr<end)
+                byte=*ptr++;
+            else
+                ++numPadding;
+            bits|=byte<<(56-numBits);
+            numBits+=8;
+        }
+    }
+
+    const unsigned char* ptr;
+    const unsigned char* end;
+    uint64_t bits; // Unread bits, left aligned
+    unsigned int numBits;
+    unsigned int numPadding; // Zero bytes read past the end
+    bool corrupt;
+};
+
+/* Median edge detector prediction from the left, upper and upper left samples: */
+inline uint16_t predictMed(uint16_t a, uint16_t b, uint16_t c)
+{
+    uint16_t lo=a<b?a:b, hi=a<b?b:a;
+    if(c>=hi)
+        return lo;
+    if(c<=lo)
+        return hi;
+    return uint16_t(a+b-c);
+}
+
+/* Prediction of a sample from the decoded samples before it; invalid (0) samples are not used as predictors: */
+inline uint16_t predict(const uint16_t* frame, const uint16_t* previous, unsigned int width, unsigned int x, bool firstRow, size_t i)
+{
+    /* Delta frames predict from the previous frame where it was valid: */
+    if(previous!=0&&previous[i]!=0)
+        return previous[i];
+    uint16_t a=x!=0?frame[i-1]:0;
+    uint16_t b=!firstRow?frame[i-width]:0;
+    uint16_t c=x!=0&&!firstRow?frame[i-width-1]:0;
+    if(a!=0&&b!=0&&c!=0)
+        return predictMed(a, b, c);
+    return a!=0?a:b;
+}
+
+/* Code of a sample given its prediction: 0 if they match, 1 for an invalid sample, else the zigzagged difference plus 1: */
+inline uint32_t getSymbol(uint16_t sample, uint16_t prediction)
+{
+    if(sample==prediction)
+        return 0;
+    if(sample==0)
+        return 1;
+    int16_t d=int16_t(uint16_t(sample-prediction));
+    return uint32_t(uint16_t((uint16_t(d)<<1)^uint16_t(d>>15)))+1;
+}
+
+inline uint16_t getSample(uint32_t symbol, uint16_t prediction) // symbol>0
+{
+    if(symbol==1)
+        return 0;
+    uint32_t u=symbol-1;
+    return uint16_t(prediction+((u>>1)^(0U-(u&1U))));
+}
+
+/* Samples are coded one symbol each, until a sample matches its prediction; the codec
+   then switches to run mode and codes the number of following matching samples, and
+   the mismatching sample ending the run, before returning to regular mode: */
+size_t encodeBand(const uint16_t* frame, const uint16_t* previous, unsigned int width, unsigned int y0, unsigned int y1, unsigned char* out)
+{
+    BitWriter writer(out);
+    RiceState runState(16, maxRunK), valueState(2, maxValueK);
+    size_t end=size_t(y1)*width;
+    bool inRun=false;
+    uint32_t run=0;
+    for(unsigned int y=y0;y<y1;++y)
+    {
+        size_t i=size_t(y)*width;
+        for(unsigned int x=0;x<width;++x,++i)
+        {
+            uint32_t symbol=getSymbol(frame[i], predict(frame, previous, width, x, y==y0, i));
+            if(inRun)
+            {
+                if(symbol==0)
+                {
+                    ++run;
+                    continue;
+                }
+                writer.putRice(run, runState.getK(), 32);
+                runState.update(run);
+                writer.putRice(symbol-1, valueState.getK(), 16);
+                valueState.update(symbol-1);
+                inRun=false;
+                continue;
+            }
+            writer.putRice(symbol, valueState.getK(), valueBits);
+            valueState.update(symbol);
+            if(symbol==0&&i+1<end)
+            {
+                inRun=true;
+                run=0;
+            }
+        }
+    }
+    if(inRun)
+        writer.putRice(run, runState.getK(), 32);
+    return writer.finish();
+}
+
+bool decodeBand(const unsigned char* data, size_t size, const uint16_t* previous, unsigned int width, unsigned int y0, unsigned int y1, uint16_t* frame)
+{
+    if(y0==y1)
+        return size==0;
+    BitReader reader(data, size);
+    RiceState runState(16, maxRunK), valueState(2, maxValueK);
+    size_t end=size_t(y1)*width;
+    bool inRun=false;
+    uint32_t run=0;
+    for(unsigned int y=y0;y<y1;++y)
+    {
+        size_t i=size_t(y)*width;
+        for(unsigned int x=0;x<width;++x,++i)
+        {
+            uint16_t prediction=predict(frame, previous, width, x, y==y0, i);
+            if(inRun)
+            {
+                if(run!=0)
+                {
+                    frame[i]=prediction;
+                    --run;
+                    continue;
+                }
+                uint32_t symbol=reader.getRice(valueState.getK(), 16)+1;
+                valueState.update(symbol-1);
+                frame[i]=getSample(symbol, prediction);
+                inRun=false;
+                continue;
+            }
+            uint32_t symbol=reader.getRice(valueState.getK(), valueBits);
+            valueState.update(symbol);
+            if(symbol!=0)
+            {
+                frame[i]=getSample(symbol, prediction);
+                continue;
+            }
+            frame[i]=prediction;
+            if(i+1<end)
+            {
+                /* The run length follows the sample starting the run: */
+                run=reader.getRice(runState.getK(), 32);
+                runState.update(run);
+                if(run>end-i-1)
+                    return false;
+                inRun=true;
+            }
+        }
+        if(!reader.isValid())
+            return false;
+    }
+    return reader.isValid();
+}
+
+const size_t frameHeaderSize=2*sizeof(uint32_t);
+
+inline uint32_t readWord(const unsigned char* data)
+{
+    uint32_t word;
+    std::memcpy(&word, data, sizeof(word));
+    return word;
+}
+
+inline void writeWord(unsigned char* data, uint32_t word)
+{
+    std::memcpy(data, &word, sizeof(word));
+}
+
+}
+
+size_t encode(const uint16_t* frame, const uint16_t* previous, unsigned int width, unsigned int height, int numBands, std::vector<unsigned char>& encoded, WorkerPool* pool)
+{
+    /* Give each band room for its worst case, then close the gaps: */
+    numBands=std::max(numBands,1);
+    size_t tableSize=frameHeaderSize+size_t(numBands)*sizeof(uint32_t);
+    size_t maxBandSize=(size_t(width)*(height/numBands+1)*maxBitsPerSample+7)/8+8;
+    if(encoded.size()<tableSize+size_t(numBands)*maxBandSize)
+        encoded.resize(tableSize+size_t(numBands)*maxBandSize);
+    std::vector<size_t> bandSizes(numBands);
+    unsigned char* base=encoded.data();
+    auto encodeOne=[&](int band){
+        unsigned int y0=(unsigned int)(uint64_t(height)*band/numBands);
+        unsigned int y1=(unsigned int)(uint64_t(height)*(band+1)/numBands);
+        bandSizes[band]=encodeBand(frame, previous, width, y0, y1, base+tableSize+band*maxBandSize);
+    };
+    if(pool!=0)
+        pool->run(numBands, encodeOne);
+    else
+        for(int band=0;band<numBands;++band)
+            encodeOne(band);
+
+    writeWord(base, previous!=0?DELTA_FRAME:KEY_FRAME);
+    writeWord(base+sizeof(uint32_t), uint32_t(numBands));
+    size_t pos=tableSize;
+    for(int band=0;band<numBands;++band)
+    {
+        writeWord(base+frameHeaderSize+band*sizeof(uint32_t), uint32_t(bandSizes[band]));
+        std::memmove(base+pos, base+tableSize+band*maxBandSize, bandSizes[band]);
+        pos+=bandSizes[band];
+    }
+    return pos;
+}
+
+size_t getEncodedSize(const unsigned char* data, size_t size)
+{
+    if(size<frameHeaderSize)
+        return 0;
+    uint64_t numBands=readWord(data+sizeof(uint32_t));
+    uint64_t total=frameHeaderSize+numBands*sizeof(uint32_t);
+    if(total>size)
+        return 0;
+    for(uint64_t band=0;band<numBands;++band)
+        total+=readWord(data+frameHeaderSize+band*sizeof(uint32_t));
+    return total<=size?size_t(total):0;
+}
+
+FrameType getFrameType(const unsigned char* data)
+{
+    return readWord(data)==KEY_FRAME?KEY_FRAME:DELTA_FRAME;
+}
+
+bool decode(const unsigned char* data, size_t size, const uint16_t* previous, unsigned int width, unsigned int height, uint16_t* frame, WorkerPool* pool)
+{
+    size_t encodedSize=getEncodedSize(data, size);
+    if(encodedSize==0)
+        return false;
+    FrameType type=FrameType(readWord(data));
+    int numBands=int(readWord(data+sizeof(uint32_t)));
+    if((type!=KEY_FRAME&&type!=DELTA_FRAME)||(type==DELTA_FRAME&&previous==0)||numBands<1)
+        return false;
+
+    /* Locate the bands, then decode them in parallel: */
+    std::vector<size_t> bandOffsets(numBands+1);
+    bandOffsets[0]=frameHeaderSize+size_t(numBands)*sizeof(uint32_t);
+    for(int band=0;band<numBands;++band)
+        bandOffsets[band+1]=bandOffsets[band]+readWord(data+frameHeaderSize+band*sizeof(uint32_t));
+    const uint16_t* reference=type==DELTA_FRAME?previous:0;
+    std::atomic<bool> ok(true);
+    auto decodeOne=[&](int band){
+        unsigned int y0=(unsigned int)(uint64_t(height)*band/numBands);
+        unsigned int y1=(unsigned int)(uint64_t(height)*(band+1)/numBands);
+        if(!decodeBand(data+bandOffsets[band], bandOffsets[band+1]-bandOffsets[band], reference, width, y0, y1, frame))
+            ok=false;
+    };
+    if(pool!=0)
+        pool->run(numBands, decodeOne);
+    else
+        for(int band=0;band<numBands;++band)
+            decodeOne(band);
+    return ok;
+}
+
+}
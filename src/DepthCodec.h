@@ -0,0 +1,40 @@
+/***********************************************************************
+ DepthCodec - Lossless codec for raw depth frames in millimeters. Key
+ frames predict each sample from its neighbors in the same frame, delta
+ frames from the same sample of the previous frame; the residuals are
+ coded as runs of zeros and nonzero values with adaptive Rice codes,
+ which suits sandbox data where most of the sand does not change from
+ one frame to the next. Frames are split into horizontal bands coded
+ independently, so bands are encoded and decoded in parallel.
+
+ Encoded frame layout (native byte order):
+   uint32_t frame type, uint32_t number of bands
+   uint32_t size of each band in bytes
+   Band bit streams, one after the other
+ ***********************************************************************/
+
+#pragma once
+#include "WorkerPool.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace DepthCodec {
+    enum FrameType
+    {
+        KEY_FRAME=0, // Decodes on its own
+        DELTA_FRAME=1 // Decodes against the previous frame
+    };
+
+    /* Encodes a frame against the previous frame, or as a key frame if previous is 0, to the start of encoded, which is grown as needed and kept as scratch space; returns the size of the encoded frame: */
+    size_t encode(const uint16_t* frame, const uint16_t* previous, unsigned int width, unsigned int height, int numBands, std::vector<unsigned char>& encoded, WorkerPool* pool);
+
+    /* Returns the size of an encoded frame, or 0 if the data is too short to hold it: */
+    size_t getEncodedSize(const unsigned char* data, size_t size);
+
+    /* Returns the type of an encoded frame: */
+    FrameType getFrameType(const unsigned char* data);
+
+    /* Decodes a frame; previous is only read for delta frames. Returns false on corrupt data: */
+    bool decode(const unsigned char* data, size_t size, const uint16_t* previous, unsigned int width, unsigned int height, uint16_t* frame, WorkerPool* pool);
+}
@@ -0,0 +1,226 @@
+/***********************************************************************
+ DepthFusion - Fuses the filtered depth of several sensors into a
+ single heightmap.
+ ***********************************************************************/
+
+#include "DepthFusion.h"
+#include "ofxCv.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace cv;
+
+/****************************
+ Methods of class DepthFusion:
+ ****************************/
+
+DepthFusion::DepthFusion()
+:blendTolerance(20.0f), featherWidth(32.0f)
+{
+    grid.width=grid.height=0;
+    grid.originX=grid.originY=0.0f;
+    grid.cellSize=1.0f;
+    workerPool.setNumThreads(1);
+}
+
+void DepthFusion::setup(const Grid& newGrid)
+{
+    grid=newGrid;
+}
+
+void DepthFusion::setBlendTolerance(float newTolerance)
+{
+    blendTolerance=std::max(newTolerance,0.0f);
+}
+
+void DepthFusion::setFeatherWidth(float newFeatherWidth)
+{
+    featherWidth=std::max(newFeatherWidth,1.0f);
+}
+
+void DepthFusion::setNumThreads(int newNumThreads)
+{
+    workerPool.setNumThreads(newNumThreads);
+}
+
+void DepthFusion::splat(const uint16_t* depth, unsigned int width, unsigned int height, const DepthSource::Intrinsics& intrinsics, const Pose& pose, Layer& layer) const
+{
+    /* Start from an empty layer, reusing its capacity: */
+    size_t numCells=size_t(grid.width)*size_t(grid.height);
+    layer.depth.assign(numCells,0);
+    layer.weight.assign(numCells,0.0f);
+
+    const float* r=pose.rotation;
+    const float* t=pose.translation;
+    float invCellSize=1.0f/grid.cellSize;
+    float invFx=1.0f/intrinsics.fx;
+    float invFy=1.0f/intrinsics.fy;
+    float invFeather=1.0f/featherWidth;
+
+    const uint16_t* dPtr=depth;
+    for(unsigned int y=0;y<height;++y)
+    {
+        float ry=(float(y)-intrinsics.cy)*invFy;
+        float borderY=float(std::min(y,height-1-y)+1);
+        for(unsigned int x=0;x<width;++x,++dPtr)
+        {
+            if(*dPtr==0)
+                continue;
+
+            /* Reproject the sample to the world: */
+            float z=float(*dPtr);
+            float cx=(float(x)-intrinsics.cx)*invFx*z;
+            float cy=ry*z;
+            float wx=r[0]*cx+r[1]*cy+r[2]*z+t[0];
+            float wy=r[3]*cx+r[4]*cy+r[5]*z+t[1];
+            float wz=r[6]*cx+r[7]*cy+r[8]*z+t[2];
+            if(wz<1.0f||wz>65535.0f)
+                continue;
+            uint16_t sampleDepth=uint16_t(wz+0.5f);
+
+            /* Cover the cells under the sample's footprint, a pixel being z/fx millimeters wide: */
+            float gx=(wx-grid.originX)*invCellSize;
+            float gy=(wy-grid.originY)*invCellSize;
+            int radius=std::min(int(0.5f*z*invFx*invCellSize+0.5f),int(maxSplatRadius));
+            int cellX=int(std::floor(gx));
+            int cellY=int(std::floor(gy));
+            if(cellX+radius<0||cellY+radius<0||cellX-radius>=int(grid.width)||cellY-radius>=int(grid.height))
+                continue;
+
+            /* Weigh the sample by its distance to the image border: */
+            float border=std::min(float(std::min(x,width-1-x)+1),borderY);
+            float weight=std::min(border*invFeather,1.0f);
+
+            /* Keep the closest surface in each cell: */
+            for(int sy=std::max(cellY-radius,0);sy<=std::min(cellY+radius,int(grid.height)-1);++sy)
+                for(int sx=std::max(cellX-radius,0);sx<=std::min(cellX+radius,int(grid.width)-1);++sx)
+                {
+                    size_t cell=size_t(sy)*grid.width+sx;
+                    if(layer.depth[cell]==0||sampleDepth<layer.depth[cell])
+                    {
+                        layer.depth[cell]=sampleDepth;
+                        layer.weight[cell]=weight;
+                    }
+                }
+        }
+    }
+}
+
+void DepthFusion::fuse(const std::vector<const Layer*>& layers, uint16_t* heightmap)
+{
+    size_t numLayers=layers.size();
+    unsigned int tolerance=(unsigned int)(blendTolerance);
+
+    /* Blend horizontal bands of the grid in parallel: */
+    int numBands=workerPool.getNumThreads();
+    workerPool.run(numBands,[&](int band){
+        size_t i0=size_t(band*grid.height/numBands)*grid.width;
+        size_t i1=size_t((band+1)*grid.height/numBands)*grid.width;
+        for(size_t i=i0;i<i1;++i)
+        {
+            /* Find the closest surface seen by any sensor: */
+            unsigned int nearest=0;
+            for(size_t l=0;l<numLayers;++l)
+            {
+                unsigned int d=layers[l]->depth[i];
+                if(d!=0&&(nearest==0||d<nearest))
+                    nearest=d;
+            }
+            if(nearest==0)
+            {
+                heightmap[i]=0;
+                continue;
+            }
+
+            /* Average the samples of that surface; deeper ones are hidden from the other sensors by it: */
+            float sum=0.0f,weightSum=0.0f;
+            for(size_t l=0;l<numLayers;++l)
+            {
+                unsigned int d=layers[l]->depth[i];
+                if(d!=0&&d<=nearest+tolerance)
+                {
+                    float w=layers[l]->weight[i];
+                    sum+=w*float(d);
+                    weightSum+=w;
+                }
+            }
+            heightmap[i]=uint16_t(sum/weightSum+0.5f);
+        }
+    });
+}
+
+DepthFusion::Pose DepthFusion::getIdentityPose(void)
+{
+    Pose pose;
+    for(int i=0;i<9;++i)
+        pose.rotation[i]=i%4==0?1.0f:0.0f;
+    for(int i=0;i<3;++i)
+        pose.translation[i]=0.0f;
+    return pose;
+}
+
+DepthFusion::Grid DepthFusion::fitGrid(unsigned int width, unsigned int height, const std::vector<unsigned int>& sensorWidths, const std::vector<unsigned int>& sensorHeights, const std::vector<DepthSource::Intrinsics>& intrinsics, const std::vector<Pose>& poses, float referenceDepth)
+{
+    /* Bound the corners of every sensor's view at the reference depth: */
+    float minX=std::numeric_limits<float>::max(),minY=minX;
+    float maxX=-minX,maxY=-minX;
+    for(size_t s=0;s<poses.size();++s)
+    {
+        const float* r=poses[s].rotation;
+        const float* t=poses[s].translation;
+        for(int corner=0;corner<4;++corner)
+        {
+            float u=corner&1?float(sensorWidths[s]):0.0f;
+            float v=corner&2?float(sensorHeights[s]):0.0f;
+            float cx=(u-intrinsics[s].cx)/intrinsics[s].fx*referenceDepth;
+            float cy=(v-intrinsics[s].cy)/intrinsics[s].fy*referenceDepth;
+            float wx=r[0]*cx+r[1]*cy+r[2]*referenceDepth+t[0];
+            float wy=r[3]*cx+r[4]*cy+r[5]*referenceDepth+t[1];
+            minX=std::min(minX,wx);
+            maxX=std::max(maxX,wx);
+            minY=std::min(minY,wy);
+            maxY=std::max(maxY,wy);
+        }
+    }
+
+    /* Fit the bounds into the grid with square cells, centered: */
+    Grid result;
+    result.width=width;
+    result.height=height;
+    result.cellSize=std::max((maxX-minX)/float(width),(maxY-minY)/float(height));
+    if(!(result.cellSize>0.0f))
+        result.cellSize=1.0f;
+    result.originX=0.5f*(minX+maxX)-0.5f*float(width)*result.cellSize;
+    result.originY=0.5f*(minY+maxY)-0.5f*float(height)*result.cellSize;
+    return result;
+}
+
+bool DepthFusion::loadPoses(const std::string& fileName, std::vector<Pose>& poses)
+{
+    /* Each sensor has a row-major rotation and a translation in millimeters, the first one being the primary sensor's: */
+    poses.clear();
+    FileStorage fs(ofToDataPath(fileName), FileStorage::READ);
+    FileNode sensors = fs["Sensors"];
+    for(FileNodeIterator it=sensors.begin();it!=sensors.end();++it)
+    {
+        FileNode rotation=(*it)["rotation"];
+        FileNode translation=(*it)["translation"];
+        if(rotation.size()!=9||translation.size()!=3)
+        {
+            ofLog(OF_LOG_ERROR, "DepthFusion: sensor "+ofToString(poses.size())+" of "+fileName+" needs 9 rotation and 3 translation values");
+            poses.clear();
+            break;
+        }
+        Pose pose;
+        for(int i=0;i<9;++i)
+            pose.rotation[i]=(float)rotation[i];
+        for(int i=0;i<3;++i)
+            pose.translation[i]=(float)translation[i];
+        poses.push_back(pose);
+    }
+    fs.release();
+    if(poses.empty())
+        ofLog(OF_LOG_ERROR, "DepthFusion: no sensor poses in "+fileName);
+    return !poses.empty();
+}
@@ -0,0 +1,74 @@
+/***********************************************************************
+ DepthFusion - Fuses the filtered depth of several sensors looking down
+ at one table into a single heightmap. Each sensor's frame in
+ millimeters is reprojected to world space through the sensor's
+ intrinsics and pose, and splatted with a z-buffer into a layer of a
+ world-space grid, which can run on the sensor's own thread. The layers
+ are then blended band by band: where sensors overlap, the samples near
+ the closest surface are averaged with weights fading out towards the
+ borders of each sensor's image, so seams do not show. The heightmap
+ holds, for each grid cell, the depth in millimeters below the plane
+ z=0 of the world, so it goes through the rest of the pipeline as the
+ frame of a single sensor looking straight down.
+ ***********************************************************************/
+
+#pragma once
+#include "DepthSource.h"
+#include "WorkerPool.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class DepthFusion {
+public:
+    struct Pose // Rigid transformation from a sensor's camera to the world, in millimeters; world z points down from the sensors
+    {
+        float rotation[9]; // Row-major rotation matrix
+        float translation[3];
+    };
+
+    struct Grid // World-space grid of the heightmap, cells aligned with the world x and y axes
+    {
+        unsigned int width, height; // Number of cells
+        float originX, originY; // World position of the corner of cell (0, 0)
+        float cellSize; // Width and height of a cell
+    };
+
+    struct Layer // One sensor's frame splatted into the grid
+    {
+        std::vector<uint16_t> depth; // Depth of the closest surface seen in each cell, 0 if none
+        std::vector<float> weight; // Blending weight of each cell's sample
+    };
+
+    DepthFusion();
+
+    void setup(const Grid& newGrid); // Sets the grid of the heightmap
+    const Grid& getGrid(void) const
+    {
+        return grid;
+    }
+    void setBlendTolerance(float newTolerance); // Sets the depth difference in millimeters up to which overlapping samples are blended, deeper ones being hidden (default 20)
+    void setFeatherWidth(float newFeatherWidth); // Sets the distance in pixels from the image border over which a sensor's weight fades in (default 32)
+    void setNumThreads(int newNumThreads); // Sets the number of threads blending the layers (default 1, 0 = one per core)
+
+    /* Splats a sensor's depth frame into a layer of the grid; only reads the settings, so sensors can splat concurrently: */
+    void splat(const uint16_t* depth, unsigned int width, unsigned int height, const DepthSource::Intrinsics& intrinsics, const Pose& pose, Layer& layer) const;
+
+    /* Blends the layers into a heightmap of the grid's size: */
+    void fuse(const std::vector<const Layer*>& layers, uint16_t* heightmap);
+
+    static Pose getIdentityPose(void);
+    static Grid fitGrid(unsigned int width, unsigned int height, const std::vector<unsigned int>& sensorWidths, const std::vector<unsigned int>& sensorHeights, const std::vector<DepthSource::Intrinsics>& intrinsics, const std::vector<Pose>& poses, float referenceDepth); // Returns a grid of the given size covering the views of all sensors at the reference depth
+    static bool loadPoses(const std::string& fileName, std::vector<Pose>& poses); // Reads the sensor poses from a file in the data folder; returns false if it has none
+
+    static const int maxSplatRadius=2; // Largest footprint of a sample in cells from its center, for grids finer than the sensors
+
+private:
+    DepthFusion(const DepthFusion&); // Prohibit copy constructor
+    DepthFusion& operator=(const DepthFusion&); // Prohibit assignment operator
+
+    Grid grid;
+    float blendTolerance; // Depth difference up to which overlapping samples are blended
+    float featherWidth; // Width of the faded border of a sensor's image, in pixels
+    WorkerPool workerPool; // Threads blending horizontal bands of the grid
+};
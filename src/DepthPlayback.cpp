@@ -0,0 +1,249 @@
+/***********************************************************************
+ DepthPlayback - Depth source playing back a memory mapped recording.
+ ***********************************************************************/
+
+#include "DepthPlayback.h"
+#include <algorithm>
+
+DepthPlayback::DepthPlayback()
+:realTime(true), loop(true), currentFrame(-1), startTime(0), finished(false), numSkippedFrames(0),
+ decodeBuffer(0), decodedFrame(-1), depthPixelsValid(false)
+{
+    decoderPool.setNumThreads(1);
+}
+
+bool DepthPlayback::open(const std::string& fileName)
+{
+    if(!recording.open(fileName))
+        return false;
+    depthPixels.allocate(recording.getWidth(), recording.getHeight(), 1);
+    if(!recording.hasColor())
+    {
+        colorPixels.allocate(recording.getWidth(), recording.getHeight(), 3);
+        colorPixels.set(0);
+    }
+    if(recording.isCompressed())
+    {
+        size_t numPixels=size_t(recording.getWidth())*size_t(recording.getHeight());
+        decodeBuffers[0].assign(numPixels,0);
+        decodeBuffers[1].assign(numPixels,0);
+    }
+    decodedFrame=-1;
+    numSkippedFrames=0;
+    rewind();
+    return true;
+}
+
+std::string DepthPlayback::getName(void) const
+{
+    return "recording";
+}
+
+bool DepthPlayback::isOpen(void) const
+{
+    return recording.isOpen();
+}
+
+void DepthPlayback::close(void)
+{
+    rawDepthPixels.clear();
+    colorPixels.clear();
+    recording.close();
+    decodeBuffers[0].clear();
+    decodeBuffers[1].clear();
+    decodedFrame=-1;
+    currentFrame=-1;
+}
+
+unsigned int DepthPlayback::getWidth(void) const
+{
+    return recording.getWidth();
+}
+
+unsigned int DepthPlayback::getHeight(void) const
+{
+    return recording.getHeight();
+}
+
+DepthSource::Intrinsics DepthPlayback::getIntrinsics(void) const
+{
+    if(recording.hasIntrinsics())
+        return recording.getIntrinsics();
+    return getNominalIntrinsics(getWidth(), getHeight());
+}
+
+bool DepthPlayback::hasColor(void) const
+{
+    return recording.hasColor();
+}
+
+void DepthPlayback::setRealTime(bool newRealTime)
+{
+    realTime=newRealTime;
+    if(realTime&&currentFrame>=0)
+    {
+        /* Continue from the current frame at its recorded pace: */
+        startTime=ofGetElapsedTimeMicros()-recording.getEntry(currentFrame).timestamp;
+    }
+}
+
+void DepthPlayback::setLoop(bool newLoop)
+{
+    loop=newLoop;
+}
+
+void DepthPlayback::setNumThreads(int newNumThreads)
+{
+    decoderPool.setNumThreads(newNumThreads);
+}
+
+void DepthPlayback::setDepthClipping(float snearclip, float sfarclip)
+{
+    DepthSource::setDepthClipping(snearclip, sfarclip);
+    depthPixelsValid=false;
+}
+
+void DepthPlayback::rewind(void)
+{
+    currentFrame=-1;
+    finished=false;
+    startTime=ofGetElapsedTimeMicros();
+}
+
+bool DepthPlayback::update(void)
+{
+    if(!recording.isOpen()||finished)
+        return false;
+
+    int numFrames=int(recording.getNumFrames());
+    int nextFrame=currentFrame+1;
+    if(realTime)
+    {
+        uint64_t now=ofGetElapsedTimeMicros()-startTime;
+        if(nextFrame>=numFrames)
+        {
+            if(!loop)
+            {
+                finished=true;
+                return false;
+            }
+            /* Restart one frame interval after the last frame: */
+            uint64_t period=recording.getDuration()+recording.getDuration()/uint64_t(std::max(numFrames-1,1));
+            if(now<period)
+                return false;
+            startTime+=period;
+            now-=period;
+            nextFrame=0;
+        }
+        if(recording.getEntry(nextFrame).timestamp>now)
+            return false;
+        
+        /* Deliver the last frame due now, skipping the ones we are too late for: */
+        while(nextFrame+1<numFrames&&recording.getEntry(nextFrame+1).timestamp<=now)
+        {
+            ++nextFrame;
+            ++numSkippedFrames;
+        }
+    }
+    else if(nextFrame>=numFrames)
+    {
+        if(!loop)
+        {
+            finished=true;
+            return false;
+        }
+        nextFrame=0;
+    }
+
+    showFrame(nextFrame);
+    return true;
+}
+
+uint64_t DepthPlayback::getTimeToNextFrame(void) const
+{
+    if(!realTime||!recording.isOpen()||finished)
+        return 0;
+    int numFrames=int(recording.getNumFrames());
+    int nextFrame=currentFrame+1;
+    uint64_t due;
+    if(nextFrame<numFrames)
+        due=recording.getEntry(nextFrame).timestamp;
+    else if(loop)
+        due=recording.getDuration()+recording.getDuration()/uint64_t(std::max(numFrames-1,1)); // the loop restarts one frame interval after the last frame
+    else
+        return 0; // the next update() finishes the playback
+    uint64_t now=ofGetElapsedTimeMicros()-startTime;
+    return due>now?due-now:0;
+}
+
+bool DepthPlayback::isFinished(void) const
+{
+    return finished;
+}
+
+void DepthPlayback::showFrame(int frame)
+{
+    currentFrame=frame;
+    unsigned int w=recording.getWidth();
+    unsigned int h=recording.getHeight();
+
+    /* The filter and the recorder only read their input, so the read-only mapping can back the pixels: */
+    if(recording.isCompressed())
+    {
+        if(!decodeFrame(frame))
+            ofLog(OF_LOG_ERROR, "DepthPlayback: cannot decode frame "+ofToString(frame));
+        rawDepthPixels.setFromExternalPixels(decodeBuffers[decodeBuffer].data(), w, h, 1);
+    }
+    else
+        rawDepthPixels.setFromExternalPixels(const_cast<uint16_t*>(recording.getRawDepth(frame)), w, h, 1);
+    if(recording.hasColor())
+        colorPixels.setFromExternalPixels(const_cast<unsigned char*>(recording.getColor(frame)), w, h, 3);
+    depthPixelsValid=false;
+}
+
+bool DepthPlayback::decodeFrame(int frame)
+{
+    if(frame==decodedFrame)
+        return true;
+
+    /* Go back to the frame after the decoded one, or to the last key frame: */
+    int first=frame;
+    while(first>0&&first!=decodedFrame+1&&!recording.isKeyFrame(first))
+        --first;
+    if(!recording.isKeyFrame(first)&&first!=decodedFrame+1)
+        return false;
+
+    /* Decode forward, each frame against the one before, including the frames real time playback skips: */
+    for(int f=first;f<=frame;++f)
+    {
+        int target=1-decodeBuffer;
+        if(!recording.decodeRawDepth(f, decodeBuffers[decodeBuffer].data(), decodeBuffers[target].data(), &decoderPool))
+        {
+            decodedFrame=-1;
+            return false;
+        }
+        decodeBuffer=target;
+        decodedFrame=f;
+    }
+    return true;
+}
+
+const ofShortPixels& DepthPlayback::getRawDepthPixels(void)
+{
+    return rawDepthPixels;
+}
+
+const ofPixels& DepthPlayback::getDepthPixels(void)
+{
+    if(!depthPixelsValid&&currentFrame>=0)
+    {
+        mapDepth(rawDepthPixels.getData(), depthPixels.getData(), size_t(recording.getWidth())*size_t(recording.getHeight()));
+        depthPixelsValid=true;
+    }
+    return depthPixels;
+}
+
+const ofPixels& DepthPlayback::getColorPixels(void)
+{
+    return colorPixels;
+}
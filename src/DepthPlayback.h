@@ -0,0 +1,74 @@
+/***********************************************************************
+ DepthPlayback - Depth source playing back a memory mapped recording.
+ Frames are delivered at their recorded times, skipping frames the
+ caller was too late for, or one per update() at maximum speed for
+ benchmarks. Raw depth and color point into the mapped file; only the
+ 8-bit depth is computed, on demand. Compressed recordings are decoded
+ from the last key frame or decoded frame on, in parallel bands.
+ ***********************************************************************/
+
+#pragma once
+#include "DepthSource.h"
+#include "DepthRecording.h"
+#include "WorkerPool.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class DepthPlayback: public DepthSource {
+public:
+    DepthPlayback();
+
+    bool open(const std::string& fileName); // Opens a recording and rewinds to its first frame
+    void setRealTime(bool newRealTime); // Sets whether frames are delivered at their recorded times (default) or one per update()
+    void setLoop(bool newLoop); // Sets whether playback restarts at the end of the recording (default)
+    void setNumThreads(int newNumThreads); // Sets the number of threads decoding compressed frames (default 1, 0 = one per core)
+    void rewind(void); // Restarts playback at the first frame
+
+    virtual std::string getName(void) const;
+    virtual bool isOpen(void) const;
+    virtual void close(void);
+    virtual unsigned int getWidth(void) const;
+    virtual unsigned int getHeight(void) const;
+    virtual Intrinsics getIntrinsics(void) const; // As recorded, or nominal for recordings without intrinsics
+    virtual bool hasColor(void) const;
+    virtual void setDepthClipping(float snearclip, float sfarclip);
+    virtual bool update(void); // Advances to the frame due now, or to the next frame at maximum speed
+    virtual uint64_t getTimeToNextFrame(void) const;
+    virtual bool isFinished(void) const; // Returns true once the last frame was delivered, if not looping
+    virtual const ofShortPixels& getRawDepthPixels(void);
+    virtual const ofPixels& getDepthPixels(void);
+    virtual const ofPixels& getColorPixels(void);
+
+    const DepthRecordingFile& getRecording(void) const
+    {
+        return recording;
+    }
+    int getCurrentFrame(void) const // Returns the index of the current frame, -1 before the first update()
+    {
+        return currentFrame;
+    }
+    uint64_t getNumSkippedFrames(void) const // Returns the number of frames skipped in real time playback since open()
+    {
+        return numSkippedFrames;
+    }
+
+private:
+    void showFrame(int frame); // Points the pixels at a frame of the recording
+    bool decodeFrame(int frame); // Decodes a compressed frame and the frames it depends on
+
+    DepthRecordingFile recording;
+    bool realTime, loop;
+    int currentFrame;
+    uint64_t startTime; // Wall clock time at which the first frame is due, in microseconds
+    bool finished;
+    uint64_t numSkippedFrames;
+    WorkerPool decoderPool; // Threads decoding the bands of compressed frames
+    std::vector<uint16_t> decodeBuffers[2]; // Last two decoded frames of a compressed recording
+    int decodeBuffer; // Index of the buffer holding decodedFrame
+    int decodedFrame; // Last decoded frame, -1 if none
+    ofShortPixels rawDepthPixels; // Current frame's depth, pointing into the mapped file or a decode buffer
+    ofPixels depthPixels; // Current frame's 8-bit depth
+    bool depthPixelsValid; // Flag whether depthPixels holds the current frame
+    ofPixels colorPixels; // Current frame's color, pointing into the mapped file if the recording has color
+};
@@ -0,0 +1,503 @@
+/***********************************************************************
+ DepthRecording - Container for recorded depth streams.
+ ***********************************************************************/
+
+#include "DepthRecording.h"
+#include "DepthCodec.h"
+#include <algorithm>
+#include <cstring>
+#ifdef TARGET_WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+/* Size of an uncompressed frame record including its padding to 8 bytes: */
+uint64_t getUncompressedRecordSize(const DepthRecording::Header& header)
+{
+    uint64_t numPixels=uint64_t(header.width)*uint64_t(header.height);
+    uint64_t size=numPixels*sizeof(uint16_t);
+    if(header.flags&DepthRecording::HAS_COLOR)
+        size+=numPixels*3;
+    return (size+7)&~uint64_t(7);
+}
+
+}
+
+/******************************
+ Methods of class DepthRecorder:
+ ******************************/
+
+DepthRecorder::DepthRecorder()
+:file(0), position(0), firstArrivalTime(0), numFramesAdded(0), compress(false), numEncoderThreads(2),
+ writing(false), stopping(false), failed(false), numRawBytes(0), numEncodedBytes(0), numStalls(0)
+{
+    std::memset(&header,0,sizeof(header));
+}
+
+DepthRecorder::~DepthRecorder()
+{
+    close();
+}
+
+void DepthRecorder::setCompression(bool newCompress, int newNumEncoderThreads)
+{
+    compress=newCompress;
+    numEncoderThreads=std::max(newNumEncoderThreads,1);
+}
+
+bool DepthRecorder::open(const std::string& sFileName, unsigned int swidth, unsigned int sheight, bool sWithColor, const DepthSource::Intrinsics& intrinsics)
+{
+    close();
+    fileName=sFileName;
+    file=std::fopen(ofToDataPath(fileName).c_str(),"wb");
+    if(file==0)
+    {
+        ofLog(OF_LOG_ERROR, "DepthRecorder: cannot create "+fileName);
+        return false;
+    }
+
+    /* Write a header marking the recording as unfinished: */
+    std::memset(&header,0,sizeof(header));
+    std::memcpy(header.magic,DepthRecording::magic,sizeof(header.magic));
+    header.version=DepthRecording::formatVersion;
+    header.width=swidth;
+    header.height=sheight;
+    header.flags=sWithColor?uint32_t(DepthRecording::HAS_COLOR):0U;
+    if(compress)
+    {
+        header.flags|=DepthRecording::COMPRESSED;
+        header.keyFrameInterval=DepthRecording::keyFrameInterval;
+    }
+    header.intrinsics[0]=intrinsics.fx;
+    header.intrinsics[1]=intrinsics.fy;
+    header.intrinsics[2]=intrinsics.cx;
+    header.intrinsics[3]=intrinsics.cy;
+    index.clear();
+    position=sizeof(header);
+    numFramesAdded=0;
+    failed=false;
+    if(std::fwrite(&header,sizeof(header),1,file)!=1)
+    {
+        ofLog(OF_LOG_ERROR, "DepthRecorder: cannot write to "+fileName);
+        std::fclose(file);
+        file=0;
+        return false;
+    }
+
+    if(compress)
+    {
+        /* Allow two frames in flight per encoder thread before the caller waits: */
+        size_t numPixels=size_t(swidth)*size_t(sheight);
+        jobs.clear();
+        freeJobs.clear();
+        for(int i=0;i<2*numEncoderThreads;++i)
+        {
+            jobs.push_back(std::unique_ptr<EncodeJob>(new EncodeJob));
+            jobs.back()->depth.resize(numPixels);
+            jobs.back()->previous.resize(numPixels);
+            if(sWithColor)
+                jobs.back()->color.resize(numPixels*3);
+            freeJobs.push_back(jobs.back().get());
+        }
+        previousDepth.assign(numPixels,0);
+        writing=false;
+        stopping=false;
+        numRawBytes=0;
+        numEncodedBytes=0;
+        numStalls=0;
+        for(int i=0;i<numEncoderThreads;++i)
+            encoders.push_back(std::thread(&DepthRecorder::encoderLoop,this));
+    }
+    return true;
+}
+
+bool DepthRecorder::addFrame(const uint16_t* rawDepth, const unsigned char* color, uint64_t arrivalTime, float nearclip, float farclip)
+{
+    if(file==0)
+        return false;
+    if(numFramesAdded==0)
+        firstArrivalTime=arrivalTime;
+
+    DepthRecording::IndexEntry entry;
+    entry.offset=0;
+    entry.timestamp=arrivalTime-firstArrivalTime;
+    entry.nearclip=nearclip;
+    entry.farclip=farclip;
+    bool ok;
+    if(header.flags&DepthRecording::COMPRESSED)
+        ok=queueFrame(rawDepth, color, entry, numFramesAdded%DepthRecording::keyFrameInterval==0);
+    else
+        ok=writeRecord(reinterpret_cast<const unsigned char*>(rawDepth), size_t(header.width)*size_t(header.height)*sizeof(uint16_t), color, entry);
+    if(!ok)
+    {
+        ofLog(OF_LOG_ERROR, "DepthRecorder: cannot write to "+fileName+", stopping the recording");
+        close();
+        return false;
+    }
+    ++numFramesAdded;
+    return true;
+}
+
+bool DepthRecorder::writeRecord(const unsigned char* depth, size_t depthSize, const unsigned char* color, DepthRecording::IndexEntry entry)
+{
+    /* Write the depth values, the color and the padding: */
+    size_t numPixels=size_t(header.width)*size_t(header.height);
+    bool ok=std::fwrite(depth,1,depthSize,file)==depthSize;
+    uint64_t written=depthSize;
+    if(header.flags&DepthRecording::HAS_COLOR)
+    {
+        if(color!=0)
+            ok=ok&&std::fwrite(color,3,numPixels,file)==numPixels;
+        else
+        {
+            /* Keep the record size fixed with a black frame: */
+            static const unsigned char black[256*3]={0};
+            for(size_t i=0;ok&&i<numPixels;i+=256)
+                ok=std::fwrite(black,3,std::min<size_t>(256,numPixels-i),file)==std::min<size_t>(256,numPixels-i);
+        }
+        written+=numPixels*3;
+    }
+    static const unsigned char padding[8]={0};
+    uint64_t recordSize=(written+7)&~uint64_t(7);
+    if(recordSize>written)
+        ok=ok&&std::fwrite(padding,1,size_t(recordSize-written),file)==size_t(recordSize-written);
+    if(!ok)
+        return false;
+    entry.offset=position;
+    position+=recordSize;
+    index.push_back(entry);
+    return true;
+}
+
+bool DepthRecorder::queueFrame(const uint16_t* rawDepth, const unsigned char* color, const DepthRecording::IndexEntry& entry, bool keyFrame)
+{
+    /* Wait for a free job if the encoders fall behind, rather than dropping frames: */
+    EncodeJob* job;
+    {
+        std::unique_lock<std::mutex> lock(jobMutex);
+        if(freeJobs.empty())
+            ++numStalls;
+        while(freeJobs.empty()&&!failed)
+            jobCond.wait(lock);
+        if(failed)
+            return false;
+        job=freeJobs.back();
+        freeJobs.pop_back();
+    }
+
+    /* Copy the frame, and the previous one it is coded against: */
+    size_t numPixels=size_t(header.width)*size_t(header.height);
+    job->keyFrame=keyFrame;
+    job->depth.assign(rawDepth,rawDepth+numPixels);
+    if(!job->keyFrame)
+        job->previous.swap(previousDepth);
+    previousDepth.assign(rawDepth,rawDepth+numPixels);
+    if(header.flags&DepthRecording::HAS_COLOR)
+    {
+        if(color!=0)
+            job->color.assign(color,color+numPixels*3);
+        else
+            job->color.assign(numPixels*3,0);
+    }
+    job->entry=entry;
+    job->done=false;
+    numRawBytes+=numPixels*sizeof(uint16_t);
+
+    std::lock_guard<std::mutex> lock(jobMutex);
+    queuedJobs.push_back(job);
+    orderedJobs.push_back(job);
+    jobCond.notify_all();
+    return true;
+}
+
+void DepthRecorder::encoderLoop(void)
+{
+    std::unique_lock<std::mutex> lock(jobMutex);
+    while(true)
+    {
+        while(queuedJobs.empty()&&!stopping)
+            jobCond.wait(lock);
+        if(queuedJobs.empty())
+            break;
+        EncodeJob* job=queuedJobs.front();
+        queuedJobs.pop_front();
+
+        /* Encode without holding the lock; jobs finish in any order: */
+        lock.unlock();
+        job->encodedSize=DepthCodec::encode(job->depth.data(), job->keyFrame?0:job->previous.data(), header.width, header.height, DepthRecording::numCodecBands, job->encoded, 0);
+        lock.lock();
+        job->done=true;
+        writeFinishedJobs(lock);
+    }
+}
+
+void DepthRecorder::writeFinishedJobs(std::unique_lock<std::mutex>& lock)
+{
+    /* One thread at a time writes the finished frames at the head of the order: */
+    if(writing)
+        return;
+    writing=true;
+    while(!orderedJobs.empty()&&orderedJobs.front()->done)
+    {
+        EncodeJob* job=orderedJobs.front();
+        orderedJobs.pop_front();
+        bool skip=failed; // after a failure, jobs are only recycled until the recording is closed
+        lock.unlock();
+        bool ok=true;
+        if(!skip)
+            ok=writeRecord(job->encoded.data(), job->encodedSize, job->color.empty()?0:job->color.data(), job->entry);
+        lock.lock();
+        if(!ok)
+            failed=true;
+        else
+            numEncodedBytes+=job->encodedSize;
+        freeJobs.push_back(job);
+        jobCond.notify_all();
+    }
+    writing=false;
+}
+
+void DepthRecorder::stopEncoders(void)
+{
+    {
+        std::unique_lock<std::mutex> lock(jobMutex);
+        while(!orderedJobs.empty())
+            jobCond.wait(lock);
+        stopping=true;
+        jobCond.notify_all();
+    }
+    for(size_t i=0;i<encoders.size();++i)
+        encoders[i].join();
+    encoders.clear();
+    jobs.clear();
+    freeJobs.clear();
+    previousDepth.clear();
+}
+
+bool DepthRecorder::close(void)
+{
+    if(file==0)
+        return false;
+    if(!encoders.empty())
+        stopEncoders();
+
+    /* Append the index and patch the header to mark the recording as finished: */
+    header.numFrames=(uint32_t)index.size();
+    header.indexOffset=position;
+    bool ok=!failed;
+    ok=ok&&(index.empty()||std::fwrite(index.data(),sizeof(DepthRecording::IndexEntry),index.size(),file)==index.size());
+    ok=ok&&std::fseek(file,0,SEEK_SET)==0&&std::fwrite(&header,sizeof(header),1,file)==1;
+    ok=std::fclose(file)==0&&ok;
+    file=0;
+    if(!ok)
+        ofLog(OF_LOG_ERROR, "DepthRecorder: cannot finish "+fileName);
+    else
+    {
+        std::cout<< "DepthRecorder: recorded " << header.numFrames << " frames to " << fileName <<std::endl;
+        if(header.flags&DepthRecording::COMPRESSED&&numEncodedBytes!=0)
+            std::cout<< "  depth compressed " << double(numRawBytes)/double(numEncodedBytes) << ":1, " << numStalls << " frames waited for the encoders" <<std::endl;
+    }
+    return ok;
+}
+
+/***********************************
+ Methods of class DepthRecordingFile:
+ ***********************************/
+
+DepthRecordingFile::DepthRecordingFile()
+:data(0), size(0),
+#ifdef TARGET_WIN32
+ fileHandle(0), mappingHandle(0),
+#endif
+ index(0)
+{
+    std::memset(&header,0,sizeof(header));
+}
+
+DepthRecordingFile::~DepthRecordingFile()
+{
+    close();
+}
+
+bool DepthRecordingFile::open(const std::string& fileName)
+{
+    close();
+    std::string path=ofToDataPath(fileName);
+
+    /* Map the whole file read-only: */
+#ifdef TARGET_WIN32
+    HANDLE f=CreateFileA(path.c_str(),GENERIC_READ,FILE_SHARE_READ,NULL,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,NULL);
+    if(f==INVALID_HANDLE_VALUE)
+    {
+        ofLog(OF_LOG_ERROR, "DepthRecordingFile: cannot open "+fileName);
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    HANDLE m=NULL;
+    if(GetFileSizeEx(f,&fileSize)&&fileSize.QuadPart>=LONGLONG(sizeof(header)))
+        m=CreateFileMappingA(f,NULL,PAGE_READONLY,0,0,NULL);
+    void* view=m!=NULL?MapViewOfFile(m,FILE_MAP_READ,0,0,0):NULL;
+    if(view==NULL)
+    {
+        if(m!=NULL)
+            CloseHandle(m);
+        CloseHandle(f);
+        ofLog(OF_LOG_ERROR, "DepthRecordingFile: cannot map "+fileName);
+        return false;
+    }
+    fileHandle=f;
+    mappingHandle=m;
+    data=static_cast<const unsigned char*>(view);
+    size=size_t(fileSize.QuadPart);
+#else
+    int fd=::open(path.c_str(),O_RDONLY);
+    if(fd<0)
+    {
+        ofLog(OF_LOG_ERROR, "DepthRecordingFile: cannot open "+fileName);
+        return false;
+    }
+    struct stat st;
+    void* view=MAP_FAILED;
+    if(fstat(fd,&st)==0&&st.st_size>=off_t(sizeof(header)))
+        view=mmap(0,size_t(st.st_size),PROT_READ,MAP_SHARED,fd,0);
+    ::close(fd); // the mapping keeps the file open
+    if(view==MAP_FAILED)
+    {
+        ofLog(OF_LOG_ERROR, "DepthRecordingFile: cannot map "+fileName);
+        return false;
+    }
+    data=static_cast<const unsigned char*>(view);
+    size=size_t(st.st_size);
+#if defined(MADV_SEQUENTIAL)
+    madvise(view,size,MADV_SEQUENTIAL); // playback reads frames in order
+#endif
+#endif
+
+    /* Check the header and the index: */
+    std::memcpy(&header,data,sizeof(header));
+    const char* error=0;
+    uint64_t recordSize=getUncompressedRecordSize(header);
+    if(std::memcmp(header.magic,DepthRecording::magic,sizeof(header.magic))!=0)
+        error="not a depth recording";
+    else if(header.version<1||header.version>DepthRecording::formatVersion)
+        error="unsupported format version";
+    else if(header.indexOffset==0)
+        error="recording was not finished";
+    else if(header.numFrames==0)
+        error="recording has no frames";
+    else if(header.indexOffset+uint64_t(header.numFrames)*sizeof(DepthRecording::IndexEntry)>size||header.indexOffset%8!=0)
+        error="truncated index";
+    else
+    {
+        index=reinterpret_cast<const DepthRecording::IndexEntry*>(data+header.indexOffset);
+        for(unsigned int i=0;i<header.numFrames&&error==0;++i)
+        {
+            if(isCompressed())
+            {
+                /* Compressed records run up to the next one: */
+                uint64_t end=i+1<header.numFrames?index[i+1].offset:header.indexOffset;
+                recordSize=end>index[i].offset?end-index[i].offset:header.indexOffset;
+            }
+            if(index[i].offset%8!=0||index[i].offset<sizeof(header)||index[i].offset+recordSize>header.indexOffset)
+                error="frame outside the file";
+            else if(isCompressed())
+            {
+                /* The compressed depth and the color have to fit in the record: */
+                size_t colorSize=hasColor()?size_t(header.width)*size_t(header.height)*3:0;
+                size_t depthSize=DepthCodec::getEncodedSize(data+index[i].offset, size_t(recordSize));
+                if(depthSize==0||depthSize+colorSize>recordSize)
+                    error="corrupt compressed frame";
+                else if(i==0&&!isKeyFrame(0))
+                    error="recording does not start with a key frame";
+            }
+        }
+    }
+    if(error!=0)
+    {
+        ofLog(OF_LOG_ERROR, "DepthRecordingFile: "+fileName+": "+error);
+        close();
+        return false;
+    }
+    std::cout<< "DepthRecordingFile: " << fileName << ": " << header.numFrames << " frames of " << header.width << "x" << header.height << (hasColor()?" with color, ":", ") << (isCompressed()?"compressed, ":"") << getDuration()*1.0e-6 << " s" <<std::endl;
+    return true;
+}
+
+void DepthRecordingFile::close(void)
+{
+    if(data!=0)
+    {
+#ifdef TARGET_WIN32
+        UnmapViewOfFile(data);
+        CloseHandle(mappingHandle);
+        CloseHandle(fileHandle);
+        mappingHandle=0;
+        fileHandle=0;
+#else
+        munmap(const_cast<unsigned char*>(data),size);
+#endif
+    }
+    data=0;
+    size=0;
+    index=0;
+    std::memset(&header,0,sizeof(header));
+}
+
+DepthSource::Intrinsics DepthRecordingFile::getIntrinsics(void) const
+{
+    DepthSource::Intrinsics intrinsics;
+    intrinsics.fx=header.intrinsics[0];
+    intrinsics.fy=header.intrinsics[1];
+    intrinsics.cx=header.intrinsics[2];
+    intrinsics.cy=header.intrinsics[3];
+    return intrinsics;
+}
+
+uint64_t DepthRecordingFile::getDuration(void) const
+{
+    return header.numFrames!=0?index[header.numFrames-1].timestamp:0;
+}
+
+uint64_t DepthRecordingFile::getRecordSize(unsigned int frame) const
+{
+    if(!isCompressed())
+        return getUncompressedRecordSize(header);
+    uint64_t end=frame+1<header.numFrames?index[frame+1].offset:header.indexOffset;
+    return end-index[frame].offset;
+}
+
+const uint16_t* DepthRecordingFile::getRawDepth(unsigned int frame) const
+{
+    if(isCompressed())
+        return 0;
+    return reinterpret_cast<const uint16_t*>(data+index[frame].offset);
+}
+
+bool DepthRecordingFile::isKeyFrame(unsigned int frame) const
+{
+    if(!isCompressed())
+        return true;
+    return DepthCodec::getFrameType(data+index[frame].offset)==DepthCodec::KEY_FRAME;
+}
+
+bool DepthRecordingFile::decodeRawDepth(unsigned int frame, const uint16_t* previous, uint16_t* rawDepth, WorkerPool* pool) const
+{
+    if(!isCompressed())
+        return false;
+    return DepthCodec::decode(data+index[frame].offset, size_t(getRecordSize(frame)), previous, header.width, header.height, rawDepth, pool);
+}
+
+const unsigned char* DepthRecordingFile::getColor(unsigned int frame) const
+{
+    if(!hasColor())
+        return 0;
+    size_t depthSize=size_t(header.width)*size_t(header.height)*sizeof(uint16_t);
+    if(isCompressed())
+        depthSize=DepthCodec::getEncodedSize(data+index[frame].offset, size_t(getRecordSize(frame)));
+    return data+index[frame].offset+depthSize;
+}
@@ -0,0 +1,189 @@
+/***********************************************************************
+ DepthRecording - Container for recorded depth streams. A recording
+ holds raw depth frames in millimeters, optionally with their registered
+ color frames, each tagged with its arrival time and the clip range in
+ use when it was recorded, followed by an index of the frames.
+ DepthRecorder appends frames to a file, optionally compressing the
+ depth losslessly with DepthCodec on background encoder threads;
+ DepthRecordingFile memory maps a finished recording and gives random
+ access to its frames, without copying them if they are uncompressed.
+
+ File layout (native byte order):
+   Header (64 bytes)
+   Frame records, each 8-byte aligned: width*height uint16_t depth
+   values, or a DepthCodec frame if the recording is compressed, then
+   width*height*3 color bytes if the recording has color
+   Index: numFrames IndexEntry records
+ ***********************************************************************/
+
+#pragma once
+#include "ofMain.h"
+#include "DepthSource.h"
+#include "WorkerPool.h"
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace DepthRecording {
+    static const char magic[8]={'S','B','X','D','E','P','T','H'}; // Identifies recording files
+    static const uint32_t formatVersion=2; // Version 1 files are read as well; they have no compressed frames
+    static const unsigned int keyFrameInterval=30; // Frames from one key frame to the next in compressed recordings
+    static const int numCodecBands=4; // Bands of compressed frames, decoded in parallel
+    enum Flags
+    {
+        HAS_COLOR=0x1U, // Frames carry a registered RGB color frame
+        COMPRESSED=0x2U // Depth is DepthCodec compressed, with a key frame every keyFrameInterval frames
+    };
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t width, height; // Size of the depth and color frames
+        uint32_t flags; // Combination of Flags
+        uint32_t numFrames; // Number of frames, 0 until the recording is finished
+        uint32_t keyFrameInterval; // Frames from one key frame to the next if compressed, 0 otherwise
+        uint64_t indexOffset; // Position of the index in the file, 0 until the recording is finished
+        float intrinsics[4]; // Depth camera focal lengths and principal point in pixels, all 0 if unknown
+        uint64_t reserved[1];
+    };
+
+    struct IndexEntry
+    {
+        uint64_t offset; // Position of the frame record in the file
+        uint64_t timestamp; // Arrival time of the frame relative to the first frame, in microseconds
+        float nearclip, farclip; // Clip range in millimeters when the frame was recorded
+    };
+}
+
+class DepthRecorder {
+public:
+    DepthRecorder();
+    ~DepthRecorder(); // Finishes an open recording
+
+    void setCompression(bool newCompress, int newNumEncoderThreads); // Sets whether the following recordings compress the depth, and the number of encoder threads (default uncompressed, 2 threads)
+    bool open(const std::string& fileName, unsigned int swidth, unsigned int sheight, bool sWithColor, const DepthSource::Intrinsics& intrinsics); // Starts a new recording, replacing the file
+    bool isOpen(void) const
+    {
+        return file!=0;
+    }
+    bool addFrame(const uint16_t* rawDepth, const unsigned char* color, uint64_t arrivalTime, float nearclip, float farclip); // Appends a frame, or queues it for compression; color is ignored if the recording has no color
+    bool close(void); // Waits for queued frames, writes the index and finishes the recording
+    unsigned int getNumFrames(void) const
+    {
+        return (unsigned int)index.size();
+    }
+
+private:
+    struct EncodeJob // Frame queued for compression
+    {
+        std::vector<uint16_t> depth; // Copy of the frame's depth
+        std::vector<uint16_t> previous; // Copy of the previous frame's depth, for delta frames
+        std::vector<unsigned char> color; // Copy of the frame's color, if recorded
+        std::vector<unsigned char> encoded; // Encoder output and scratch space
+        size_t encodedSize;
+        bool keyFrame;
+        bool done; // Flag whether the frame is encoded and ready to be written
+        DepthRecording::IndexEntry entry; // Time and clip range; the offset is set when written
+    };
+
+    DepthRecorder(const DepthRecorder&); // Prohibit copy constructor
+    DepthRecorder& operator=(const DepthRecorder&); // Prohibit assignment operator
+
+    bool writeRecord(const unsigned char* depth, size_t depthSize, const unsigned char* color, DepthRecording::IndexEntry entry); // Writes a frame record at the end of the file
+    bool queueFrame(const uint16_t* rawDepth, const unsigned char* color, const DepthRecording::IndexEntry& entry, bool keyFrame); // Hands a frame to the encoder threads
+    void encoderLoop(void); // Encodes queued frames; runs on the encoder threads
+    void writeFinishedJobs(std::unique_lock<std::mutex>& lock); // Writes encoded frames in order; called with the lock held
+    void stopEncoders(void); // Waits for the queued frames and stops the encoder threads
+
+    std::FILE* file; // Recording being written, 0 if none
+    std::string fileName;
+    DepthRecording::Header header;
+    std::vector<DepthRecording::IndexEntry> index; // Frames written so far
+    uint64_t position; // Current end of the file
+    uint64_t firstArrivalTime; // Arrival time of the first frame, in microseconds
+    uint32_t numFramesAdded; // Frames written or queued since open()
+    bool compress; // Flag whether new recordings are compressed
+    int numEncoderThreads;
+    std::vector<std::thread> encoders; // Encoder threads of a compressed recording
+    std::vector<std::unique_ptr<EncodeJob> > jobs; // All jobs, bounding the frames in flight
+    std::mutex jobMutex; // Protects the job queues and flags below
+    std::condition_variable jobCond; // Signals queued frames, encoded frames and free jobs
+    std::vector<EncodeJob*> freeJobs; // Jobs ready to take a frame
+    std::deque<EncodeJob*> queuedJobs; // Jobs waiting for an encoder thread
+    std::deque<EncodeJob*> orderedJobs; // Jobs not written yet, in frame order
+    bool writing; // Flag whether an encoder thread is writing finished jobs
+    bool stopping; // Flag to shut the encoder threads down
+    bool failed; // Flag whether writing a frame failed
+    std::vector<uint16_t> previousDepth; // Depth of the last queued frame
+    uint64_t numRawBytes, numEncodedBytes; // Depth bytes queued and written for compressed recordings
+    unsigned int numStalls; // Frames that waited for a free job
+};
+
+class DepthRecordingFile {
+public:
+    DepthRecordingFile();
+    ~DepthRecordingFile();
+
+    bool open(const std::string& fileName); // Maps a finished recording; returns false if the file is missing or malformed
+    void close(void);
+    bool isOpen(void) const
+    {
+        return data!=0;
+    }
+    unsigned int getWidth(void) const
+    {
+        return header.width;
+    }
+    unsigned int getHeight(void) const
+    {
+        return header.height;
+    }
+    bool hasColor(void) const
+    {
+        return (header.flags&DepthRecording::HAS_COLOR)!=0;
+    }
+    unsigned int getNumFrames(void) const
+    {
+        return header.numFrames;
+    }
+    bool isCompressed(void) const
+    {
+        return (header.flags&DepthRecording::COMPRESSED)!=0;
+    }
+    bool hasIntrinsics(void) const
+    {
+        return header.intrinsics[0]>0.0f;
+    }
+    DepthSource::Intrinsics getIntrinsics(void) const; // Returns the recorded depth camera model, if hasIntrinsics()
+    const DepthRecording::IndexEntry& getEntry(unsigned int frame) const // Returns the time and clip range of a frame
+    {
+        return index[frame];
+    }
+    uint64_t getDuration(void) const; // Returns the time of the last frame, in microseconds
+    const uint16_t* getRawDepth(unsigned int frame) const; // Returns the depth values of a frame in millimeters, mapped read-only, or 0 if the recording is compressed
+    bool isKeyFrame(unsigned int frame) const; // Returns true if a frame decodes without the previous one; always true if uncompressed
+    bool decodeRawDepth(unsigned int frame, const uint16_t* previous, uint16_t* rawDepth, WorkerPool* pool) const; // Decodes the depth of a compressed frame, given the previous frame's depth for delta frames
+    const unsigned char* getColor(unsigned int frame) const; // Returns the RGB color of a frame, or 0 if the recording has no color
+
+private:
+    DepthRecordingFile(const DepthRecordingFile&); // Prohibit copy constructor
+    DepthRecordingFile& operator=(const DepthRecordingFile&); // Prohibit assignment operator
+
+    uint64_t getRecordSize(unsigned int frame) const; // Returns the size of a frame record including padding
+
+    const unsigned char* data; // Mapped file, 0 if none
+    size_t size; // Size of the mapped file
+#ifdef TARGET_WIN32
+    void* fileHandle; // Handles of the file and its mapping
+    void* mappingHandle;
+#endif
+    DepthRecording::Header header;
+    const DepthRecording::IndexEntry* index; // Index inside the mapped file
+};
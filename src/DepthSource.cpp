@@ -0,0 +1,107 @@
+/***********************************************************************
+ DepthSource - Abstract source of depth frames feeding the grabber.
+ ***********************************************************************/
+
+#include "DepthSource.h"
+
+DepthSource::DepthSource()
+:nearclip(500.0f), farclip(4000.0f), lastFrameTime(0), framePeriod(0), numFrameIntervals(0)
+{
+    DepthSource::setDepthClipping(nearclip, farclip);
+}
+
+DepthSource::~DepthSource()
+{
+}
+
+DepthSource::Intrinsics DepthSource::getIntrinsics(void) const
+{
+    return getNominalIntrinsics(getWidth(), getHeight());
+}
+
+void DepthSource::setDepthClipping(float snearclip, float sfarclip)
+{
+    nearclip=snearclip;
+    farclip=sfarclip;
+
+    /* Map millimeters to the clip range, near plane at 255 and far plane at 0 (0 stays invalid): */
+    depthLookupTable.resize(65536);
+    depthLookupTable[0]=0;
+    for(unsigned int i=1;i<depthLookupTable.size();++i)
+        depthLookupTable[i]=(unsigned char)(ofMap(float(i), nearclip, farclip, 255.0f, 0.0f, true));
+}
+
+uint64_t DepthSource::getTimeToNextFrame(void) const
+{
+    if(framePeriod==0)
+        return 0;
+
+    /* Wake an eighth of a period early, to absorb the jitter of the arrivals: */
+    uint64_t now=ofGetElapsedTimeMicros();
+    uint64_t due=lastFrameTime+framePeriod-framePeriod/8;
+    if(now<due)
+        return due-now;
+
+    /* A source that stopped delivering is checked once per period until it recovers: */
+    if(now>lastFrameTime+2*framePeriod)
+        return framePeriod;
+    return 0;
+}
+
+bool DepthSource::isFinished(void) const
+{
+    return false;
+}
+
+DepthSource::Intrinsics DepthSource::getNominalIntrinsics(unsigned int width, unsigned int height)
+{
+    /* The kinect's depth camera at 640x480 (zero plane at 120 mm, 0.1042 mm reference pixels at twice the resolution): */
+    Intrinsics intrinsics;
+    float scale=float(width)/640.0f;
+    intrinsics.fx=intrinsics.fy=120.0f/(2.0f*0.1042f)*scale;
+    intrinsics.cx=float(width)*0.5f;
+    intrinsics.cy=float(height)*0.5f;
+    return intrinsics;
+}
+
+void DepthSource::frameArrived(void)
+{
+    uint64_t now=ofGetElapsedTimeMicros();
+    if(lastFrameTime==0)
+    {
+        lastFrameTime=now;
+        return;
+    }
+
+    /* Average the intervals, leaving out the gaps of dropped frames once the estimate settled: */
+    uint64_t interval=now-lastFrameTime;
+    if(numFrameIntervals<8)
+    {
+        ++numFrameIntervals;
+        framePeriod=(framePeriod*(numFrameIntervals-1)+interval)/numFrameIntervals;
+        lastFrameTime=now;
+    }
+    else if(interval<framePeriod+framePeriod/2)
+    {
+        /* Frames are noticed late, never early: follow early arrivals at once and late ones slowly: */
+        uint64_t predicted=lastFrameTime+framePeriod;
+        lastFrameTime=now<predicted?now:predicted+(now-predicted)/8;
+        framePeriod=(framePeriod*7+interval)/8;
+    }
+    else
+        lastFrameTime=now;
+}
+
+void DepthSource::resetFrameTiming(void)
+{
+    lastFrameTime=0;
+    framePeriod=0;
+    numFrameIntervals=0;
+}
+
+void DepthSource::mapDepth(const uint16_t* rawDepth, unsigned char* depth, size_t numPixels) const
+{
+    const unsigned char* table=depthLookupTable.data();
+    for(size_t i=0;i<numPixels;++i)
+        depth[i]=table[rawDepth[i]];
+}
@@ -0,0 +1,65 @@
+/***********************************************************************
+ DepthSource - Abstract source of depth frames feeding the grabber: a
+ kinect, a recording or a synthetic generator. The grabber thread sleeps
+ until the source's next frame is due, calls update() and reads the
+ current frame through references into the source's own buffers, valid
+ until the next update(), so sources hand out frames without copying
+ them. Sources whose frames arrive on their own schedule report the
+ arrivals, and the time of the next frame is predicted from them. Depth comes in millimeters and as
+ 8-bit depth mapped to the clip range, near plane at 255 and 0 invalid.
+ ***********************************************************************/
+
+#pragma once
+#include "ofMain.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class DepthSource {
+public:
+    struct Intrinsics // Pinhole model of the depth camera, in pixels
+    {
+        float fx, fy; // Focal lengths
+        float cx, cy; // Principal point
+    };
+
+    DepthSource();
+    virtual ~DepthSource();
+
+    virtual std::string getName(void) const =0; // Returns a description of the source for the log
+    virtual bool isOpen(void) const =0;
+    virtual void close(void) =0;
+    virtual unsigned int getWidth(void) const =0;
+    virtual unsigned int getHeight(void) const =0;
+    virtual Intrinsics getIntrinsics(void) const; // Returns the depth camera model; defaults to the kinect's nominal one
+    virtual bool hasColor(void) const =0; // Returns true if getColorPixels() carries a registered color frame
+    virtual void setDepthClipping(float snearclip, float sfarclip); // Sets the range mapped to the 8-bit depth
+    float getNearClipping(void) const
+    {
+        return nearclip;
+    }
+    float getFarClipping(void) const
+    {
+        return farclip;
+    }
+
+    virtual bool update(void) =0; // Checks for a new frame without blocking; makes it current and returns true if one arrived
+    virtual uint64_t getTimeToNextFrame(void) const; // Returns the time until the next frame is due in microseconds, 0 if unknown or overdue; predicted from the reported arrivals by default
+    virtual bool isFinished(void) const; // Returns true if the source will deliver no more frames
+    virtual const ofShortPixels& getRawDepthPixels(void) =0; // Depth of the current frame in millimeters, 0 invalid
+    virtual const ofPixels& getDepthPixels(void) =0; // Depth of the current frame mapped to the clip range
+    virtual const ofPixels& getColorPixels(void) =0; // RGB color of the current frame, black if the source has no color
+
+    static Intrinsics getNominalIntrinsics(unsigned int width, unsigned int height); // Returns the kinect's nominal depth camera model scaled to a frame size
+
+protected:
+    void mapDepth(const uint16_t* rawDepth, unsigned char* depth, size_t numPixels) const; // Maps millimeters to the clip range
+    void frameArrived(void); // Reports the arrival of a frame, for sources not knowing when their next frame is due
+    void resetFrameTiming(void); // Forgets the reported arrivals, when the source is reopened
+
+    float nearclip, farclip; // Clip range in millimeters
+    std::vector<unsigned char> depthLookupTable; // Maps millimeters to the clip range
+    uint64_t lastFrameTime; // Time the last reported frame arrived in microseconds
+    uint64_t framePeriod; // Estimated time between reported frames in microseconds, 0 until two frames arrived
+    unsigned int numFrameIntervals; // Number of intervals averaged into framePeriod
+};
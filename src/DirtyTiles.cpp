@@ -0,0 +1,69 @@
+/***********************************************************************
+ DirtyTiles - Tracks which square tiles of a stream of 8-bit frames
+ changed since the previous frame.
+ ***********************************************************************/
+
+#include "DirtyTiles.h"
+#include <algorithm>
+#include <cstring>
+
+DirtyTiles::DirtyTiles()
+:width(0), height(0), tileSize(1), tilesX(0), tilesY(0), previousValid(false), numDirty(0)
+{
+}
+
+void DirtyTiles::setup(unsigned int swidth, unsigned int sheight, unsigned int sTileSize)
+{
+    width=swidth;
+    height=sheight;
+    tileSize=std::max(1u,sTileSize);
+    tilesX=(width+tileSize-1)/tileSize;
+    tilesY=(height+tileSize-1)/tileSize;
+    previousFrame.assign(size_t(width)*height,0);
+    markAll();
+}
+
+void DirtyTiles::markAll(void)
+{
+    dirty.assign(size_t(tilesX)*tilesY,1);
+    numDirty=tilesX*tilesY;
+    previousValid=false;
+}
+
+unsigned int DirtyTiles::update(const unsigned char* frame)
+{
+    numDirty=0;
+    for(int ty=0;ty<tilesY;++ty)
+    {
+        unsigned int y0=ty*tileSize, y1=std::min(y0+tileSize,height);
+        for(int tx=0;tx<tilesX;++tx)
+        {
+            unsigned int x0=tx*tileSize, x1=std::min(x0+tileSize,width);
+            
+            /* Compare the tile row by row, and remember it if it changed: */
+            bool changed=!previousValid;
+            for(unsigned int y=y0;y<y1&&!changed;++y)
+                changed=std::memcmp(frame+size_t(y)*width+x0,&previousFrame[size_t(y)*width+x0],x1-x0)!=0;
+            if(changed)
+            {
+                for(unsigned int y=y0;y<y1;++y)
+                    std::memcpy(&previousFrame[size_t(y)*width+x0],frame+size_t(y)*width+x0,x1-x0);
+                ++numDirty;
+            }
+            dirty[ty*tilesX+tx]=changed?1:0;
+        }
+    }
+    previousValid=true;
+    return numDirty;
+}
+
+void DirtyTiles::dilate(int numTiles, std::vector<unsigned char>& result) const
+{
+    result.assign(dirty.size(),0);
+    for(int ty=0;ty<tilesY;++ty)
+        for(int tx=0;tx<tilesX;++tx)
+            if(dirty[ty*tilesX+tx])
+                for(int y=std::max(0,ty-numTiles);y<=std::min(tilesY-1,ty+numTiles);++y)
+                    for(int x=std::max(0,tx-numTiles);x<=std::min(tilesX-1,tx+numTiles);++x)
+                        result[y*tilesX+x]=1;
+}
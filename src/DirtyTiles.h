@@ -0,0 +1,61 @@
+/***********************************************************************
+ DirtyTiles - Tracks which square tiles of a stream of 8-bit frames
+ changed since the previous frame, so that downstream stages can skip
+ the unchanged parts of the sandbox.
+ ***********************************************************************/
+
+#pragma once
+#include <cstddef>
+#include <vector>
+
+class DirtyTiles {
+public:
+    DirtyTiles();
+
+    void setup(unsigned int swidth, unsigned int sheight, unsigned int sTileSize); // Sets the frame and tile sizes and marks all tiles dirty
+    unsigned int update(const unsigned char* frame); // Marks the tiles differing from the previous frame and remembers the frame; returns the number of dirty tiles
+    void markAll(void); // Marks all tiles dirty and forgets the previous frame
+    void dilate(int numTiles, std::vector<unsigned char>& result) const; // Marks in result the tiles within numTiles of a dirty tile
+    
+    unsigned int getTileSize(void) const
+    {
+        return tileSize;
+    }
+    int getTilesX(void) const
+    {
+        return tilesX;
+    }
+    int getTilesY(void) const
+    {
+        return tilesY;
+    }
+    int getNumTiles(void) const
+    {
+        return tilesX*tilesY;
+    }
+    unsigned int getNumDirty(void) const
+    {
+        return numDirty;
+    }
+    bool isDirty(int tx, int ty) const
+    {
+        return dirty[ty*tilesX+tx]!=0;
+    }
+    const std::vector<unsigned char>& getFlags(void) const // One flag per tile, row by row
+    {
+        return dirty;
+    }
+    bool isAllDirty(void) const
+    {
+        return numDirty==unsigned(getNumTiles());
+    }
+    
+private:
+    unsigned int width, height; // Width and height of the frames
+    unsigned int tileSize; // Width and height of a tile in pixels
+    int tilesX, tilesY; // Number of tiles in each direction, the last ones possibly partial
+    std::vector<unsigned char> previousFrame; // Frame of the last update
+    bool previousValid; // Flag whether previousFrame holds the last frame
+    std::vector<unsigned char> dirty; // Dirty flag of each tile
+    unsigned int numDirty; // Number of dirty tiles
+};
@@ -0,0 +1,167 @@
+/***********************************************************************
+ ExponentialFilter - Per-pixel exponentially weighted mean and variance
+ of a stream of depth frames, templated on the raw depth type. Keeps
+ constant state per pixel whatever the averaging window, as an
+ alternative to the averaging buffer of TemporalFilter.
+ ***********************************************************************/
+
+#pragma once
+#include "FrameFilterKernels.h"
+#include "WorkerPool.h"
+
+template <class RawDepthParam>
+class ExponentialFilter {
+public:
+    typedef RawDepthParam RawDepth; // Data type for raw depth values
+    typedef FrameFilterKernels::DepthTraits<RawDepth> Traits;
+    typedef FrameFilterKernels::TemporalParams<RawDepth> Params;
+    typedef FrameFilterKernels::ExponentialBuffers<RawDepth> Buffers;
+
+    ExponentialFilter()
+    :width(0), height(0), window(0), decay(0.0f),
+     weightBuffer(0), meanBuffer(0), m2Buffer(0), validBuffer(0)
+    {
+    }
+    ~ExponentialFilter()
+    {
+        release();
+    }
+
+    void allocate(unsigned int swidth, unsigned int sheight, int sWindow) // Allocates and clears all buffers; sWindow is the effective number of averaged frames
+    {
+        release();
+        width=swidth;
+        height=sheight;
+        window=sWindow>1?sWindow:1;
+        decay=1.0f-1.0f/float(window);
+        size_t numPixels=getNumPixels();
+
+        weightBuffer=new float[numPixels];
+        meanBuffer=new float[numPixels];
+        m2Buffer=new float[numPixels];
+        validBuffer=new RawDepth[numPixels];
+        clear();
+    }
+    void release(void) // Releases all buffers
+    {
+        delete[] weightBuffer;
+        delete[] meanBuffer;
+        delete[] m2Buffer;
+        delete[] validBuffer;
+        weightBuffer=0;
+        meanBuffer=0;
+        m2Buffer=0;
+        validBuffer=0;
+    }
+    void clear(void) // Discards all samples and stable values
+    {
+        size_t numPixels=getNumPixels();
+        for(size_t i=0;i<numPixels;++i)
+        {
+            weightBuffer[i]=0.0f;
+            meanBuffer[i]=0.0f;
+            m2Buffer[i]=0.0f;
+            validBuffer[i]=0;
+        }
+    }
+    bool isAllocated(void) const
+    {
+        return weightBuffer!=0;
+    }
+
+    /* Enters a new frame into the statistics and writes the filtered frame: */
+    void process(const RawDepth* input, RawDepth* output, const Params& params, FrameFilterKernels::Isa isa, WorkerPool& workerPool)
+    {
+        Buffers buffers={input,weightBuffer,meanBuffer,m2Buffer,validBuffer,output};
+
+        /* Process horizontal bands of the frame in parallel: */
+        int numBands=workerPool.getNumThreads();
+        workerPool.run(numBands,[&](int band){
+            unsigned int y0=band*height/numBands;
+            unsigned int y1=(band+1)*height/numBands;
+            FrameFilterKernels::exponential(isa,buffers.advance(size_t(y0)*width),size_t(y1-y0)*width,params,decay);
+        });
+    }
+
+    /* Maps all means and stable values d to scale*d+offset, as when the units of the raw depth change; pixels whose mean leaves the valid range are discarded: */
+    void remap(float scale, float offset, WorkerPool& workerPool)
+    {
+        float minValid=1.0f;
+        float maxValid=float(Traits::invalidSample-1);
+
+        /* Remap horizontal bands of the buffers in parallel: */
+        int numBands=workerPool.getNumThreads();
+        workerPool.run(numBands,[&](int band){
+            size_t i0=size_t(band*height/numBands)*width;
+            size_t i1=size_t((band+1)*height/numBands)*width;
+            for(size_t i=i0;i<i1;++i)
+            {
+                /* The mean moves with the units and the squared deviations scale with their square: */
+                float mean=scale*meanBuffer[i]+offset;
+                if(weightBuffer[i]>0.0f&&mean>=minValid&&mean<=maxValid)
+                {
+                    meanBuffer[i]=mean;
+                    m2Buffer[i]*=scale*scale;
+                }
+                else
+                {
+                    weightBuffer[i]=0.0f;
+                    meanBuffer[i]=0.0f;
+                    m2Buffer[i]=0.0f;
+                }
+
+                /* Remap the stable value, 0 if it falls outside the valid range: */
+                float valid=scale*float(validBuffer[i])+offset;
+                validBuffer[i]=validBuffer[i]!=0&&valid>=minValid&&valid<=maxValid?RawDepth(valid+0.5f):0;
+            }
+        });
+    }
+
+    size_t getStatisticsSize(void) const // Returns the size of the weight, mean and m2 planes in bytes
+    {
+        return isAllocated()?getNumPixels()*3*sizeof(float):0;
+    }
+    size_t getValidBufferSize(void) const // Returns the size of the stable value plane in bytes
+    {
+        return isAllocated()?getNumPixels()*sizeof(RawDepth):0;
+    }
+    size_t getBytesPerFrame(void) const // Returns the number of bytes the kernel streams through the cache per frame
+    {
+        if(!isAllocated())
+            return 0;
+        return getNumPixels()*(2*sizeof(RawDepth)+3*sizeof(float)+sizeof(RawDepth));
+    }
+    const RawDepth* getValidBuffer(void) const // Returns the most recent stable value of each pixel
+    {
+        return validBuffer;
+    }
+    const float* getWeightBuffer(void) const // Returns the exponentially weighted number of valid samples of each pixel
+    {
+        return weightBuffer;
+    }
+    const float* getMeanBuffer(void) const // Returns the exponentially weighted mean of each pixel
+    {
+        return meanBuffer;
+    }
+    const float* getM2Buffer(void) const // Returns the exponentially weighted sum of squared deviations of each pixel
+    {
+        return m2Buffer;
+    }
+
+private:
+    size_t getNumPixels(void) const
+    {
+        return size_t(width)*size_t(height);
+    }
+
+    ExponentialFilter(const ExponentialFilter&); // Prohibit copy constructor
+    ExponentialFilter& operator=(const ExponentialFilter&); // Prohibit assignment operator
+
+    unsigned int width, height; // Width and height of processed frames
+    int window; // Effective number of averaged frames
+    float decay; // Weight of the history on each new frame, 1-1/window
+    float* weightBuffer; // Exponentially weighted number of valid samples of each pixel
+    float* meanBuffer; // Exponentially weighted mean of the valid samples of each pixel
+    float* m2Buffer; // Exponentially weighted sum of squared deviations of each pixel
+    RawDepth* validBuffer; // Buffer holding the most recent stable depth value for each pixel
+};
@@ -0,0 +1,497 @@
+/***********************************************************************
+ FilterBenchmark - Compares the averaging and exponential modes of the
+ temporal filter on synthetic noisy depth frames.
+ ***********************************************************************/
+
+#include "FilterBenchmark.h"
+#include "ofMain.h"
+#include "DepthPlayback.h"
+#include "FrameFilter.h"
+#include "FrameFilterKernels.h"
+#include "KinectGrabber.h"
+#include "TemporalFilter.h"
+#include "ExponentialFilter.h"
+#include "SpatialFilter.h"
+#include "RoiDetector.h"
+#include "SyntheticDepthSource.h"
+#include "WorkerPool.h"
+#include "ofxOpenCv.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace FilterBenchmark {
+
+typedef unsigned char RawDepth;
+
+struct Result // Measures of one filter mode
+{
+    size_t memory; // Bytes held by the filter
+    double microsPerFrame; // Mean filtering time
+    double rmsError; // RMS difference between the filtered and the noise-free frame, over stable pixels
+    double stableFraction; // Fraction of stable pixels in the last frame
+};
+
+static void measure(const std::function<void(const RawDepth*, RawDepth*)>& process, const std::vector<std::vector<RawDepth> >& frames, const std::vector<RawDepth>& truth, Result& result)
+{
+    std::vector<RawDepth> output(truth.size());
+    uint64_t start=ofGetElapsedTimeMicros();
+    for(size_t f=0;f<frames.size();++f)
+        process(&frames[f][0],&output[0]);
+    result.microsPerFrame=double(ofGetElapsedTimeMicros()-start)/double(frames.size());
+
+    double sumSq=0.0;
+    size_t numStable=0;
+    for(size_t i=0;i<truth.size();++i)
+        if(output[i]!=0)
+        {
+            double d=double(output[i])-double(truth[i]);
+            sumSq+=d*d;
+            ++numStable;
+        }
+    result.rmsError=numStable>0?std::sqrt(sumSq/double(numStable)):0.0;
+    result.stableFraction=double(numStable)/double(truth.size());
+}
+
+static void print(const char* name, const Result& result)
+{
+    std::cout<< "  " << name << ": " << result.memory << " bytes, " << result.microsPerFrame << " us/frame, rms error " << result.rmsError << ", stable " << result.stableFraction*100.0 << "%" <<std::endl;
+}
+
+/* Noisy frames of a noise-free surface, a slope with a bump in the clip range, with a few dropped samples: */
+static void makeNoisyFrames(unsigned int width, unsigned int height, int numFrames, std::vector<RawDepth>& truth, std::vector<std::vector<RawDepth> >& frames)
+{
+    truth.resize(size_t(width)*height);
+    for(unsigned int y=0;y<height;++y)
+        for(unsigned int x=0;x<width;++x)
+        {
+            float dx=(float(x)-width*0.5f)/width, dy=(float(y)-height*0.5f)/height;
+            truth[y*width+x]=RawDepth(100.0f+60.0f*float(x)/width+60.0f*std::exp(-20.0f*(dx*dx+dy*dy)));
+        }
+
+    std::minstd_rand rng(1);
+    std::normal_distribution<float> noise(0.0f,1.0f);
+    std::uniform_real_distribution<float> drop(0.0f,1.0f);
+    frames.assign(numFrames,std::vector<RawDepth>(truth.size()));
+    for(int f=0;f<numFrames;++f)
+        for(size_t i=0;i<truth.size();++i)
+            frames[f][i]=drop(rng)<0.02f?0:RawDepth(ofClamp(std::floor(truth[i]+noise(rng)+0.5f),1.0f,254.0f));
+}
+
+void compareFilterModes(unsigned int width, unsigned int height, int window, unsigned int minNumSamples, unsigned int maxVariance, float hysteresis, int numFrames, int numThreads)
+{
+    /* Generate the frames before timing: */
+    std::vector<RawDepth> truth;
+    std::vector<std::vector<RawDepth> > frames;
+    makeNoisyFrames(width,height,numFrames,truth,frames);
+
+    FrameFilterKernels::TemporalParams<RawDepth> params;
+    params.minNumSamples=minNumSamples;
+    params.maxVariance=maxVariance;
+    params.hysteresis=hysteresis;
+    params.retainValids=true;
+    params.instableValue=0;
+
+    WorkerPool pool;
+    pool.setNumThreads(numThreads);
+    FrameFilterKernels::Isa isa=FrameFilterKernels::detectIsa();
+
+    std::cout<< "Filter modes on " << numFrames << " frames of " << width << "x" << height << ", window " << window << ":" <<std::endl;
+
+    Result averaging;
+    if(window<=FrameFilterKernels::maxAveragingSlots)
+    {
+        TemporalFilter<RawDepth> filter;
+        filter.allocate(width,height,window);
+        averaging.memory=filter.getAveragingBufferSize()+filter.getStatisticsSize()+filter.getValidBufferSize();
+        measure([&](const RawDepth* input, RawDepth* output){filter.process(input,output,params,isa,pool);},frames,truth,averaging);
+        print("Averaging",averaging);
+    }
+    else
+        std::cout<< "  Averaging: window exceeds " << FrameFilterKernels::maxAveragingSlots << " slots" <<std::endl;
+
+    Result exponential;
+    {
+        ExponentialFilter<RawDepth> filter;
+        filter.allocate(width,height,window);
+        exponential.memory=filter.getStatisticsSize()+filter.getValidBufferSize();
+        measure([&](const RawDepth* input, RawDepth* output){filter.process(input,output,params,isa,pool);},frames,truth,exponential);
+        print("Exponential",exponential);
+    }
+}
+
+/* Frames built to reach the corners of the 8-bit kernels: samples next to the invalid markers, pixels flipping between 1
+   and 254 or uniformly random including the markers, variances around maxVariance and steps testing the hysteresis: */
+static void makeExtremeFrames(unsigned int width, unsigned int height, int numFrames, unsigned int maxVariance, std::vector<std::vector<RawDepth> >& frames)
+{
+    size_t numPixels=size_t(width)*height;
+    int spread=int(std::sqrt(float(maxVariance)));
+    std::minstd_rand rng(2);
+    std::vector<unsigned char> kind(numPixels);
+    for(size_t i=0;i<numPixels;++i)
+        kind[i]=(unsigned char)(rng()%6);
+    frames.assign(numFrames,std::vector<RawDepth>(numPixels));
+    for(int f=0;f<numFrames;++f)
+        for(size_t i=0;i<numPixels;++i)
+        {
+            RawDepth value;
+            switch(kind[i])
+            {
+                case 0: // largest variance of valid samples
+                    value=(f+int(i))%2==0?1:254;
+                    break;
+                case 1: // anything, invalid markers included
+                    value=RawDepth(rng()%256);
+                    break;
+                case 2: // stable next to the markers, with dropouts to both
+                    value=rng()%8==0?RawDepth(rng()%2*255):(i%2==0?1:254);
+                    break;
+                case 3: // variance just below and above maxVariance
+                    value=RawDepth(128+(rng()%2==0?-1:1)*(spread+int(rng()%2)));
+                    break;
+                case 4: // steps around the hysteresis envelope
+                    value=RawDepth(100+(f/7)%3);
+                    break;
+                default: // a stable sample with noise
+                    value=RawDepth(ofClamp(float(200+int(rng()%5)-2),1.0f,254.0f));
+            }
+            frames[f][i]=value;
+        }
+}
+
+/* Runs every supported kernel in lockstep with the scalar one on the given frames, with and without retaining stable values, and returns true if they match bit for bit: */
+static bool compareKernelIsas(const std::string& name, unsigned int width, unsigned int height, const std::vector<std::vector<RawDepth> >& frames, int window, unsigned int minNumSamples, unsigned int maxVariance, float hysteresis)
+{
+    size_t numPixels=size_t(width)*height;
+    int numFrames=int(frames.size());
+
+    WorkerPool pool;
+    pool.setNumThreads(1);
+    FrameFilterKernels::Isa bestIsa=FrameFilterKernels::detectIsa();
+    const int numIsas=3;
+    bool averagingIdentical[numIsas]={true,true,true};
+    bool exponentialIdentical[numIsas]={true,true,true};
+
+    for(int retain=0;retain<2;++retain)
+    {
+        FrameFilterKernels::TemporalParams<RawDepth> params;
+        params.minNumSamples=minNumSamples;
+        params.maxVariance=maxVariance;
+        params.hysteresis=hysteresis;
+        params.retainValids=retain!=0;
+        params.instableValue=0;
+
+        TemporalFilter<RawDepth> averaging[numIsas];
+        ExponentialFilter<RawDepth> exponential[numIsas];
+        std::vector<RawDepth> averagingOutput[numIsas],exponentialOutput[numIsas];
+        for(int isa=0;isa<=bestIsa;++isa)
+        {
+            averaging[isa].allocate(width,height,window);
+            exponential[isa].allocate(width,height,window);
+            averagingOutput[isa].resize(numPixels);
+            exponentialOutput[isa].resize(numPixels);
+        }
+        for(int f=0;f<numFrames;++f)
+            for(int isa=0;isa<=bestIsa;++isa)
+            {
+                averaging[isa].process(&frames[f][0],&averagingOutput[isa][0],params,FrameFilterKernels::Isa(isa),pool);
+                exponential[isa].process(&frames[f][0],&exponentialOutput[isa][0],params,FrameFilterKernels::Isa(isa),pool);
+                averagingIdentical[isa]=averagingIdentical[isa]&&averagingOutput[isa]==averagingOutput[0];
+                exponentialIdentical[isa]=exponentialIdentical[isa]&&exponentialOutput[isa]==exponentialOutput[0];
+            }
+
+        /* The statistics planes must match bit for bit too, or later frames would drift apart: */
+        for(int isa=1;isa<=bestIsa;++isa)
+        {
+            const TemporalFilter<RawDepth>& a=averaging[isa];
+            const TemporalFilter<RawDepth>& ra=averaging[0];
+            averagingIdentical[isa]=averagingIdentical[isa]&&
+                std::memcmp(a.getAveragingBuffer(),ra.getAveragingBuffer(),a.getAveragingBufferSize())==0&&
+                std::memcmp(a.getCountBuffer(),ra.getCountBuffer(),numPixels*sizeof(*a.getCountBuffer()))==0&&
+                std::memcmp(a.getSumBuffer(),ra.getSumBuffer(),numPixels*sizeof(*a.getSumBuffer()))==0&&
+                std::memcmp(a.getSumSqBuffer(),ra.getSumSqBuffer(),numPixels*sizeof(*a.getSumSqBuffer()))==0&&
+                std::memcmp(a.getValidBuffer(),ra.getValidBuffer(),a.getValidBufferSize())==0;
+            const ExponentialFilter<RawDepth>& e=exponential[isa];
+            const ExponentialFilter<RawDepth>& re=exponential[0];
+            exponentialIdentical[isa]=exponentialIdentical[isa]&&
+                std::memcmp(e.getWeightBuffer(),re.getWeightBuffer(),numPixels*sizeof(float))==0&&
+                std::memcmp(e.getMeanBuffer(),re.getMeanBuffer(),numPixels*sizeof(float))==0&&
+                std::memcmp(e.getM2Buffer(),re.getM2Buffer(),numPixels*sizeof(float))==0&&
+                std::memcmp(e.getValidBuffer(),re.getValidBuffer(),e.getValidBufferSize())==0;
+        }
+    }
+
+    std::cout<< "Temporal kernels against the scalar kernel on " << numFrames << " " << name << " frames of " << width << "x" << height << ", window " << window << ", max variance " << maxVariance << ":" <<std::endl;
+    bool identical=true;
+    for(int isa=1;isa<numIsas;++isa)
+    {
+        std::cout<< "  " << FrameFilterKernels::isaName(FrameFilterKernels::Isa(isa)) << ": ";
+        if(isa>bestIsa)
+            std::cout<< "not supported by this CPU" <<std::endl;
+        else
+        {
+            std::cout<< "averaging " << (averagingIdentical[isa]?"identical":"DIFFERENT") << ", exponential " << (exponentialIdentical[isa]?"identical":"DIFFERENT") <<std::endl;
+            identical=identical&&averagingIdentical[isa]&&exponentialIdentical[isa];
+        }
+    }
+    if(!identical)
+        ofLog(OF_LOG_ERROR, "FilterBenchmark: the vector temporal kernels differ from the scalar kernel on "+name+" frames");
+    return identical;
+}
+
+bool compareKernelIsas(unsigned int width, unsigned int height, int window, unsigned int minNumSamples, unsigned int maxVariance, float hysteresis, int numFrames)
+{
+    std::vector<RawDepth> truth;
+    std::vector<std::vector<RawDepth> > frames;
+    makeNoisyFrames(width,height,numFrames,truth,frames);
+    bool identical=compareKernelIsas("noisy",width,height,frames,window,minNumSamples,maxVariance,hysteresis);
+    makeExtremeFrames(width,height,numFrames,maxVariance,frames);
+    identical=compareKernelIsas("extreme",width,height,frames,window,minNumSamples,maxVariance,hysteresis)&&identical;
+    return identical;
+}
+
+bool compareKernelIsasOnRecording(const std::string& fileName, float nearclip, float farclip, int window, unsigned int minNumSamples, unsigned int maxVariance, float hysteresis, int numFrames)
+{
+    /* The recording's depth mapped to the clip range as the grabber reads it, one frame per update: */
+    DepthPlayback playback;
+    if(!playback.open(fileName))
+    {
+        ofLog(OF_LOG_ERROR, "FilterBenchmark: cannot open the recording "+fileName);
+        return false;
+    }
+    playback.setRealTime(false);
+    playback.setLoop(false);
+    playback.setNumThreads(0);
+    playback.setDepthClipping(nearclip, farclip);
+    std::vector<std::vector<RawDepth> > frames;
+    size_t numPixels=size_t(playback.getWidth())*playback.getHeight();
+    while(int(frames.size())<numFrames&&playback.update())
+    {
+        const RawDepth* depth=playback.getDepthPixels().getData();
+        frames.push_back(std::vector<RawDepth>(depth,depth+numPixels));
+    }
+    if(frames.empty())
+    {
+        ofLog(OF_LOG_ERROR, "FilterBenchmark: the recording "+fileName+" has no frames");
+        return false;
+    }
+    return compareKernelIsas("recorded",playback.getWidth(),playback.getHeight(),frames,window,minNumSamples,maxVariance,hysteresis);
+}
+
+bool checkSensorStability(void)
+{
+    /* Two synthetic sensors side by side, filtered in normalized depth like the application: */
+    KinectGrabber grabber;
+    SyntheticDepthSource* sources[2];
+    for(int i=0;i<2;++i)
+    {
+        sources[i]=new SyntheticDepthSource;
+        sources[i]->open(320, 240, 0.0f);
+    }
+    std::vector<DepthFusion::Pose> poses(2,DepthFusion::getIdentityPose());
+    poses[1].translation[0]=300.0f;
+    grabber.setup(sources[0]);
+    grabber.setupFusion(std::vector<DepthSource*>(1,sources[1]), poses, 850.0f);
+    unsigned int maxVariance=2;
+    float hysteresis=0.1f;
+    grabber.setupFramefilter(20, 10, maxVariance, hysteresis, true, 20, 750.0f, 950.0f);
+
+    /* The setup range, the ROI detection's range, and a narrow range from the GUI: */
+    const float ranges[3][2]={{750.0f,950.0f},{500.0f,4000.0f},{800.0f,880.0f}};
+    bool followed=grabber.getNumSensors()==2;
+    std::cout<< "Stability criterion of the fused sensors by clip range:" <<std::endl;
+    for(int r=0;r<3;++r)
+    {
+        if(r>0)
+            grabber.setDepthRange(ranges[r][0], ranges[r][1]);
+        float step=(ranges[r][1]-ranges[r][0])/255.0f;
+        unsigned int expectedVariance=std::max(1U,(unsigned int)(float(maxVariance)*step*step+0.5f));
+        float expectedHysteresis=hysteresis*step;
+        bool rangeFollowed=true;
+        for(size_t i=0;i<grabber.getNumSensors();++i)
+        {
+            FrameFilterKernels::TemporalParams<FrameFilter::RawDepthMillimeters> params=grabber.getSensorFilter(i).getTemporalParams<FrameFilter::RawDepthMillimeters>();
+            rangeFollowed=rangeFollowed&&params.maxVariance==expectedVariance&&std::abs(params.hysteresis-expectedHysteresis)<=1.0e-5f*expectedHysteresis;
+        }
+        std::cout<< "  " << ranges[r][0] << "-" << ranges[r][1] << " mm: max variance " << expectedVariance << " mm^2, hysteresis " << expectedHysteresis << " mm, " << (rangeFollowed?"followed":"NOT FOLLOWED") << " by the sensors" <<std::endl;
+        followed=followed&&rangeFollowed;
+    }
+    if(!followed)
+        ofLog(OF_LOG_ERROR, "FilterBenchmark: the fused sensors' stability criterion does not follow the clip range");
+    return followed;
+}
+
+void measureThreadScaling(unsigned int width, unsigned int height, int numFrames, int maxThreads)
+{
+    /* Frames of the synthetic sandbox at the default clip range, generated before timing: */
+    float nearclip=750.0f,farclip=950.0f;
+    SyntheticDepthSource source;
+    source.setNumThreads(0);
+    source.open(width, height, 0.0f);
+    source.setDepthClipping(nearclip, farclip);
+    std::vector<ofPixels> frames(numFrames);
+    for(int f=0;f<numFrames;++f)
+    {
+        source.update();
+        frames[f]=source.getDepthPixels();
+    }
+    if(maxThreads<=0)
+        maxThreads=std::max(1,int(std::thread::hardware_concurrency()));
+
+    /* The whole filter as the grabber runs it, restarted from a fresh state for each thread count: */
+    FrameFilter filter;
+    filter.setup(width, height, 20, 10, 2, 0.1f, true, 20, nearclip, farclip);
+    std::cout<< "Frame filter on " << numFrames << " synthetic frames of " << width << "x" << height << " by number of threads:" <<std::endl;
+    double oneThreadMicros=0.0;
+    for(int numThreads=1;numThreads<=maxThreads;++numThreads)
+    {
+        filter.setNumThreads(numThreads);
+        filter.resetBuffers();
+        uint64_t start=ofGetElapsedTimeMicros();
+        for(int f=0;f<numFrames;++f)
+            filter.filter(frames[f]);
+        double micros=double(ofGetElapsedTimeMicros()-start)/numFrames;
+        if(numThreads==1)
+            oneThreadMicros=micros;
+        std::cout<< "  " << numThreads << (numThreads==1?" thread: ":" threads: ") << micros << " us/frame, speedup " << oneThreadMicros/micros <<std::endl;
+    }
+}
+
+/* The former spatial filter: a vertical then a horizontal float pass over the whole frame: */
+static void referenceSpatialPass(RawDepth* frame, RawDepth* buffer, unsigned int width, unsigned int height)
+{
+    for(unsigned int y=0;y<height;++y)
+    {
+        const RawDepth* rowPtr=frame+y*width;
+        RawDepth* dstPtr=buffer+y*width;
+        for(unsigned int x=0;x<width;++x)
+        {
+            if(y==0)
+                dstPtr[x]=(rowPtr[x]*2.0f+rowPtr[x+width])/3.0f;
+            else if(y==height-1)
+                dstPtr[x]=((rowPtr-width)[x]+rowPtr[x]*2.0f)/3.0f;
+            else
+                dstPtr[x]=((rowPtr-width)[x]+rowPtr[x]*2.0f+rowPtr[x+width])*0.25f;
+        }
+    }
+    for(unsigned int y=0;y<height;++y)
+    {
+        const RawDepth* rowPtr=buffer+y*width;
+        RawDepth* dstPtr=frame+y*width;
+        dstPtr[0]=(rowPtr[0]*2.0f+rowPtr[1])/3.0f;
+        for(unsigned int x=1;x<width-1;++x)
+            dstPtr[x]=(rowPtr[x-1]+rowPtr[x]*2.0f+rowPtr[x+1])*0.25f;
+        dstPtr[width-1]=(rowPtr[width-2]+rowPtr[width-1]*2.0f)/3.0f;
+    }
+}
+
+bool compareSpatialFilters(unsigned int width, unsigned int height, int numFrames, int numThreads)
+{
+    std::minstd_rand rng(1);
+    std::vector<RawDepth> input(size_t(width)*height);
+    for(size_t i=0;i<input.size();++i)
+        input[i]=RawDepth(rng()%256);
+
+    /* Former filter, single threaded as it was: */
+    std::vector<RawDepth> reference(input.size()),buffer(input.size());
+    uint64_t start=ofGetElapsedTimeMicros();
+    for(int f=0;f<numFrames;++f)
+    {
+        std::copy(input.begin(),input.end(),reference.begin());
+        for(int pass=0;pass<2;++pass)
+            referenceSpatialPass(&reference[0],&buffer[0],width,height);
+    }
+    double referenceMicros=double(ofGetElapsedTimeMicros()-start)/numFrames;
+
+    /* Strip processed filter, on one thread and on the worker pool: */
+    SpatialFilter filter;
+    filter.allocate(width,height);
+    std::vector<RawDepth> output(input.size());
+    double stripMicros[2];
+    for(int run=0;run<2;++run)
+    {
+        WorkerPool pool;
+        pool.setNumThreads(run==0?1:numThreads);
+        start=ofGetElapsedTimeMicros();
+        for(int f=0;f<numFrames;++f)
+        {
+            std::copy(input.begin(),input.end(),output.begin());
+            filter.apply(&output[0],pool);
+        }
+        stripMicros[run]=double(ofGetElapsedTimeMicros()-start)/numFrames;
+    }
+
+    std::cout<< "Spatial filter on " << width << "x" << height << ": former " << referenceMicros << " us/frame, strips " << stripMicros[0] << " us/frame (1 thread), " << stripMicros[1] << " us/frame (pool), " << (output==reference?"identical":"DIFFERENT") << " output" <<std::endl;
+    return output==reference;
+}
+
+/* The former ROI detection: a contour pass at each threshold, keeping the largest hole containing all points: */
+static ofRectangle referenceRoiSweep(const ofPixels& frame, const std::vector<ofVec2f>& points)
+{
+    ofxCvGrayscaleImage thresholdedImage;
+    thresholdedImage.allocate(frame.getWidth(), frame.getHeight());
+    ofxCvContourFinder contourFinder;
+    ofPolyline large;
+    for(int threshold=220;threshold<255;++threshold)
+    {
+        thresholdedImage.setFromPixels(frame);
+        cvThreshold(thresholdedImage.getCvImage(), thresholdedImage.getCvImage(), threshold, 255, CV_THRESH_TOZERO);
+        contourFinder.findContours(thresholdedImage, 12, frame.getWidth()*frame.getHeight(), 5, true);
+        ofPolyline small;
+        for(int i=0;i<contourFinder.nBlobs;++i)
+        {
+            if(!contourFinder.blobs[i].hole)
+                continue;
+            ofPolyline poly(contourFinder.blobs[i].pts);
+            bool ok=true;
+            for(size_t j=0;j<points.size()&&ok;++j)
+                ok=poly.inside(points[j].x, points[j].y);
+            if(ok&&(small.size()==0||poly.getArea()>small.getArea()))
+                small=poly;
+        }
+        if(large.getArea()<small.getArea())
+            large=small;
+    }
+    return large.getBoundingBox();
+}
+
+void compareRoiDetection(unsigned int width, unsigned int height, int numRuns)
+{
+    /* A box seen at the calibration's depth range: floor outside, walls nearer than the sand inside, a chessboard in the middle: */
+    ofPixels frame;
+    frame.allocate(width, height, 1);
+    RawDepth* framePtr=frame.getData();
+    unsigned int x0=width/8,y0=height/8,x1=width-width/8,y1=height-height/8,wall=12;
+    for(unsigned int y=0;y<height;++y)
+        for(unsigned int x=0;x<width;++x)
+        {
+            bool outside=x<x0||x>=x1||y<y0||y>=y1;
+            bool inside=x>=x0+wall&&x<x1-wall&&y>=y0+wall&&y<y1-wall;
+            framePtr[y*width+x]=outside?200:inside?RawDepth(225+(x/7+y/5)%20):250;
+        }
+    std::vector<ofVec2f> points;
+    for(int j=0;j<5;++j)
+        for(int i=0;i<7;++i)
+            points.push_back(ofVec2f(width*(0.35f+0.05f*i), height*(0.4f+0.05f*j)));
+
+    uint64_t start=ofGetElapsedTimeMicros();
+    ofRectangle referenceRoi;
+    for(int run=0;run<numRuns;++run)
+        referenceRoi=referenceRoiSweep(frame, points);
+    double referenceMicros=double(ofGetElapsedTimeMicros()-start)/numRuns;
+
+    start=ofGetElapsedTimeMicros();
+    RoiDetector::Result result;
+    for(int run=0;run<numRuns;++run)
+        result=RoiDetector::detect(frame, points, 220, false, false);
+    double singlePassMicros=double(ofGetElapsedTimeMicros()-start)/numRuns;
+
+    std::cout<< "ROI detection on " << width << "x" << height << ": threshold sweep " << referenceMicros << " us (" << referenceRoi.x << "," << referenceRoi.y << " " << referenceRoi.width << "x" << referenceRoi.height << "), single pass " << singlePassMicros << " us (" << result.roi.x << "," << result.roi.y << " " << result.roi.width << "x" << result.roi.height << " at threshold " << result.threshold << ")" <<std::endl;
+}
+
+}
@@ -0,0 +1,35 @@
+/***********************************************************************
+ FilterBenchmark - Compares the averaging and exponential modes of the
+ temporal filter on synthetic noisy depth frames: memory, time per frame
+ and residual noise against the noise-free frame, and checks the vector
+ kernels against the scalar one. Also times the whole filter by number
+ of threads, the strip processed spatial filter against the former
+ per-pass float filter, and the single pass ROI detection against the
+ former threshold sweep.
+ ***********************************************************************/
+
+#pragma once
+#include <string>
+
+namespace FilterBenchmark {
+    /* Filters numFrames noisy frames of a static surface with both modes and prints the results: */
+    void compareFilterModes(unsigned int width, unsigned int height, int window, unsigned int minNumSamples, unsigned int maxVariance, float hysteresis, int numFrames, int numThreads);
+
+    /* Filters numFrames noisy frames, then numFrames frames reaching the corners of the kernels, with the SSE4.1 and AVX2 kernels the CPU supports and the scalar kernel, checks their output frames and statistics planes match bit for bit, prints the results and returns true if they do: */
+    bool compareKernelIsas(unsigned int width, unsigned int height, int window, unsigned int minNumSamples, unsigned int maxVariance, float hysteresis, int numFrames);
+
+    /* The same check on up to numFrames frames of a recording, mapped to the clip range; returns false if they differ or the recording cannot be read: */
+    bool compareKernelIsasOnRecording(const std::string& fileName, float nearclip, float farclip, int window, unsigned int minNumSamples, unsigned int maxVariance, float hysteresis, int numFrames);
+
+    /* Fuses two synthetic sensors, moves the clip range as the GUI and the ROI detection do, and returns true if the sensors' stability criterion in millimeters followed each range: */
+    bool checkSensorStability(void);
+
+    /* Filters numFrames synthetic frames with the whole frame filter on 1 to maxThreads threads (0 = one per core) and prints the time per frame of each: */
+    void measureThreadScaling(unsigned int width, unsigned int height, int numFrames, int maxThreads);
+
+    /* Times two 1-2-1 spatial filter passes over a random frame with SpatialFilter and the former filter, and returns true if they match: */
+    bool compareSpatialFilters(unsigned int width, unsigned int height, int numFrames, int numThreads);
+
+    /* Times the ROI detection of the calibration with RoiDetector and the former threshold sweep on a synthetic box, and prints both regions: */
+    void compareRoiDetection(unsigned int width, unsigned int height, int numRuns);
+}
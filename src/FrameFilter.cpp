@@ -7,16 +7,17 @@
 
 #include "FrameFilter.h"
 #include "ofConstants.h"
+#include <cstring>
 
 /****************************
  Methods of class FrameFilter:
  ****************************/
 
-FrameFilter::FrameFilter(): newFrame(true), bufferInitiated(false)
+FrameFilter::FrameFilter(): newFrame(true), bufferInitiated(false), gradientVersion(0), depthMode(NORMALIZED_DEPTH), filterMode(AVERAGING_FILTER), kernelIsa(FrameFilterKernels::detectIsa()), fillHoles(false), spatialTimePerTile(0.0f), gradientTimePerTile(0.0f), lastFilterTime(0), lastTemporalTime(0)
 {
 }
 
-bool FrameFilter::setup(const unsigned int swidth,const unsigned int sheight,int sNumAveragingSlots, unsigned int newMinNumSamples, unsigned int newMaxVariance, float newHysteresis, bool newSpatialFilter, int sgradFieldresolution, float snearclip, float sfarclip, void* _backend)
+bool FrameFilter::setup(const unsigned int swidth,const unsigned int sheight,int sNumAveragingSlots, unsigned int newMinNumSamples, unsigned int newMaxVariance, float newHysteresis, bool newSpatialFilter, int sgradFieldresolution, float snearclip, float sfarclip)
 {
 	/* Settings variables : */
 	width = swidth;
@@ -28,6 +29,10 @@ bool FrameFilter::setup(const unsigned int swidth,const unsigned int sheight,int
 	
 	/* Initialize the averaging buffer: */
 	numAveragingSlots=sNumAveragingSlots;
+    if(filterMode==AVERAGING_FILTER&&numAveragingSlots>FrameFilterKernels::maxAveragingSlots){
+        ofLog(OF_LOG_WARNING, "FrameFilter: limiting the averaging buffer to "+ofToString(FrameFilterKernels::maxAveragingSlots)+" slots");
+        numAveragingSlots=FrameFilterKernels::maxAveragingSlots;
+    }
     
 	/* Initialize the stability criterion: */
     //	minNumSamples=(numAveragingSlots+1)/2;
@@ -37,9 +42,7 @@ bool FrameFilter::setup(const unsigned int swidth,const unsigned int sheight,int
 	instableValue=0.0;
     maxgradfield = 1000;
     
-    nearclip = snearclip;
-    farclip = sfarclip;
-    depthrange = sfarclip-snearclip;
+    setDepthRange(snearclip, sfarclip);
     
     minNumSamples=newMinNumSamples;
     maxVariance=newMaxVariance;
@@ -56,17 +59,11 @@ bool FrameFilter::setup(const unsigned int swidth,const unsigned int sheight,int
     std::cout<< "Width: " << width << " Cols: " << gradFieldcols <<std::endl;
     gradFieldrows = height / sgradFieldresolution;
     std::cout<< "Height: " << height << " Rows: " << gradFieldrows <<std::endl;
-    
-    // cast the kinect backend
-    backend = static_cast <ofxKinect *>(_backend);
-    // check if the backend is connected & capturing calibrated video
-    if(!backend->isConnected()){
-        ofLog(OF_LOG_ERROR, "Please open the kinect prior to setting the Framefilter");
-        return;
-    }
+    std::cout<< "Filter kernel: " << FrameFilterKernels::isaName(kernelIsa) <<std::endl;
     
     //setting buffers
 	initiateBuffers();
+    printMemoryFootprint();
     
 	return true;
 }
@@ -77,22 +74,14 @@ FrameFilter::~FrameFilter(){
 	// the thread to finish
     //	toAnalyze.close();
     //	analyzed.close();
-    delete[] averagingBuffer;
-    delete[] statBuffer;
-    delete[] validBuffer;
     delete[] wrldcoordbuffer;
-    delete[] gradField;
     //	waitForThread(true);
 }
 
 void FrameFilter::resetBuffers(void){
 	/* Release all allocated buffers if needed */
     if (bufferInitiated){
-        delete[] averagingBuffer;
-        delete[] statBuffer;
-        delete[] validBuffer;
         delete[] wrldcoordbuffer;
-        delete[] gradField;
     }
     initiateBuffers();
 }
@@ -102,35 +91,44 @@ void FrameFilter::initiateBuffers(void){
     //    /* Initialize the input frame slot: */
     //    inputFrameVersion=0;
     
-    averagingBuffer=new RawDepth[numAveragingSlots*height*width];
-    RawDepth* abPtr=averagingBuffer;
-    for(int i=0;i<numAveragingSlots;++i)
-        for(unsigned int y=0;y<height;++y)
-            for(unsigned int x=0;x<width;++x,++abPtr)
-                *abPtr=255; // Mark sample as invalid
-    averagingSlotIndex=0;
-    
-    /* Initialize the statistics buffer: */
-    statBuffer=new unsigned int[height*width*3];
-    unsigned int* sbPtr=statBuffer;
-    for(unsigned int y=0;y<height;++y)
-        for(unsigned int x=0;x<width;++x)
-            for(int i=0;i<3;++i,++sbPtr)
-                *sbPtr=0;
+    /* Initialize the statistics of the active depth and filter modes, releasing the others: */
+    normalizedFilter.release();
+    rawFilter.release();
+    normalizedExponentialFilter.release();
+    rawExponentialFilter.release();
+    if(depthMode==RAW_DEPTH){
+        if(filterMode==EXPONENTIAL_FILTER)
+            rawExponentialFilter.allocate(width, height, numAveragingSlots);
+        else
+            rawFilter.allocate(width, height, numAveragingSlots);
+        rawOutputframe.allocate(width, height, 1);
+        rawOutputframe.set(0);
+    } else {
+        if(filterMode==EXPONENTIAL_FILTER)
+            normalizedExponentialFilter.allocate(width, height, numAveragingSlots);
+        else
+            normalizedFilter.allocate(width, height, numAveragingSlots);
+    }
     
-    /* Initialize the valid buffer: */
-    validBuffer=new RawDepth[height*width];
-    RawDepth* vbPtr=validBuffer;
-    for(unsigned int y=0;y<height;++y)
-        for(unsigned int x=0;x<width;++x,++vbPtr)
-            *vbPtr=0;
+    /* Initialize the hole filling pyramid and the spatial filter's intermediate frame: */
+    holeFiller.allocate(width, height);
+    spatialLowPass.allocate(width, height);
     
-    /* Initialize the gradient field buffer: */
-    gradField = new ofVec2f[gradFieldcols*gradFieldrows];
-    ofVec2f* gfPtr=gradField;
-    for(unsigned int y=0;y<gradFieldrows;++y)
-        for(unsigned int x=0;x<gradFieldcols;++x,++gfPtr)
-            *gfPtr=ofVec2f(0);
+    /* Initialize the dirty tile trackers, all tiles dirty: */
+    spatialInputTiles.setup(width, height, gradFieldresolution);
+    outputTiles.setup(width, height, gradFieldresolution);
+    std::memset(&dirtyTileStatistics,0,sizeof(dirtyTileStatistics));
+    
+    /* Preallocate output frames for the three slots of the grabber's mailbox, the frame being filtered and one spare: */
+    framePool.setup(width, height, 1, 5);
+    
+    /* Initialize the gradient field pyramid: */
+    gradientPyramid.allocate(width, height, gradFieldresolution);
+    
+    /* Preallocate gradient field snapshots for the same holders as the output frames: */
+    int primaryLevel = gradientPyramid.getPrimaryLevel();
+    gradientFieldPool.setup(gradientPyramid.getCols(primaryLevel), gradientPyramid.getRows(primaryLevel), gradFieldresolution, 5);
+    gradientSnapshot.release();
     
     /* Initialize the gradient field buffer: */
     wrldcoordbuffer = new Point3f[height*width];
@@ -148,9 +146,48 @@ void FrameFilter::setDepthRange(float snearclip, float sfarclip){
     // previous frames
     //    ++inputFrameVersion;
     //    toAnalyze.send(inputframe);
+    
+    /* Normalized statistics are in units of the old clip range: carry them over to the new one: */
+    if(bufferInitiated&&depthMode==NORMALIZED_DEPTH&&(snearclip!=nearclip||sfarclip!=farclip))
+        remapStatistics(snearclip, sfarclip);
+    
     nearclip = snearclip;
     farclip = sfarclip;
     depthrange = sfarclip-snearclip;
+    
+    /* Map millimeters to the clip range, near plane at 255 and far plane at 0 (0 stays invalid): */
+    depthLookupTable.resize(65536);
+    depthLookupTable[0]=0;
+    for(unsigned int i=1;i<depthLookupTable.size();++i)
+        depthLookupTable[i]=RawDepth(ofMap(float(i), nearclip, farclip, 255.0f, 0.0f, true));
+    
+    /* The gradient field scales with the depth range: recompute all cells on the next frame: */
+    outputTiles.markAll();
+}
+
+void FrameFilter::remapStatistics(float newNearclip, float newFarclip){
+    /* Discard the statistics if either range is empty: */
+    if(farclip<=nearclip||newFarclip<=newNearclip){
+        normalizedFilter.clear();
+        normalizedExponentialFilter.clear();
+        return;
+    }
+    
+    /* A normalized sample d stands for the millimeters in [d, d+1) of the old range: map the middle of that interval as the depth sources map millimeters: */
+    float oldStep=(farclip-nearclip)/255.0f;
+    if(filterMode==EXPONENTIAL_FILTER){
+        /* The mapping is affine in the mean, which is biased by half a step by the truncation of the samples: */
+        float scale=(farclip-nearclip)/(newFarclip-newNearclip);
+        float offset=255.0f*(newFarclip-farclip)/(newFarclip-newNearclip)+0.5f*scale-0.5f;
+        normalizedExponentialFilter.remap(scale, offset, workerPool);
+    } else {
+        RawDepth remapTable[256];
+        remapTable[0]=0;
+        remapTable[255]=255;
+        for(int d=1;d<255;++d)
+            remapTable[d]=RawDepth(ofMap(farclip-(float(d)+0.5f)*oldStep, newNearclip, newFarclip, 255.0f, 0.0f, true));
+        normalizedFilter.remap(remapTable, workerPool);
+    }
 }
 
 void FrameFilter::update(){
@@ -176,20 +213,54 @@ bool FrameFilter::isFrameNew(){
 }
 
 ofVec2f FrameFilter::getGradFieldXY(int x, int y){
-    int xbin = (int)floorf(((float)x)/(float)gradFieldresolution);
-    int ybin = (int)floorf(((float)y)/(float)gradFieldresolution);
-    return gradField[ybin*gradFieldcols+xbin];
+    return gradientPyramid.getGradient(x, y, gradientPyramid.getPrimaryLevel());
 }
 
 ofVec2f* FrameFilter::getGradField(){
-    return gradField;
+    return gradientPyramid.getField(gradientPyramid.getPrimaryLevel());
+}
+
+GradientFieldPool::Field FrameFilter::getGradFieldSnapshot() const{
+    return gradientSnapshot;
+}
+
+ofVec2f FrameFilter::getGradFieldXY(int x, int y, int level){
+    return gradientPyramid.getGradient(x, y, level);
+}
+
+ofVec2f* FrameFilter::getGradField(int level){
+    return gradientPyramid.getField(level);
+}
+
+int FrameFilter::getNumGradFieldLevels() const{
+    return gradientPyramid.getNumLevels();
+}
+
+int FrameFilter::getGradFieldLevel() const{
+    return gradientPyramid.getPrimaryLevel();
+}
+
+int FrameFilter::getGradFieldCellSize(int level) const{
+    return gradientPyramid.getCellSize(level);
+}
+
+int FrameFilter::getGradFieldCols(int level) const{
+    return gradientPyramid.getCols(level);
+}
+
+int FrameFilter::getGradFieldRows(int level) const{
+    return gradientPyramid.getRows(level);
+}
+
+void FrameFilter::setGradientTimeBudget(uint64_t newTimeBudget){
+    gradientPyramid.setTimeBudget(newTimeBudget);
 }
 
 Point3f* FrameFilter::getWrldcoordbuffer(){
     return wrldcoordbuffer;
 }
 
-void FrameFilter::displayFlowField()
+void FrameFilter::displayFlowField(const GradientFieldPool::Field& field)
 {
     
     /*
@@ -200,6 +271,12 @@ void FrameFilter::displayFlowField()
      ofLine(screenCenter.x + 50,screenCenter.y-50,screenCenter.x-50,screenCenter.y+50);
      */
     
+    if(!field.isValid())
+        return;
+    const ofVec2f* gradField = field.getData();
+    int gradFieldcols = field.getCols();
+    int gradFieldrows = field.getRows();
+    int gradFieldresolution = field.getCellSize();
     for(int rowPos=0; rowPos< gradFieldrows ; rowPos++)
     {
         for(int colPos=0; colPos< gradFieldcols ; colPos++)
@@ -230,7 +307,7 @@ void FrameFilter::drawArrow(ofVec2f v1)
     //ofDrawLine(-length/2 + length*0.8, length*-0.1, length/2, 0);
 }
 
-ofPixels FrameFilter::filter(ofPixels inputframe){
+FramePool::Frame FrameFilter::filter(const ofPixels& inputframe){
     // wait until there's a new frame
     // this blocks the thread, so it doesn't use
     // the CPU at all, until a frame arrives.
@@ -249,9 +326,10 @@ ofPixels FrameFilter::filter(ofPixels inputframe){
     // Convert in proj space
     //    ofPixels inputframe = convertProjSpace(sinputframe);
     
-    // Create a new output frame: */
-    ofPixels newOutputFrame;
-    newOutputFrame.allocate(width, height, 1);
+    uint64_t filterStartTime=ofGetElapsedTimeMicros();
+    
+    // Take a new output frame from the pool: */
+    FramePool::Frame newOutputFrame=framePool.acquire();
     
     /* Initialize a new gradient field buffer and number of valid gradient measures */
     //    ofVec2f* valgradField = new ofVec2f[gradFieldcols*gradFieldrows];
@@ -267,147 +345,116 @@ ofPixels FrameFilter::filter(ofPixels inputframe){
     
     // Enter the new frame into the averaging buffer and calculate the output frame's pixel values: */
     const RawDepth* ifPtr=static_cast<const RawDepth*>(inputframe.getData());
-    RawDepth* abPtr=averagingBuffer+averagingSlotIndex*height*width;
-    unsigned int* sPtr=statBuffer;
-    RawDepth* ofPtr=validBuffer; // static_cast<const float*>(outputFrame.getBuffer());
-    RawDepth* nofPtr=static_cast<RawDepth*>(newOutputFrame.getData());
-    float z;
+    RawDepth* nofPtr=newOutputFrame.getData();
+    if(filterMode==EXPONENTIAL_FILTER)
+        normalizedExponentialFilter.process(ifPtr, nofPtr, getTemporalParams<RawDepth>(), kernelIsa, workerPool);
+    else
+        normalizedFilter.process(ifPtr, nofPtr, getTemporalParams<RawDepth>(), kernelIsa, workerPool);
+    lastTemporalTime=ofGetElapsedTimeMicros()-filterStartTime;
     
-    for(unsigned int y=0;y<height;++y)
-    {
-        //            float py=float(y)+0.5f;
-        for(unsigned int x=0;x<width;++x,++ifPtr,++abPtr,sPtr+=3,++ofPtr,++nofPtr)
-        {
-            //                float px=float(x)+0.5f;
-            
-            unsigned char oldVal=*abPtr;
-            unsigned char newVal=*ifPtr;
-            
-            //                    /* Depth-correct the new value: */
-            //                    float newCVal=pdcPtr->correct(newVal);
-            //
-            //                    /* Plug the depth-corrected new value into the minimum and maximum plane equations to determine its validity: */
-            //                    float minD=minPlane[0]*px+minPlane[1]*py+minPlane[2]*newCVal+minPlane[3];
-            //                    float maxD=maxPlane[0]*px+maxPlane[1]*py+maxPlane[2]*newCVal+maxPlane[3];
-            if(newVal != 0 && newVal != 255) // Pixel depth not clipped => inside valide range
-            {
-                /* Store the new input value: */
-                *abPtr=newVal;
-                
-                /* Update the pixel's statistics: */
-                ++sPtr[0]; // Number of valid samples
-                sPtr[1]+=newVal; // Sum of valid samples
-                sPtr[2]+=newVal*newVal; // Sum of squares of valid samples
-                
-                /* Check if the previous value in the averaging buffer was valid: */
-                if(oldVal!=255)
-                {
-                    --sPtr[0]; // Number of valid samples
-                    sPtr[1]-=oldVal; // Sum of valid samples
-                    sPtr[2]-=oldVal*oldVal; // Sum of squares of valid samples
-                }
-            }
-            else if(!retainValids)
-            {
-                /* Store an invalid input value: */
-                *abPtr=255;
-                
-                /* Check if the previous value in the averaging buffer was valid: */
-                if(oldVal!=255)
-                {
-                    --sPtr[0]; // Number of valid samples
-                    sPtr[1]-=oldVal; // Sum of valid samples
-                    sPtr[2]-=oldVal*oldVal; // Sum of squares of valid samples
-                }
-            }
-            
-            // Check if the pixel is considered "stable": */
-            if(sPtr[0]>=minNumSamples&&sPtr[2]*sPtr[0]<=maxVariance*sPtr[0]*sPtr[0]+sPtr[1]*sPtr[1])
-            {
-                /* Check if the new depth-corrected running mean is outside the previous value's envelope: */
-                float newFiltered=float(sPtr[1])/float(sPtr[0]);
-                if(abs(newFiltered-*ofPtr)>=hysteresis)
-                {
-                    /* Set the output pixel value to the depth-corrected running mean: */
-                    *nofPtr=*ofPtr=newFiltered;
-                    // Update world coordonate of point
-//                    z = (255.0-newFiltered)/255.0*(farclip-nearclip)+nearclip;
-//                    wrldcoordbuffer[y*width+x]=toCv(backend->getWorldCoordinateAt(x, y, z));
-                }
-                else
-                {
-                    /* Leave the pixel at its previous value: */
-                    *nofPtr=*ofPtr;
-                }
-            }
-            else if(retainValids)
-            {
-                /* Leave the pixel at its previous value: */
-                *nofPtr=*ofPtr;
-            }
-            else
-            {
-                /* Assign default value to instable pixels: */
-                *nofPtr=instableValue;
-            }
-        }
-    }
+    finishFrame(newOutputFrame);
+    lastFilterTime=ofGetElapsedTimeMicros()-filterStartTime;
+    return newOutputFrame;
+}
+
+FramePool::Frame FrameFilter::filter(const ofShortPixels& inputframe){
+    uint64_t filterStartTime=ofGetElapsedTimeMicros();
+    
+    // Enter the new frame in millimeters into the averaging buffer and map the filtered frame to the clip range: */
+    filterTemporal(inputframe);
+    FramePool::Frame newOutputFrame=normalizeFrame(rawOutputframe);
+    lastTemporalTime=ofGetElapsedTimeMicros()-filterStartTime;
+    
+    finishFrame(newOutputFrame);
+    lastFilterTime=ofGetElapsedTimeMicros()-filterStartTime;
+    return newOutputFrame;
+}
+
+const ofShortPixels& FrameFilter::filterTemporal(const ofShortPixels& inputframe){
+    uint64_t filterStartTime=ofGetElapsedTimeMicros();
     
-    /* Go to the next averaging slot: */
-    if(++averagingSlotIndex==numAveragingSlots)
-        averagingSlotIndex=0;
+    // Enter the new frame in millimeters into the averaging buffer: */
+    if(filterMode==EXPONENTIAL_FILTER)
+        rawExponentialFilter.process(inputframe.getData(), rawOutputframe.getData(), getTemporalParams<RawDepthMillimeters>(), kernelIsa, workerPool);
+    else
+        rawFilter.process(inputframe.getData(), rawOutputframe.getData(), getTemporalParams<RawDepthMillimeters>(), kernelIsa, workerPool);
+    lastTemporalTime=ofGetElapsedTimeMicros()-filterStartTime;
+    return rawOutputframe;
+}
+
+FramePool::Frame FrameFilter::filterFused(const ofShortPixels& depth){
+    uint64_t filterStartTime=ofGetElapsedTimeMicros();
     
-    /* Apply a spatial filter if requested: */
+    // The depth was filtered over time by the sensors: only map it to the clip range: */
+    FramePool::Frame newOutputFrame=normalizeFrame(depth);
+    lastTemporalTime=ofGetElapsedTimeMicros()-filterStartTime;
+    
+    finishFrame(newOutputFrame);
+    lastFilterTime=ofGetElapsedTimeMicros()-filterStartTime;
+    return newOutputFrame;
+}
+
+FramePool::Frame FrameFilter::normalizeFrame(const ofShortPixels& depth){
+    // Map the filtered frame to the current clip range for the spatial filter and the gradient field: */
+    FramePool::Frame newOutputFrame=framePool.acquire();
+    int numBands=workerPool.getNumThreads();
+    RawDepth* framePtr=newOutputFrame.getData();
+    const RawDepthMillimeters* depthPtr=depth.getData();
+    workerPool.run(numBands,[&](int band){
+        normalizeDepth(depthPtr,framePtr,band*height/numBands,(band+1)*height/numBands);
+    });
+    return newOutputFrame;
+}
+
+const ofShortPixels& FrameFilter::getFilteredDepth() const{
+    return rawOutputframe;
+}
+
+FramePool& FrameFilter::getFramePool(){
+    return framePool;
+}
+
+template <class InputDepth>
+FrameFilterKernels::TemporalParams<InputDepth> FrameFilter::getTemporalParams(void) const{
+    FrameFilterKernels::TemporalParams<InputDepth> params;
+    params.minNumSamples=minNumSamples;
+    /* Larger variances would overflow the stability test of 8-bit depth: */
+    params.maxVariance=std::min(maxVariance,(unsigned int)(FrameFilterKernels::DepthTraits<InputDepth>::maxVarianceLimit));
+    params.hysteresis=hysteresis;
+    params.retainValids=retainValids;
+    params.instableValue=InputDepth(instableValue);
+    return params;
+}
+
+template FrameFilterKernels::TemporalParams<FrameFilter::RawDepth> FrameFilter::getTemporalParams<FrameFilter::RawDepth>(void) const;
+template FrameFilterKernels::TemporalParams<FrameFilter::RawDepthMillimeters> FrameFilter::getTemporalParams<FrameFilter::RawDepthMillimeters>(void) const;
+
+void FrameFilter::normalizeDepth(const RawDepthMillimeters* src, RawDepth* dst, unsigned int y0, unsigned int y1){
+    const RawDepth* lut=&depthLookupTable[0];
+    for(unsigned int i=y0*width;i<y1*width;++i)
+        dst[i]=lut[src[i]];
+}
+
+void FrameFilter::finishFrame(FramePool::Frame& newOutputFrame){
+    RawDepth* framePtr=newOutputFrame.getData();
+    
+    /* Fill the pixels without a stable value if requested: */
+    if(fillHoles)
+        holeFiller.fill(framePtr);
+    
+    /* Apply a spatial filter if requested, only around the tiles that changed: */
+    uint64_t spatialStartTime=ofGetElapsedTimeMicros();
+    int numSpatialTiles=0;
     if(spatialFilter)
     {
-        for(int filterPass=0;filterPass<2;++filterPass)
-        {
-            /* Low-pass filter the entire output frame in-place: */
-            for(unsigned int x=0;x<width;++x)
-            {
-                /* Get a pointer to the current column: */
-                RawDepth* colPtr=static_cast<RawDepth*>(newOutputFrame.getData())+x;
-                
-                /* Filter the first pixel in the column: */
-                float lastVal=*colPtr;
-                *colPtr=(colPtr[0]*2.0f+colPtr[width])/3.0f;
-                colPtr+=width;
-                
-                /* Filter the interior pixels in the column: */
-                for(unsigned int y=1;y<height-1;++y,colPtr+=width)
-                {
-                    /* Filter the pixel: */
-                    float nextLastVal=*colPtr;
-                    *colPtr=(lastVal+colPtr[0]*2.0f+colPtr[width])*0.25f;
-                    lastVal=nextLastVal;
-                }
-                
-                /* Filter the last pixel in the column: */
-                *colPtr=(lastVal+colPtr[0]*2.0f)/3.0f;
-            }
-            RawDepth* rowPtr=static_cast<RawDepth*>(newOutputFrame.getData());
-            for(unsigned int y=0;y<height;++y)
-            {
-                /* Filter the first pixel in the row: */
-                float lastVal=*rowPtr;
-                *rowPtr=(rowPtr[0]*2.0f+rowPtr[1])/3.0f;
-                ++rowPtr;
-                
-                /* Filter the interior pixels in the row: */
-                for(unsigned int x=1;x<width-1;++x,++rowPtr)
-                {
-                    /* Filter the pixel: */
-                    float nextLastVal=*rowPtr;
-                    *rowPtr=(lastVal+rowPtr[0]*2.0f+rowPtr[1])*0.25f;
-                    lastVal=nextLastVal;
-                }
-                
-                /* Filter the last pixel in the row: */
-                *rowPtr=(lastVal+rowPtr[0]*2.0f)/3.0f;
-                ++rowPtr;
-            }
-        }
+        spatialInputTiles.update(framePtr);
+        spatialLowPass.apply(framePtr, workerPool, spatialInputTiles);
+        numSpatialTiles=spatialLowPass.getNumFilteredTiles();
     }
+    uint64_t spatialTime=ofGetElapsedTimeMicros()-spatialStartTime;
+    
+    /* Find the tiles of the output frame that changed: */
+    outputTiles.update(framePtr);
     
     /* Pass the new output frame to the registered receiver: */
     //            if(outputFrameFunction!=0)
@@ -425,11 +472,26 @@ ofPixels FrameFilter::filter(ofPixels inputframe){
     //        }
     
     outputframe=newOutputFrame;
+    uint64_t gradientStartTime=ofGetElapsedTimeMicros();
     updateGradientField();
-    // once processed send the result back to the
-    // main thread. in c++11 we can move it to
-    // avoid a copy
-    return newOutputFrame;
+    uint64_t gradientTime=ofGetElapsedTimeMicros()-gradientStartTime;
+    
+    /* Estimate the cost of the tiles skipped by the spatial filter and the gradient field: */
+    DirtyTileStatistics& stats=dirtyTileStatistics;
+    stats.numTiles=outputTiles.getNumTiles();
+    stats.numDirtyTiles=outputTiles.getNumDirty();
+    stats.numSpatialTiles=numSpatialTiles;
+    stats.numGradientTiles=gradientPyramid.getNumUpdatedTiles();
+    stats.numDeferredGradientTiles=gradientPyramid.getNumDeferredTiles();
+    stats.dirtyRatio=stats.numTiles>0?float(stats.numDirtyTiles)/float(stats.numTiles):0.0f;
+    stats.spatialTime=spatialTime;
+    stats.gradientTime=gradientTime;
+    if(numSpatialTiles>0)
+        spatialTimePerTile=spatialTimePerTile*0.9f+float(spatialTime)/numSpatialTiles*0.1f;
+    if(stats.numGradientTiles>0)
+        gradientTimePerTile=gradientTimePerTile*0.9f+float(gradientTime)/stats.numGradientTiles*0.1f;
+    float saved=(spatialFilter?(stats.numTiles-numSpatialTiles)*spatialTimePerTile:0.0f)+(stats.numTiles-stats.numGradientTiles)*gradientTimePerTile;
+    stats.timeSaved=uint64_t(saved);
     //#if __cplusplus>=201103
     //        analyzed.send(std::move(newOutputFrame));
     //#else
@@ -440,42 +502,12 @@ ofPixels FrameFilter::filter(ofPixels inputframe){
 
 void FrameFilter::updateGradientField()
 {
-    //Compute gradient field
-    int ind = 0;
-    float gx;
-    float gy;
-    int gvx, gvy;
-    float lgth = 0;
-    RawDepth* nofPtr=outputframe.getData();
-    for(unsigned int y=0;y<gradFieldrows;++y) {
-        for(unsigned int x=0;x<gradFieldcols;++x) {
-            //            if (x==7 && y ==7)
-            //                cout << "hop" << endl;
-            gx = 0;
-            gvx = 0;
-            gy = 0;
-            gvy = 0;
-            for (unsigned int i=0; i<gradFieldresolution; i++) {
-                ind = y*gradFieldresolution*width+i*width+x*gradFieldresolution;
-                if (nofPtr[ind]!= 0 && nofPtr[ind+gradFieldresolution-1]!=0){
-                    gvx+=1;
-                    gx+=nofPtr[ind]-nofPtr[ind+gradFieldresolution-1];
-                }
-                ind = y*gradFieldresolution*width+i+x*gradFieldresolution;
-                if (nofPtr[ind]!= 0 && nofPtr[ind+(gradFieldresolution-1)*width]!=0){
-                    gvy+=1;
-                    gy+=nofPtr[ind]-nofPtr[ind+(gradFieldresolution-1)*width];
-                }
-            }
-            if (gvx !=0 && gvy !=0)
-                gradField[y*gradFieldcols+x]=ofVec2f(gx/gradFieldresolution/gvx*depthrange, gy/gradFieldresolution/gvy*depthrange);
-            if (gradField[y*gradFieldcols+x].length() > maxgradfield){
-                gradField[y*gradFieldcols+x].scale(maxgradfield);// /= gradField[y*gradFieldcols+x].length()*maxgradfield;
-                lgth+=1;
-            }
-        }
-    }
-    //    cout << "Max gradient: " << lgth << endl;
+    /* Recompute the cells reached by the tiles of the output frame that changed: */
+    gradientPyramid.update(outputframe.getData(), outputTiles, depthrange, maxgradfield, workerPool);
+    
+    /* Publish a snapshot for the other threads; the previous one stays valid while it is in use: */
+    if(gradientPyramid.getNumUpdatedTiles()!=0||!gradientSnapshot.isValid())
+        gradientSnapshot=gradientFieldPool.publish(getGradField(), ++gradientVersion);
 }
 
 
@@ -520,6 +552,134 @@ void FrameFilter::setSpatialFilter(bool newSpatialFilter)
     spatialFilter=newSpatialFilter;
 }
 
+void FrameFilter::setFillHoles(bool newFillHoles)
+{
+    fillHoles=newFillHoles;
+}
+
+const HoleFiller::Statistics& FrameFilter::getHoleFillStatistics(void) const
+{
+    return holeFiller.getStatistics();
+}
+
+const DirtyTiles& FrameFilter::getDirtyTiles(void) const
+{
+    return outputTiles;
+}
+
+const FrameFilter::DirtyTileStatistics& FrameFilter::getDirtyTileStatistics(void) const
+{
+    return dirtyTileStatistics;
+}
+
+void FrameFilter::setSpatialFilterPasses(int newNumPasses)
+{
+    spatialLowPass.setNumPasses(newNumPasses);
+}
+
+void FrameFilter::setSpatialFilterRadius(int newRadius)
+{
+    spatialLowPass.setRadius(newRadius);
+}
+
+void FrameFilter::setDepthMode(DepthMode newDepthMode)
+{
+    if(depthMode==newDepthMode)
+        return;
+    depthMode=newDepthMode;
+    if(bufferInitiated)
+        resetBuffers();
+}
+
+FrameFilter::DepthMode FrameFilter::getDepthMode(void) const
+{
+    return depthMode;
+}
+
+void FrameFilter::setFilterMode(FilterMode newFilterMode)
+{
+    if(filterMode==newFilterMode)
+        return;
+    filterMode=newFilterMode;
+    if(bufferInitiated){
+        if(filterMode==AVERAGING_FILTER&&numAveragingSlots>FrameFilterKernels::maxAveragingSlots){
+            ofLog(OF_LOG_WARNING, "FrameFilter: limiting the averaging buffer to "+ofToString(FrameFilterKernels::maxAveragingSlots)+" slots");
+            numAveragingSlots=FrameFilterKernels::maxAveragingSlots;
+        }
+        resetBuffers();
+    }
+}
+
+FrameFilter::FilterMode FrameFilter::getFilterMode(void) const
+{
+    return filterMode;
+}
+
+void FrameFilter::setKernelIsa(FrameFilterKernels::Isa newIsa)
+{
+    /* Never dispatch to an instruction set the CPU does not support: */
+    if(newIsa>FrameFilterKernels::detectIsa())
+        newIsa=FrameFilterKernels::detectIsa();
+    kernelIsa=newIsa;
+}
+
+FrameFilterKernels::Isa FrameFilter::getKernelIsa(void) const
+{
+    return kernelIsa;
+}
+
+void FrameFilter::setNumThreads(int newNumThreads)
+{
+    workerPool.setNumThreads(newNumThreads);
+}
+
+int FrameFilter::getNumThreads(void) const
+{
+    return workerPool.getNumThreads();
+}
+
+uint64_t FrameFilter::getLastFilterTime(void) const
+{
+    return lastFilterTime;
+}
+
+uint64_t FrameFilter::getLastTemporalTime(void) const
+{
+    return lastTemporalTime;
+}
+
+FrameFilter::MemoryFootprint FrameFilter::getMemoryFootprint(void) const
+{
+    size_t numPixels=size_t(width)*size_t(height);
+    MemoryFootprint footprint;
+    footprint.averagingBuffer=normalizedFilter.getAveragingBufferSize()+rawFilter.getAveragingBufferSize();
+    footprint.statistics=normalizedFilter.getStatisticsSize()+rawFilter.getStatisticsSize()+normalizedExponentialFilter.getStatisticsSize()+rawExponentialFilter.getStatisticsSize();
+    footprint.frames=normalizedFilter.getValidBufferSize()+rawFilter.getValidBufferSize()+normalizedExponentialFilter.getValidBufferSize()+rawExponentialFilter.getValidBufferSize()+spatialLowPass.getMemoryFootprint()+holeFiller.getMemoryFootprint(); // valid, hole filling and spatial filter buffers
+    if(depthMode==RAW_DEPTH)
+        footprint.frames+=numPixels*sizeof(RawDepthMillimeters); // filtered depth in millimeters
+    footprint.frames+=framePool.getStatistics().numObjects*numPixels; // pooled output frames
+    footprint.gradientField=gradientPyramid.getMemoryFootprint()+gradientFieldPool.getMemoryFootprint();
+    footprint.worldCoordinates=numPixels*sizeof(Point3f);
+    footprint.perFrame=normalizedFilter.getBytesPerFrame()+rawFilter.getBytesPerFrame()+normalizedExponentialFilter.getBytesPerFrame()+rawExponentialFilter.getBytesPerFrame();
+    footprint.total=footprint.averagingBuffer+footprint.statistics+footprint.frames+footprint.gradientField+footprint.worldCoordinates;
+    return footprint;
+}
+
+void FrameFilter::printMemoryFootprint(void) const
+{
+    MemoryFootprint footprint=getMemoryFootprint();
+    std::cout<< "FrameFilter memory footprint (bytes):" <<std::endl;
+    std::cout<< "  Averaging buffer: " << footprint.averagingBuffer << " (" << numAveragingSlots << (filterMode==EXPONENTIAL_FILTER?" frames exponential window, ":" slots, ") << (depthMode==RAW_DEPTH?"raw":"normalized") << " depth)" <<std::endl;
+    std::cout<< "  Statistics: " << footprint.statistics <<std::endl;
+    std::cout<< "  Frames: " << footprint.frames <<std::endl;
+    std::cout<< "  Gradient field: " << footprint.gradientField <<std::endl;
+    std::cout<< "  World coordinates: " << footprint.worldCoordinates <<std::endl;
+    std::cout<< "  Streamed per frame: " << footprint.perFrame <<std::endl;
+    std::cout<< "  Total: " << footprint.total <<std::endl;
+    FramePool::Statistics poolStatistics=framePool.getStatistics();
+    std::cout<< "  Frame pool: " << poolStatistics.numObjects << " frames, " << poolStatistics.numAllocations << " allocations for " << poolStatistics.numAcquired << " frames handed out" <<std::endl;
+}
+
 //void FrameFilter::setOutputFrameFunction(FrameFilter::OutputFrameFunction* newOutputFrameFunction)
 //	{
 //	delete outputFrameFunction;
@@ -8,7 +8,16 @@
 #pragma once
 #include "ofMain.h"
 #include "ofxCv.h"
-#include "ofxKinect.h"
+#include "FrameFilterKernels.h"
+#include "TemporalFilter.h"
+#include "ExponentialFilter.h"
+#include "SpatialFilter.h"
+#include "HoleFiller.h"
+#include "DirtyTiles.h"
+#include "GradientPyramid.h"
+#include "FramePool.h"
+#include "GradientFieldPool.h"
+#include "WorkerPool.h"
 #include <vector>
 
 using namespace ofxCv;
@@ -17,7 +26,44 @@ using namespace cv;
 class FrameFilter /*: public ofThread */{
 public:
 	typedef unsigned char RawDepth; // Data type for raw depth values
+	typedef unsigned short RawDepthMillimeters; // Data type for raw depth values in millimeters
 	typedef float FilteredDepth; // Data type for filtered depth values
+    
+    enum DepthMode // Input of the temporal filter
+    {
+        NORMALIZED_DEPTH=0, // 8-bit depth normalized to the clip range (kinect.getDepthPixels())
+        RAW_DEPTH // 16-bit depth in millimeters (kinect.getRawDepthPixels()), independent of the clip range
+    };
+    
+    enum FilterMode // Statistics kept by the temporal filter
+    {
+        AVERAGING_FILTER=0, // Mean and variance over an averaging buffer of numAveragingSlots frames
+        EXPONENTIAL_FILTER // Exponentially weighted mean and variance over a window of numAveragingSlots frames, constant memory
+    };
+    
+    struct MemoryFootprint // Sizes in bytes of the buffers held by the filter
+    {
+        size_t averagingBuffer; // Averaging buffer, all slots
+        size_t statistics; // Per-pixel count, sum and sum of squares planes
+        size_t frames; // Valid, hole filling, spatial filter and pooled output frames
+        size_t gradientField; // Gradient field pyramid and its published snapshots
+        size_t worldCoordinates; // World coordinates buffer
+        size_t perFrame; // Bytes streamed through the cache by the temporal filter on each frame
+        size_t total; // All buffers
+    };
+
+    struct DirtyTileStatistics // Work skipped on unchanged tiles (tiles are gradFieldresolution pixels wide) in the last frame
+    {
+        int numTiles; // Number of tiles in a frame
+        int numDirtyTiles; // Number of tiles of the output frame that changed
+        int numSpatialTiles; // Number of tiles processed by the spatial filter
+        int numGradientTiles; // Number of tiles of the gradient field recomputed
+        int numDeferredGradientTiles; // Number of tiles of the gradient field deferred to the next frame by the time budget
+        float dirtyRatio; // numDirtyTiles/numTiles
+        uint64_t spatialTime; // Time spent in the spatial filter, in microseconds
+        uint64_t gradientTime; // Time spent updating the gradient field, in microseconds
+        uint64_t timeSaved; // Estimated time the spatial filter and gradient field would have spent on the skipped tiles, in microseconds
+    };
 
 //    ofThreadChannel<ofPixels> toAnalyze;
 //    ofThreadChannel<ofPixels> analyzed;
@@ -25,39 +71,80 @@ public:
     FrameFilter();
     ~FrameFilter();
     
-    bool setup(const unsigned int swidth,const unsigned int sheight,int sNumAveragingSlots, unsigned int newMinNumSamples, unsigned int newMaxVariance, float newHysteresis, bool newSpatialFilter, int gradFieldresolution,float snearclip, float sfarclip, void* _backend);
+    bool setup(const unsigned int swidth,const unsigned int sheight,int sNumAveragingSlots, unsigned int newMinNumSamples, unsigned int newMaxVariance, float newHysteresis, bool newSpatialFilter, int gradFieldresolution,float snearclip, float sfarclip);
     void initiateBuffers(void); // Reinitialise buffers
     void resetBuffers(void);
-   void setDepthRange(float nearclip, float farclip);
+   void setDepthRange(float nearclip, float farclip); // Sets the clip range; normalized statistics are remapped to it, not discarded
     void update();
     bool isFrameNew();
-    ofVec2f getGradFieldXY(int x, int y); // gradient field at pos x, y
-    ofVec2f* getGradField(); // gradient field
+    ofVec2f getGradFieldXY(int x, int y); // gradient field at pos x, y; live field, filtering thread only
+    ofVec2f* getGradField(); // gradient field; live field, rewritten by each frame, filtering thread only
+    GradientFieldPool::Field getGradFieldSnapshot() const; // immutable snapshot of the gradient field of the last frame, safe to hand to other threads
+    ofVec2f getGradFieldXY(int x, int y, int level); // gradient field of a pyramid level at pos x, y
+    ofVec2f* getGradField(int level); // gradient field of a pyramid level, getGradFieldCols(level) cells per row
+    int getNumGradFieldLevels() const; // number of gradient field pyramid levels, from the finest cells
+    int getGradFieldLevel() const; // pyramid level of cells of gradFieldresolution pixels, returned by getGradField()
+    int getGradFieldCellSize(int level) const; // width and height in pixels of the cells of a pyramid level
+    int getGradFieldCols(int level) const;
+    int getGradFieldRows(int level) const;
+    void setGradientTimeBudget(uint64_t newTimeBudget); // Sets the time allowed to update the gradient field per frame in microseconds, 0 for unlimited
     Point3f* getWrldcoordbuffer();
 //    void draw(float x, float y);
 //    void draw(float x, float y, float w, float h);
 	void setValidDepthInterval(unsigned int newMinDepth,unsigned int newMaxDepth); // Sets the interval of depth values considered by the depth image filter
 	void setValidElevationInterval(double newMinElevation,double newMaxElevation); // Sets the interval of elevations relative to the given base plane considered by the depth image filter
-	void setStableParameters(unsigned int newMinNumSamples,unsigned int newMaxVariance); // Sets the statistical properties to consider a pixel stable
+	void setStableParameters(unsigned int newMinNumSamples,unsigned int newMaxVariance); // Sets the statistical properties to consider a pixel stable; the variance is limited to 1535 for 8-bit depth
 	void setHysteresis(float newHysteresis); // Sets the stable value hysteresis envelope
 	void setRetainValids(bool newRetainValids); // Sets whether the filter retains previous stable values for instable pixels
 	void setInstableValue(float newInstableValue); // Sets the depth value to assign to instable pixels
 	void setSpatialFilter(bool newSpatialFilter); // Sets the spatial filtering flag
-    void displayFlowField();
-    void drawArrow(ofVec2f);
-    void updateGradientField();
-    ofPixels filter(ofPixels inputframe);
+	void setSpatialFilterPasses(int newNumPasses); // Sets the number of spatial filter passes per frame (default 2)
+	void setFillHoles(bool newFillHoles); // Sets whether pixels without a stable value are filled from their surroundings
+	const HoleFiller::Statistics& getHoleFillStatistics(void) const; // Returns the cost of filling the holes of the last frame
+	const DirtyTiles& getDirtyTiles(void) const; // Returns the tiles of the last output frame that changed from the previous one
+	const DirtyTileStatistics& getDirtyTileStatistics(void) const; // Returns the work skipped on unchanged tiles in the last frame
+	void setSpatialFilterRadius(int newRadius); // Sets the spatial filter kernel radius, 1 (1-2-1 kernel, default) to SpatialFilter::maxRadius
+	void setDepthMode(DepthMode newDepthMode); // Selects the input depth of the temporal filter; stability parameters are in units of that depth
+	DepthMode getDepthMode(void) const; // Returns the input depth of the temporal filter
+	void setFilterMode(FilterMode newFilterMode); // Selects the statistics kept by the temporal filter
+	FilterMode getFilterMode(void) const; // Returns the statistics kept by the temporal filter
+	void setKernelIsa(FrameFilterKernels::Isa newIsa); // Selects the temporal filter kernel (ISA_SCALAR is the reference implementation)
+	FrameFilterKernels::Isa getKernelIsa(void) const; // Returns the instruction set of the temporal filter kernel
+	void setNumThreads(int newNumThreads); // Sets the number of threads filtering bands of each frame (0 = one per core)
+	int getNumThreads(void) const; // Returns the number of threads filtering each frame
+	uint64_t getLastFilterTime(void) const; // Returns the time spent filtering the last frame, in microseconds
+	uint64_t getLastTemporalTime(void) const; // Returns the time spent in the temporal filter and depth normalization of the last frame, in microseconds
+	MemoryFootprint getMemoryFootprint(void) const; // Returns the sizes of the buffers held by the filter
+	void printMemoryFootprint(void) const; // Prints the sizes of the buffers held by the filter
+    static void displayFlowField(const GradientFieldPool::Field& field); // Draws a snapshot of the gradient field
+    static void drawArrow(ofVec2f);
+    void updateGradientField(); // Updates the gradient field and publishes a new snapshot if it changed
+    FramePool::Frame filter(const ofPixels& inputframe); // Filters an 8-bit normalized depth frame (NORMALIZED_DEPTH mode) into a pooled frame
+    FramePool::Frame filter(const ofShortPixels& inputframe); // Filters a depth frame in millimeters (RAW_DEPTH mode) into a pooled frame normalized to the clip range
+    const ofShortPixels& filterTemporal(const ofShortPixels& inputframe); // Runs only the temporal filter on a depth frame in millimeters (RAW_DEPTH mode) and returns the filtered depth, for sensors fused before the spatial stages
+    FramePool::Frame filterFused(const ofShortPixels& depth); // Maps a depth frame in millimeters filtered elsewhere, such as a fusion of several sensors, to the clip range and applies the spatial stages
+    FramePool& getFramePool(); // Returns the pool of frames handed out by filter()
+    const ofShortPixels& getFilteredDepth() const; // Returns the last filtered depth frame in millimeters (RAW_DEPTH mode)
+    
+    template <class InputDepth>
+    FrameFilterKernels::TemporalParams<InputDepth> getTemporalParams(void) const; // Returns the stability criterion for the temporal filter, for RawDepth or RawDepthMillimeters input
     
 private:
-    ofxKinect * backend;
-
-    ofPixels inputframe;
-    ofPixels outputframe;
+    void remapStatistics(float newNearclip, float newFarclip); // Maps the normalized statistics from the current clip range to a new one
+    FramePool::Frame normalizeFrame(const ofShortPixels& depth); // Maps a filtered frame in millimeters to the clip range into a pooled frame
+    void normalizeDepth(const RawDepthMillimeters* src, RawDepth* dst, unsigned int y0, unsigned int y1); // Maps rows [y0, y1) from millimeters to the clip range
+    void finishFrame(FramePool::Frame& newOutputFrame); // Fills holes, applies the spatial filter and updates the gradient field
+    
+    FramePool framePool; // Output frames shared with the grabber and the application
+    FramePool::Frame outputframe; // Last output frame, read by the gradient field
     ofTexture texture;
     bool newFrame;
     bool bufferInitiated;
     
-    ofVec2f* gradField;
+    GradientPyramid gradientPyramid; // Sobel gradient field at several cell sizes
+    GradientFieldPool gradientFieldPool; // Snapshots of the primary level shared with the grabber and the application
+    GradientFieldPool::Field gradientSnapshot; // Snapshot of the gradient field of the last frame
+    uint64_t gradientVersion; // Version of the last published snapshot
     int gradFieldcols, gradFieldrows;
     int gradFieldresolution;           //Resolution of grid relative to window width and height in pixels
     float maxgradfield, depthrange;
@@ -70,17 +157,32 @@ private:
 	volatile bool runFilterThread; // Flag to keep the background filtering thread running
 	float min; // lower bound of valid depth values in depth image space
 	float max; // upper bound of valid depth values in depth image space
-	int numAveragingSlots; // Number of slots in each pixel's averaging buffer
-	RawDepth* averagingBuffer; // Buffer to calculate running averages of each pixel's depth value
-	int averagingSlotIndex; // Index of averaging slot in which to store the next frame's depth values
-	unsigned int* statBuffer; // Buffer retaining the running means and variances of each pixel's depth value
+	int numAveragingSlots; // Number of slots in each pixel's averaging buffer, or window of the exponential filter
+	DepthMode depthMode; // Input depth of the temporal filter
+	TemporalFilter<RawDepth> normalizedFilter; // Averaging buffer and statistics in NORMALIZED_DEPTH mode
+	TemporalFilter<RawDepthMillimeters> rawFilter; // Averaging buffer and statistics in RAW_DEPTH mode
+	FilterMode filterMode; // Statistics kept by the temporal filter
+	ExponentialFilter<RawDepth> normalizedExponentialFilter; // Exponential statistics in NORMALIZED_DEPTH mode
+	ExponentialFilter<RawDepthMillimeters> rawExponentialFilter; // Exponential statistics in RAW_DEPTH mode
+	ofShortPixels rawOutputframe; // Last filtered depth frame in millimeters
+	std::vector<RawDepth> depthLookupTable; // Maps millimeters to the clip range, as the depth sources do for getDepthPixels()
+	FrameFilterKernels::Isa kernelIsa; // Instruction set used by the temporal filter kernel
 	unsigned int minNumSamples; // Minimum number of valid samples needed to consider a pixel stable
 	unsigned int maxVariance; // Maximum variance to consider a pixel stable
 	float hysteresis; // Amount by which a new filtered value has to differ from the current value to update
 	bool retainValids; // Flag whether to retain previous stable values if a new pixel in instable, or reset to a default value
 	float instableValue; // Value to assign to instable pixels if retainValids is false
 	bool spatialFilter; // Flag whether to apply a spatial filter to time-averaged depth values
-	RawDepth* validBuffer; // Buffer holding the most recent stable depth value for each pixel
+	bool fillHoles; // Flag whether to fill pixels without a stable value before the spatial filter
+	HoleFiller holeFiller; // Push-pull hole filling of the time-averaged depth values
+	SpatialFilter spatialLowPass; // Separable low-pass filter applied to time-averaged depth values
+	DirtyTiles spatialInputTiles; // Tiles of the spatial filter input that changed
+	DirtyTiles outputTiles; // Tiles of the output frame that changed, one per gradient field cell
+	DirtyTileStatistics dirtyTileStatistics; // Work skipped on unchanged tiles in the last frame
+	float spatialTimePerTile, gradientTimePerTile; // Running estimates of the cost of one tile, in microseconds
+	WorkerPool workerPool; // Threads filtering horizontal bands of each frame
+	uint64_t lastFilterTime; // Time spent filtering the last frame, in microseconds
+	uint64_t lastTemporalTime; // Time spent in the temporal filter of the last frame, in microseconds
 //	void* filterThreadMethod(void); // Method for the background filtering thread
 	
 };
@@ -0,0 +1,566 @@
+/***********************************************************************
+ FrameFilterKernels - Per-pixel kernels used by FrameFilter to update the
+ averaging buffer and the running statistics of each pixel, test pixel
+ stability and apply the hysteresis envelope.
+ Kernels are templated on the raw depth type: 8-bit depth normalized to
+ the clip range, or 16-bit raw depth in millimeters.
+ The scalar kernel is the reference implementation; for 8-bit depth the
+ SSE4.1 and AVX2 kernels produce bit-identical results and are selected
+ at runtime.
+ ***********************************************************************/
+
+#include "FrameFilterKernels.h"
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define FRAMEFILTER_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(FRAMEFILTER_X86) && (defined(__GNUC__) || defined(__clang__))
+#define FRAMEFILTER_TARGET(isa) __attribute__((target(isa)))
+#else
+#define FRAMEFILTER_TARGET(isa)
+#endif
+
+namespace FrameFilterKernels {
+
+Isa detectIsa(void)
+{
+#if defined(FRAMEFILTER_X86) && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return ISA_AVX2;
+    if(__builtin_cpu_supports("sse4.1"))
+        return ISA_SSE41;
+#elif defined(FRAMEFILTER_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info,0);
+    int maxLeaf=info[0];
+    __cpuid(info,1);
+    bool sse41=(info[2]&(1<<19))!=0;
+    bool osxsave=(info[2]&(1<<27))!=0;
+    if(maxLeaf>=7&&osxsave&&(_xgetbv(0)&0x6)==0x6)
+    {
+        __cpuidex(info,7,0);
+        if(info[1]&(1<<5))
+            return ISA_AVX2;
+    }
+    if(sse41)
+        return ISA_SSE41;
+#endif
+    return ISA_SCALAR;
+}
+
+const char* isaName(Isa isa)
+{
+    switch(isa)
+    {
+        case ISA_AVX2:
+            return "AVX2";
+        case ISA_SSE41:
+            return "SSE4.1";
+        default:
+            return "scalar";
+    }
+}
+
+template <class RawDepth>
+void temporalScalar(const TemporalBuffers<RawDepth>& buffers,size_t numPixels,const TemporalParams<RawDepth>& params)
+{
+    typedef DepthTraits<RawDepth> Traits;
+    typedef typename Traits::Accumulator Accumulator;
+
+    const RawDepth* ifPtr=buffers.input;
+    RawDepth* abPtr=buffers.averagingSlot;
+    typename Traits::SampleCount* cPtr=buffers.count;
+    typename Traits::SampleSum* sPtr=buffers.sum;
+    typename Traits::SampleSumSq* qPtr=buffers.sumSq;
+    RawDepth* ofPtr=buffers.valid;
+    RawDepth* nofPtr=buffers.output;
+
+    for(size_t i=0;i<numPixels;++i,++ifPtr,++abPtr,++cPtr,++sPtr,++qPtr,++ofPtr,++nofPtr)
+    {
+        Accumulator oldVal=*abPtr;
+        Accumulator newVal=*ifPtr;
+        Accumulator count=*cPtr;
+        Accumulator sum=*sPtr;
+        Accumulator sumSq=*qPtr;
+
+        if(Traits::isValid(*ifPtr)) // Pixel depth not clipped => inside valide range
+        {
+            /* Store the new input value: */
+            *abPtr=newVal;
+
+            /* Update the pixel's statistics: */
+            ++count; // Number of valid samples
+            sum+=newVal; // Sum of valid samples
+            sumSq+=newVal*newVal; // Sum of squares of valid samples
+
+            /* Check if the previous value in the averaging buffer was valid: */
+            if(oldVal!=Traits::invalidSample)
+            {
+                --count; // Number of valid samples
+                sum-=oldVal; // Sum of valid samples
+                sumSq-=oldVal*oldVal; // Sum of squares of valid samples
+            }
+        }
+        else if(!params.retainValids)
+        {
+            /* Store an invalid input value: */
+            *abPtr=Traits::invalidSample;
+
+            /* Check if the previous value in the averaging buffer was valid: */
+            if(oldVal!=Traits::invalidSample)
+            {
+                --count; // Number of valid samples
+                sum-=oldVal; // Sum of valid samples
+                sumSq-=oldVal*oldVal; // Sum of squares of valid samples
+            }
+        }
+        *cPtr=typename Traits::SampleCount(count);
+        *sPtr=typename Traits::SampleSum(sum);
+        *qPtr=typename Traits::SampleSumSq(sumSq);
+
+        // Check if the pixel is considered "stable": */
+        if(count>=params.minNumSamples&&sumSq*count<=params.maxVariance*count*count+sum*sum)
+        {
+            /* Check if the new running mean is outside the previous value's envelope: */
+            float newFiltered=float(sum)/float(count);
+            if(std::fabs(newFiltered-*ofPtr)>=params.hysteresis)
+            {
+                /* Set the output pixel value to the running mean: */
+                *nofPtr=*ofPtr=newFiltered;
+            }
+            else
+            {
+                /* Leave the pixel at its previous value: */
+                *nofPtr=*ofPtr;
+            }
+        }
+        else if(params.retainValids)
+        {
+            /* Leave the pixel at its previous value: */
+            *nofPtr=*ofPtr;
+        }
+        else
+        {
+            /* Assign default value to instable pixels: */
+            *nofPtr=params.instableValue;
+        }
+    }
+}
+
+template void temporalScalar(const TemporalBuffers<unsigned char>& buffers,size_t numPixels,const TemporalParams<unsigned char>& params);
+template void temporalScalar(const TemporalBuffers<unsigned short>& buffers,size_t numPixels,const TemporalParams<unsigned short>& params);
+
+template <class RawDepth>
+void exponentialScalar(const ExponentialBuffers<RawDepth>& buffers,size_t numPixels,const TemporalParams<RawDepth>& params,float decay)
+{
+    typedef DepthTraits<RawDepth> Traits;
+
+    const RawDepth* ifPtr=buffers.input;
+    float* wPtr=buffers.weight;
+    float* mPtr=buffers.mean;
+    float* qPtr=buffers.m2;
+    RawDepth* ofPtr=buffers.valid;
+    RawDepth* nofPtr=buffers.output;
+
+    float minWeight=float(params.minNumSamples)-0.5f; // The weight approaches the window from below
+    float maxVariance=float(params.maxVariance);
+
+    /* Invalid samples only age the history, as an invalid slot in the averaging buffer, unless valid values are retained: */
+    float invalidDecay=params.retainValids?1.0f:decay;
+
+    for(size_t i=0;i<numPixels;++i)
+    {
+        bool valid=Traits::isValid(ifPtr[i]);
+        float newVal=float(ifPtr[i]);
+
+        /* Weighted Welford update with decayed history: */
+        float weight=wPtr[i]*(valid?decay:invalidDecay)+(valid?1.0f:0.0f);
+        float m2=qPtr[i]*(valid?decay:invalidDecay);
+        float mean=mPtr[i];
+        float delta=valid?newVal-mean:0.0f;
+        mean+=delta/(valid?weight:1.0f);
+        m2+=delta*(newVal-mean);
+        wPtr[i]=weight;
+        mPtr[i]=mean;
+        qPtr[i]=m2;
+
+        /* Check if the pixel is considered "stable" and the new running mean is outside the previous value's envelope: */
+        bool stable=weight>=minWeight&&m2<=maxVariance*weight;
+        RawDepth oldValid=ofPtr[i];
+        RawDepth newValid=stable&&std::fabs(mean-float(oldValid))>=params.hysteresis?RawDepth(mean):oldValid;
+        ofPtr[i]=newValid;
+
+        /* Leave instable pixels at their previous value or assign the default value: */
+        nofPtr[i]=stable||params.retainValids?newValid:params.instableValue;
+    }
+}
+
+template void exponentialScalar(const ExponentialBuffers<unsigned char>& buffers,size_t numPixels,const TemporalParams<unsigned char>& params,float decay);
+template void exponentialScalar(const ExponentialBuffers<unsigned short>& buffers,size_t numPixels,const TemporalParams<unsigned short>& params,float decay);
+
+#if defined(FRAMEFILTER_X86)
+
+typedef DepthTraits<unsigned char>::RawDepth RawDepth;
+typedef DepthTraits<unsigned char>::SampleSum SampleSum;
+
+/* Load four raw depth values widened to 32-bit lanes: */
+FRAMEFILTER_TARGET("sse4.1") static inline __m128i load4(const RawDepth* ptr)
+{
+    int bytes;
+    std::memcpy(&bytes,ptr,4);
+    return _mm_cvtepu8_epi32(_mm_cvtsi32_si128(bytes));
+}
+
+/* Store four 32-bit lanes in [0, 255] as raw depth values: */
+FRAMEFILTER_TARGET("sse4.1") static inline void store4(RawDepth* ptr,__m128i v)
+{
+    __m128i packed=_mm_packus_epi16(_mm_packus_epi32(v,v),_mm_setzero_si128());
+    int bytes=_mm_cvtsi128_si32(packed);
+    std::memcpy(ptr,&bytes,4);
+}
+
+/* Load four sample sums widened to 32-bit lanes: */
+FRAMEFILTER_TARGET("sse4.1") static inline __m128i loadSum4(const SampleSum* ptr)
+{
+    return _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(ptr)));
+}
+
+/* Store four 32-bit lanes in [0, 65535] as sample sums: */
+FRAMEFILTER_TARGET("sse4.1") static inline void storeSum4(SampleSum* ptr,__m128i v)
+{
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(ptr),_mm_packus_epi32(v,v));
+}
+
+/* Unsigned 32-bit a<=b mask: */
+FRAMEFILTER_TARGET("sse4.1") static inline __m128i cmpleEpu32(__m128i a,__m128i b)
+{
+    return _mm_cmpeq_epi32(_mm_max_epu32(a,b),b);
+}
+
+FRAMEFILTER_TARGET("sse4.1") void temporalSSE41(const TemporalBuffers<unsigned char>& buffers,size_t numPixels,const TemporalParams<unsigned char>& params)
+{
+    const __m128i zero=_mm_setzero_si128();
+    const __m128i invalid=_mm_set1_epi32(255);
+    const __m128i minNumSamples=_mm_set1_epi32(int(params.minNumSamples));
+    const __m128i maxVariance=_mm_set1_epi32(int(params.maxVariance));
+    const __m128i instableValue=_mm_set1_epi32(params.instableValue);
+    const __m128 hysteresis=_mm_set1_ps(params.hysteresis);
+    const __m128 absMask=_mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    const __m128i retainMask=params.retainValids?_mm_set1_epi32(-1):zero;
+
+    size_t i=0;
+    for(;i+4<=numPixels;i+=4)
+    {
+        __m128i newVal=load4(buffers.input+i);
+        __m128i oldVal=load4(buffers.averagingSlot+i);
+        __m128i count=load4(buffers.count+i);
+        __m128i sum=loadSum4(buffers.sum+i);
+        __m128i sumSq=_mm_loadu_si128(reinterpret_cast<const __m128i*>(buffers.sumSq+i));
+        __m128i valid=load4(buffers.valid+i);
+
+        /* New sample inside the valid range, old sample present in the averaging buffer: */
+        __m128i newValid=_mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi32(newVal,zero),_mm_cmpeq_epi32(newVal,invalid)),_mm_set1_epi32(-1));
+        __m128i oldValid=_mm_andnot_si128(_mm_cmpeq_epi32(oldVal,invalid),_mm_set1_epi32(-1));
+
+        /* The old sample leaves the statistics when it is replaced, or always if valids are not retained: */
+        __m128i removeOld=_mm_and_si128(oldValid,_mm_or_si128(newValid,_mm_andnot_si128(retainMask,_mm_set1_epi32(-1))));
+        __m128i keepSlot=_mm_and_si128(retainMask,_mm_andnot_si128(newValid,_mm_set1_epi32(-1)));
+        __m128i slot=_mm_blendv_epi8(invalid,newVal,newValid);
+        slot=_mm_blendv_epi8(slot,oldVal,keepSlot);
+        store4(buffers.averagingSlot+i,slot);
+
+        /* Update the pixel's statistics (masks are -1 where set): */
+        count=_mm_add_epi32(_mm_sub_epi32(count,newValid),removeOld);
+        sum=_mm_sub_epi32(_mm_add_epi32(sum,_mm_and_si128(newVal,newValid)),_mm_and_si128(oldVal,removeOld));
+        sumSq=_mm_sub_epi32(_mm_add_epi32(sumSq,_mm_and_si128(_mm_mullo_epi32(newVal,newVal),newValid)),_mm_and_si128(_mm_mullo_epi32(oldVal,oldVal),removeOld));
+        store4(buffers.count+i,count);
+        storeSum4(buffers.sum+i,sum);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(buffers.sumSq+i),sumSq);
+
+        /* Stability test, in the same wrapping unsigned arithmetic as the scalar kernel: */
+        __m128i enough=cmpleEpu32(minNumSamples,count);
+        __m128i lhs=_mm_mullo_epi32(sumSq,count);
+        __m128i rhs=_mm_add_epi32(_mm_mullo_epi32(_mm_mullo_epi32(maxVariance,count),count),_mm_mullo_epi32(sum,sum));
+        __m128i stable=_mm_and_si128(enough,cmpleEpu32(lhs,rhs));
+
+        /* Hysteresis envelope around the previous stable value: */
+        __m128 newFiltered=_mm_div_ps(_mm_cvtepi32_ps(sum),_mm_cvtepi32_ps(count));
+        __m128 distance=_mm_and_ps(_mm_sub_ps(newFiltered,_mm_cvtepi32_ps(valid)),absMask);
+        __m128i update=_mm_and_si128(stable,_mm_castps_si128(_mm_cmpge_ps(distance,hysteresis)));
+        valid=_mm_blendv_epi8(valid,_mm_cvttps_epi32(newFiltered),update);
+        store4(buffers.valid+i,valid);
+
+        __m128i output=_mm_blendv_epi8(instableValue,valid,_mm_or_si128(stable,retainMask));
+        store4(buffers.output+i,output);
+    }
+
+    /* Process the remaining pixels with the reference kernel: */
+    if(i<numPixels)
+        temporalScalar(buffers.advance(i),numPixels-i,params);
+}
+
+FRAMEFILTER_TARGET("sse4.1") void exponentialSSE41(const ExponentialBuffers<unsigned char>& buffers,size_t numPixels,const TemporalParams<unsigned char>& params,float decay)
+{
+    const __m128i zero=_mm_setzero_si128();
+    const __m128i invalid=_mm_set1_epi32(255);
+    const __m128 one=_mm_set1_ps(1.0f);
+    const __m128 validDecay=_mm_set1_ps(decay);
+    const __m128 invalidDecay=_mm_set1_ps(params.retainValids?1.0f:decay);
+    const __m128 minWeight=_mm_set1_ps(float(params.minNumSamples)-0.5f);
+    const __m128 maxVariance=_mm_set1_ps(float(params.maxVariance));
+    const __m128i instableValue=_mm_set1_epi32(params.instableValue);
+    const __m128 hysteresis=_mm_set1_ps(params.hysteresis);
+    const __m128 absMask=_mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    const __m128i retainMask=params.retainValids?_mm_set1_epi32(-1):zero;
+
+    size_t i=0;
+    for(;i+4<=numPixels;i+=4)
+    {
+        __m128i newVal=load4(buffers.input+i);
+        __m128i valid=load4(buffers.valid+i);
+        __m128 sample=_mm_cvtepi32_ps(newVal);
+        __m128 newValid=_mm_castsi128_ps(_mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi32(newVal,zero),_mm_cmpeq_epi32(newVal,invalid)),_mm_set1_epi32(-1)));
+
+        /* Weighted Welford update with decayed history, in the operation order of the scalar kernel: */
+        __m128 pixelDecay=_mm_blendv_ps(invalidDecay,validDecay,newValid);
+        __m128 weight=_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(buffers.weight+i),pixelDecay),_mm_and_ps(one,newValid));
+        __m128 m2=_mm_mul_ps(_mm_loadu_ps(buffers.m2+i),pixelDecay);
+        __m128 mean=_mm_loadu_ps(buffers.mean+i);
+        __m128 delta=_mm_and_ps(_mm_sub_ps(sample,mean),newValid);
+        mean=_mm_add_ps(mean,_mm_div_ps(delta,_mm_blendv_ps(one,weight,newValid)));
+        m2=_mm_add_ps(m2,_mm_mul_ps(delta,_mm_sub_ps(sample,mean)));
+        _mm_storeu_ps(buffers.weight+i,weight);
+        _mm_storeu_ps(buffers.mean+i,mean);
+        _mm_storeu_ps(buffers.m2+i,m2);
+
+        /* Stability test and hysteresis envelope around the previous stable value: */
+        __m128i stable=_mm_castps_si128(_mm_and_ps(_mm_cmpge_ps(weight,minWeight),_mm_cmple_ps(m2,_mm_mul_ps(maxVariance,weight))));
+        __m128 distance=_mm_and_ps(_mm_sub_ps(mean,_mm_cvtepi32_ps(valid)),absMask);
+        __m128i update=_mm_and_si128(stable,_mm_castps_si128(_mm_cmpge_ps(distance,hysteresis)));
+        valid=_mm_blendv_epi8(valid,_mm_cvttps_epi32(mean),update);
+        store4(buffers.valid+i,valid);
+
+        __m128i output=_mm_blendv_epi8(instableValue,valid,_mm_or_si128(stable,retainMask));
+        store4(buffers.output+i,output);
+    }
+
+    /* Process the remaining pixels with the reference kernel: */
+    if(i<numPixels)
+        exponentialScalar(buffers.advance(i),numPixels-i,params,decay);
+}
+
+/* Load eight raw depth values widened to 32-bit lanes: */
+FRAMEFILTER_TARGET("avx2") static inline __m256i load8(const RawDepth* ptr)
+{
+    return _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(ptr)));
+}
+
+/* Store eight 32-bit lanes in [0, 255] as raw depth values: */
+FRAMEFILTER_TARGET("avx2") static inline void store8(RawDepth* ptr,__m256i v)
+{
+    __m256i packed=_mm256_packus_epi16(_mm256_packus_epi32(v,v),_mm256_setzero_si256());
+    int low=_mm_cvtsi128_si32(_mm256_castsi256_si128(packed));
+    int high=_mm_cvtsi128_si32(_mm256_extracti128_si256(packed,1));
+    std::memcpy(ptr,&low,4);
+    std::memcpy(ptr+4,&high,4);
+}
+
+/* Load eight sample sums widened to 32-bit lanes: */
+FRAMEFILTER_TARGET("avx2") static inline __m256i loadSum8(const SampleSum* ptr)
+{
+    return _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr)));
+}
+
+/* Store eight 32-bit lanes in [0, 65535] as sample sums: */
+FRAMEFILTER_TARGET("avx2") static inline void storeSum8(SampleSum* ptr,__m256i v)
+{
+    __m256i packed=_mm256_permute4x64_epi64(_mm256_packus_epi32(v,v),0x08);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(ptr),_mm256_castsi256_si128(packed));
+}
+
+/* Unsigned 32-bit a<=b mask: */
+FRAMEFILTER_TARGET("avx2") static inline __m256i cmpleEpu32(__m256i a,__m256i b)
+{
+    return _mm256_cmpeq_epi32(_mm256_max_epu32(a,b),b);
+}
+
+FRAMEFILTER_TARGET("avx2") void temporalAVX2(const TemporalBuffers<unsigned char>& buffers,size_t numPixels,const TemporalParams<unsigned char>& params)
+{
+    const __m256i ones=_mm256_set1_epi32(-1);
+    const __m256i zero=_mm256_setzero_si256();
+    const __m256i invalid=_mm256_set1_epi32(255);
+    const __m256i minNumSamples=_mm256_set1_epi32(int(params.minNumSamples));
+    const __m256i maxVariance=_mm256_set1_epi32(int(params.maxVariance));
+    const __m256i instableValue=_mm256_set1_epi32(params.instableValue);
+    const __m256 hysteresis=_mm256_set1_ps(params.hysteresis);
+    const __m256 absMask=_mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    const __m256i retainMask=params.retainValids?ones:zero;
+
+    size_t i=0;
+    for(;i+8<=numPixels;i+=8)
+    {
+        __m256i newVal=load8(buffers.input+i);
+        __m256i oldVal=load8(buffers.averagingSlot+i);
+        __m256i count=load8(buffers.count+i);
+        __m256i sum=loadSum8(buffers.sum+i);
+        __m256i sumSq=_mm256_loadu_si256(reinterpret_cast<const __m256i*>(buffers.sumSq+i));
+        __m256i valid=load8(buffers.valid+i);
+
+        /* New sample inside the valid range, old sample present in the averaging buffer: */
+        __m256i newValid=_mm256_andnot_si256(_mm256_or_si256(_mm256_cmpeq_epi32(newVal,zero),_mm256_cmpeq_epi32(newVal,invalid)),ones);
+        __m256i oldValid=_mm256_andnot_si256(_mm256_cmpeq_epi32(oldVal,invalid),ones);
+
+        /* The old sample leaves the statistics when it is replaced, or always if valids are not retained: */
+        __m256i removeOld=_mm256_and_si256(oldValid,_mm256_or_si256(newValid,_mm256_andnot_si256(retainMask,ones)));
+        __m256i keepSlot=_mm256_and_si256(retainMask,_mm256_andnot_si256(newValid,ones));
+        __m256i slot=_mm256_blendv_epi8(invalid,newVal,newValid);
+        slot=_mm256_blendv_epi8(slot,oldVal,keepSlot);
+        store8(buffers.averagingSlot+i,slot);
+
+        /* Update the pixel's statistics (masks are -1 where set): */
+        count=_mm256_add_epi32(_mm256_sub_epi32(count,newValid),removeOld);
+        sum=_mm256_sub_epi32(_mm256_add_epi32(sum,_mm256_and_si256(newVal,newValid)),_mm256_and_si256(oldVal,removeOld));
+        sumSq=_mm256_sub_epi32(_mm256_add_epi32(sumSq,_mm256_and_si256(_mm256_mullo_epi32(newVal,newVal),newValid)),_mm256_and_si256(_mm256_mullo_epi32(oldVal,oldVal),removeOld));
+        store8(buffers.count+i,count);
+        storeSum8(buffers.sum+i,sum);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(buffers.sumSq+i),sumSq);
+
+        /* Stability test, in the same wrapping unsigned arithmetic as the scalar kernel: */
+        __m256i enough=cmpleEpu32(minNumSamples,count);
+        __m256i lhs=_mm256_mullo_epi32(sumSq,count);
+        __m256i rhs=_mm256_add_epi32(_mm256_mullo_epi32(_mm256_mullo_epi32(maxVariance,count),count),_mm256_mullo_epi32(sum,sum));
+        __m256i stable=_mm256_and_si256(enough,cmpleEpu32(lhs,rhs));
+
+        /* Hysteresis envelope around the previous stable value: */
+        __m256 newFiltered=_mm256_div_ps(_mm256_cvtepi32_ps(sum),_mm256_cvtepi32_ps(count));
+        __m256 distance=_mm256_and_ps(_mm256_sub_ps(newFiltered,_mm256_cvtepi32_ps(valid)),absMask);
+        __m256i update=_mm256_and_si256(stable,_mm256_castps_si256(_mm256_cmp_ps(distance,hysteresis,_CMP_GE_OQ)));
+        valid=_mm256_blendv_epi8(valid,_mm256_cvttps_epi32(newFiltered),update);
+        store8(buffers.valid+i,valid);
+
+        __m256i output=_mm256_blendv_epi8(instableValue,valid,_mm256_or_si256(stable,retainMask));
+        store8(buffers.output+i,output);
+    }
+
+    /* Process the remaining pixels with the reference kernel: */
+    if(i<numPixels)
+        temporalScalar(buffers.advance(i),numPixels-i,params);
+}
+
+FRAMEFILTER_TARGET("avx2") void exponentialAVX2(const ExponentialBuffers<unsigned char>& buffers,size_t numPixels,const TemporalParams<unsigned char>& params,float decay)
+{
+    const __m256i zero=_mm256_setzero_si256();
+    const __m256i invalid=_mm256_set1_epi32(255);
+    const __m256 one=_mm256_set1_ps(1.0f);
+    const __m256 validDecay=_mm256_set1_ps(decay);
+    const __m256 invalidDecay=_mm256_set1_ps(params.retainValids?1.0f:decay);
+    const __m256 minWeight=_mm256_set1_ps(float(params.minNumSamples)-0.5f);
+    const __m256 maxVariance=_mm256_set1_ps(float(params.maxVariance));
+    const __m256i instableValue=_mm256_set1_epi32(params.instableValue);
+    const __m256 hysteresis=_mm256_set1_ps(params.hysteresis);
+    const __m256 absMask=_mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    const __m256i retainMask=params.retainValids?_mm256_set1_epi32(-1):zero;
+
+    size_t i=0;
+    for(;i+8<=numPixels;i+=8)
+    {
+        __m256i newVal=load8(buffers.input+i);
+        __m256i valid=load8(buffers.valid+i);
+        __m256 sample=_mm256_cvtepi32_ps(newVal);
+        __m256 newValid=_mm256_castsi256_ps(_mm256_andnot_si256(_mm256_or_si256(_mm256_cmpeq_epi32(newVal,zero),_mm256_cmpeq_epi32(newVal,invalid)),_mm256_set1_epi32(-1)));
+
+        /* Weighted Welford update with decayed history, in the operation order of the scalar kernel: */
+        __m256 pixelDecay=_mm256_blendv_ps(invalidDecay,validDecay,newValid);
+        __m256 weight=_mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(buffers.weight+i),pixelDecay),_mm256_and_ps(one,newValid));
+        __m256 m2=_mm256_mul_ps(_mm256_loadu_ps(buffers.m2+i),pixelDecay);
+        __m256 mean=_mm256_loadu_ps(buffers.mean+i);
+        __m256 delta=_mm256_and_ps(_mm256_sub_ps(sample,mean),newValid);
+        mean=_mm256_add_ps(mean,_mm256_div_ps(delta,_mm256_blendv_ps(one,weight,newValid)));
+        m2=_mm256_add_ps(m2,_mm256_mul_ps(delta,_mm256_sub_ps(sample,mean)));
+        _mm256_storeu_ps(buffers.weight+i,weight);
+        _mm256_storeu_ps(buffers.mean+i,mean);
+        _mm256_storeu_ps(buffers.m2+i,m2);
+
+        /* Stability test and hysteresis envelope around the previous stable value: */
+        __m256i stable=_mm256_castps_si256(_mm256_and_ps(_mm256_cmp_ps(weight,minWeight,_CMP_GE_OQ),_mm256_cmp_ps(m2,_mm256_mul_ps(maxVariance,weight),_CMP_LE_OQ)));
+        __m256 distance=_mm256_and_ps(_mm256_sub_ps(mean,_mm256_cvtepi32_ps(valid)),absMask);
+        __m256i update=_mm256_and_si256(stable,_mm256_castps_si256(_mm256_cmp_ps(distance,hysteresis,_CMP_GE_OQ)));
+        valid=_mm256_blendv_epi8(valid,_mm256_cvttps_epi32(mean),update);
+        store8(buffers.valid+i,valid);
+
+        __m256i output=_mm256_blendv_epi8(instableValue,valid,_mm256_or_si256(stable,retainMask));
+        store8(buffers.output+i,output);
+    }
+
+    /* Process the remaining pixels with the reference kernel: */
+    if(i<numPixels)
+        exponentialScalar(buffers.advance(i),numPixels-i,params,decay);
+}
+
+#else
+
+void temporalSSE41(const TemporalBuffers<unsigned char>& buffers,size_t numPixels,const TemporalParams<unsigned char>& params)
+{
+    temporalScalar(buffers,numPixels,params);
+}
+
+void temporalAVX2(const TemporalBuffers<unsigned char>& buffers,size_t numPixels,const TemporalParams<unsigned char>& params)
+{
+    temporalScalar(buffers,numPixels,params);
+}
+
+void exponentialSSE41(const ExponentialBuffers<unsigned char>& buffers,size_t numPixels,const TemporalParams<unsigned char>& params,float decay)
+{
+    exponentialScalar(buffers,numPixels,params,decay);
+}
+
+void exponentialAVX2(const ExponentialBuffers<unsigned char>& buffers,size_t numPixels,const TemporalParams<unsigned char>& params,float decay)
+{
+    exponentialScalar(buffers,numPixels,params,decay);
+}
+
+#endif
+
+template <>
+void temporal(Isa isa,const TemporalBuffers<unsigned char>& buffers,size_t numPixels,const TemporalParams<unsigned char>& params)
+{
+    switch(isa)
+    {
+        case ISA_AVX2:
+            temporalAVX2(buffers,numPixels,params);
+            break;
+        case ISA_SSE41:
+            temporalSSE41(buffers,numPixels,params);
+            break;
+        default:
+            temporalScalar(buffers,numPixels,params);
+            break;
+    }
+}
+
+template <>
+void exponential(Isa isa,const ExponentialBuffers<unsigned char>& buffers,size_t numPixels,const TemporalParams<unsigned char>& params,float decay)
+{
+    switch(isa)
+    {
+        case ISA_AVX2:
+            exponentialAVX2(buffers,numPixels,params,decay);
+            break;
+        case ISA_SSE41:
+            exponentialSSE41(buffers,numPixels,params,decay);
+            break;
+        default:
+            exponentialScalar(buffers,numPixels,params,decay);
+            break;
+    }
+}
+
+}
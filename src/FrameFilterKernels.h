@@ -0,0 +1,148 @@
+/***********************************************************************
+ FrameFilterKernels - Per-pixel kernels used by FrameFilter to update the
+ averaging buffer and the running statistics of each pixel, test pixel
+ stability and apply the hysteresis envelope.
+ Kernels are templated on the raw depth type: 8-bit depth normalized to
+ the clip range, or 16-bit raw depth in millimeters.
+ The exponential kernels keep exponentially weighted statistics instead
+ of an averaging buffer, so their state does not grow with the window.
+ The scalar kernel is the reference implementation; for 8-bit depth the
+ SSE4.1 and AVX2 kernels produce bit-identical results and are selected
+ at runtime.
+ ***********************************************************************/
+
+#pragma once
+#include <cstddef>
+#include <stdint.h>
+
+namespace FrameFilterKernels {
+
+    /* Largest averaging buffer supported by the 8-bit sample count planes: */
+    const int maxAveragingSlots=255;
+
+    template <class RawDepthParam>
+    struct DepthTraits; // Sample markers and statistics types for a raw depth type
+
+    template <>
+    struct DepthTraits<unsigned char> // Depth normalized to the clip range, 255 at the near plane
+    {
+        typedef unsigned char RawDepth;
+        typedef unsigned char SampleCount; // Data type for the number of valid samples of a pixel
+        typedef unsigned short SampleSum; // Data type for the sum of valid samples of a pixel
+        typedef unsigned int SampleSumSq; // Data type for the sum of squares of valid samples of a pixel
+        typedef unsigned int Accumulator; // Data type of the stability test products
+
+        /* Valid samples are in [1, 254], so with at most 255 slots: count <= 255, sum <= 255*254 = 64770 < 2^16,
+           sum of squares <= 255*254^2 = 16451580 < 2^32, and the stability test product sumSq*count stays below
+           255^2*254^2 = 4195152900 < 2^32; as sum*sum <= count^2*254^2, its other side maxVariance*count^2+sum*sum
+           stays below 255^2*(1535+254^2) = 4294966275 < 2^32 as long as maxVariance <= maxVarianceLimit: */
+        static const RawDepth invalidSample=255; // Marks an empty averaging buffer slot
+        static const unsigned int maxVarianceLimit=1535; // Largest maximum variance the stability test supports
+        static bool isValid(RawDepth value) // Returns true if a new sample is inside the clip range
+        {
+            return value!=0&&value!=invalidSample;
+        }
+    };
+
+    template <>
+    struct DepthTraits<unsigned short> // Raw depth in millimeters, 0 where the sensor has no reading
+    {
+        typedef unsigned short RawDepth;
+        typedef unsigned char SampleCount;
+        typedef unsigned int SampleSum;
+        typedef uint64_t SampleSumSq;
+        typedef uint64_t Accumulator;
+
+        /* Valid samples are in [1, 65534], so with at most 255 slots: sum <= 255*65534 < 2^24 (exact as a float),
+           sum of squares <= 255*65534^2 < 2^41, and the stability test terms stay below 2^49 for any maxVariance < 2^32: */
+        static const RawDepth invalidSample=65535;
+        static const unsigned int maxVarianceLimit=0xffffffffU;
+        static bool isValid(RawDepth value)
+        {
+            return value!=0&&value!=invalidSample;
+        }
+    };
+
+    enum Isa // Instruction sets a kernel can be dispatched to
+    {
+        ISA_SCALAR=0,ISA_SSE41,ISA_AVX2
+    };
+
+    template <class RawDepth>
+    struct TemporalParams // Stability criterion and output policy, in units of the raw depth
+    {
+        unsigned int minNumSamples; // Minimum number of valid samples needed to consider a pixel stable
+        unsigned int maxVariance; // Maximum variance to consider a pixel stable
+        float hysteresis; // Amount by which a new filtered value has to differ from the current value to update
+        bool retainValids; // Flag whether to retain previous stable values for instable pixels
+        RawDepth instableValue; // Value to assign to instable pixels if retainValids is false
+    };
+
+    template <class RawDepth>
+    struct TemporalBuffers // Per-pixel planes processed by a kernel
+    {
+        typedef DepthTraits<RawDepth> Traits;
+
+        const RawDepth* input; // New depth frame
+        RawDepth* averagingSlot; // Averaging buffer slot receiving the new frame
+        typename Traits::SampleCount* count; // Number of valid samples
+        typename Traits::SampleSum* sum; // Sum of valid samples
+        typename Traits::SampleSumSq* sumSq; // Sum of squares of valid samples
+        RawDepth* valid; // Most recent stable value of each pixel
+        RawDepth* output; // Output frame
+
+        TemporalBuffers advance(size_t numPixels) const // Returns the buffers starting numPixels further
+        {
+            TemporalBuffers result={input+numPixels,averagingSlot+numPixels,count+numPixels,sum+numPixels,sumSq+numPixels,valid+numPixels,output+numPixels};
+            return result;
+        }
+    };
+
+    template <class RawDepth>
+    struct ExponentialBuffers // Per-pixel planes processed by the exponential kernel
+    {
+        const RawDepth* input; // New depth frame
+        float* weight; // Exponentially weighted number of valid samples
+        float* mean; // Exponentially weighted mean of valid samples
+        float* m2; // Exponentially weighted sum of squared deviations from the mean
+        RawDepth* valid; // Most recent stable value of each pixel
+        RawDepth* output; // Output frame
+
+        ExponentialBuffers advance(size_t numPixels) const // Returns the buffers starting numPixels further
+        {
+            ExponentialBuffers result={input+numPixels,weight+numPixels,mean+numPixels,m2+numPixels,valid+numPixels,output+numPixels};
+            return result;
+        }
+    };
+
+    Isa detectIsa(void); // Returns the best instruction set supported by the running CPU
+    const char* isaName(Isa isa); // Returns a printable name for an instruction set
+
+    /* Process numPixels consecutive pixels starting at the given buffer pointers: */
+    template <class RawDepth>
+    void temporalScalar(const TemporalBuffers<RawDepth>& buffers,size_t numPixels,const TemporalParams<RawDepth>& params);
+    void temporalSSE41(const TemporalBuffers<unsigned char>& buffers,size_t numPixels,const TemporalParams<unsigned char>& params);
+    void temporalAVX2(const TemporalBuffers<unsigned char>& buffers,size_t numPixels,const TemporalParams<unsigned char>& params);
+
+    /* Decay the statistics by decay (1-1/window) and enter the new frame, with the stability test of temporalScalar: */
+    template <class RawDepth>
+    void exponentialScalar(const ExponentialBuffers<RawDepth>& buffers,size_t numPixels,const TemporalParams<RawDepth>& params,float decay);
+    void exponentialSSE41(const ExponentialBuffers<unsigned char>& buffers,size_t numPixels,const TemporalParams<unsigned char>& params,float decay);
+    void exponentialAVX2(const ExponentialBuffers<unsigned char>& buffers,size_t numPixels,const TemporalParams<unsigned char>& params,float decay);
+
+    /* Dispatch to the kernel for isa, falling back to the scalar kernel for depth types without vector kernels: */
+    template <class RawDepth>
+    inline void temporal(Isa /*isa*/,const TemporalBuffers<RawDepth>& buffers,size_t numPixels,const TemporalParams<RawDepth>& params)
+    {
+        temporalScalar(buffers,numPixels,params);
+    }
+    template <>
+    void temporal(Isa isa,const TemporalBuffers<unsigned char>& buffers,size_t numPixels,const TemporalParams<unsigned char>& params);
+    template <class RawDepth>
+    inline void exponential(Isa /*isa*/,const ExponentialBuffers<RawDepth>& buffers,size_t numPixels,const TemporalParams<RawDepth>& params,float decay)
+    {
+        exponentialScalar(buffers,numPixels,params,decay);
+    }
+    template <>
+    void exponential(Isa isa,const ExponentialBuffers<unsigned char>& buffers,size_t numPixels,const TemporalParams<unsigned char>& params,float decay);
+}
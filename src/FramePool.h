@@ -0,0 +1,90 @@
+/***********************************************************************
+ FramePool - Pool of preallocated depth frames handed out as reference
+ counted handles. Handles are cheap to copy and move through thread
+ channels; a frame returns to the pool when its last handle is released,
+ so in steady state frames travel from the grabber thread to the
+ application without heap allocations or copies.
+ ***********************************************************************/
+
+#pragma once
+#include "ofMain.h"
+#include "RefCountedPool.h"
+
+class FramePool {
+    struct Buffer // Pooled frame
+    {
+        struct Layout
+        {
+            unsigned int width, height; // Size of the frames
+            int numChannels; // Number of channels of the frames
+
+            Layout(unsigned int sWidth=0, unsigned int sHeight=0, int sNumChannels=1)
+            :width(sWidth), height(sHeight), numChannels(sNumChannels)
+            {
+            }
+            bool operator!=(const Layout& other) const
+            {
+                return width!=other.width||height!=other.height||numChannels!=other.numChannels;
+            }
+        };
+
+        ofPixels pixels; // Frame buffer
+
+        void allocate(const Layout& layout)
+        {
+            pixels.allocate(layout.width,layout.height,layout.numChannels);
+        }
+    };
+
+    typedef RefCountedPool<Buffer> Pool;
+public:
+    class Frame:public Pool::Handle // Reference counted handle to a pooled frame
+    {
+    public:
+        Frame()
+        {
+        }
+
+        ofPixels& getPixels(void)
+        {
+            return getPayload().pixels;
+        }
+        const ofPixels& getPixels(void) const
+        {
+            return getPayload().pixels;
+        }
+        unsigned char* getData(void)
+        {
+            return getPixels().getData();
+        }
+        const unsigned char* getData(void) const
+        {
+            return getPixels().getData();
+        }
+
+    private:
+        friend class FramePool;
+        explicit Frame(Pool::Handle&& handle)
+        :Pool::Handle(std::move(handle))
+        {
+        }
+    };
+
+    typedef Pool::Statistics Statistics; // Usage of the pool since setup() changed the frame size
+
+    void setup(unsigned int swidth, unsigned int sheight, int sNumChannels, unsigned int numPreallocated) // Sets the frame size and preallocates frames; does nothing if the size did not change
+    {
+        pool.setup(Buffer::Layout(swidth,sheight,sNumChannels),numPreallocated);
+    }
+    Frame acquire(void) // Returns a free frame, allocating one only if all are in use; the content is undefined
+    {
+        return Frame(pool.acquire());
+    }
+    Statistics getStatistics(void) const
+    {
+        return pool.getStatistics();
+    }
+
+private:
+    Pool pool; // Frames, deleted when their last handle is released if the pool is destroyed first
+};
@@ -0,0 +1,40 @@
+/***********************************************************************
+ GradientFieldPool - Pool of immutable, versioned snapshots of the
+ gradient field handed out as reference counted handles.
+ ***********************************************************************/
+
+#include "GradientFieldPool.h"
+#include <algorithm>
+
+/***************************************
+ Methods of class GradientFieldPool::Field:
+ ***************************************/
+
+ofVec2f GradientFieldPool::Field::getGradient(int x, int y) const
+{
+    const Snapshot& snapshot=getPayload();
+    int col=std::min(std::max(x/snapshot.layout.cellSize,0),snapshot.layout.cols-1);
+    int row=std::min(std::max(y/snapshot.layout.cellSize,0),snapshot.layout.rows-1);
+    return snapshot.cells[row*snapshot.layout.cols+col];
+}
+
+/**********************************
+ Methods of class GradientFieldPool:
+ **********************************/
+
+GradientFieldPool::Field GradientFieldPool::publish(const ofVec2f* field, uint64_t version)
+{
+    Field snapshot(pool.acquire());
+
+    /* Fill the snapshot before any reader can see it: */
+    Snapshot& payload=snapshot.getPayload();
+    std::copy(field,field+payload.cells.size(),payload.cells.begin());
+    payload.version=version;
+    return snapshot;
+}
+
+size_t GradientFieldPool::getMemoryFootprint(void) const
+{
+    Snapshot::Layout layout=pool.getLayout();
+    return pool.getStatistics().numObjects*size_t(layout.cols)*size_t(layout.rows)*sizeof(ofVec2f);
+}
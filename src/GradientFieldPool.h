@@ -0,0 +1,97 @@
+/***********************************************************************
+ GradientFieldPool - Pool of immutable, versioned snapshots of the
+ gradient field handed out as reference counted handles. The filter
+ copies its live field into a free snapshot after each update and
+ publishes the handle; readers keep the snapshot alive as long as they
+ use it, so they never see a field that is being rewritten or freed,
+ and the filter never waits for them.
+ ***********************************************************************/
+
+#pragma once
+#include "ofMain.h"
+#include "RefCountedPool.h"
+#include <stdint.h>
+#include <vector>
+
+class GradientFieldPool {
+    struct Snapshot // Pooled snapshot
+    {
+        struct Layout
+        {
+            int cols, rows, cellSize; // Size of the field
+
+            Layout(int sCols=0, int sRows=0, int sCellSize=1)
+            :cols(sCols), rows(sRows), cellSize(sCellSize)
+            {
+            }
+            bool operator!=(const Layout& other) const
+            {
+                return cols!=other.cols||rows!=other.rows||cellSize!=other.cellSize;
+            }
+        };
+
+        std::vector<ofVec2f> cells; // Gradient field
+        Layout layout; // Size of the field
+        uint64_t version; // Version of the published field
+
+        void allocate(const Layout& sLayout)
+        {
+            cells.resize(size_t(sLayout.cols)*size_t(sLayout.rows));
+            layout=sLayout;
+            version=0;
+        }
+    };
+
+    typedef RefCountedPool<Snapshot> Pool;
+public:
+    class Field:public Pool::Handle // Reference counted handle to an immutable gradient field snapshot
+    {
+    public:
+        Field()
+        {
+        }
+
+        const ofVec2f* getData(void) const // Returns the cells, getCols() cells per row
+        {
+            return getPayload().cells.data();
+        }
+        int getCols(void) const
+        {
+            return getPayload().layout.cols;
+        }
+        int getRows(void) const
+        {
+            return getPayload().layout.rows;
+        }
+        int getCellSize(void) const // Returns the width and height of a cell in pixels
+        {
+            return getPayload().layout.cellSize;
+        }
+        uint64_t getVersion(void) const // Returns the version of the snapshot, increasing with each published field
+        {
+            return getPayload().version;
+        }
+        ofVec2f getGradient(int x, int y) const; // Returns the gradient of the cell containing pixel (x, y)
+
+    private:
+        friend class GradientFieldPool;
+        explicit Field(Pool::Handle&& handle)
+        :Pool::Handle(std::move(handle))
+        {
+        }
+    };
+
+    void setup(int sCols, int sRows, int sCellSize, unsigned int numPreallocated) // Sets the field size and preallocates snapshots; does nothing if the size did not change
+    {
+        pool.setup(Snapshot::Layout(sCols,sRows,sCellSize),numPreallocated);
+    }
+    Field publish(const ofVec2f* field, uint64_t version); // Copies a field of the current size into a free snapshot, allocating one only if all are in use
+    unsigned int getNumSnapshots(void) const // Returns the number of snapshots owned by the pool, in use or free
+    {
+        return pool.getStatistics().numObjects;
+    }
+    size_t getMemoryFootprint(void) const;
+
+private:
+    Pool pool; // Snapshots, deleted when their last handle is released if the pool is destroyed first
+};
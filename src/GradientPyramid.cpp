@@ -0,0 +1,344 @@
+/***********************************************************************
+ GradientPyramid - Full-resolution Sobel gradient of depth frames reduced
+ into cells of several sizes, recomputed over dirty tiles.
+ ***********************************************************************/
+
+#include "GradientPyramid.h"
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=2)
+#define GRADIENTPYRAMID_SSE2 1
+#include <emmintrin.h>
+#endif
+
+GradientPyramid::GradientPyramid()
+:width(0), height(0), tileSize(1), tilesX(0), tilesY(0), primaryLevel(0),
+ scale(1.0f), maxLength(0.0f), timeBudget(0), startRow(0), numUpdatedTiles(0), numDeferredTiles(0)
+{
+}
+
+void GradientPyramid::allocate(unsigned int swidth, unsigned int sheight, int sPrimaryCellSize)
+{
+    width=swidth;
+    height=sheight;
+    tileSize=std::max(1,sPrimaryCellSize);
+    tilesX=(width+tileSize-1)/tileSize;
+    tilesY=(height+tileSize-1)/tileSize;
+
+    /* Halve the primary cell size up to twice while it divides exactly: */
+    int finest=tileSize;
+    primaryLevel=0;
+    while(primaryLevel<2&&finest%2==0&&finest>=4)
+    {
+        finest/=2;
+        ++primaryLevel;
+    }
+
+    /* Levels from the finest cell size to twice the primary cell size: */
+    levels.clear();
+    for(int cellSize=finest;cellSize<=2*tileSize;cellSize*=2)
+    {
+        Level level;
+        level.cellSize=cellSize;
+        level.cols=width/cellSize;
+        level.rows=height/cellSize;
+        size_t numCells=size_t(level.cols)*level.rows;
+        level.sumX.assign(numCells,0);
+        level.sumY.assign(numCells,0);
+        level.count.assign(numCells,0);
+        level.field.assign(numCells,ofVec2f(0));
+        levels.push_back(level);
+    }
+
+    pending.assign(size_t(tilesX)*tilesY,1);
+    startRow=0;
+    numUpdatedTiles=0;
+    numDeferredTiles=0;
+    bandColumns.clear();
+}
+
+void GradientPyramid::setTimeBudget(uint64_t newTimeBudget)
+{
+    timeBudget=newTimeBudget;
+}
+
+uint64_t GradientPyramid::getTimeBudget(void) const
+{
+    return timeBudget;
+}
+
+ofVec2f GradientPyramid::getGradient(int x, int y, int level) const
+{
+    const Level& l=levels[level];
+    if(l.cols==0||l.rows==0)
+        return ofVec2f(0);
+    int cx=std::min(std::max(x/l.cellSize,0),l.cols-1);
+    int cy=std::min(std::max(y/l.cellSize,0),l.rows-1);
+    return l.field[cy*l.cols+cx];
+}
+
+int GradientPyramid::getNumUpdatedTiles(void) const
+{
+    return numUpdatedTiles;
+}
+
+int GradientPyramid::getNumDeferredTiles(void) const
+{
+    return numDeferredTiles;
+}
+
+size_t GradientPyramid::getMemoryFootprint(void) const
+{
+    size_t size=pending.size()+dilated.size();
+    for(size_t l=0;l<levels.size();++l)
+        size+=levels[l].field.size()*(3*sizeof(int)+sizeof(ofVec2f));
+    for(size_t b=0;b<bandColumns.size();++b)
+        size+=bandColumns[b].size()*sizeof(short);
+    return size;
+}
+
+void GradientPyramid::update(const RawDepth* frame, const DirtyTiles& dirtyTiles, float sScale, float sMaxLength, WorkerPool& workerPool)
+{
+    uint64_t startTime=ofGetElapsedTimeMicros();
+    scale=sScale;
+    maxLength=sMaxLength;
+
+    /* A pixel's Sobel response reads its neighbours: queue the dirty tiles and their neighbours: */
+    if(dirtyTiles.getTilesX()==tilesX&&dirtyTiles.getTilesY()==tilesY)
+    {
+        dirtyTiles.dilate(1,dilated);
+        for(size_t i=0;i<pending.size();++i)
+            pending[i]|=dilated[i];
+    }
+    else
+        std::fill(pending.begin(),pending.end(),1);
+
+    int numBands=std::max(1,std::min(workerPool.getNumThreads(),tilesY));
+    if(int(bandColumns.size())<numBands)
+    {
+        bandColumns.resize(numBands,std::vector<short>(size_t(width)*3));
+    }
+    std::vector<int> bandUpdated(numBands,0);
+
+    /* Recompute the pending tiles in bands of tile rows, starting at the oldest deferred row: */
+    workerPool.run(numBands,[&](int band){
+        int r0=band*tilesY/numBands;
+        int r1=(band+1)*tilesY/numBands;
+        for(int r=r0;r<r1;++r)
+        {
+            /* Defer the rest of the band once the budget is spent, but always make progress: */
+            if(r>r0&&timeBudget!=0&&ofGetElapsedTimeMicros()-startTime>timeBudget)
+                break;
+            int ty=(startRow+r)%tilesY;
+            unsigned char* rowPending=&pending[size_t(ty)*tilesX];
+            int tx=0;
+            while(tx<tilesX)
+            {
+                if(!rowPending[tx])
+                {
+                    ++tx;
+                    continue;
+                }
+                int tx0=tx;
+                while(tx<tilesX&&rowPending[tx])
+                    rowPending[tx++]=0;
+                updateTileRun(frame,ty,tx0,tx,band);
+                bandUpdated[band]+=tx-tx0;
+            }
+        }
+    });
+
+    numUpdatedTiles=0;
+    for(int b=0;b<numBands;++b)
+        numUpdatedTiles+=bandUpdated[b];
+    numDeferredTiles=int(std::count(pending.begin(),pending.end(),1));
+
+    /* Start the next update at the first deferred tile row: */
+    if(numDeferredTiles!=0)
+        for(int r=0;r<tilesY;++r)
+        {
+            int ty=(startRow+r)%tilesY;
+            if(std::find(pending.begin()+size_t(ty)*tilesX,pending.begin()+size_t(ty+1)*tilesX,1)!=pending.begin()+size_t(ty+1)*tilesX)
+            {
+                startRow=ty;
+                break;
+            }
+        }
+
+    /* The levels above the primary level span several tiles: reduce them entirely: */
+    if(numUpdatedTiles!=0)
+        for(int l=primaryLevel+1;l<int(levels.size());++l)
+        {
+            reduceCells(l,0,0,levels[l].cols,levels[l].rows);
+            updateField(l,0,0,levels[l].cols,levels[l].rows);
+        }
+}
+
+void GradientPyramid::updateTileRun(const RawDepth* frame, int ty, int tx0, int tx1, int band)
+{
+    /* Finest cells of the tiles, from the column sums of the Sobel responses: */
+    Level& f=levels[0];
+    int cs=f.cellSize;
+    int cx0=tx0*tileSize/cs, cx1=std::min(tx1*tileSize/cs,f.cols);
+    int cy0=ty*tileSize/cs, cy1=std::min((ty+1)*tileSize/cs,f.rows);
+    if(cx0<cx1&&cy0<cy1)
+    {
+        unsigned int xa=cx0*cs, xb=cx1*cs;
+        short* colX=&bandColumns[band][0];
+        short* colY=colX+width;
+        short* colN=colY+width;
+        for(int cy=cy0;cy<cy1;++cy)
+        {
+            int rowIndex=cy*f.cols;
+            for(int cx=cx0;cx<cx1;++cx)
+                f.sumX[rowIndex+cx]=f.sumY[rowIndex+cx]=f.count[rowIndex+cx]=0;
+            
+            /* Sum the rows of the cells in chunks short enough for 16-bit column sums: */
+            for(unsigned int y0=cy*cs;y0<unsigned(cy+1)*cs;y0+=maxChunkRows)
+            {
+                unsigned int y1=std::min(y0+maxChunkRows,unsigned(cy+1)*cs);
+                std::fill(colX+xa,colX+xb,0);
+                std::fill(colY+xa,colY+xb,0);
+                std::fill(colN+xa,colN+xb,0);
+                for(unsigned int y=y0;y<y1;++y)
+                    accumulateSobelRow(frame,y,xa,xb,colX,colY,colN);
+                for(int cx=cx0;cx<cx1;++cx)
+                {
+                    int sumX=0, sumY=0, count=0;
+                    for(unsigned int x=cx*cs;x<unsigned(cx+1)*cs;++x)
+                    {
+                        sumX+=colX[x];
+                        sumY+=colY[x];
+                        count+=colN[x];
+                    }
+                    f.sumX[rowIndex+cx]+=sumX;
+                    f.sumY[rowIndex+cx]+=sumY;
+                    f.count[rowIndex+cx]+=count;
+                }
+            }
+        }
+        updateField(0,cx0,cy0,cx1,cy1);
+    }
+
+    /* Levels up to the primary level lie within the tiles: */
+    for(int l=1;l<=primaryLevel;++l)
+    {
+        const Level& level=levels[l];
+        int lcx0=tx0*tileSize/level.cellSize, lcx1=std::min(tx1*tileSize/level.cellSize,level.cols);
+        int lcy0=ty*tileSize/level.cellSize, lcy1=std::min((ty+1)*tileSize/level.cellSize,level.rows);
+        if(lcx0<lcx1&&lcy0<lcy1)
+        {
+            reduceCells(l,lcx0,lcy0,lcx1,lcy1);
+            updateField(l,lcx0,lcy0,lcx1,lcy1);
+        }
+    }
+}
+
+void GradientPyramid::accumulateSobelRow(const RawDepth* frame, unsigned int y, unsigned int xa, unsigned int xb, short* colX, short* colY, short* colN) const
+{
+    /* Pixels on the frame border have no full neighbourhood: */
+    if(y==0||y+1>=height)
+        return;
+    unsigned int x=std::max(xa,1U);
+    unsigned int xEnd=std::min(xb,width-1);
+
+    const RawDepth* r0=frame+size_t(y-1)*width;
+    const RawDepth* r1=r0+width;
+    const RawDepth* r2=r1+width;
+
+#if defined(GRADIENTPYRAMID_SSE2)
+    /* Sixteen pixels at a time in 16-bit lanes: */
+    const __m128i zero=_mm_setzero_si128();
+    const __m128i one=_mm_set1_epi16(1);
+    for(;x+16<=xEnd;x+=16)
+    {
+        __m128i a00=_mm_loadu_si128(reinterpret_cast<const __m128i*>(r0+x-1));
+        __m128i a01=_mm_loadu_si128(reinterpret_cast<const __m128i*>(r0+x));
+        __m128i a02=_mm_loadu_si128(reinterpret_cast<const __m128i*>(r0+x+1));
+        __m128i a10=_mm_loadu_si128(reinterpret_cast<const __m128i*>(r1+x-1));
+        __m128i a11=_mm_loadu_si128(reinterpret_cast<const __m128i*>(r1+x));
+        __m128i a12=_mm_loadu_si128(reinterpret_cast<const __m128i*>(r1+x+1));
+        __m128i a20=_mm_loadu_si128(reinterpret_cast<const __m128i*>(r2+x-1));
+        __m128i a21=_mm_loadu_si128(reinterpret_cast<const __m128i*>(r2+x));
+        __m128i a22=_mm_loadu_si128(reinterpret_cast<const __m128i*>(r2+x+1));
+
+        /* A pixel is valid if its whole neighbourhood is: */
+        __m128i m=_mm_min_epu8(_mm_min_epu8(_mm_min_epu8(a00,a01),_mm_min_epu8(a02,a10)),_mm_min_epu8(_mm_min_epu8(a11,a12),_mm_min_epu8(a20,_mm_min_epu8(a21,a22))));
+        __m128i invalid=_mm_cmpeq_epi8(m,zero);
+
+        for(int half=0;half<2;++half)
+        {
+            __m128i w00, w01, w02, w10, w12, w20, w21, w22, inv;
+            if(half==0)
+            {
+                w00=_mm_unpacklo_epi8(a00,zero); w01=_mm_unpacklo_epi8(a01,zero); w02=_mm_unpacklo_epi8(a02,zero);
+                w10=_mm_unpacklo_epi8(a10,zero); w12=_mm_unpacklo_epi8(a12,zero);
+                w20=_mm_unpacklo_epi8(a20,zero); w21=_mm_unpacklo_epi8(a21,zero); w22=_mm_unpacklo_epi8(a22,zero);
+                inv=_mm_unpacklo_epi8(invalid,invalid);
+            }
+            else
+            {
+                w00=_mm_unpackhi_epi8(a00,zero); w01=_mm_unpackhi_epi8(a01,zero); w02=_mm_unpackhi_epi8(a02,zero);
+                w10=_mm_unpackhi_epi8(a10,zero); w12=_mm_unpackhi_epi8(a12,zero);
+                w20=_mm_unpackhi_epi8(a20,zero); w21=_mm_unpackhi_epi8(a21,zero); w22=_mm_unpackhi_epi8(a22,zero);
+                inv=_mm_unpackhi_epi8(invalid,invalid);
+            }
+            __m128i sx=_mm_add_epi16(_mm_add_epi16(_mm_sub_epi16(w02,w00),_mm_sub_epi16(w22,w20)),_mm_slli_epi16(_mm_sub_epi16(w12,w10),1));
+            __m128i top=_mm_add_epi16(_mm_add_epi16(w00,w02),_mm_slli_epi16(w01,1));
+            __m128i bottom=_mm_add_epi16(_mm_add_epi16(w20,w22),_mm_slli_epi16(w21,1));
+            __m128i sy=_mm_sub_epi16(bottom,top);
+
+            __m128i* xPtr=reinterpret_cast<__m128i*>(colX+x+8*half);
+            __m128i* yPtr=reinterpret_cast<__m128i*>(colY+x+8*half);
+            __m128i* nPtr=reinterpret_cast<__m128i*>(colN+x+8*half);
+            _mm_storeu_si128(xPtr,_mm_add_epi16(_mm_loadu_si128(xPtr),_mm_andnot_si128(inv,sx)));
+            _mm_storeu_si128(yPtr,_mm_add_epi16(_mm_loadu_si128(yPtr),_mm_andnot_si128(inv,sy)));
+            _mm_storeu_si128(nPtr,_mm_add_epi16(_mm_loadu_si128(nPtr),_mm_andnot_si128(inv,one)));
+        }
+    }
+#endif
+
+    /* Remaining pixels: */
+    for(;x<xEnd;++x)
+    {
+        if(r0[x-1]==0||r0[x]==0||r0[x+1]==0||r1[x-1]==0||r1[x]==0||r1[x+1]==0||r2[x-1]==0||r2[x]==0||r2[x+1]==0)
+            continue;
+        colX[x]+=short((r0[x+1]-r0[x-1])+2*(r1[x+1]-r1[x-1])+(r2[x+1]-r2[x-1]));
+        colY[x]+=short((r2[x-1]+2*r2[x]+r2[x+1])-(r0[x-1]+2*r0[x]+r0[x+1]));
+        ++colN[x];
+    }
+}
+
+void GradientPyramid::reduceCells(int level, int x0, int y0, int x1, int y1)
+{
+    const Level& below=levels[level-1];
+    Level& l=levels[level];
+    for(int cy=y0;cy<y1;++cy)
+        for(int cx=x0;cx<x1;++cx)
+        {
+            int i0=(2*cy)*below.cols+2*cx;
+            int i1=i0+below.cols;
+            int index=cy*l.cols+cx;
+            l.sumX[index]=below.sumX[i0]+below.sumX[i0+1]+below.sumX[i1]+below.sumX[i1+1];
+            l.sumY[index]=below.sumY[i0]+below.sumY[i0+1]+below.sumY[i1]+below.sumY[i1+1];
+            l.count[index]=below.count[i0]+below.count[i0+1]+below.count[i1]+below.count[i1+1];
+        }
+}
+
+void GradientPyramid::updateField(int level, int x0, int y0, int x1, int y1)
+{
+    /* The Sobel kernels weigh the depth difference over two pixels by 4: divide by 8 for units per pixel, pointing downhill as before: */
+    Level& l=levels[level];
+    for(int cy=y0;cy<y1;++cy)
+        for(int cx=x0;cx<x1;++cx)
+        {
+            int index=cy*l.cols+cx;
+            if(l.count[index]==0)
+                continue; // keep the last gradient of cells without valid pixels
+            float factor=-scale/(8.0f*float(l.count[index]));
+            ofVec2f gradient(float(l.sumX[index])*factor,float(l.sumY[index])*factor);
+            if(gradient.length()>maxLength)
+                gradient.scale(maxLength);
+            l.field[index]=gradient;
+        }
+}
@@ -0,0 +1,88 @@
+/***********************************************************************
+ GradientPyramid - Gradient field of depth frames normalized to the clip
+ range, at several cell sizes. A 3x3 Sobel operator is evaluated at every
+ pixel whose neighbourhood holds valid (non-zero) depth values, and the
+ per-pixel gradients are summed into cells of the finest level; each
+ coarser level sums 2x2 cells of the level below, so every level is the
+ mean full-resolution gradient over its cells. The primary cell size is
+ a tile of the dirty tile tracker: only tiles reached by changed pixels
+ are recomputed, within an optional per-frame time budget beyond which
+ the remaining tiles are deferred to the next frame.
+ ***********************************************************************/
+
+#pragma once
+#include "ofMain.h"
+#include "WorkerPool.h"
+#include "DirtyTiles.h"
+#include <vector>
+
+class GradientPyramid {
+public:
+    typedef unsigned char RawDepth; // Data type for depth values normalized to the clip range
+
+    static const unsigned int maxChunkRows=32; // Rows summed in 16-bit columns; a Sobel response is at most 4*255
+
+    GradientPyramid();
+
+    void allocate(unsigned int swidth, unsigned int sheight, int sPrimaryCellSize); // Allocates cell sizes primary/4 (or the finest exact divisor) up to 2*primary and clears the field
+    void setTimeBudget(uint64_t newTimeBudget); // Sets the time allowed to update() in microseconds, 0 for unlimited
+    uint64_t getTimeBudget(void) const;
+    void update(const RawDepth* frame, const DirtyTiles& dirtyTiles, float scale, float maxLength, WorkerPool& workerPool); // Recomputes the cells reached by dirty tiles; gradients are in depth units per pixel times scale, clamped to maxLength
+
+    int getNumLevels(void) const
+    {
+        return int(levels.size());
+    }
+    int getPrimaryLevel(void) const // Level whose cells are tiles
+    {
+        return primaryLevel;
+    }
+    int getCellSize(int level) const
+    {
+        return levels[level].cellSize;
+    }
+    int getCols(int level) const
+    {
+        return levels[level].cols;
+    }
+    int getRows(int level) const
+    {
+        return levels[level].rows;
+    }
+    ofVec2f* getField(int level) // Gradients of a level, row by row
+    {
+        return levels[level].field.data();
+    }
+    ofVec2f getGradient(int x, int y, int level) const; // Gradient of the cell of a level containing pixel (x, y)
+    int getNumUpdatedTiles(void) const; // Returns the number of tiles recomputed by the last update()
+    int getNumDeferredTiles(void) const; // Returns the number of tiles left for the next update() by the time budget
+    size_t getMemoryFootprint(void) const; // Returns the size of the pyramid in bytes
+
+private:
+    struct Level // Cells of one size
+    {
+        int cellSize; // Width and height of a cell in pixels
+        int cols, rows; // Number of cells entirely inside the frame
+        std::vector<int> sumX, sumY; // Sums of the Sobel responses of the valid pixels of each cell
+        std::vector<int> count; // Number of valid pixels of each cell
+        std::vector<ofVec2f> field; // Mean gradient of each cell, kept when the cell has no valid pixel
+    };
+
+    void updateTileRun(const RawDepth* frame, int ty, int tx0, int tx1, int band); // Recomputes tiles [tx0, tx1) of tile row ty, at levels up to the primary level
+    void accumulateSobelRow(const RawDepth* frame, unsigned int y, unsigned int xa, unsigned int xb, short* colX, short* colY, short* colN) const; // Adds the Sobel responses of the valid pixels [xa, xb) of row y to the column sums
+    void reduceCells(int level, int x0, int y0, int x1, int y1); // Sums cells [x0, x1) x [y0, y1) of a level from the level below
+    void updateField(int level, int x0, int y0, int x1, int y1); // Converts cells [x0, x1) x [y0, y1) of a level to mean gradients
+
+    unsigned int width, height; // Width and height of processed frames
+    int tileSize; // Cell size of the primary level
+    int tilesX, tilesY; // Number of tiles in each direction, as in DirtyTiles
+    int primaryLevel; // Index of the level whose cells are tiles
+    std::vector<Level> levels; // Levels from the finest to the coarsest cell size
+    float scale, maxLength; // Conversion of Sobel sums to gradients for the current update()
+    uint64_t timeBudget; // Time allowed to update() in microseconds, 0 for unlimited
+    std::vector<unsigned char> pending; // Tiles waiting to be recomputed
+    std::vector<unsigned char> dilated; // Dirty tiles dilated by the reach of the Sobel operator
+    int startRow; // Tile row processed first, rotated when tiles are deferred
+    int numUpdatedTiles, numDeferredTiles;
+    std::vector<std::vector<short> > bandColumns; // Per-band column sums of the Sobel responses and valid flags over a chunk of rows
+};
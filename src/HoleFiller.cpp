@@ -0,0 +1,248 @@
+/***********************************************************************
+ HoleFiller - Push-pull hole filling for depth frames normalized to the
+ clip range, incremental over tiles.
+ ***********************************************************************/
+
+#include "HoleFiller.h"
+#include "ofMain.h"
+#include <algorithm>
+#include <cstring>
+
+HoleFiller::HoleFiller()
+:width(0), height(0), tilesX(0), tilesY(0), historyValid(false), filledValid(false)
+{
+    std::memset(&statistics,0,sizeof(statistics));
+}
+
+void HoleFiller::allocate(unsigned int swidth, unsigned int sheight)
+{
+    width=swidth;
+    height=sheight;
+    tilesX=(width+tileSize-1)/tileSize;
+    tilesY=(height+tileSize-1)/tileSize;
+
+    /* Halve the resolution until a single cell remains, and at least up to the tile level: */
+    levels.assign(1,Level());
+    int w=width, h=height;
+    while(levels.size()<=size_t(tileLevel)||w>1||h>1)
+    {
+        w=(w+1)/2;
+        h=(h+1)/2;
+        Level level;
+        level.width=w;
+        level.height=h;
+        level.value.assign(size_t(w)*h,0.0f);
+        level.weight.assign(size_t(w)*h,0.0f);
+        level.filled.assign(size_t(w)*h,0.0f);
+        levels.push_back(level);
+    }
+
+    previousFrame.assign(size_t(width)*height,0);
+    filledFrame.assign(size_t(width)*height,0);
+    tileHoles.assign(size_t(tilesX)*tilesY,0);
+    historyValid=false;
+    filledValid=false;
+}
+
+const HoleFiller::Statistics& HoleFiller::getStatistics(void) const
+{
+    return statistics;
+}
+
+size_t HoleFiller::getMemoryFootprint(void) const
+{
+    size_t size=previousFrame.size()+filledFrame.size()+tileHoles.size()*sizeof(unsigned int);
+    for(size_t l=1;l<levels.size();++l)
+        size+=levels[l].value.size()*3*sizeof(float);
+    return size;
+}
+
+void HoleFiller::fill(RawDepth* frame)
+{
+    uint64_t fillStartTime=ofGetElapsedTimeMicros();
+    statistics.numChangedTiles=0;
+
+    /* Push the tiles that changed since the last frame: */
+    for(int ty=0;ty<tilesY;++ty)
+        for(int tx=0;tx<tilesX;++tx)
+        {
+            unsigned int x0=tx*tileSize, x1=std::min(x0+tileSize,width);
+            unsigned int y0=ty*tileSize, y1=std::min(y0+tileSize,height);
+            bool changed=!historyValid;
+            for(unsigned int y=y0;y<y1&&!changed;++y)
+                changed=std::memcmp(frame+y*width+x0,&previousFrame[y*width+x0],x1-x0)!=0;
+            if(changed)
+            {
+                for(unsigned int y=y0;y<y1;++y)
+                    std::memcpy(&previousFrame[y*width+x0],frame+y*width+x0,x1-x0);
+                pushTile(frame,tx,ty);
+                ++statistics.numChangedTiles;
+            }
+        }
+
+    statistics.numHoles=0;
+    statistics.numHoleTiles=0;
+    for(size_t t=0;t<tileHoles.size();++t)
+        if(tileHoles[t]!=0)
+        {
+            statistics.numHoles+=tileHoles[t];
+            ++statistics.numHoleTiles;
+        }
+
+    if(statistics.numChangedTiles!=0&&statistics.numHoles!=0)
+    {
+        /* The levels above the tile level depend on every tile: push them entirely: */
+        int top=int(levels.size())-1;
+        for(int l=tileLevel+1;l<=top;++l)
+            pushLevel(l,0,0,levels[l].width,levels[l].height);
+        
+        /* Leave the holes at 0 if the frame has no valid pixel at all: */
+        filledValid=levels[top].weight[0]>0.0f;
+        if(filledValid)
+        {
+            /* Pull the levels above the tile level entirely: */
+            for(int l=top;l>tileLevel;--l)
+                pullLevel(l,0,0,levels[l].width,levels[l].height);
+            
+            /* Pull the tile levels down to the pixels, only in tiles containing holes: */
+            for(int l=tileLevel;l>=0;--l)
+                for(int ty=0;ty<tilesY;++ty)
+                    for(int tx=0;tx<tilesX;++tx)
+                        if(tileHoles[ty*tilesX+tx]!=0)
+                        {
+                            int shift=tileLevel-l;
+                            int lw=l==0?int(width):levels[l].width;
+                            int lh=l==0?int(height):levels[l].height;
+                            pullLevel(l,tx<<shift,ty<<shift,std::min((tx+1)<<shift,lw),std::min((ty+1)<<shift,lh));
+                        }
+        }
+    }
+    historyValid=true;
+
+    /* Copy the filled values into the holes of the frame: */
+    if(statistics.numHoles!=0&&filledValid)
+        for(int ty=0;ty<tilesY;++ty)
+            for(int tx=0;tx<tilesX;++tx)
+                if(tileHoles[ty*tilesX+tx]!=0)
+                {
+                    unsigned int x0=tx*tileSize, x1=std::min(x0+tileSize,width);
+                    unsigned int y0=ty*tileSize, y1=std::min(y0+tileSize,height);
+                    for(unsigned int y=y0;y<y1;++y)
+                    {
+                        RawDepth* rowPtr=frame+y*width;
+                        const RawDepth* filledPtr=&filledFrame[y*width];
+                        for(unsigned int x=x0;x<x1;++x)
+                            if(rowPtr[x]==0)
+                                rowPtr[x]=filledPtr[x];
+                    }
+                }
+
+    statistics.fillTime=ofGetElapsedTimeMicros()-fillStartTime;
+}
+
+void HoleFiller::pushTile(const RawDepth* frame, int tx, int ty)
+{
+    /* Level 1 from the pixels, counting the holes: */
+    unsigned int numHoles=0;
+    Level& l1=levels[1];
+    int cx0=tx*(tileSize/2), cx1=std::min(cx0+tileSize/2,l1.width);
+    int cy0=ty*(tileSize/2), cy1=std::min(cy0+tileSize/2,l1.height);
+    for(int cy=cy0;cy<cy1;++cy)
+        for(int cx=cx0;cx<cx1;++cx)
+        {
+            float sum=0.0f, weight=0.0f;
+            for(unsigned int y=cy*2;y<std::min(unsigned(cy*2+2),height);++y)
+                for(unsigned int x=cx*2;x<std::min(unsigned(cx*2+2),width);++x)
+                {
+                    RawDepth value=frame[y*width+x];
+                    if(value!=0)
+                    {
+                        sum+=value;
+                        weight+=1.0f;
+                    }
+                    else
+                        ++numHoles;
+                }
+            int index=cy*l1.width+cx;
+            l1.value[index]=weight>0.0f?sum/weight:0.0f;
+            l1.weight[index]=std::min(weight,1.0f);
+        }
+    tileHoles[ty*tilesX+tx]=numHoles;
+
+    /* Levels 2 to the tile level: */
+    for(int l=2;l<=tileLevel;++l)
+    {
+        int cells=tileSize>>l;
+        pushLevel(l,tx*cells,ty*cells,std::min((tx+1)*cells,levels[l].width),std::min((ty+1)*cells,levels[l].height));
+    }
+}
+
+void HoleFiller::pushLevel(int level, int x0, int y0, int x1, int y1)
+{
+    const Level& below=levels[level-1];
+    Level& l=levels[level];
+    for(int cy=y0;cy<y1;++cy)
+        for(int cx=x0;cx<x1;++cx)
+        {
+            float sum=0.0f, weight=0.0f;
+            for(int y=cy*2;y<std::min(cy*2+2,below.height);++y)
+                for(int x=cx*2;x<std::min(cx*2+2,below.width);++x)
+                {
+                    int index=y*below.width+x;
+                    sum+=below.value[index]*below.weight[index];
+                    weight+=below.weight[index];
+                }
+            int index=cy*l.width+cx;
+            l.value[index]=weight>0.0f?sum/weight:0.0f;
+            l.weight[index]=std::min(weight,1.0f);
+        }
+}
+
+void HoleFiller::pullLevel(int level, int x0, int y0, int x1, int y1)
+{
+    int top=int(levels.size())-1;
+    if(level==0)
+    {
+        /* Pixels: interpolate the holes only: */
+        for(int y=y0;y<y1;++y)
+            for(int x=x0;x<x1;++x)
+            {
+                size_t index=size_t(y)*width+x;
+                if(previousFrame[index]==0)
+                    filledFrame[index]=RawDepth(std::min(std::max(upsample(0,x,y)+0.5f,1.0f),254.0f));
+            }
+        return;
+    }
+
+    Level& l=levels[level];
+    for(int y=y0;y<y1;++y)
+        for(int x=x0;x<x1;++x)
+        {
+            int index=y*l.width+x;
+            float weight=l.weight[index];
+            if(weight>=1.0f)
+                continue; // filledValue() returns the pushed value
+            float parent=level<top?upsample(level,x,y):0.0f;
+            l.filled[index]=l.value[index]*weight+parent*(1.0f-weight);
+        }
+}
+
+float HoleFiller::filledValue(const Level& l, int index) const
+{
+    return l.weight[index]>=1.0f?l.value[index]:l.filled[index];
+}
+
+float HoleFiller::upsample(int level, int x, int y) const
+{
+    const Level& parent=levels[level+1];
+
+    /* Parent cells surrounding the cell center, weighted 3/4 and 1/4 in each direction: */
+    int px0=x>>1, py0=y>>1;
+    int px1=(x&1)?std::min(px0+1,parent.width-1):std::max(px0-1,0);
+    int py1=(y&1)?std::min(py0+1,parent.height-1):std::max(py0-1,0);
+    float v00=filledValue(parent,py0*parent.width+px0);
+    float v01=filledValue(parent,py0*parent.width+px1);
+    float v10=filledValue(parent,py1*parent.width+px0);
+    float v11=filledValue(parent,py1*parent.width+px1);
+    return (v00*0.75f+v01*0.25f)*0.75f+(v10*0.75f+v11*0.25f)*0.25f;
+}
@@ -0,0 +1,63 @@
+/***********************************************************************
+ HoleFiller - Push-pull hole filling for depth frames normalized to the
+ clip range, where 0 marks pixels without a stable depth value.
+ The push phase averages valid pixels into a pyramid of half-resolution
+ levels; the pull phase fills holes from the level above by bilinear
+ interpolation. The frame is divided in tiles matching one cell of the
+ tile level: only tiles whose pixels changed since the last frame are
+ pushed again, only tiles containing holes are pulled, and nothing is
+ recomputed when the frame did not change.
+ ***********************************************************************/
+
+#pragma once
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+class HoleFiller {
+public:
+    typedef unsigned char RawDepth; // Data type for depth values normalized to the clip range
+
+    static const int tileLevel=5; // Pyramid level of which one cell covers a tile
+    static const int tileSize=1<<tileLevel; // Width and height of a tile in pixels
+
+    struct Statistics // Cost of the last call to fill()
+    {
+        unsigned int numHoles; // Number of filled pixels
+        unsigned int numHoleTiles; // Number of tiles containing holes
+        unsigned int numChangedTiles; // Number of tiles pushed again
+        uint64_t fillTime; // Time spent in fill(), in microseconds
+    };
+
+    HoleFiller();
+
+    void allocate(unsigned int swidth, unsigned int sheight); // Allocates the pyramid and clears the frame history
+    void fill(RawDepth* frame); // Replaces the 0 pixels of the frame by values interpolated from their valid surroundings
+    const Statistics& getStatistics(void) const; // Returns the cost of the last call to fill()
+    size_t getMemoryFootprint(void) const; // Returns the size of the pyramid and frame history in bytes
+
+private:
+    struct Level // One level of the pyramid
+    {
+        int width, height;
+        std::vector<float> value; // Weighted mean of the valid pixels below each cell
+        std::vector<float> weight; // Fraction of the cell covered by valid pixels, clamped to 1
+        std::vector<float> filled; // Value after the pull phase, for cells with weight<1
+    };
+
+    void pushTile(const RawDepth* frame, int tx, int ty); // Recomputes the fine levels and the hole count of a tile
+    void pushLevel(int level, int x0, int y0, int x1, int y1); // Recomputes cells [x0, x1) x [y0, y1) of a level above 1 from the level below
+    void pullLevel(int level, int x0, int y0, int x1, int y1); // Fills cells [x0, x1) x [y0, y1) of a level from the level above
+    float upsample(int level, int x, int y) const; // Bilinear interpolation of the filled level+1 at the center of cell (x, y) of level
+    float filledValue(const Level& l, int index) const; // Value of a cell after the pull phase
+
+    unsigned int width, height; // Width and height of processed frames
+    int tilesX, tilesY; // Number of tiles in each direction
+    std::vector<Level> levels; // Pyramid levels 1 (half resolution) to the 1x1 top level; index 0 is unused
+    std::vector<RawDepth> previousFrame; // Unfilled frame of the last call, to find changed tiles
+    std::vector<RawDepth> filledFrame; // Filled frame of the last call, reused for unchanged frames
+    std::vector<unsigned int> tileHoles; // Number of holes in each tile
+    bool historyValid; // Flag whether previousFrame holds the last frame
+    bool filledValid; // Flag whether filledFrame holds the holes of the last frame filled
+    Statistics statistics;
+};
@@ -0,0 +1,99 @@
+/***********************************************************************
+ KinectDepthSource - Depth source reading a kinect through ofxKinect.
+ ***********************************************************************/
+
+#include "KinectDepthSource.h"
+
+bool KinectDepthSource::open(void)
+{
+    return open(-1);
+}
+
+bool KinectDepthSource::open(int deviceIndex)
+{
+    kinect.init();
+    kinect.setRegistration(true);
+    kinect.open(deviceIndex);
+    kinect.setUseTexture(false);
+    kinect.setDepthClipping(nearclip, farclip);
+    resetFrameTiming();
+    if(!kinect.isConnected())
+    {
+        ofLog(OF_LOG_ERROR, "KinectDepthSource: no kinect connected");
+        return false;
+    }
+    return true;
+}
+
+std::string KinectDepthSource::getName(void) const
+{
+    return "kinect";
+}
+
+bool KinectDepthSource::isOpen(void) const
+{
+    return kinect.isConnected();
+}
+
+void KinectDepthSource::close(void)
+{
+    kinect.close();
+}
+
+unsigned int KinectDepthSource::getWidth(void) const
+{
+    return (unsigned int)kinect.getWidth();
+}
+
+unsigned int KinectDepthSource::getHeight(void) const
+{
+    return (unsigned int)kinect.getHeight();
+}
+
+DepthSource::Intrinsics KinectDepthSource::getIntrinsics(void) const
+{
+    /* The registration parameters are only known once the device is open: */
+    Intrinsics intrinsics=getNominalIntrinsics(getWidth(), getHeight());
+    float pixelSize=kinect.getZeroPlanePixelSize();
+    if(isOpen()&&pixelSize>0.0f)
+        intrinsics.fx=intrinsics.fy=kinect.getZeroPlaneDistance()/(2.0f*pixelSize)*float(getWidth())/640.0f;
+    return intrinsics;
+}
+
+bool KinectDepthSource::hasColor(void) const
+{
+    return true;
+}
+
+void KinectDepthSource::setDepthClipping(float snearclip, float sfarclip)
+{
+    /* ofxKinect maps its 8-bit depth itself: */
+    nearclip=snearclip;
+    farclip=sfarclip;
+    kinect.setDepthClipping(snearclip, sfarclip);
+}
+
+bool KinectDepthSource::update(void)
+{
+    /* ofxKinect does not signal new frames, so the grabber wakes when the next one is predicted: */
+    kinect.update();
+    if(!kinect.isFrameNew())
+        return false;
+    frameArrived();
+    return true;
+}
+
+const ofShortPixels& KinectDepthSource::getRawDepthPixels(void)
+{
+    return kinect.getRawDepthPixels();
+}
+
+const ofPixels& KinectDepthSource::getDepthPixels(void)
+{
+    return kinect.getDepthPixels();
+}
+
+const ofPixels& KinectDepthSource::getColorPixels(void)
+{
+    return kinect.getPixels();
+}
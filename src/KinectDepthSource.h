@@ -0,0 +1,36 @@
+/***********************************************************************
+ KinectDepthSource - Depth source reading a kinect through ofxKinect,
+ with depth registered to the color camera. Frames are ofxKinect's own
+ buffers, handed out without copying.
+ ***********************************************************************/
+
+#pragma once
+#include "DepthSource.h"
+#include "ofxKinect.h"
+
+class KinectDepthSource: public DepthSource {
+public:
+    bool open(void); // Opens the first kinect; returns false if none is connected
+    bool open(int deviceIndex); // Opens the kinect of the given index, -1 for the first one available
+
+    virtual std::string getName(void) const;
+    virtual bool isOpen(void) const;
+    virtual void close(void);
+    virtual unsigned int getWidth(void) const;
+    virtual unsigned int getHeight(void) const;
+    virtual Intrinsics getIntrinsics(void) const; // Derived from the kinect's registration parameters when connected
+    virtual bool hasColor(void) const;
+    virtual void setDepthClipping(float snearclip, float sfarclip);
+    virtual bool update(void);
+    virtual const ofShortPixels& getRawDepthPixels(void);
+    virtual const ofPixels& getDepthPixels(void);
+    virtual const ofPixels& getColorPixels(void);
+
+    ofxKinect& getKinect(void) // Returns the driver, for the projector calibration
+    {
+        return kinect;
+    }
+
+private:
+    ofxKinect kinect;
+};
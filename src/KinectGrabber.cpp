@@ -6,10 +6,27 @@
  */
 
 #include "KinectGrabber.h"
+#include "DepthPlayback.h"
 #include "ofConstants.h"
+#include <algorithm>
+#include <chrono>
+#ifndef TARGET_WIN32
+#include <time.h>
+#endif
+
+/* CPU time consumed by the calling thread in seconds, or -1 if unavailable: */
+static double getThreadCpuTime(){
+#if defined(CLOCK_THREAD_CPUTIME_ID)
+    timespec ts;
+    if(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+        return double(ts.tv_sec)+double(ts.tv_nsec)*1.0e-9;
+#endif
+    return -1.0;
+}
 
 KinectGrabber::KinectGrabber()
-:newFrame(true){
+:nextSequence(0), pollInterval(2000), cpuTimeAtStart(0.0), source(&kinectSource), recording(false), runSensors(false), minNumSamples(0), maxVariance(0), hysteresis(0.0f), newFrame(true){
+    resetStatistics();
 	// start the thread as soon as the
 	// class is created, it won't use any CPU
 	// until we send a new frame to be analyzed
@@ -22,7 +39,12 @@ KinectGrabber::~KinectGrabber(){
 	// the thread to finish
     //	toAnalyze.close();
     //	analyzed.close();
-	waitForThread(true);
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopThread();
+    }
+    sleepCond.notify_all();
+	waitForThread(false);
 }
 
 void KinectGrabber::setup(){
@@ -31,20 +53,104 @@ void KinectGrabber::setup(){
     //	// we want to update the grabber while analyzing
     //    // previous frames
     
+    kinectSource.open();
+    fusionSensors.clear();
+    customSource.reset();
+    source = &kinectSource;
+    setupFrameSize(source->getWidth(), source->getHeight());
+}
+
+bool KinectGrabber::setup(DepthSource* newSource){
+    std::unique_ptr<DepthSource> newCustomSource(newSource);
+    if (newSource == 0 || !newSource->isOpen())
+        return false;
+    fusionSensors.clear();
+    customSource = std::move(newCustomSource);
+    source = customSource.get();
+    setupFrameSize(source->getWidth(), source->getHeight());
+    DepthSource::Intrinsics intrinsics = source->getIntrinsics();
+    std::cout<< "KinectGrabber: reading frames from the " << source->getName() << " source, " << source->getWidth() << "x" << source->getHeight() << ", focal length " << intrinsics.fx <<std::endl;
+    return true;
+}
+
+bool KinectGrabber::setupPlayback(const std::string& fileName, bool realTime, bool loop){
+    DepthPlayback* playback = new DepthPlayback;
+    if (!playback->open(fileName)) {
+        delete playback;
+        return false;
+    }
+    playback->setRealTime(realTime);
+    playback->setLoop(loop);
+    return setup(playback);
+}
+
+bool KinectGrabber::setupFusion(const std::vector<DepthSource*>& otherSources, const std::vector<DepthFusion::Pose>& poses, float referenceDepth){
+    std::vector<std::unique_ptr<DepthSource> > newSources;
+    bool ready = source->isOpen() && poses.size() > otherSources.size();
+    for (size_t i = 0; i < otherSources.size(); ++i) {
+        newSources.emplace_back(otherSources[i]);
+        if (otherSources[i] == 0 || !otherSources[i]->isOpen())
+            ready = false;
+    }
+    if (!ready) {
+        ofLog(OF_LOG_ERROR, "KinectGrabber: cannot fuse the sensors, a source is not open or has no pose");
+        return false;
+    }
+    
+    // the primary source stays the grabber's, the others belong to their sensor
+    fusionSensors.clear();
+    std::vector<unsigned int> widths, heights;
+    std::vector<DepthSource::Intrinsics> intrinsics;
+    std::vector<DepthFusion::Pose> sensorPoses;
+    for (size_t i = 0; i <= otherSources.size(); ++i) {
+        fusionSensors.emplace_back(new FusionSensor);
+        FusionSensor& sensor = *fusionSensors.back();
+        if (i == 0) {
+            sensor.source = source;
+        } else {
+            sensor.ownedSource = std::move(newSources[i-1]);
+            sensor.source = sensor.ownedSource.get();
+        }
+        sensor.intrinsics = sensor.source->getIntrinsics();
+        sensor.pose = poses[i];
+        widths.push_back(sensor.source->getWidth());
+        heights.push_back(sensor.source->getHeight());
+        intrinsics.push_back(sensor.intrinsics);
+        sensorPoses.push_back(sensor.pose);
+    }
+    
+    // the heightmap has the primary sensor's frame size, so the filter and the calibration frames share it
+    fusion.setup(DepthFusion::fitGrid(kinectWidth, kinectHeight, widths, heights, intrinsics, sensorPoses, referenceDepth));
+    fusedDepth.allocate(kinectWidth, kinectHeight, 1);
+    fusedDepth.set(0);
+    std::cout<< "KinectGrabber: fusing " << fusionSensors.size() << " sensors into a " << kinectWidth << "x" << kinectHeight << " heightmap of " << fusion.getGrid().cellSize << " mm cells" <<std::endl;
+    return true;
+}
+
+bool KinectGrabber::isFusing() const{
+    return !fusionSensors.empty();
+}
+
+DepthFusion& KinectGrabber::getFusion(){
+    return fusion;
+}
+
+DepthSource& KinectGrabber::getSource(){
+    return *source;
+}
+
+ofxKinect& KinectGrabber::getKinect(){
+    return kinectSource.getKinect();
+}
+
+void KinectGrabber::setupFrameSize(int width, int height){
 	// settings and defaults
 	enableCalibration = false;
 	enableTestmode	  = true;
-	storedframes = 0;
     //    storedcoloredframes = 0;
     
-    kinect.init();
-    kinect.setRegistration(true);
-    kinect.open();
-    kinect.setUseTexture(false);
-    kinectWidth = kinect.getWidth();
-    kinectHeight = kinect.getHeight();
-    kinectDepthImage.allocate(kinectWidth, kinectHeight);
-    kinectDepthImage.setUseTexture(false);
+    kinectWidth = width;
+    kinectHeight = height;
     kinectColorImage.allocate(kinectWidth, kinectHeight);
     kinectColorImage.setUseTexture(false);
 }
@@ -52,8 +158,24 @@ void KinectGrabber::setup(){
 void KinectGrabber::setupFramefilter(int sNumAveragingSlots, unsigned int newMinNumSamples, unsigned int newMaxVariance, float newHysteresis, bool newSpatialFilter, int gradFieldresolution, float snearclip, float sfarclip) {
     nearclip =snearclip;
     farclip =sfarclip;
-    kinect.setDepthClipping(snearclip, sfarclip);
-    framefilter.setup(kinectWidth, kinectHeight, sNumAveragingSlots, newMinNumSamples, newMaxVariance, newHysteresis, newSpatialFilter, gradFieldresolution, snearclip, sfarclip, &kinect);
+    source->setDepthClipping(snearclip, sfarclip);
+    if (!source->isOpen())
+        ofLog(OF_LOG_ERROR, "Please open the depth source prior to setting the Framefilter");
+    framefilter.setup(kinectWidth, kinectHeight, sNumAveragingSlots, newMinNumSamples, newMaxVariance, newHysteresis, newSpatialFilter, gradFieldresolution, snearclip, sfarclip);
+    minNumSamples = newMinNumSamples;
+    maxVariance = newMaxVariance;
+    hysteresis = newHysteresis;
+    
+    // fused sensors filter their depth in millimeters over time, each with a share of the cores
+    int numSensorThreads = std::max(1, int(std::thread::hardware_concurrency())/std::max(1, int(fusionSensors.size())));
+    for (size_t i = 0; i < fusionSensors.size(); ++i) {
+        FusionSensor& sensor = *fusionSensors[i];
+        sensor.framefilter.setDepthMode(FrameFilter::RAW_DEPTH);
+        sensor.framefilter.setFilterMode(framefilter.getFilterMode());
+        sensor.framefilter.setup(sensor.source->getWidth(), sensor.source->getHeight(), sNumAveragingSlots, newMinNumSamples, newMaxVariance, newHysteresis, false, gradFieldresolution, snearclip, sfarclip);
+        sensor.framefilter.setNumThreads(numSensorThreads);
+    }
+    updateSensorStability();
     // framefilter.startThread();
 }
 
@@ -67,7 +189,37 @@ void KinectGrabber::setupClip(float snearclip, float sfarclip){
     //    }
     nearclip =snearclip;
     farclip =sfarclip;
-    kinect.setDepthClipping(snearclip, sfarclip);
+    source->setDepthClipping(snearclip, sfarclip);
+}
+
+void KinectGrabber::setDepthRange(float snearclip, float sfarclip){
+    nearclip = snearclip;
+    farclip = sfarclip;
+    source->setDepthClipping(snearclip, sfarclip);
+    // normalized statistics are remapped to the new range, raw depth in millimeters does not depend on it
+    framefilter.setDepthRange(snearclip, sfarclip);
+    updateSensorStability();
+}
+
+size_t KinectGrabber::getNumSensors() const{
+    return fusionSensors.size();
+}
+
+const FrameFilter& KinectGrabber::getSensorFilter(size_t sensor) const{
+    return fusionSensors[sensor]->framefilter;
+}
+
+void KinectGrabber::updateSensorStability(){
+    // the sensors test stability in millimeters, the main filter in units of its input depth:
+    // a unit of normalized depth is a 255th of the clip range, so the criterion follows the range
+    float step = framefilter.getDepthMode() == FrameFilter::RAW_DEPTH ? 1.0f : (farclip-nearclip)/255.0f;
+    unsigned int sensorMaxVariance = std::max(1U, (unsigned int)(float(maxVariance)*step*step+0.5f));
+    for (size_t i = 0; i < fusionSensors.size(); ++i) {
+        FusionSensor& sensor = *fusionSensors[i];
+        std::lock_guard<std::mutex> lock(sensor.filterMutex);
+        sensor.framefilter.setStableParameters(minNumSamples, sensorMaxVariance);
+        sensor.framefilter.setHysteresis(hysteresis*step);
+    }
 }
 
 void KinectGrabber::setTestmode(){
@@ -85,6 +237,158 @@ bool KinectGrabber::isFrameNew(){
 	return newFrame;
 }
 
+const KinectGrabber::FilteredFrame* KinectGrabber::receiveFilteredFrame(){
+    if (!filtered.tryConsume())
+        return 0;
+    const FilteredFrame& frame = filtered.getFrontBuffer();
+    float latency = float(ofGetElapsedTimeMicros()-frame.arrivalTime);
+    latencySum += latency;
+    ++numLatencies;
+    maxLatency = std::max(maxLatency, latency);
+    return &frame;
+}
+
+void KinectGrabber::setPollInterval(int newPollIntervalMicros){
+    pollInterval = std::max(100, newPollIntervalMicros);
+}
+
+KinectGrabber::Statistics KinectGrabber::getStatistics(){
+    Statistics s;
+    s.numProduced = filtered.getNumProduced()-statisticsBase.numProduced;
+    s.numConsumed = filtered.getNumConsumed()-statisticsBase.numConsumed;
+    s.numDropped = filtered.getNumDropped()-statisticsBase.numDropped;
+    s.numIdleWaits = numIdleWaits-statisticsBase.numIdleWaits;
+    s.cpuUsage = cpuUsage;
+    s.meanLatency = numLatencies != 0 ? float(latencySum/numLatencies) : 0.0f;
+    s.maxLatency = maxLatency;
+    return s;
+}
+
+void KinectGrabber::resetStatistics(){
+    statisticsBase.numProduced = filtered.getNumProduced();
+    statisticsBase.numConsumed = filtered.getNumConsumed();
+    statisticsBase.numDropped = filtered.getNumDropped();
+    statisticsBase.numIdleWaits = numIdleWaits;
+    latencySum = 0.0;
+    numLatencies = 0;
+    maxLatency = 0.0f;
+    cpuUsage = -1.0f;
+    statisticsStartTime = ofGetElapsedTimeMicros();
+    resetCpuTime = true;
+}
+
+void KinectGrabber::printStatistics(){
+    Statistics s = getStatistics();
+    std::cout<< "KinectGrabber: " << s.numProduced << " frames produced, " << s.numConsumed << " consumed, " << s.numDropped << " dropped, " << s.numIdleWaits << " idle waits" <<std::endl;
+    if (s.cpuUsage >= 0.0f)
+        std::cout<< "  CPU usage: " << s.cpuUsage*100.0f << "% of a core" <<std::endl;
+    std::cout<< "  Latency from arrival to consumption: mean " << s.meanLatency << " us, max " << s.maxLatency << " us" <<std::endl;
+}
+
+void KinectGrabber::startRecording(const std::string& fileName, bool withColor, bool compressed, int numEncoderThreads){
+    RecordingRequest request;
+    request.fileName = fileName;
+    request.withColor = withColor;
+    request.compressed = compressed;
+    request.numEncoderThreads = numEncoderThreads;
+    recordingchannel.send(request);
+}
+
+void KinectGrabber::stopRecording(){
+    RecordingRequest request;
+    request.withColor = false;
+    request.compressed = false;
+    request.numEncoderThreads = 0;
+    recordingchannel.send(request);
+}
+
+bool KinectGrabber::isRecording() const{
+    return recording;
+}
+
+void KinectGrabber::updateCpuUsage(){
+    double cpuTime = getThreadCpuTime();
+    if (cpuTime < 0.0)
+        return;
+    if (resetCpuTime.exchange(false))
+        cpuTimeAtStart = cpuTime;
+    uint64_t wallTime = ofGetElapsedTimeMicros()-statisticsStartTime;
+    if (wallTime > 0)
+        cpuUsage = float((cpuTime-cpuTimeAtStart)*1.0e6/double(wallTime));
+}
+
+void KinectGrabber::waitForFrame(){
+    // sources don't signal new frames: sleep until the next frame is due,
+    // checking at the poll interval only while it is overdue or its time
+    // unknown, and waking early on shutdown
+    uint64_t wait = source->isFinished() ? 100000 : source->getTimeToNextFrame();
+    if (wait == 0)
+        wait = pollInterval.load();
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    if (!isThreadRunning())
+        return;
+    ++numIdleWaits;
+    sleepCond.wait_for(lock, std::chrono::microseconds(std::min<uint64_t>(wait, 100000)));
+}
+
+const ofShortPixels& KinectGrabber::fuseSensors(const ofShortPixels& primaryDepth){
+    // the primary sensor is splatted on the grabber thread, the others on their own threads
+    FusionSensor& primary = *fusionSensors[0];
+    fusion.splat(primaryDepth.getData(), primary.source->getWidth(), primary.source->getHeight(), primary.intrinsics, primary.pose, primary.layers.getBackBuffer());
+    primary.layers.publish();
+    
+    // blend the latest frame of each sensor; a sensor keeps its last frame until it delivers a new one
+    fusionLayers.clear();
+    for (size_t i = 0; i < fusionSensors.size(); ++i) {
+        fusionSensors[i]->layers.tryConsume();
+        const DepthFusion::Layer& layer = fusionSensors[i]->layers.getFrontBuffer();
+        if (!layer.depth.empty())
+            fusionLayers.push_back(&layer);
+    }
+    fusion.fuse(fusionLayers, fusedDepth.getData());
+    return fusedDepth;
+}
+
+void KinectGrabber::startSensors(){
+    runSensors = true;
+    for (size_t i = 1; i < fusionSensors.size(); ++i)
+        fusionSensors[i]->thread = std::thread(&KinectGrabber::sensorThreadFunction, this, fusionSensors[i].get());
+}
+
+void KinectGrabber::stopSensors(){
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        runSensors = false;
+    }
+    sleepCond.notify_all();
+    for (size_t i = 1; i < fusionSensors.size(); ++i) {
+        if (fusionSensors[i]->thread.joinable())
+            fusionSensors[i]->thread.join();
+        fusionSensors[i]->source->close();
+    }
+}
+
+void KinectGrabber::sensorThreadFunction(FusionSensor* sensor){
+    // the sensor's frames are filtered and splatted on this thread,
+    // the grabber thread only blends the latest layer of each sensor
+    while (runSensors) {
+        if (!sensor->source->update()) {
+            uint64_t wait = sensor->source->getTimeToNextFrame();
+            if (wait == 0)
+                wait = pollInterval.load();
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            if (runSensors)
+                sleepCond.wait_for(lock, std::chrono::microseconds(std::min<uint64_t>(wait, 100000)));
+            continue;
+        }
+        std::unique_lock<std::mutex> filterLock(sensor->filterMutex);
+        const ofShortPixels& depth = sensor->framefilter.filterTemporal(sensor->source->getRawDepthPixels());
+        filterLock.unlock();
+        fusion.splat(depth.getData(), sensor->source->getWidth(), sensor->source->getHeight(), sensor->intrinsics, sensor->pose, sensor->layers.getBackBuffer());
+        sensor->layers.publish();
+    }
+}
+
 //ofPixels KinectGrabber::convertProjSpace(ofPixels inputframe){
 //    // Create a new output frame: */
 //    ofPixels newOutputFrame;
@@ -147,10 +451,11 @@ bool KinectGrabber::isFrameNew(){
 //    //}
 
 void KinectGrabber::threadedFunction(){
-    // wait until there's a new frame
-    // this blocks the thread, so it doesn't use
-    // the CPU at all, until a frame arrives.
-    // also receive doesn't allocate or make any copies
+    // the thread sleeps until the source's next frame is due, so it
+    // doesn't use the CPU while nothing arrives, and publishes frames
+    // to a latest-wins mailbox: it never waits for the application
+    bool reportedEnd = false;
+    startSensors();
 	while(isThreadRunning()) {
         
         //Update clipping planes of kinect if needed
@@ -159,62 +464,116 @@ void KinectGrabber::threadedFunction(){
         if(nearclipchannel.tryReceive(snearclip) || farclipchannel.tryReceive(sfarclip)) {
             while(nearclipchannel.tryReceive(snearclip) || farclipchannel.tryReceive(sfarclip)) {
             } // clear queue
-            kinect.setDepthClipping(snearclip, sfarclip);
-            framefilter.setDepthRange(snearclip, sfarclip);
-            framefilter.resetBuffers();
+            setDepthRange(snearclip, sfarclip);
         }
 
+        // Start or stop recording
+        RecordingRequest request;
+        while (recordingchannel.tryReceive(request)) {
+            if (request.fileName.empty()) {
+                recorder.close();
+            } else {
+                recorder.setCompression(request.compressed, request.numEncoderThreads);
+                recorder.open(request.fileName, kinectWidth, kinectHeight, request.withColor && source->hasColor(), source->getIntrinsics());
+            }
+            recording = recorder.isOpen();
+        }
+        
+        updateCpuUsage();
+        
         newFrame = false;
-        if (storedframes == 0)
-        {
-            // If new image in kinect => send to filter thread
-            kinect.update();
-            
-            if(kinect.isFrameNew()){
-                newFrame = true;
-                //		kinectColorImage.setFromPixels(kinect.getPixels());
-                kinectDepthImage.setFromPixels(kinect.getDepthPixels());
-                //		kinectColoredDepth.setFromPixels(kinectDepthImage.getPixels());
-                
-                if (enableCalibration) {
-                    kinectColorImage.setFromPixels(kinect.getPixels());
-                    // If new filtered image => send back to main thread
+        uint64_t updateStartTime = ofGetElapsedTimeMicros();
+        if (!source->update()) {
+            if (source->isFinished() && !reportedEnd) {
+                std::cout<< "KinectGrabber: the " << source->getName() << " source has no more frames" <<std::endl;
+                printStatistics();
+                reportedEnd = true;
+            }
+            waitForFrame();
+            continue;
+        }
+        
+        newFrame = true;
+        uint64_t arrivalTime = ofGetElapsedTimeMicros();
+        const ofShortPixels& rawDepthPixels = source->getRawDepthPixels();
+        const ofPixels& colorPixels = source->getColorPixels();
+        if (recorder.isOpen()) {
+            // a failed write closes the recording
+            recorder.addFrame(rawDepthPixels.getData(), colorPixels.getData(), arrivalTime, nearclip, farclip);
+            recording = recorder.isOpen();
+        }
+        //		kinectColorImage.setFromPixels(kinect.getPixels());
+        //		kinectColoredDepth.setFromPixels(kinectDepthImage.getPixels());
+        
+        if (enableCalibration) {
+            kinectColorImage.setFromPixels(colorPixels);
+            // The unfiltered depth goes through a pooled frame, the only copy of the frame
+            FilteredFrame& out = filtered.getBackBuffer();
+            out.frame = framefilter.getFramePool().acquire();
+            out.frame.getPixels().setFromPixels(source->getDepthPixels().getData(), kinectWidth, kinectHeight, 1);
+            out.hasDirtyTiles = false;
+            out.gradient.release();
+            out.sequence = nextSequence++;
+            out.arrivalTime = arrivalTime;
+            out.trace.start(out.sequence, arrivalTime);
+            out.trace.setStageTime(LatencyTrace::SOURCE_UPDATE, arrivalTime-updateStartTime);
+            out.trace.mark(ofGetElapsedTimeMicros());
+            // If new filtered image => send back to main thread
 #if __cplusplus>=201103
-                    colored.send(std::move(kinectColorImage.getPixels()));
-                    filtered.send(std::move(kinectDepthImage.getPixels()));
+            colored.send(std::move(kinectColorImage.getPixels()));
 #else
-                    colored.send(kinectColorImage.getPixels());
-                    filtered.send(kinectDepthImage.getPixels());
+            colored.send(kinectColorImage.getPixels());
 #endif
-                    lock();
-                    storedframes += 1;
-                    unlock();
-                    
-                }
-                // if the test mode is activated, the settings are loaded automatically (see gui function)
-                if (enableTestmode) {
-                    ofPixels filteredframe;//, kinectProjImage;
-                    filteredframe = framefilter.filter(kinectDepthImage.getPixels());
-                    filteredframe.setImageType(OF_IMAGE_GRAYSCALE);
+            filtered.publish();
+        }
+        // if the test mode is activated, the settings are loaded automatically (see gui function)
+        if (enableTestmode) {
+            // the filter reads the source's buffers directly and writes into a pooled frame
+            FilteredFrame& out = filtered.getBackBuffer();//, kinectProjImage;
+            uint64_t sensorTemporalTime = 0;
+            uint64_t fusionTime = 0;
+            if (!fusionSensors.empty()) {
+                // each sensor is filtered over time before the fusion, the heightmap only goes through the spatial stages
+                std::unique_lock<std::mutex> filterLock(fusionSensors[0]->filterMutex);
+                const ofShortPixels& primaryDepth = fusionSensors[0]->framefilter.filterTemporal(rawDepthPixels);
+                filterLock.unlock();
+                sensorTemporalTime = fusionSensors[0]->framefilter.getLastTemporalTime();
+                uint64_t fusionStartTime = ofGetElapsedTimeMicros();
+                const ofShortPixels& fused = fuseSensors(primaryDepth);
+                fusionTime = ofGetElapsedTimeMicros()-fusionStartTime;
+                out.frame = framefilter.filterFused(fused);
+            } else if (framefilter.getDepthMode() == FrameFilter::RAW_DEPTH)
+                out.frame = framefilter.filter(rawDepthPixels);
+            else
+                out.frame = framefilter.filter(source->getDepthPixels());
 //                    wrldcoord = framefilter.getWrldcoordbuffer();
 //                    kinectProjImage = convertProjSpace(filteredframe);
 //                    kinectProjImage.setImageType(OF_IMAGE_GRAYSCALE);
-                    
-                    // If new filtered image => send back to main thread
-#if __cplusplus>=201103
-                    filtered.send(std::move(filteredframe));
-                    gradient.send(std::move(framefilter.getGradField()));
-#else
-                    filtered.send(filteredframe);
-                    gradient.send(framefilter.getGradField());
-#endif
-                    lock();
-                    storedframes += 1;
-                    unlock();
-                }
-            }
+            
+            // If new filtered image => publish it to the main thread, replacing an unread one
+            const std::vector<unsigned char>& flags = framefilter.getDirtyTiles().getFlags();
+            out.dirtyTiles.assign(flags.begin(), flags.end()); // reuses the slot's capacity
+            out.hasDirtyTiles = true;
+            out.gradient = framefilter.getGradFieldSnapshot();
+            out.sequence = nextSequence++;
+            out.arrivalTime = arrivalTime;
+            // the queue stage starts now, at publication
+            const FrameFilter::DirtyTileStatistics& tileStats = framefilter.getDirtyTileStatistics();
+            out.trace.start(out.sequence, arrivalTime);
+            out.trace.setStageTime(LatencyTrace::SOURCE_UPDATE, arrivalTime-updateStartTime);
+            out.trace.setStageTime(LatencyTrace::TEMPORAL_FILTER, sensorTemporalTime+framefilter.getLastTemporalTime());
+            if (!fusionSensors.empty())
+                out.trace.setStageTime(LatencyTrace::FUSION, fusionTime);
+            out.trace.setStageTime(LatencyTrace::SPATIAL_FILTER, tileStats.spatialTime);
+            out.trace.setStageTime(LatencyTrace::GRADIENT_FIELD, tileStats.gradientTime);
+            out.trace.setStageTime(LatencyTrace::FILTER, sensorTemporalTime+fusionTime+framefilter.getLastFilterTime());
+            out.trace.mark(ofGetElapsedTimeMicros());
+            filtered.publish();
         }
     }
-    kinect.close();
+    stopSensors();
+    recorder.close();
+    recording = false;
+    source->close();
 }
 
@@ -6,13 +6,57 @@
 #include "ofxKinect.h"
 
 #include "FrameFilter.h"
+#include "TripleBuffer.h"
+#include "DepthSource.h"
+#include "KinectDepthSource.h"
+#include "DepthRecording.h"
+#include "LatencyTrace.h"
+#include "DepthFusion.h"
+#include <memory>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 class KinectGrabber: public ofThread {
 public:
+    struct FilteredFrame // Frame published to the application
+    {
+        FramePool::Frame frame; // Depth frame, pooled by the frame filter
+        std::vector<unsigned char> dirtyTiles; // Tiles that changed since the previous frame of the sequence
+        bool hasDirtyTiles; // Flag whether dirtyTiles is valid (filtered frames only)
+        GradientFieldPool::Field gradient; // Snapshot of the gradient field of the frame, empty for unfiltered frames
+        uint64_t sequence; // Number of the frame, consecutive unless frames were dropped
+        uint64_t arrivalTime; // Time the kinect frame arrived, in microseconds
+        LatencyTrace::Record trace; // Stage timings up to publication, for the application to complete
+    };
+    
+    struct Statistics // Activity of the grabber since the last resetStatistics()
+    {
+        uint64_t numProduced; // Frames published to the application
+        uint64_t numConsumed; // Frames received by the application
+        uint64_t numDropped; // Frames replaced by a newer one before the application received them
+        uint64_t numIdleWaits; // Waits for the next kinect frame
+        float cpuUsage; // Fraction of a core used by the grabber thread (-1 if unavailable)
+        float meanLatency; // Mean time from frame arrival to consumption by the application, in microseconds
+        float maxLatency; // Longest time from frame arrival to consumption by the application, in microseconds
+    };
+    
 	KinectGrabber();
 	~KinectGrabber();
-    void setup();
+    void setup(); // Reads frames from the kinect
+    bool setup(DepthSource* newSource); // Reads frames from an opened source instead of the kinect and takes ownership of it; returns false (and deletes it) if it is not open
+    bool setupPlayback(const std::string& fileName, bool realTime, bool loop); // Plays back a recording instead of the kinect
+    bool setupFusion(const std::vector<DepthSource*>& otherSources, const std::vector<DepthFusion::Pose>& poses, float referenceDepth); // Fuses further open sources with the current one into a single heightmap seen from the plane of the sensors, poses[0] being the current source's, and takes ownership of them; call before setupFramefilter. Returns false (and deletes them) if a source is not open or has no pose
+    bool isFusing() const; // Returns true if several sensors are fused
+    DepthFusion& getFusion(); // Returns the fusion of the sensors, to tune its blending before the thread starts
+    DepthSource& getSource(); // Returns the source of the frames, the primary sensor when fusing; its frames belong to the grabber thread once started
+    ofxKinect& getKinect(); // Returns the kinect driver, for the projector calibration; not open unless setup() was used
     void setupClip(float nearclip, float farclip);
+    void setDepthRange(float nearclip, float farclip); // Applies a clip range to the source, the filter and the stability criterion of the fused sensors; grabber thread only once started
+    size_t getNumSensors() const; // Returns the number of fused sensors, 0 for a single sensor
+    const FrameFilter& getSensorFilter(size_t sensor) const; // Returns the temporal filter of a fused sensor, in millimeters
     void setupFramefilter(int sNumAveragingSlots, unsigned int newMinNumSamples, unsigned int newMaxVariance, float newHysteresis, bool newSpatialFilter, int gradFieldresolution,float snearclip, float sfarclip);
     void setupCalibration(int projectorWidth, int projectorHeight, float schessboardSize, float schessboardColor, float sStabilityTimeInMs, float smaxReprojError);
     void setCalibrationmode();
@@ -20,17 +64,21 @@ public:
     //void update();
 //    ofPixels convertProjSpace(ofPixels sinputframe);
 	bool isFrameNew();
-    int storedframes;//, storedcoloredframes;
+    const FilteredFrame* receiveFilteredFrame(); // Returns the newest frame if one was published since the last call, or 0; main thread only
+    void setPollInterval(int newPollIntervalMicros); // Sets the wait between checks for a frame that is overdue or whose time is unknown, in microseconds (default 2000)
+    Statistics getStatistics(); // main thread only
+    void resetStatistics(); // main thread only
+    void printStatistics();
+    void startRecording(const std::string& fileName, bool withColor, bool compressed, int numEncoderThreads); // Records the raw depth (and color) of the following frames, with their times and clip ranges; compressed depth is encoded losslessly on background threads
+    void stopRecording(); // Finishes the recording
+    bool isRecording() const;
 	ofPixels & getPixels();
 	ofTexture & getTexture();
     
-	ofThreadChannel<ofPixels> filtered;
 	ofThreadChannel<ofPixels> colored;
-	ofThreadChannel<ofVec2f*> gradient;
 	ofThreadChannel<float> nearclipchannel;
 	ofThreadChannel<float> farclipchannel;
 
-    ofxKinect               kinect;
 //    float                       lowThresh;
 //    float                       highThresh;
     float                       chessboardThreshold;
@@ -38,7 +86,63 @@ public:
     FrameFilter                 framefilter;
 
 private:
+    struct RecordingRequest // Recording command for the grabber thread
+    {
+        std::string fileName; // File to record to, empty to stop recording
+        bool withColor;
+        bool compressed;
+        int numEncoderThreads;
+    };
+    
+    struct FusionSensor // Sensor fused into the heightmap, with its own temporal filter
+    {
+        DepthSource* source; // Source of the sensor's frames
+        std::unique_ptr<DepthSource> ownedSource; // Source of the other sensors, the primary one belonging to the grabber
+        DepthSource::Intrinsics intrinsics; // Depth camera model of the sensor
+        DepthFusion::Pose pose; // Transformation from the sensor to the world
+        FrameFilter framefilter; // Temporal filter of the sensor's depth in millimeters
+        std::mutex filterMutex; // Held while the sensor's frames are filtered or its stability criterion changes
+        TripleBuffer<DepthFusion::Layer> layers; // Latest-wins mailbox of the sensor's splatted frames for the grabber thread
+        std::thread thread; // Reads, filters and splats the frames of the other sensors
+    };
+    
+    void setupFrameSize(int width, int height); // Sets the frame size and the default modes
+    void waitForFrame(); // Sleeps until the source's next frame is due, or for the poll interval if it is overdue or unknown; wakes early on shutdown
 	void threadedFunction();
+    void updateCpuUsage(); // Samples the grabber thread's CPU time; called on the grabber thread
+    const ofShortPixels& fuseSensors(const ofShortPixels& primaryDepth); // Splats the primary sensor's filtered frame and blends it with the latest frames of the others; grabber thread only
+    void startSensors(); // Starts the threads of the other sensors; grabber thread only
+    void stopSensors(); // Stops the threads of the other sensors and closes them; grabber thread only
+    void sensorThreadFunction(FusionSensor* sensor);
+    void updateSensorStability(); // Converts the main filter's stability criterion to millimeters at the current clip range for the fused sensors
+    
+    TripleBuffer<FilteredFrame> filtered; // Latest-wins mailbox of frames for the application
+    uint64_t nextSequence; // Sequence number of the next published frame
+    std::mutex sleepMutex; // Mutex of sleepCond
+    std::condition_variable sleepCond; // Wakes the grabber thread on shutdown
+    std::atomic<int> pollInterval; // Wait between checks for an overdue frame, in microseconds
+    std::atomic<uint64_t> numIdleWaits; // Waits for the next kinect frame
+    std::atomic<float> cpuUsage; // Fraction of a core used by the grabber thread since the last reset
+    std::atomic<bool> resetCpuTime; // Flag to restart the CPU usage measurement on the grabber thread
+    std::atomic<uint64_t> statisticsStartTime; // Wall clock time of the last reset, in microseconds
+    double cpuTimeAtStart; // Grabber thread CPU time at the last reset, in seconds; grabber thread only
+    Statistics statisticsBase; // Counters at the last reset
+    double latencySum; // Sum of the latencies of the received frames; main thread only
+    uint64_t numLatencies; // Number of received frames; main thread only
+    float maxLatency; // Longest latency of a received frame; main thread only
+    KinectDepthSource kinectSource; // The kinect, kept for the projector calibration when another source is used
+    std::unique_ptr<DepthSource> customSource; // Source set up instead of the kinect, if any
+    DepthSource* source; // Source of the frames; grabber thread only once started
+    DepthRecorder recorder; // Recording of the incoming frames; grabber thread only
+    ofThreadChannel<RecordingRequest> recordingchannel; // Recording commands from the main thread
+    std::atomic<bool> recording; // Flag whether the grabber thread is recording
+    std::vector<std::unique_ptr<FusionSensor> > fusionSensors; // Sensors fused into the heightmap, the primary source first; empty for a single sensor
+    DepthFusion fusion; // Reprojection and blending of the sensors
+    ofShortPixels fusedDepth; // Last fused heightmap in millimeters; grabber thread only
+    std::vector<const DepthFusion::Layer*> fusionLayers; // Layers blended into the last heightmap; grabber thread only
+    std::atomic<bool> runSensors; // Flag to keep the threads of the other sensors running
+    unsigned int minNumSamples, maxVariance; // Stability criterion of the main filter, in units of its input depth
+    float hysteresis; // Hysteresis of the main filter, in units of its input depth
 //	ofThreadChannel<ofPixels> toAnalyze;
 	ofPixels pixels;
 	ofTexture texture;
@@ -50,7 +154,6 @@ private:
     int kinectWidth, kinectHeight;//, projWidth, projHeight;
     ofxCvColorImage         kinectColorImage;
 //    ofxCvGrayscaleImage		kinectGreyscaledImage;
-    ofxCvGrayscaleImage     kinectDepthImage;
     //   ofImage                 kinectColoredDepth;
     float maxReprojError;
     // calibration
@@ -0,0 +1,167 @@
+/***********************************************************************
+ LatencyTrace - Per-frame latency of the stages from depth acquisition
+ to projection.
+ ***********************************************************************/
+
+#include "LatencyTrace.h"
+#include "ofMain.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+/************************************
+ Methods of class LatencyTrace::Record:
+ ************************************/
+
+LatencyTrace::Record::Record(void)
+{
+    start(0, 0);
+}
+
+void LatencyTrace::Record::start(uint64_t newFrameId, uint64_t newArrivalTime)
+{
+    frameId=newFrameId;
+    arrivalTime=newArrivalTime;
+    lastStamp=newArrivalTime;
+    for(int i=0;i<NUM_STAGES;++i)
+        stageTimes[i]=-1.0f;
+}
+
+void LatencyTrace::Record::setStageTime(Stage stage, uint64_t micros)
+{
+    stageTimes[stage]=float(micros);
+}
+
+void LatencyTrace::Record::stamp(Stage stage, uint64_t now)
+{
+    stageTimes[stage]=now>lastStamp?float(now-lastStamp):0.0f;
+    lastStamp=now;
+}
+
+void LatencyTrace::Record::mark(uint64_t now)
+{
+    lastStamp=now;
+}
+
+/****************************
+ Methods of class LatencyTrace:
+ ****************************/
+
+LatencyTrace::LatencyTrace(void)
+:windowSize(1000), next(0)
+{
+    records.reserve(windowSize);
+}
+
+void LatencyTrace::setWindow(unsigned int newNumFrames)
+{
+    windowSize=std::max(newNumFrames,1U);
+    reset();
+}
+
+void LatencyTrace::add(const Record& record)
+{
+    if(records.size()<windowSize)
+        records.push_back(record);
+    else
+        records[next]=record;
+    next=(next+1)%windowSize;
+}
+
+void LatencyTrace::reset(void)
+{
+    records.clear();
+    records.reserve(windowSize);
+    next=0;
+}
+
+unsigned int LatencyTrace::getNumFrames(void) const
+{
+    return (unsigned int)records.size();
+}
+
+LatencyTrace::Summary LatencyTrace::getSummary(Stage stage) const
+{
+    /* Sort the measured durations of the window; percentiles use the nearest rank: */
+    std::vector<float> times;
+    times.reserve(records.size());
+    for(size_t i=0;i<records.size();++i)
+        if(records[i].getStageTime(stage)>=0.0f)
+            times.push_back(records[i].getStageTime(stage));
+    Summary summary;
+    summary.numSamples=(unsigned int)times.size();
+    summary.mean=summary.p50=summary.p95=summary.p99=summary.max=0.0f;
+    if(times.empty())
+        return summary;
+    std::sort(times.begin(),times.end());
+    double sum=0.0;
+    for(size_t i=0;i<times.size();++i)
+        sum+=times[i];
+    summary.mean=float(sum/double(times.size()));
+    size_t n=times.size();
+    summary.p50=times[std::min(n-1,size_t(std::ceil(0.50*n))-1)];
+    summary.p95=times[std::min(n-1,size_t(std::ceil(0.95*n))-1)];
+    summary.p99=times[std::min(n-1,size_t(std::ceil(0.99*n))-1)];
+    summary.max=times.back();
+    return summary;
+}
+
+const char* LatencyTrace::getStageName(Stage stage)
+{
+    static const char* names[NUM_STAGES]={"source update","temporal filter","fusion","spatial filter","gradient field","filter","queue","texture upload","draw wait","draw proj","end to end"};
+    return names[stage];
+}
+
+void LatencyTrace::print(void) const
+{
+    std::cout<< "LatencyTrace: last " << records.size() << " frames, in microseconds (mean / p50 / p95 / p99 / max):" <<std::endl;
+    for(int i=0;i<NUM_STAGES;++i)
+    {
+        Summary s=getSummary(Stage(i));
+        if(s.numSamples==0)
+            continue;
+        std::cout<< "  " << getStageName(Stage(i)) << ": " << s.mean << " / " << s.p50 << " / " << s.p95 << " / " << s.p99 << " / " << s.max << " (" << s.numSamples << " frames)" <<std::endl;
+    }
+}
+
+bool LatencyTrace::dump(const std::string& fileName) const
+{
+    std::ofstream file(ofToDataPath(fileName).c_str());
+    if(!file)
+    {
+        ofLog(OF_LOG_ERROR, "LatencyTrace: cannot create "+fileName);
+        return false;
+    }
+
+    /* Per-stage summaries, then one line per frame from the oldest on; unmeasured stages are left empty: */
+    file<< "stage,frames,mean,p50,p95,p99,max\n";
+    for(int i=0;i<NUM_STAGES;++i)
+    {
+        Summary s=getSummary(Stage(i));
+        file<< getStageName(Stage(i)) << "," << s.numSamples << "," << s.mean << "," << s.p50 << "," << s.p95 << "," << s.p99 << "," << s.max << "\n";
+    }
+    file<< "\nframe,arrival";
+    for(int i=0;i<NUM_STAGES;++i)
+        file<< "," << getStageName(Stage(i));
+    file<< "\n";
+    size_t first=records.size()<windowSize?0:next;
+    for(size_t j=0;j<records.size();++j)
+    {
+        const Record& record=records[(first+j)%records.size()];
+        file<< record.getFrameId() << "," << record.getArrivalTime();
+        for(int i=0;i<NUM_STAGES;++i)
+        {
+            file<< ",";
+            if(record.getStageTime(Stage(i))>=0.0f)
+                file<< record.getStageTime(Stage(i));
+        }
+        file<< "\n";
+    }
+    if(!file)
+    {
+        ofLog(OF_LOG_ERROR, "LatencyTrace: cannot write to "+fileName);
+        return false;
+    }
+    std::cout<< "LatencyTrace: wrote " << records.size() << " frames to " << fileName <<std::endl;
+    return true;
+}
@@ -0,0 +1,81 @@
+/***********************************************************************
+ LatencyTrace - Per-frame latency of the stages from depth acquisition
+ to projection. Each frame carries a Record, stamped by the grabber
+ thread while it is filtered and by the application while it is
+ uploaded and drawn; completed records are kept over a rolling window
+ of frames, from which per-stage percentiles are computed on demand.
+ ***********************************************************************/
+
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class LatencyTrace {
+public:
+    enum Stage // Pipeline stages, in frame order
+    {
+        SOURCE_UPDATE=0, // Source update delivering the frame (kinect.update())
+        TEMPORAL_FILTER, // Temporal filter and depth normalization
+        FUSION, // Splatting and blending of several sensors into one heightmap
+        SPATIAL_FILTER, // Spatial low-pass filter
+        GRADIENT_FIELD, // Gradient field update and snapshot
+        FILTER, // Whole FrameFilter::filter, including the three stages above and hole filling
+        QUEUE, // From publication by the grabber to reception by the application
+        TEXTURE_UPLOAD, // Upload of the filtered depth to the texture
+        DRAW_WAIT, // From the upload to the start of the next projector draw
+        DRAW_PROJ, // Projector draw
+        END_TO_END, // From the frame's arrival to the end of its first projector draw
+        NUM_STAGES
+    };
+
+    struct Summary // Latency of one stage over the window
+    {
+        unsigned int numSamples; // Frames in which the stage was measured
+        float mean, p50, p95, p99, max; // In microseconds
+    };
+
+    class Record // Timings of one frame, travelling with the frame
+    {
+    public:
+        Record(void);
+        void start(uint64_t newFrameId, uint64_t newArrivalTime); // Starts a new frame that arrived at the given time, with no stage measured
+        void setStageTime(Stage stage, uint64_t micros); // Sets the duration of a stage measured elsewhere
+        void stamp(Stage stage, uint64_t now); // Ends a stage at the given time; it started at the previous stamp
+        void mark(uint64_t now); // Starts the next stage at the given time without ending one
+        uint64_t getFrameId(void) const
+        {
+            return frameId;
+        }
+        uint64_t getArrivalTime(void) const
+        {
+            return arrivalTime;
+        }
+        float getStageTime(Stage stage) const // Returns the duration of a stage in microseconds, or -1 if it was not measured
+        {
+            return stageTimes[stage];
+        }
+
+    private:
+        uint64_t frameId; // Monotonic number of the frame
+        uint64_t arrivalTime; // Time the source delivered the frame, in microseconds
+        uint64_t lastStamp; // Time of the last stamp, in microseconds
+        float stageTimes[NUM_STAGES]; // Stage durations in microseconds, -1 if not measured
+    };
+
+    LatencyTrace(void);
+
+    void setWindow(unsigned int newNumFrames); // Sets the number of most recent frames kept (default 1000); clears the trace
+    void add(const Record& record); // Adds a completed frame, replacing the oldest one once the window is full
+    void reset(void); // Forgets all frames
+    unsigned int getNumFrames(void) const; // Returns the number of frames in the window
+    Summary getSummary(Stage stage) const; // Returns the latency percentiles of a stage over the window
+    static const char* getStageName(Stage stage);
+    void print(void) const; // Prints the summaries of all stages
+    bool dump(const std::string& fileName) const; // Writes the summaries and the frames of the window as CSV to a file in the data folder
+
+private:
+    std::vector<Record> records; // Ring buffer of completed frames
+    unsigned int windowSize; // Capacity of the ring buffer
+    unsigned int next; // Position of the next frame in the ring buffer
+};
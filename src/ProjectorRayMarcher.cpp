@@ -0,0 +1,302 @@
+/***********************************************************************
+ ProjectorRayMarcher - Finds, for every projector pixel, the terrain
+ sample its light actually falls on.
+ ***********************************************************************/
+
+#include "ProjectorRayMarcher.h"
+#include "ofxHomographyHelper.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+const float maxPosition=float((1<<(15-ProjectorRayMarcher::subpixelBits))-1); // Largest distance from the depth frame's origin that fits a ray end
+const int stepBits=8; // Additional fractional bits of the positions along a ray
+
+}
+
+/************************************
+ Methods of class ProjectorRayMarcher:
+ ************************************/
+
+ProjectorRayMarcher::ProjectorRayMarcher()
+:valid(false), depthWidth(0), depthHeight(0), projectorWidth(0), projectorHeight(0), numSteps(0),
+ heightTilesX(0), heightTilesY(0), blocksX(0), blocksY(0), hasOutput(false), lastNumRays(0), lastBuildTime(0), lastMarchTime(0)
+{
+    workerPool.setNumThreads(1);
+}
+
+void ProjectorRayMarcher::setNumThreads(int newNumThreads)
+{
+    workerPool.setNumThreads(newNumThreads);
+}
+
+bool ProjectorRayMarcher::build(unsigned int newDepthWidth, unsigned int newDepthHeight, float nearclip, float farclip, unsigned int newProjectorWidth, unsigned int newProjectorHeight, const Projection& project)
+{
+    uint64_t startTime=ofGetElapsedTimeMicros();
+    clear();
+    depthWidth=newDepthWidth;
+    depthHeight=newDepthHeight;
+    projectorWidth=newProjectorWidth;
+    projectorHeight=newProjectorHeight;
+    if(depthWidth<2||depthHeight<2||projectorWidth==0||projectorHeight==0||!(farclip>nearclip))
+    {
+        ofLog(OF_LOG_WARNING, "ProjectorRayMarcher: empty frame or clip range");
+        return false;
+    }
+
+    /* The near and far planes are at the centers of the 8-bit depths 255 and 0: */
+    float step=(farclip-nearclip)/255.0f;
+    float planeDepths[2]={farclip-255.5f*step,farclip-0.5f*step};
+
+    /* On a plane, projector and depth pixels are related by a homography, fitted on the frame's corners in normalized coordinates: */
+    float homographies[2][16];
+    for(int p=0;p<2;++p)
+    {
+        float src[4][2],dst[4][2];
+        for(int c=0;c<4;++c)
+        {
+            float x=c==1||c==2?float(depthWidth-1):0.0f;
+            float y=c>=2?float(depthHeight-1):0.0f;
+            ofPoint q=project(ofPoint(x,y,planeDepths[p]));
+            if(!std::isfinite(q.x)||!std::isfinite(q.y))
+            {
+                ofLog(OF_LOG_WARNING, "ProjectorRayMarcher: the calibration does not project the depth frame's corners");
+                return false;
+            }
+            src[c][0]=q.x/float(projectorWidth);
+            src[c][1]=q.y/float(projectorHeight);
+            dst[c][0]=x/float(depthWidth);
+            dst[c][1]=y/float(depthHeight);
+        }
+        ofxHomographyHelper::findHomography(src,dst,homographies[p]);
+    }
+
+    /* Map the center of each projector pixel to the ends of its ray: */
+    rays.resize(size_t(projectorWidth)*projectorHeight);
+    float scale=float(1<<subpixelBits);
+    float maxLength=0.0f;
+    Ray* rPtr=&rays[0];
+    for(unsigned int v=0;v<projectorHeight;++v)
+        for(unsigned int u=0;u<projectorWidth;++u,++rPtr)
+        {
+            float ends[2][2];
+            float nu=(float(u)+0.5f)/float(projectorWidth);
+            float nv=(float(v)+0.5f)/float(projectorHeight);
+            for(int p=0;p<2;++p)
+            {
+                const float* h=homographies[p];
+                float w=h[3]*nu+h[7]*nv+h[15];
+                float x=(h[0]*nu+h[4]*nv+h[12])/w*float(depthWidth);
+                float y=(h[1]*nu+h[5]*nv+h[13])/w*float(depthHeight);
+                ends[p][0]=std::isfinite(x)?std::min(std::max(x,-maxPosition),maxPosition):-maxPosition;
+                ends[p][1]=std::isfinite(y)?std::min(std::max(y,-maxPosition),maxPosition):-maxPosition;
+            }
+            rPtr->x0=int16_t(std::floor(ends[0][0]*scale+0.5f));
+            rPtr->y0=int16_t(std::floor(ends[0][1]*scale+0.5f));
+            rPtr->x1=int16_t(std::floor(ends[1][0]*scale+0.5f));
+            rPtr->y1=int16_t(std::floor(ends[1][1]*scale+0.5f));
+
+            /* Only rays crossing the frame bound the step length: */
+            bool inside0=ends[0][0]>=0.0f&&ends[0][1]>=0.0f&&ends[0][0]<float(depthWidth)&&ends[0][1]<float(depthHeight);
+            bool inside1=ends[1][0]>=0.0f&&ends[1][1]>=0.0f&&ends[1][0]<float(depthWidth)&&ends[1][1]<float(depthHeight);
+            if(inside0||inside1)
+                maxLength=std::max(maxLength,std::sqrt((ends[1][0]-ends[0][0])*(ends[1][0]-ends[0][0])+(ends[1][1]-ends[0][1])*(ends[1][1]-ends[0][1])));
+        }
+
+    /* Every ray takes the same steps, none longer than a depth pixel; the depth along a ray is linear in 1/z: */
+    numSteps=std::min(std::max(int(std::ceil(maxLength)),1),int(maxSteps));
+    thresholds.resize(numSteps+1);
+    for(int i=0;i<=numSteps;++i)
+    {
+        float t=float(i)/float(numSteps);
+        float z=1.0f/((1.0f-t)/planeDepths[0]+t/planeDepths[1]);
+        float d=(farclip-z)/step-0.5f;
+        thresholds[i]=std::min(std::max(int(std::ceil(d-1.0e-3f)),1),255);
+    }
+    firstSteps.resize(256);
+    for(int d=255,i=0;d>=0;--d)
+    {
+        while(i<=numSteps&&thresholds[i]>d)
+            ++i;
+        firstSteps[d]=i;
+    }
+    heightTilesX=(depthWidth+heightTileSize-1)/heightTileSize;
+    heightTilesY=(depthHeight+heightTileSize-1)/heightTileSize;
+    tileHeights.assign(size_t(heightTilesX)*heightTilesY,255);
+
+    /* Bound the depth pixels crossed by the rays of each block: */
+    blocksX=(projectorWidth+blockSize-1)/blockSize;
+    blocksY=(projectorHeight+blockSize-1)/blockSize;
+    blockBounds.resize(size_t(blocksX)*blocksY);
+    for(int by=0;by<blocksY;++by)
+        for(int bx=0;bx<blocksX;++bx)
+        {
+            Bounds& b=blockBounds[by*blocksX+bx];
+            b.x0=b.y0=std::numeric_limits<int>::max();
+            b.x1=b.y1=std::numeric_limits<int>::min();
+            for(int v=by*blockSize;v<std::min((by+1)*blockSize,int(projectorHeight));++v)
+                for(int u=bx*blockSize;u<std::min((bx+1)*blockSize,int(projectorWidth));++u)
+                {
+                    const Ray& r=rays[size_t(v)*projectorWidth+u];
+                    b.x0=std::min(b.x0,std::min(int(r.x0),int(r.x1)));
+                    b.y0=std::min(b.y0,std::min(int(r.y0),int(r.y1)));
+                    b.x1=std::max(b.x1,std::max(int(r.x0),int(r.x1)));
+                    b.y1=std::max(b.y1,std::max(int(r.y0),int(r.y1)));
+                }
+
+            /* Samples are taken at the nearest pixel, clipped to the frame: */
+            int half=1<<(subpixelBits-1);
+            b.x0=std::max((b.x0+half)>>subpixelBits,0);
+            b.y0=std::max((b.y0+half)>>subpixelBits,0);
+            b.x1=std::min((b.x1+half)>>subpixelBits,int(depthWidth)-1);
+            b.y1=std::min((b.y1+half)>>subpixelBits,int(depthHeight)-1);
+        }
+
+    projectedDepth.allocate(projectorWidth,projectorHeight,1);
+    projectedDepth.set(0);
+    hits.assign(size_t(projectorWidth)*projectorHeight,-1);
+    valid=true;
+    lastBuildTime=ofGetElapsedTimeMicros()-startTime;
+    return true;
+}
+
+void ProjectorRayMarcher::clear(void)
+{
+    valid=false;
+    hasOutput=false;
+    rays.clear();
+    thresholds.clear();
+    firstSteps.clear();
+    tileHeights.clear();
+    blockBounds.clear();
+    hits.clear();
+}
+
+void ProjectorRayMarcher::marchBlock(const unsigned char* depth, int block)
+{
+    const Bounds& b=blockBounds[block];
+    int bx=block%blocksX,by=block/blocksX;
+    unsigned int u0=bx*blockSize,u1=std::min(u0+blockSize,projectorWidth);
+    unsigned int v0=by*blockSize,v1=std::min(v0+blockSize,projectorHeight);
+    const int* thresholdPtr=&thresholds[0];
+    int half=1<<(subpixelBits+stepBits-1);
+
+    /* The rays are above every surface under the block's bounds until they reach its highest one: */
+    int firstStep=numSteps+1;
+    if(b.x0<=b.x1&&b.y0<=b.y1)
+    {
+        int height=0;
+        for(int ty=b.y0/heightTileSize;ty<=b.y1/heightTileSize;++ty)
+            for(int tx=b.x0/heightTileSize;tx<=b.x1/heightTileSize;++tx)
+                height=std::max(height,int(tileHeights[ty*heightTilesX+tx]));
+        firstStep=firstSteps[height];
+    }
+
+    for(unsigned int v=v0;v<v1;++v)
+    {
+        const Ray* rPtr=&rays[size_t(v)*projectorWidth+u0];
+        unsigned char* pPtr=projectedDepth.getData()+size_t(v)*projectorWidth+u0;
+        int32_t* hPtr=&hits[size_t(v)*projectorWidth+u0];
+        for(unsigned int u=u0;u<u1;++u,++rPtr,++pPtr,++hPtr)
+        {
+            *pPtr=0;
+            *hPtr=-1;
+            if(firstStep>numSteps)
+                continue;
+
+            /* Step from the highest surface until the surface is at or in front of the ray, which has to be seen above it on the previous step: */
+            int dx=((int(rPtr->x1)-int(rPtr->x0))<<stepBits)/numSteps;
+            int dy=((int(rPtr->y1)-int(rPtr->y0))<<stepBits)/numSteps;
+            int x=(int(rPtr->x0)<<stepBits)+(firstStep-1)*dx,y=(int(rPtr->y0)<<stepBits)+(firstStep-1)*dy;
+            bool inside=firstStep==0||((unsigned int)((x+half)>>(subpixelBits+stepBits))<depthWidth&&(unsigned int)((y+half)>>(subpixelBits+stepBits))<depthHeight);
+            for(int i=firstStep;i<=numSteps;++i)
+            {
+                x+=dx;
+                y+=dy;
+                bool wasInside=inside;
+                unsigned int sx=(unsigned int)((x+half)>>(subpixelBits+stepBits));
+                unsigned int sy=(unsigned int)((y+half)>>(subpixelBits+stepBits));
+                inside=sx<depthWidth&&sy<depthHeight;
+                if(!inside)
+                    continue;
+                size_t index=size_t(sy)*depthWidth+sx;
+                int d=depth[index];
+                if(d>=thresholdPtr[i])
+                {
+                    if(wasInside)
+                    {
+                        *pPtr=(unsigned char)(d);
+                        *hPtr=int32_t(index);
+                    }
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void ProjectorRayMarcher::march(const ofPixels& depth, const std::vector<unsigned char>* dirtyTiles, unsigned int tileSize)
+{
+    uint64_t startTime=ofGetElapsedTimeMicros();
+    if(!valid||depth.getWidth()!=depthWidth||depth.getHeight()!=depthHeight)
+        return;
+
+    /* Rays whose samples all lie in unchanged tiles hit the same sample as before: */
+    int tilesX=tileSize>0?int((depthWidth+tileSize-1)/tileSize):0;
+    int tilesY=tileSize>0?int((depthHeight+tileSize-1)/tileSize):0;
+    bool incremental=hasOutput&&dirtyTiles!=0&&int(dirtyTiles->size())==tilesX*tilesY;
+    if(incremental)
+    {
+        summedTiles.assign(size_t(tilesX+1)*(tilesY+1),0);
+        for(int ty=0;ty<tilesY;++ty)
+            for(int tx=0;tx<tilesX;++tx)
+                summedTiles[(ty+1)*(tilesX+1)+tx+1]=((*dirtyTiles)[ty*tilesX+tx]?1:0)+summedTiles[ty*(tilesX+1)+tx+1]+summedTiles[(ty+1)*(tilesX+1)+tx]-summedTiles[ty*(tilesX+1)+tx];
+    }
+    pendingBlocks.clear();
+    unsigned int numRays=0;
+    for(int block=0;block<blocksX*blocksY;++block)
+    {
+        const Bounds& b=blockBounds[block];
+        if(incremental)
+        {
+            if(b.x0>b.x1||b.y0>b.y1)
+                continue;
+            int tx0=b.x0/tileSize,ty0=b.y0/tileSize;
+            int tx1=b.x1/tileSize+1,ty1=b.y1/tileSize+1;
+            int numDirty=summedTiles[ty1*(tilesX+1)+tx1]-summedTiles[ty0*(tilesX+1)+tx1]-summedTiles[ty1*(tilesX+1)+tx0]+summedTiles[ty0*(tilesX+1)+tx0];
+            if(numDirty==0)
+                continue;
+        }
+        pendingBlocks.push_back(block);
+        numRays+=(std::min((block%blocksX+1)*blockSize,int(projectorWidth))-(block%blocksX)*blockSize)*(std::min((block/blocksX+1)*blockSize,int(projectorHeight))-(block/blocksX)*blockSize);
+    }
+
+    /* Bound the surface in each tile of the frame: */
+    const unsigned char* depthData=depth.getData();
+    int numThreads=workerPool.getNumThreads();
+    workerPool.run(numThreads,[&](int thread){
+        for(int ty=thread*heightTilesY/numThreads;ty<(thread+1)*heightTilesY/numThreads;++ty)
+        {
+            unsigned char* tPtr=&tileHeights[ty*heightTilesX];
+            std::fill(tPtr,tPtr+heightTilesX,0);
+            for(int y=ty*heightTileSize;y<std::min((ty+1)*heightTileSize,int(depthHeight));++y)
+            {
+                const unsigned char* dPtr=depthData+size_t(y)*depthWidth;
+                for(unsigned int x=0;x<depthWidth;++x)
+                    tPtr[x/heightTileSize]=std::max(tPtr[x/heightTileSize],dPtr[x]);
+            }
+        }
+    });
+
+    /* Blocks write disjoint projector pixels; interleave them over the threads, as neighboring blocks cost about the same: */
+    int numPending=int(pendingBlocks.size());
+    workerPool.run(numThreads,[&](int thread){
+        for(int i=thread;i<numPending;i+=numThreads)
+            marchBlock(depthData,pendingBlocks[i]);
+    });
+    hasOutput=true;
+    lastNumRays=numRays;
+    lastMarchTime=ofGetElapsedTimeMicros()-startTime;
+}
@@ -0,0 +1,112 @@
+/***********************************************************************
+ ProjectorRayMarcher - Finds, for every projector pixel, the terrain
+ sample its light actually falls on. Seen from the kinect, the ray of a
+ projector pixel is a straight segment of the depth frame between the
+ points where it crosses the near and the far clip planes, and its
+ depth along the segment changes evenly in 1/z. Both ends are mapped
+ once from the kinect-projector calibration, through the homographies
+ from the projector to the depth frame on the two planes. Each frame,
+ the rays are marched from the near plane one depth pixel at a time
+ until they reach the surface, so hills shadowing the sand behind them
+ are respected. All rays take the same steps against one threshold
+ table, and rays are grouped in blocks of projector pixels whose
+ segments are bounded in the depth frame. A block's rays skip the steps
+ above the highest surface under its bounds, and when the dirty tiles
+ of the depth frame are known, only the blocks whose bounds cross one
+ of them are marched again. Rays entering the frame from the side
+ below the surface hit something the kinect does not see, and show
+ nothing.
+ ***********************************************************************/
+
+#pragma once
+#include "ofMain.h"
+#include "ProjectorRemap.h"
+#include "WorkerPool.h"
+#include <stdint.h>
+#include <vector>
+
+class ProjectorRayMarcher {
+public:
+    typedef ProjectorRemap::Projection Projection; // Projects a depth pixel (x, y, depth in millimeters) to projector pixels
+
+    ProjectorRayMarcher();
+
+    void setNumThreads(int newNumThreads); // Sets the number of threads marching blocks of rays (default 1, 0 = one per core)
+
+    /* Maps the rays of the projector's pixels into depth frames of the given size for the clip range; returns false if the calibration does not project the frame's corners: */
+    bool build(unsigned int depthWidth, unsigned int depthHeight, float nearclip, float farclip, unsigned int projectorWidth, unsigned int projectorHeight, const Projection& project);
+    void clear(void); // Discards the rays
+    bool isValid(void) const // Returns true if the rays were mapped
+    {
+        return valid;
+    }
+
+    /* Marches the rays against an 8-bit depth frame; given the dirty tiles of tileSize pixels since the previously marched frame, only the rays crossing them: */
+    void march(const ofPixels& depth, const std::vector<unsigned char>* dirtyTiles, unsigned int tileSize);
+    const ofPixels& getProjectedDepth(void) const // Returns the depth of the sample hit by each projector pixel, 0 if none
+    {
+        return projectedDepth;
+    }
+    const std::vector<int32_t>& getHits(void) const // Returns the index in the depth frame of the sample hit by each projector pixel, -1 if none
+    {
+        return hits;
+    }
+    int getNumSteps(void) const // Returns the number of steps of every ray
+    {
+        return numSteps;
+    }
+    unsigned int getLastNumRays(void) const // Returns the number of rays marched for the last frame
+    {
+        return lastNumRays;
+    }
+    uint64_t getLastBuildTime(void) const // Returns the time spent mapping the rays, in microseconds
+    {
+        return lastBuildTime;
+    }
+    uint64_t getLastMarchTime(void) const // Returns the time spent marching the last frame, in microseconds
+    {
+        return lastMarchTime;
+    }
+
+    static const int subpixelBits=4; // Fractional bits of the ray ends
+    static const int blockSize=16; // Width and height of the blocks of projector pixels marched together
+    static const int maxSteps=1024; // Largest number of steps of a ray
+    static const int heightTileSize=16; // Width and height of the tiles of the depth frame whose highest surface bounds the rays
+
+private:
+    struct Ray // Ends of a ray in the depth frame on the near and far planes, in 1/2^subpixelBits pixels
+    {
+        int16_t x0, y0, x1, y1;
+    };
+
+    struct Bounds // Depth pixels crossed by the rays of a block
+    {
+        int x0, y0, x1, y1; // Inclusive; empty if x0>x1
+    };
+
+    ProjectorRayMarcher(const ProjectorRayMarcher&); // Prohibit copy constructor
+    ProjectorRayMarcher& operator=(const ProjectorRayMarcher&); // Prohibit assignment operator
+
+    void marchBlock(const unsigned char* depth, int block); // Marches the rays of a block
+
+    bool valid;
+    unsigned int depthWidth, depthHeight; // Size of the depth frames the rays were mapped for
+    unsigned int projectorWidth, projectorHeight;
+    std::vector<Ray> rays; // Ray of each projector pixel
+    int numSteps; // Number of steps from the near to the far plane, at most one depth pixel long for every ray
+    std::vector<int> thresholds; // Smallest 8-bit depth of the surface reached at each step
+    std::vector<int> firstSteps; // First step at which a ray can reach a surface of each 8-bit depth
+    int heightTilesX, heightTilesY;
+    std::vector<unsigned char> tileHeights; // Largest 8-bit depth of each tile of the current frame
+    int blocksX, blocksY;
+    std::vector<Bounds> blockBounds; // Depth pixels crossed by the rays of each block
+    std::vector<int> summedTiles; // Summed area table of the dirty tiles
+    std::vector<int> pendingBlocks; // Blocks to march in the current frame
+    bool hasOutput; // Flag whether every ray was marched since the rays were mapped
+    ofPixels projectedDepth; // Depth of the sample hit by each projector pixel
+    std::vector<int32_t> hits; // Index of the sample hit by each projector pixel
+    WorkerPool workerPool; // Threads marching blocks of rays
+    unsigned int lastNumRays; // Number of rays marched for the last frame
+    uint64_t lastBuildTime; // Time spent mapping the rays, in microseconds
+    uint64_t lastMarchTime; // Time spent marching the last frame, in microseconds
+};
@@ -0,0 +1,210 @@
+/***********************************************************************
+ ProjectorRemap - Depth-aware mapping of the filtered depth frame into
+ projector space.
+ ***********************************************************************/
+
+#include "ProjectorRemap.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+const int16_t invalidPosition=std::numeric_limits<int16_t>::min(); // Marks positions the calibration cannot project
+const float maxPosition=float((1<<(15-ProjectorRemap::subpixelBits))-1); // Largest distance from the projector origin that fits the table
+
+/* Index of the first pixel whose center lies at or right of a subpixel position, for negative positions too: */
+inline int firstPixel(int position)
+{
+    const int one=1<<ProjectorRemap::subpixelBits;
+    int p=position-one/2+one-1;
+    return p>=0?p/one:-((-p+one-1)/one);
+}
+
+}
+
+/*******************************
+ Methods of class ProjectorRemap:
+ *******************************/
+
+ProjectorRemap::ProjectorRemap()
+:valid(false), depthWidth(0), depthHeight(0), roiX0(0), roiY0(0), roiX1(0), roiY1(0),
+ projectorWidth(0), projectorHeight(0), numIntervals(0), lastBuildTime(0), lastRemapTime(0)
+{
+    workerPool.setNumThreads(1);
+}
+
+void ProjectorRemap::setNumThreads(int newNumThreads)
+{
+    workerPool.setNumThreads(newNumThreads);
+}
+
+void ProjectorRemap::build(unsigned int newDepthWidth, unsigned int newDepthHeight, const ofRectangle& roi, float nearclip, float farclip, int newNumIntervals, unsigned int newProjectorWidth, unsigned int newProjectorHeight, const Projection& project)
+{
+    uint64_t startTime=ofGetElapsedTimeMicros();
+    clear();
+    depthWidth=newDepthWidth;
+    depthHeight=newDepthHeight;
+    projectorWidth=newProjectorWidth;
+    projectorHeight=newProjectorHeight;
+    numIntervals=std::max(newNumIntervals,1);
+
+    /* Clip the region of interest to the frame: */
+    roiX0=std::max(int(std::floor(roi.getMinX())),0);
+    roiY0=std::max(int(std::floor(roi.getMinY())),0);
+    roiX1=std::min(int(std::ceil(roi.getMaxX())),int(depthWidth));
+    roiY1=std::min(int(std::ceil(roi.getMaxY())),int(depthHeight));
+    if(roiX1<=roiX0||roiY1<=roiY0||!(farclip>nearclip))
+    {
+        ofLog(OF_LOG_WARNING, "ProjectorRemap: empty region of interest or clip range");
+        return;
+    }
+
+    /* Plane k is at the center of the depth value its share of the 8-bit range reaches, 255 (near) for k=0 and 0 (far) for k=numIntervals: */
+    int numPlanes=numIntervals+1;
+    float step=(farclip-nearclip)/255.0f;
+    std::vector<float> planeDepths(numPlanes);
+    for(int k=0;k<numPlanes;++k)
+        planeDepths[k]=farclip-(255.0f*float(numIntervals-k)/float(numIntervals)+0.5f)*step;
+
+    /* Project every pixel on every plane: */
+    int roiWidth=roiX1-roiX0,roiHeight=roiY1-roiY0;
+    float scale=float(1<<subpixelBits);
+    table.resize(size_t(roiWidth)*roiHeight*numPlanes);
+    Position* tPtr=&table[0];
+    for(int y=roiY0;y<roiY1;++y)
+        for(int x=roiX0;x<roiX1;++x)
+            for(int k=0;k<numPlanes;++k,++tPtr)
+            {
+                ofPoint p=project(ofPoint(float(x),float(y),planeDepths[k]));
+                if(std::isfinite(p.x)&&std::isfinite(p.y))
+                {
+                    tPtr->x=int16_t(std::floor(std::min(std::max(p.x,-maxPosition),maxPosition)*scale+0.5f));
+                    tPtr->y=int16_t(std::floor(std::min(std::max(p.y,-maxPosition),maxPosition)*scale+0.5f));
+                }
+                else
+                    tPtr->x=tPtr->y=invalidPosition;
+            }
+
+    /* A pixel's box spans the parallelogram to its right and lower neighbors, the largest over the region on each plane: */
+    footprints.resize(numPlanes);
+    int maxFootprintY=0;
+    for(int k=0;k<numPlanes;++k)
+    {
+        int sizeX=1<<subpixelBits,sizeY=1<<subpixelBits;
+        for(int y=0;y+1<roiHeight;++y)
+            for(int x=0;x+1<roiWidth;++x)
+            {
+                const Position& p=table[(size_t(y)*roiWidth+x)*numPlanes+k];
+                const Position& right=table[(size_t(y)*roiWidth+x+1)*numPlanes+k];
+                const Position& below=table[(size_t(y+1)*roiWidth+x)*numPlanes+k];
+                if(p.x==invalidPosition||right.x==invalidPosition||below.x==invalidPosition)
+                    continue;
+                sizeX=std::max(sizeX,std::abs(right.x-p.x)+std::abs(below.x-p.x));
+                sizeY=std::max(sizeY,std::abs(right.y-p.y)+std::abs(below.y-p.y));
+            }
+
+        /* One subpixel more closes the gaps left by rounding: */
+        footprints[k].x=int16_t(std::min(sizeX+1,int(std::numeric_limits<int16_t>::max())));
+        footprints[k].y=int16_t(std::min(sizeY+1,int(std::numeric_limits<int16_t>::max())));
+        maxFootprintY=std::max(maxFootprintY,int(footprints[k].y));
+    }
+
+    /* Bound the projector rows reached by each table row, so bands of projector rows only visit the rows that land on them: */
+    rowMinY.assign(roiHeight,std::numeric_limits<int>::max());
+    rowMaxY.assign(roiHeight,std::numeric_limits<int>::min());
+    size_t rowSize=size_t(roiWidth)*numPlanes;
+    for(int y=0;y<roiHeight;++y)
+    {
+        const Position* rowPtr=&table[y*rowSize];
+        for(size_t i=0;i<rowSize;++i)
+            if(rowPtr[i].x!=invalidPosition)
+            {
+                rowMinY[y]=std::min(rowMinY[y],int(rowPtr[i].y)-maxFootprintY/2);
+                rowMaxY[y]=std::max(rowMaxY[y],int(rowPtr[i].y)+maxFootprintY/2);
+            }
+    }
+
+    valid=true;
+    lastBuildTime=ofGetElapsedTimeMicros()-startTime;
+}
+
+void ProjectorRemap::clear(void)
+{
+    valid=false;
+    table.clear();
+    footprints.clear();
+    rowMinY.clear();
+    rowMaxY.clear();
+}
+
+void ProjectorRemap::remapRows(const unsigned char* depth, unsigned char* projected, int row0, int row1) const
+{
+    std::memset(projected+size_t(row0)*projectorWidth,0,size_t(row1-row0)*projectorWidth);
+    int numPlanes=numIntervals+1;
+    int roiWidth=roiX1-roiX0;
+    int bandMinY=row0<<subpixelBits,bandMaxY=row1<<subpixelBits;
+    for(int y=roiY0;y<roiY1;++y)
+    {
+        int tableRow=y-roiY0;
+        if(rowMaxY[tableRow]<bandMinY||rowMinY[tableRow]>=bandMaxY)
+            continue;
+        const unsigned char* dPtr=depth+size_t(y)*depthWidth+roiX0;
+        const Position* tPtr=&table[size_t(tableRow)*roiWidth*numPlanes];
+        for(int x=0;x<roiWidth;++x,tPtr+=numPlanes)
+        {
+            /* 0 is invalid or beyond the far clip, which is what the projected frame holds anyway: */
+            unsigned int d=dPtr[x];
+            if(d==0)
+                continue;
+
+            /* Interpolate the position between the two planes around the pixel's depth: */
+            int t=int(255-d)*numIntervals;
+            int k=t/255;
+            int f=t-k*255;
+            const Position& p0=tPtr[k];
+            const Position& p1=tPtr[k+1];
+            if(p0.x==invalidPosition||p1.x==invalidPosition)
+                continue;
+            int px=p0.x+(int(p1.x-p0.x)*f)/255;
+            int py=p0.y+(int(p1.y-p0.y)*f)/255;
+            int sizeX=std::max(footprints[k].x,footprints[k+1].x);
+            int sizeY=std::max(footprints[k].y,footprints[k+1].y);
+
+            /* Cover the projector pixels whose centers lie in the pixel's box, keeping the nearest surface: */
+            int i0=std::max(firstPixel(px-sizeX/2),0);
+            int i1=std::min(firstPixel(px-sizeX/2+sizeX),int(projectorWidth));
+            int j0=std::max(firstPixel(py-sizeY/2),row0);
+            int j1=std::min(firstPixel(py-sizeY/2+sizeY),row1);
+            for(int j=j0;j<j1;++j)
+            {
+                unsigned char* pPtr=projected+size_t(j)*projectorWidth;
+                for(int i=i0;i<i1;++i)
+                    if(pPtr[i]<d)
+                        pPtr[i]=(unsigned char)(d);
+            }
+        }
+    }
+}
+
+void ProjectorRemap::remap(const ofPixels& depth, ofPixels& projected)
+{
+    uint64_t startTime=ofGetElapsedTimeMicros();
+    if(projected.getWidth()!=projectorWidth||projected.getHeight()!=projectorHeight||projected.getNumChannels()!=1)
+        projected.allocate(projectorWidth,projectorHeight,1);
+    if(!valid||depth.getWidth()!=depthWidth||depth.getHeight()!=depthHeight)
+    {
+        projected.set(0);
+        return;
+    }
+
+    /* Each band owns its projector rows, so the splats of different bands never touch: */
+    const unsigned char* depthData=depth.getData();
+    unsigned char* projectedData=projected.getData();
+    int numBands=workerPool.getNumThreads();
+    workerPool.run(numBands,[&](int band){
+        remapRows(depthData,projectedData,band*projectorHeight/numBands,(band+1)*projectorHeight/numBands);
+    });
+    lastRemapTime=ofGetElapsedTimeMicros()-startTime;
+}
@@ -0,0 +1,76 @@
+/***********************************************************************
+ ProjectorRemap - Depth-aware mapping of the filtered depth frame into
+ projector space. For every depth pixel of the region of interest, the
+ table holds the projector position of the pixel at a few planes
+ spanning the clip range, projected once through the kinect-projector
+ calibration; a frame is then warped by interpolating each pixel's
+ position at its own depth and splatting it into the projector frame,
+ so the relief of the sand is registered instead of a plane at the far
+ clip. Pixels cover a box the size of a depth pixel at their depth, and
+ the nearest surface wins where boxes overlap, which is simply the
+ largest 8-bit depth. The table only has to be rebuilt when the
+ calibration, the region of interest or the clip range change; warping
+ costs the same every frame and runs in bands of projector rows, with
+ scalar code within each band.
+ ***********************************************************************/
+
+#pragma once
+#include "ofMain.h"
+#include "WorkerPool.h"
+#include <functional>
+#include <stdint.h>
+#include <vector>
+
+class ProjectorRemap {
+public:
+    typedef std::function<ofPoint(const ofPoint&)> Projection; // Projects a depth pixel (x, y, depth in millimeters) to projector pixels
+
+    ProjectorRemap();
+
+    void setNumThreads(int newNumThreads); // Sets the number of threads warping bands of each frame (default 1, 0 = one per core)
+
+    /* Builds the table for the depth pixels of roi, with numIntervals+1 planes from the near to the far clip: */
+    void build(unsigned int depthWidth, unsigned int depthHeight, const ofRectangle& roi, float nearclip, float farclip, int numIntervals, unsigned int projectorWidth, unsigned int projectorHeight, const Projection& project);
+    void clear(void); // Discards the table
+    bool isValid(void) const // Returns true if a table was built
+    {
+        return valid;
+    }
+
+    /* Warps an 8-bit depth frame of the size the table was built for into a depth frame of the projector's size, 0 where no pixel lands: */
+    void remap(const ofPixels& depth, ofPixels& projected);
+
+    uint64_t getLastBuildTime(void) const // Returns the time spent building the table, in microseconds
+    {
+        return lastBuildTime;
+    }
+    uint64_t getLastRemapTime(void) const // Returns the time spent warping the last frame, in microseconds
+    {
+        return lastRemapTime;
+    }
+
+    static const int subpixelBits=3; // Fractional bits of the projector positions in the table
+
+private:
+    struct Position // Projector position in 1/2^subpixelBits pixels
+    {
+        int16_t x, y;
+    };
+
+    ProjectorRemap(const ProjectorRemap&); // Prohibit copy constructor
+    ProjectorRemap& operator=(const ProjectorRemap&); // Prohibit assignment operator
+
+    void remapRows(const unsigned char* depth, unsigned char* projected, int row0, int row1) const; // Splats all pixels landing on projector rows [row0, row1)
+
+    bool valid;
+    unsigned int depthWidth, depthHeight; // Size of the depth frames the table was built for
+    int roiX0, roiY0, roiX1, roiY1; // Depth pixels [roiX0, roiX1) x [roiY0, roiY1) of the table
+    unsigned int projectorWidth, projectorHeight;
+    int numIntervals; // Number of depth intervals between the planes
+    std::vector<Position> table; // numIntervals+1 positions per depth pixel, nearest plane first
+    std::vector<Position> footprints; // Size of the box covered by a depth pixel on each plane
+    std::vector<int> rowMinY, rowMaxY; // Range of projector y reached by the boxes of each table row, on any plane
+    WorkerPool workerPool; // Threads warping bands of projector rows
+    uint64_t lastBuildTime; // Time spent building the table, in microseconds
+    uint64_t lastRemapTime; // Time spent warping the last frame, in microseconds
+};
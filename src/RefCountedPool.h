@@ -0,0 +1,231 @@
+/***********************************************************************
+ RefCountedPool - Pool of preallocated objects handed out as reference
+ counted handles, templated on the pooled payload. Handles are cheap to
+ copy and move through thread channels; an object returns to the pool
+ when its last handle is released, so in steady state objects travel
+ between threads without heap allocations. The payload is default
+ constructible and has a Layout type, comparable with !=, describing its
+ size, and an allocate(const Layout&) method sizing it; changing the
+ layout drops the free objects and deletes those in use when released.
+ ***********************************************************************/
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+template <class PayloadParam>
+class RefCountedPool {
+public:
+    typedef PayloadParam Payload; // Type of the pooled objects
+    typedef typename Payload::Layout Layout; // Size of the pooled objects
+
+private:
+    struct Node // Pooled object with its reference count
+    {
+        Payload payload;
+        std::atomic<int> refCount; // Number of handles to the object
+        RefCountedPool* pool; // Pool to return the object to, 0 if the pool was destroyed
+        unsigned int generation; // Layout generation the object was allocated for
+    };
+
+public:
+    class Handle // Reference counted handle to a pooled object
+    {
+    public:
+        Handle()
+        :node(0)
+        {
+        }
+        Handle(const Handle& source)
+        :node(source.node)
+        {
+            if(node!=0)
+                ++node->refCount;
+        }
+        Handle(Handle&& source)
+        :node(source.node)
+        {
+            source.node=0;
+        }
+        ~Handle()
+        {
+            release();
+        }
+        Handle& operator=(const Handle& source)
+        {
+            if(source.node!=node)
+            {
+                if(source.node!=0)
+                    ++source.node->refCount;
+                release();
+                node=source.node;
+            }
+            return *this;
+        }
+        Handle& operator=(Handle&& source)
+        {
+            if(&source!=this)
+            {
+                release();
+                node=source.node;
+                source.node=0;
+            }
+            return *this;
+        }
+
+        void release(void) // Drops this handle; the object returns to the pool with the last handle
+        {
+            if(node!=0&&--node->refCount==0)
+            {
+                if(node->pool!=0)
+                    node->pool->recycle(node);
+                else
+                    delete node;
+            }
+            node=0;
+        }
+        bool isValid(void) const
+        {
+            return node!=0;
+        }
+        int getUseCount(void) const // Returns the number of handles sharing the object
+        {
+            return node!=0?node->refCount.load():0;
+        }
+
+    protected:
+        Payload& getPayload(void)
+        {
+            return node->payload;
+        }
+        const Payload& getPayload(void) const
+        {
+            return node->payload;
+        }
+
+    private:
+        friend class RefCountedPool;
+        explicit Handle(Node* sNode) // Takes the first reference of a node
+        :node(sNode)
+        {
+            node->refCount=1;
+        }
+
+        Node* node; // Shared object, 0 for an empty handle
+    };
+
+    struct Statistics // Usage of the pool since the layout last changed
+    {
+        unsigned int numObjects; // Objects owned by the pool, in use or free
+        unsigned int numFree; // Objects waiting in the pool
+        uint64_t numAllocations; // Objects allocated on the heap
+        uint64_t numAcquired; // Objects handed out by acquire()
+    };
+
+    RefCountedPool()
+    :generation(0), numAllocations(0), numAcquired(0)
+    {
+    }
+    ~RefCountedPool() // Objects still in use are deleted when their last handle is released
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for(size_t i=0;i<nodes.size();++i)
+        {
+            if(std::find(freeNodes.begin(),freeNodes.end(),nodes[i])!=freeNodes.end())
+                delete nodes[i];
+            else
+                nodes[i]->pool=0; // deleted by its last handle
+        }
+    }
+
+    void setup(const Layout& sLayout, unsigned int numPreallocated) // Sets the layout and preallocates objects; does nothing if the layout did not change
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(sLayout!=layout)
+        {
+            /* Drop the free objects; objects in use are deleted when released: */
+            for(size_t i=0;i<freeNodes.size();++i)
+            {
+                nodes.erase(std::find(nodes.begin(),nodes.end(),freeNodes[i]));
+                delete freeNodes[i];
+            }
+            freeNodes.clear();
+            layout=sLayout;
+            ++generation;
+            numAllocations=0;
+            numAcquired=0;
+        }
+
+        /* Preallocate objects up to the requested number: */
+        while(freeNodes.size()<numPreallocated)
+            freeNodes.push_back(allocateNode());
+    }
+    Handle acquire(void) // Returns a free object, allocating one only if all are in use; the content is undefined
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Node* node;
+        if(!freeNodes.empty())
+        {
+            node=freeNodes.back();
+            freeNodes.pop_back();
+        }
+        else
+            node=allocateNode();
+        ++numAcquired;
+        return Handle(node);
+    }
+    Layout getLayout(void) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return layout;
+    }
+    Statistics getStatistics(void) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Statistics statistics;
+        statistics.numObjects=(unsigned int)nodes.size();
+        statistics.numFree=(unsigned int)freeNodes.size();
+        statistics.numAllocations=numAllocations;
+        statistics.numAcquired=numAcquired;
+        return statistics;
+    }
+
+private:
+    RefCountedPool(const RefCountedPool&); // Prohibit copy constructor
+    RefCountedPool& operator=(const RefCountedPool&); // Prohibit assignment operator
+
+    Node* allocateNode(void) // Allocates an object of the current layout; called with the mutex locked
+    {
+        Node* node=new Node;
+        node->payload.allocate(layout);
+        node->refCount=0;
+        node->pool=this;
+        node->generation=generation;
+        nodes.push_back(node);
+        freeNodes.reserve(nodes.size()); // recycling never reallocates the free list
+        ++numAllocations;
+        return node;
+    }
+    void recycle(Node* node) // Returns an object whose last handle was released
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(node->generation!=generation)
+        {
+            /* The layout changed while the object was in use: */
+            nodes.erase(std::find(nodes.begin(),nodes.end(),node));
+            delete node;
+        }
+        else
+            freeNodes.push_back(node);
+    }
+
+    mutable std::mutex mutex; // Protects the object lists and counters
+    Layout layout; // Size of the objects
+    unsigned int generation; // Incremented whenever the layout changes
+    std::vector<Node*> nodes; // All objects owned by the pool
+    std::vector<Node*> freeNodes; // Objects waiting in the pool, capacity kept at nodes.size()
+    uint64_t numAllocations, numAcquired;
+};
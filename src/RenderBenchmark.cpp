@@ -0,0 +1,292 @@
+/***********************************************************************
+ RenderBenchmark - Measures the CPU colormap and contour line renderer
+ at projector resolutions.
+ ***********************************************************************/
+
+#include "RenderBenchmark.h"
+#include "ofMain.h"
+#include "ColorMapRenderer.h"
+#include "DirtyTiles.h"
+#include "ProjectorRayMarcher.h"
+#include "SyntheticDepthSource.h"
+#include "TerrainMesh.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace RenderBenchmark {
+
+/* Returns true if two meshes have the same vertices, normals and triangles: */
+static bool sameMesh(ofMesh& a, ofMesh& b)
+{
+    if(a.getVertices().size()!=b.getVertices().size()||a.getIndices()!=b.getIndices())
+        return false;
+    for(size_t i=0;i<a.getVertices().size();++i)
+    {
+        const ofPoint& va=a.getVertices()[i];
+        const ofPoint& vb=b.getVertices()[i];
+        const ofVec3f& na=a.getNormals()[i];
+        const ofVec3f& nb=b.getNormals()[i];
+        if(va.x!=vb.x||va.y!=vb.y||va.z!=vb.z||na.x!=nb.x||na.y!=nb.y||na.z!=nb.z)
+            return false;
+    }
+    return true;
+}
+
+/* Samples an 8-bit single channel image at a texel coordinate like linear texture filtering with 8-bit weights and clamp to edge, in [0, 255]: */
+static float sampleLinear(const unsigned char* data, int width, int height, float u, float v)
+{
+    float x=u-0.5f,y=v-0.5f;
+    float x0=std::floor(x),y0=std::floor(y);
+    float wx=std::floor((x-x0)*256.0f+0.5f)/256.0f,wy=std::floor((y-y0)*256.0f+0.5f)/256.0f;
+    int ix0=std::min(std::max(int(x0),0),width-1),ix1=std::min(std::max(int(x0)+1,0),width-1);
+    int iy0=std::min(std::max(int(y0),0),height-1),iy1=std::min(std::max(int(y0)+1,0),height-1);
+    float top=float(data[iy0*width+ix0])*(1.0f-wx)+float(data[iy0*width+ix1])*wx;
+    float bottom=float(data[iy1*width+ix0])*(1.0f-wx)+float(data[iy1*width+ix1])*wx;
+    return top*(1.0f-wy)+bottom*wy;
+}
+
+/* The shader, pixel by pixel: the frame scaled into the frame buffer object, then colored and masked by the contour intervals of its corners: */
+static void referenceRender(const ColorMap& colormap, const ofPixels& depth, unsigned int width, unsigned int height, float contourLineFactor, ofPixels& rgb)
+{
+    int w=int(width),h=int(height);
+    int dw=int(depth.getWidth()),dh=int(depth.getHeight());
+    std::vector<unsigned char> fbo(size_t(w)*h);
+    for(int y=0;y<h;++y)
+        for(int x=0;x<w;++x)
+            fbo[size_t(y)*w+x]=(unsigned char)(sampleLinear(depth.getData(),dw,dh,(float(x)+0.5f)*float(dw)/float(w),(float(y)+0.5f)*float(dh)/float(h))+0.5f);
+
+    rgb.allocate(width,height,3);
+    int lastEntry=colormap.getNumEntries()-1;
+    for(int y=0;y<h;++y)
+        for(int x=0;x<w;++x)
+        {
+            float px=float(x)+0.5f,py=float(y)+0.5f;
+            float depthvalue=float(fbo[size_t(y)*w+x]);
+            float corners[4];
+            corners[0]=std::floor(sampleLinear(&fbo[0],w,h,px-0.5f,py-0.5f)/255.0f*contourLineFactor);
+            corners[1]=std::floor(sampleLinear(&fbo[0],w,h,px+0.5f,py-0.5f)/255.0f*contourLineFactor);
+            corners[2]=std::floor(sampleLinear(&fbo[0],w,h,px-0.5f,py+0.5f)/255.0f*contourLineFactor);
+            corners[3]=std::floor(sampleLinear(&fbo[0],w,h,px+0.5f,py+0.5f)/255.0f*contourLineFactor);
+            int edgeMask=0;
+            if(corners[0]!=corners[1])
+                edgeMask|=1;
+            if(corners[2]!=corners[3])
+                edgeMask|=2;
+            if(corners[0]!=corners[2])
+                edgeMask|=4;
+            if(corners[1]!=corners[3])
+                edgeMask|=8;
+            int numEdges=(edgeMask&1)+((edgeMask>>1)&1)+((edgeMask>>2)&1)+((edgeMask>>3)&1);
+            unsigned char* out=rgb.getData()+(size_t(y)*w+x)*3;
+            if(numEdges>2||edgeMask==3||edgeMask==12||(numEdges==2&&(x+y)%2==0))
+            {
+                out[0]=out[1]=out[2]=0;
+                continue;
+            }
+
+            /* The colormap texture at x=depth, between two texel centers: */
+            float cx=depthvalue-0.5f;
+            int i0=std::min(std::max(int(std::floor(cx)),0),lastEntry),i1=std::min(std::max(int(std::floor(cx))+1,0),lastEntry);
+            ColorMap::Color c0=colormap(i0),c1=colormap(i1);
+            out[0]=(unsigned char)(0.5f*(float(c0.r)+float(c1.r))+0.5f);
+            out[1]=(unsigned char)(0.5f*(float(c0.g)+float(c1.g))+0.5f);
+            out[2]=(unsigned char)(0.5f*(float(c0.b)+float(c1.b))+0.5f);
+        }
+}
+
+bool measureColorMapRenderer(const ColorMap& colormap, unsigned int width, unsigned int height, int numFrames, int numThreads)
+{
+    /* Kinect sized frames of the synthetic sandbox, mapped to 8 bits over the default clip range: */
+    SyntheticDepthSource source;
+    source.setNumThreads(numThreads);
+    source.open(640, 480, 0.0f);
+    source.setDepthClipping(750.0f, 950.0f);
+    std::vector<ofPixels> frames(numFrames);
+    for(int f=0;f<numFrames;++f)
+    {
+        source.update();
+        frames[f]=source.getDepthPixels();
+    }
+    float contourLineFactor=50.0f;
+
+    /* On one thread and on the worker pool: */
+    ofPixels rgb;
+    double renderMicros[2];
+    for(int run=0;run<2;++run)
+    {
+        ColorMapRenderer renderer;
+        renderer.setColorMap(colormap);
+        renderer.setNumThreads(run==0?1:numThreads);
+        renderer.render(frames[0],width,height,contourLineFactor,rgb);
+        uint64_t start=ofGetElapsedTimeMicros();
+        for(int f=0;f<numFrames;++f)
+            renderer.render(frames[f],width,height,contourLineFactor,rgb);
+        renderMicros[run]=double(ofGetElapsedTimeMicros()-start)/numFrames;
+    }
+
+    /* The last frame against the shader's semantics: */
+    ofPixels reference;
+    referenceRender(colormap,frames[numFrames-1],width,height,contourLineFactor,reference);
+    size_t numDifferent=0;
+    for(size_t i=0;i<size_t(width)*height;++i)
+        if(!std::equal(rgb.getData()+i*3,rgb.getData()+i*3+3,reference.getData()+i*3))
+            ++numDifferent;
+
+    std::cout<< "Colormap renderer from 640x480 to " << width << "x" << height << ": " << renderMicros[0] << " us/frame (1 thread), " << renderMicros[1] << " us/frame (pool), " << 1.0e6/renderMicros[1] << " fps, " << numDifferent << " pixels different from the shader" <<std::endl;
+    return numDifferent==0;
+}
+
+bool measureRayMarcher(unsigned int width, unsigned int height, int numFrames, int numThreads)
+{
+    /* Kinect sized frames of the synthetic sandbox and their dirty tiles, over the default clip range: */
+    float nearclip=750.0f,farclip=950.0f;
+    SyntheticDepthSource source;
+    source.setNumThreads(numThreads);
+    source.open(640, 480, 0.0f);
+    source.setDepthClipping(nearclip, farclip);
+    DirtyTiles dirtyTiles;
+    unsigned int tileSize=20;
+    dirtyTiles.setup(640, 480, tileSize);
+    std::vector<ofPixels> frames(numFrames);
+    std::vector<std::vector<unsigned char> > flags(numFrames);
+    for(int f=0;f<numFrames;++f)
+    {
+        source.update();
+        frames[f]=source.getDepthPixels();
+        dirtyTiles.update(frames[f].getData());
+        flags[f]=dirtyTiles.getFlags();
+    }
+
+    /* A pinhole projector 200 mm beside the kinect, looking the same way and covering the sand at 900 mm: */
+    DepthSource::Intrinsics intrinsics=source.getIntrinsics();
+    float projectorFocal=float(width)*900.0f/(640.0f/intrinsics.fx*900.0f);
+    ProjectorRayMarcher::Projection project=[&](const ofPoint& p) -> ofPoint {
+        float x=(p.x-intrinsics.cx)/intrinsics.fx*p.z-200.0f;
+        float y=(p.y-intrinsics.cy)/intrinsics.fy*p.z;
+        return ofPoint(x/p.z*projectorFocal+0.5f*float(width), y/p.z*projectorFocal+0.5f*float(height), 0.0f);
+    };
+
+    /* Every ray of every frame, on one thread and on the worker pool: */
+    double fullMicros[2];
+    uint64_t buildTime=0;
+    for(int run=0;run<2;++run)
+    {
+        ProjectorRayMarcher marcher;
+        marcher.setNumThreads(run==0?1:numThreads);
+        marcher.build(640, 480, nearclip, farclip, width, height, project);
+        buildTime=marcher.getLastBuildTime();
+        uint64_t start=ofGetElapsedTimeMicros();
+        for(int f=0;f<numFrames;++f)
+            marcher.march(frames[f], 0, tileSize);
+        fullMicros[run]=double(ofGetElapsedTimeMicros()-start)/numFrames;
+    }
+
+    /* Only the rays crossing changed tiles, checked against marching every ray: */
+    ProjectorRayMarcher incremental,full;
+    incremental.setNumThreads(numThreads);
+    full.setNumThreads(numThreads);
+    incremental.build(640, 480, nearclip, farclip, width, height, project);
+    full.build(640, 480, nearclip, farclip, width, height, project);
+    uint64_t incrementalTime=0;
+    double numRays=0.0;
+    bool identical=true;
+    for(int f=0;f<numFrames;++f)
+    {
+        uint64_t start=ofGetElapsedTimeMicros();
+        incremental.march(frames[f], f>0?&flags[f]:0, tileSize);
+        incrementalTime+=ofGetElapsedTimeMicros()-start;
+        numRays+=incremental.getLastNumRays();
+        full.march(frames[f], 0, tileSize);
+        identical=identical&&incremental.getHits()==full.getHits();
+    }
+    size_t numHits=0;
+    for(size_t i=0;i<full.getHits().size();++i)
+        if(full.getHits()[i]>=0)
+            ++numHits;
+
+    std::cout<< "Projector ray marcher at " << width << "x" << height << ": " << full.getNumSteps() << " steps per ray, built in " << buildTime << " us, " << 100.0*double(numHits)/double(size_t(width)*height) << "% of the rays hit" <<std::endl;
+    std::cout<< "  all rays " << fullMicros[0] << " us/frame (1 thread), " << fullMicros[1] << " us/frame (pool); changed tiles " << double(incrementalTime)/numFrames << " us/frame, " << 100.0*numRays/(double(numFrames)*width*height) << "% of the rays, " << (identical?"identical":"DIFFERENT") << " hits" <<std::endl;
+    return identical;
+}
+
+bool measureTerrainMesh(unsigned int width, unsigned int height, int numHands, int numFrames, int numThreads)
+{
+    /* Noiseless frames only change under the hands, like filtered ones; noisy frames change everywhere, every frame: */
+    float nearclip=750.0f,farclip=950.0f;
+    unsigned int tileSize=20;
+    bool allIdentical=true;
+    for(int noisy=0;noisy<2;++noisy)
+    {
+        SyntheticDepthSource source;
+        source.setNumThreads(numThreads);
+        source.setNumHands(numHands);
+        if(!noisy)
+        {
+            source.setNoise(0.0f);
+            source.setDropoutRate(0.0f);
+        }
+        source.open(width, height, 0.0f);
+        source.setDepthClipping(nearclip, farclip);
+        DirtyTiles dirtyTiles;
+        dirtyTiles.setup(width, height, tileSize);
+        std::vector<ofPixels> frames(numFrames);
+        std::vector<std::vector<unsigned char> > flags(numFrames);
+        double numDirty=0.0;
+        for(int f=0;f<numFrames;++f)
+        {
+            source.update();
+            frames[f]=source.getDepthPixels();
+            dirtyTiles.update(frames[f].getData());
+            flags[f]=dirtyTiles.getFlags();
+            if(f>0)
+                numDirty+=dirtyTiles.getNumDirty();
+        }
+
+        /* Rebuilding everything every frame, on one thread and on the worker pool: */
+        double fullMicros[2];
+        for(int run=0;run<2;++run)
+        {
+            TerrainMesh mesh;
+            mesh.setNumThreads(run==0?1:numThreads);
+            mesh.setup(width, height, source.getIntrinsics(), nearclip, farclip);
+            uint64_t start=ofGetElapsedTimeMicros();
+            for(int f=0;f<numFrames;++f)
+                mesh.update(frames[f], 0, tileSize);
+            fullMicros[run]=double(ofGetElapsedTimeMicros()-start)/numFrames;
+        }
+
+        /* Only the changed tiles after the first frame, checked against rebuilding everything: */
+        TerrainMesh incremental,full;
+        incremental.setNumThreads(numThreads);
+        incremental.setup(width, height, source.getIntrinsics(), nearclip, farclip);
+        full.setup(width, height, source.getIntrinsics(), nearclip, farclip);
+        uint64_t incrementalTime=0,maxTime=0;
+        double numVertices=0.0,numRebuilt=0.0,numTriangles=0.0;
+        bool identical=true;
+        for(int f=0;f<numFrames;++f)
+        {
+            incremental.update(frames[f], f>0?&flags[f]:0, tileSize);
+            full.update(frames[f], 0, tileSize);
+            identical=identical&&sameMesh(incremental.getMesh(),full.getMesh());
+            if(f==0)
+                continue;
+            incrementalTime+=incremental.getLastUpdateTime();
+            maxTime=std::max(maxTime,incremental.getLastUpdateTime());
+            numVertices+=incremental.getLastNumUpdatedVertices();
+            numRebuilt+=incremental.getLastNumRebuiltRoots();
+            numTriangles+=incremental.getNumTriangles();
+        }
+        int numUpdates=std::max(numFrames-1,1);
+        double gridVertices=double(incremental.getMesh().getNumVertices());
+        double gridTriangles=2.0*double(width)*double(height);
+
+        std::cout<< "Terrain mesh of " << width << "x" << height << (noisy?" noisy":" noiseless") << " frames with " << numHands << " hands: " << 100.0*numDirty/(double(numUpdates)*dirtyTiles.getNumTiles()) << "% of the tiles change per frame" <<std::endl;
+        std::cout<< "  rebuilding everything " << fullMicros[0] << " us/frame (1 thread), " << fullMicros[1] << " us/frame (pool); changed tiles " << double(incrementalTime)/numUpdates << " us/frame, at most " << maxTime << " us, " << 100.0*numVertices/(double(numUpdates)*gridVertices) << "% of the vertices moved, " << numRebuilt/numUpdates << " root nodes retriangulated, " << (identical?"identical":"DIFFERENT") << " meshes" <<std::endl;
+        std::cout<< "  " << numTriangles/numUpdates << " triangles (" << 100.0*numTriangles/(double(numUpdates)*gridTriangles) << "% of the full grid), " << incremental.getNumLeaves() << " leaves" <<std::endl;
+        allIdentical=allIdentical&&identical;
+    }
+    return allIdentical;
+}
+
+}
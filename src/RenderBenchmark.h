@@ -0,0 +1,23 @@
+/***********************************************************************
+ RenderBenchmark - Measures the CPU colormap and contour line renderer
+ at projector resolutions on frames of the synthetic sandbox, on one
+ thread and on the worker pool, and checks its output pixel by pixel
+ against a literal per-pixel transcription of the shader. Also times
+ the projector ray marcher with a pinhole projector beside the kinect,
+ marching every ray and only the rays crossing changed tiles, and the
+ terrain mesh, updated only where hands move and everywhere under noise.
+ ***********************************************************************/
+
+#pragma once
+#include "ColorMap.h"
+
+namespace RenderBenchmark {
+    /* Renders numFrames synthetic kinect frames at width x height with the given color map, prints the results and returns true if the last frame matches the shader: */
+    bool measureColorMapRenderer(const ColorMap& colormap, unsigned int width, unsigned int height, int numFrames, int numThreads);
+
+    /* Marches the rays of a width x height projector against numFrames synthetic kinect frames, fully and incrementally, checks both hit the same samples, prints the results and returns true if they do: */
+    bool measureRayMarcher(unsigned int width, unsigned int height, int numFrames, int numThreads);
+
+    /* Updates the terrain mesh of width x height synthetic kinect frames with numHands moving hands, only the changed tiles of noiseless frames and every tile of noisy ones, checks the former against rebuilding everything, prints the results and returns true if they match: */
+    bool measureTerrainMesh(unsigned int width, unsigned int height, int numHands, int numFrames, int numThreads);
+}
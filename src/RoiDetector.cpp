@@ -0,0 +1,172 @@
+/***********************************************************************
+ RoiDetector - Finds the region of interest of the sandbox in a single
+ pass over the depth frame.
+ ***********************************************************************/
+
+#include "RoiDetector.h"
+#include <algorithm>
+#include <cmath>
+
+/****************************
+ Methods of class RoiDetector:
+ ****************************/
+
+RoiDetector::RoiDetector()
+:finished(false), busy(false)
+{
+    result.found=false;
+    result.threshold=-1;
+    result.area=0;
+    result.detectionTime=0;
+}
+
+RoiDetector::~RoiDetector()
+{
+    if(thread.joinable())
+        thread.join();
+}
+
+RoiDetector::Result RoiDetector::detect(const ofPixels& depth, const std::vector<ofVec2f>& points, int minThreshold, bool mirrorX, bool mirrorY)
+{
+    uint64_t startTime=ofGetElapsedTimeMicros();
+    Result result;
+    result.found=false;
+    result.threshold=-1;
+    result.area=0;
+
+    int width=int(depth.getWidth());
+    int height=int(depth.getHeight());
+    const unsigned char* data=depth.getData();
+
+    /* Map the points to the unmirrored frame; all of them have to be inside it: */
+    std::vector<size_t> seeds;
+    for(size_t i=0;i<points.size();++i)
+    {
+        int x=int(std::floor(points[i].x));
+        int y=int(std::floor(points[i].y));
+        if(mirrorX)
+            x=width-1-x;
+        if(mirrorY)
+            y=height-1-y;
+        if(x<0||y<0||x>=width||y>=height)
+        {
+            seeds.clear();
+            break;
+        }
+        seeds.push_back(size_t(y)*width+x);
+    }
+    if(seeds.empty())
+    {
+        result.detectionTime=ofGetElapsedTimeMicros()-startTime;
+        return result;
+    }
+
+    /* Flood from the first point in order of the level at which pixels join the region, the largest value on their lowest path: */
+    const unsigned short unvisited=256;
+    std::vector<unsigned short> levels(size_t(width)*height,unvisited);
+    std::vector<std::vector<uint32_t> > queues(256);
+    unsigned int areas[256];
+    int minX[256],minY[256],maxX[256],maxY[256];
+    for(int l=0;l<256;++l)
+    {
+        areas[l]=0;
+        minX[l]=minY[l]=std::max(width,height);
+        maxX[l]=maxY[l]=-1;
+    }
+    levels[seeds[0]]=data[seeds[0]];
+    queues[data[seeds[0]]].push_back(uint32_t(seeds[0]));
+
+    /* The region leaks out of the box at the first level at which it reaches the border: */
+    int borderLevel=256;
+    for(int l=0;l<256&&borderLevel==256;++l)
+    {
+        std::vector<uint32_t>& queue=queues[l];
+        while(!queue.empty())
+        {
+            uint32_t i=queue.back();
+            queue.pop_back();
+            int x=int(i%width);
+            int y=int(i/width);
+            if(x==0||y==0||x==width-1||y==height-1)
+            {
+                borderLevel=l;
+                break;
+            }
+
+            /* Account for the pixel at its level: */
+            ++areas[l];
+            minX[l]=std::min(minX[l],x);
+            minY[l]=std::min(minY[l],y);
+            maxX[l]=std::max(maxX[l],x);
+            maxY[l]=std::max(maxY[l],y);
+
+            /* Enter the unvisited 4-neighbors at the level at which they join: */
+            uint32_t neighbors[4]={i-1,i+1,i-width,i+width};
+            for(int n=0;n<4;++n)
+                if(levels[neighbors[n]]==unvisited)
+                {
+                    unsigned short level=std::max<unsigned short>(l,data[neighbors[n]]);
+                    levels[neighbors[n]]=level;
+                    queues[level].push_back(neighbors[n]);
+                }
+        }
+    }
+
+    /* The region has to contain every point before it leaks, and its largest enclosed extent is at the last threshold before: */
+    int lowest=minThreshold;
+    for(size_t i=0;i<seeds.size();++i)
+        lowest=std::max(lowest,int(levels[seeds[i]]));
+    int threshold=std::min(254,borderLevel-1);
+    if(threshold>=lowest)
+    {
+        int x0=width,y0=height,x1=-1,y1=-1;
+        for(int l=0;l<=threshold;++l)
+        {
+            result.area+=areas[l];
+            if(areas[l]!=0)
+            {
+                x0=std::min(x0,minX[l]);
+                y0=std::min(y0,minY[l]);
+                x1=std::max(x1,maxX[l]);
+                y1=std::max(y1,maxY[l]);
+            }
+        }
+        result.found=true;
+        result.threshold=threshold;
+        result.roi=ofRectangle(float(x0),float(y0),float(x1-x0+1),float(y1-y0+1));
+    }
+    result.detectionTime=ofGetElapsedTimeMicros()-startTime;
+    return result;
+}
+
+bool RoiDetector::start(const ofPixels& depth, const std::vector<ofVec2f>& points, int minThreshold, bool mirrorX, bool mirrorY)
+{
+    if(busy)
+        return false;
+
+    /* The thread works on copies, the frame being released by the caller: */
+    frame=depth;
+    framePoints=points;
+    finished=false;
+    busy=true;
+    thread=std::thread([this,minThreshold,mirrorX,mirrorY](){
+        result=detect(frame,framePoints,minThreshold,mirrorX,mirrorY);
+        finished=true;
+    });
+    return true;
+}
+
+bool RoiDetector::isBusy(void) const
+{
+    return busy;
+}
+
+bool RoiDetector::tryGetResult(Result& newResult)
+{
+    if(!busy||!finished)
+        return false;
+    thread.join();
+    busy=false;
+    newResult=result;
+    return true;
+}
@@ -0,0 +1,53 @@
+/***********************************************************************
+ RoiDetector - Finds the region of interest of the sandbox during the
+ calibration: the largest area of the depth frame enclosed by the walls
+ of the box and containing the whole chessboard. For every threshold t,
+ the candidate is the connected region of pixels at most t (farther
+ than the walls) around the chessboard, if it does not reach the border
+ of the frame. These regions are nested, so one priority flood from the
+ chessboard, visiting pixels by the lowest threshold at which they join
+ it, gives all thresholds in a single pass; the largest valid region
+ is the one of the last threshold before the flood reaches the border.
+ Detections run on a background thread, off the UI thread.
+ ***********************************************************************/
+
+#pragma once
+#include "ofMain.h"
+#include <atomic>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+class RoiDetector {
+public:
+    struct Result // Region of interest found in a depth frame
+    {
+        bool found; // Flag whether a region enclosing the chessboard was found
+        ofRectangle roi; // Bounding box of the region, in unmirrored frame pixels
+        int threshold; // Largest threshold for which the region is enclosed
+        unsigned int area; // Number of pixels of the region
+        uint64_t detectionTime; // Time spent detecting, in microseconds
+    };
+
+    RoiDetector();
+    ~RoiDetector();
+
+    /* Detects the region of a depth frame around points given in the frame mirrored as requested, for thresholds from minThreshold to 254: */
+    static Result detect(const ofPixels& depth, const std::vector<ofVec2f>& points, int minThreshold, bool mirrorX, bool mirrorY);
+
+    /* Background detection, one at a time: */
+    bool start(const ofPixels& depth, const std::vector<ofVec2f>& points, int minThreshold, bool mirrorX, bool mirrorY); // Copies the frame and starts detecting on a background thread; returns false if a detection is in progress
+    bool isBusy(void) const; // Returns true if a detection was started and its result not received yet
+    bool tryGetResult(Result& result); // Returns the result of the started detection if it is finished
+
+private:
+    RoiDetector(const RoiDetector&); // Prohibit copy constructor
+    RoiDetector& operator=(const RoiDetector&); // Prohibit assignment operator
+
+    std::thread thread; // Thread of the started detection
+    std::atomic<bool> finished; // Flag whether the started detection finished
+    bool busy; // Flag whether a detection was started and its result not received yet
+    ofPixels frame; // Copy of the frame being searched
+    std::vector<ofVec2f> framePoints; // Copy of the chessboard points
+    Result result; // Result of the last detection
+};
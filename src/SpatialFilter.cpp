@@ -0,0 +1,275 @@
+/***********************************************************************
+ SpatialFilter - Separable binomial low-pass filter for depth frames
+ normalized to the clip range, processed in cache-friendly row strips.
+ ***********************************************************************/
+
+#include "SpatialFilter.h"
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=2)
+#define SPATIALFILTER_SSE2 1
+#include <emmintrin.h>
+#endif
+
+SpatialFilter::SpatialFilter()
+:width(0), height(0), numPasses(2), radius(0), outputCacheValid(false), numFilteredTiles(0)
+{
+    setRadius(1);
+}
+
+void SpatialFilter::allocate(unsigned int swidth, unsigned int sheight)
+{
+    width=swidth;
+    height=sheight;
+    spareFrame.assign(size_t(width)*height,0);
+    secondSpareFrame.clear();
+    outputCache.clear();
+    outputCacheValid=false;
+    bandAccumulators.clear();
+    bandRows.clear();
+}
+
+void SpatialFilter::setNumPasses(int newNumPasses)
+{
+    numPasses=newNumPasses>0?newNumPasses:0;
+    outputCacheValid=false;
+}
+
+int SpatialFilter::getNumPasses(void) const
+{
+    return numPasses;
+}
+
+void SpatialFilter::setRadius(int newRadius)
+{
+    radius=std::max(1,std::min(newRadius,int(maxRadius)));
+    outputCacheValid=false;
+    
+    /* Binomial weights C(2*radius, i): */
+    weights[0]=1;
+    for(int i=1;i<=2*radius;++i)
+        weights[i]=Accumulator(weights[i-1]*(2*radius-i+1)/i);
+}
+
+int SpatialFilter::getRadius(void) const
+{
+    return radius;
+}
+
+void SpatialFilter::apply(RawDepth* frame, WorkerPool& workerPool)
+{
+    if(numPasses==0||height==0)
+        return;
+    
+    int numBands=workerPool.getNumThreads();
+    allocateRowBuffers(numBands);
+    
+    /* Alternate between the frame and the spare frame; each pass reads across band seams from its unfiltered source: */
+    RawDepth* src=frame;
+    RawDepth* dst=&spareFrame[0];
+    for(int pass=0;pass<numPasses;++pass)
+    {
+        workerPool.run(numBands,[&](int band){
+            filterRect(src,dst,0,band*height/numBands,width,(band+1)*height/numBands,band);
+        });
+        std::swap(src,dst);
+    }
+    
+    /* Copy the result of an odd number of passes back into the frame: */
+    if(src!=frame)
+        std::copy(src,src+size_t(width)*height,frame);
+}
+
+void SpatialFilter::apply(RawDepth* frame, WorkerPool& workerPool, const DirtyTiles& inputTiles)
+{
+    size_t numPixels=size_t(width)*height;
+    if(numPasses==0||height==0)
+    {
+        numFilteredTiles=0;
+        return;
+    }
+    
+    /* Filter the whole frame the first time, or if everything changed: */
+    if(!outputCacheValid||inputTiles.isAllDirty()||int(inputTiles.getTileSize())<radius)
+    {
+        apply(frame,workerPool);
+        outputCache.assign(frame,frame+numPixels);
+        outputCacheValid=true;
+        numFilteredTiles=inputTiles.getNumTiles();
+        return;
+    }
+    
+    int numBands=workerPool.getNumThreads();
+    allocateRowBuffers(numBands);
+    if(numPasses>2&&secondSpareFrame.size()!=numPixels)
+        secondSpareFrame.assign(numPixels,0);
+    
+    /* Output tiles reached by a dirty input tile across all passes; each earlier pass covers one more ring of tiles, as a pass reads at most radius<=tileSize pixels outside the tiles it writes: */
+    int tileSize=inputTiles.getTileSize();
+    int outputReach=(numPasses*radius+tileSize-1)/tileSize;
+    const RawDepth* src=frame;
+    RawDepth* intermediates[2]={&spareFrame[0],numPasses>2?&secondSpareFrame[0]:0};
+    for(int pass=0;pass<numPasses;++pass)
+    {
+        bool lastPass=pass==numPasses-1;
+        RawDepth* dst=lastPass?&outputCache[0]:intermediates[pass%2];
+        inputTiles.dilate(outputReach+numPasses-1-pass,passTiles);
+        
+        /* Collect the tiles of this pass and share them between the bands: */
+        std::vector<int> tiles;
+        for(int t=0;t<int(passTiles.size());++t)
+            if(passTiles[t])
+                tiles.push_back(t);
+        if(lastPass)
+            numFilteredTiles=int(tiles.size());
+        int tilesX=inputTiles.getTilesX();
+        workerPool.run(numBands,[&](int band){
+            for(size_t i=band*tiles.size()/numBands;i<(band+1)*tiles.size()/numBands;++i)
+            {
+                unsigned int x0=(tiles[i]%tilesX)*tileSize, y0=(tiles[i]/tilesX)*tileSize;
+                filterRect(src,dst,x0,y0,std::min(x0+tileSize,width),std::min(y0+tileSize,height),band);
+            }
+        });
+        src=dst;
+    }
+    
+    /* The cache holds the new output in the filtered tiles and the previous output elsewhere: */
+    std::copy(outputCache.begin(),outputCache.end(),frame);
+}
+
+int SpatialFilter::getNumFilteredTiles(void) const
+{
+    return numFilteredTiles;
+}
+
+void SpatialFilter::allocateRowBuffers(int numBands)
+{
+    if(int(bandRows.size())!=numBands)
+    {
+        bandAccumulators.assign(numBands,std::vector<Accumulator>(width));
+        bandRows.assign(numBands,std::vector<RawDepth>(width));
+    }
+}
+
+size_t SpatialFilter::getMemoryFootprint(void) const
+{
+    size_t rowBuffers=bandRows.size()*width*(sizeof(RawDepth)+sizeof(Accumulator));
+    return (spareFrame.size()+secondSpareFrame.size()+outputCache.size())*sizeof(RawDepth)+rowBuffers;
+}
+
+void SpatialFilter::filterRect(const RawDepth* src, RawDepth* dst, unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1, int band)
+{
+    Accumulator* acc=&bandAccumulators[band][0];
+    RawDepth* row=&bandRows[band][0];
+    
+    /* The horizontal kernel reads radius pixels to each side of the rectangle: */
+    unsigned int xa=x0>unsigned(radius)?x0-radius:0;
+    unsigned int xb=std::min(x1+radius,width);
+    for(unsigned int y=y0;y<y1;++y)
+    {
+        filterVertical(src,y,xa,xb,acc,row);
+        filterHorizontal(row,x0,x1,dst+size_t(y)*width);
+    }
+}
+
+void SpatialFilter::filterVertical(const RawDepth* src, unsigned int y, unsigned int xa, unsigned int xb, Accumulator* acc, RawDepth* row) const
+{
+    /* Kernel taps inside the frame: */
+    int k0=std::max(0,radius-int(y));
+    int k1=std::min(2*radius,radius+int(height-1-y));
+    if(k0==0&&k1==2*radius)
+    {
+        /* Interior rows: the weights sum to 4^radius: */
+        filterTaps(src+(size_t(y)-radius)*width+xa,width,row+xa,xb-xa);
+        return;
+    }
+    
+    /* Border rows: accumulate whole rows so that the inner loops run over contiguous pixels: */
+    const RawDepth* tapPtr=src+(size_t(y)+k0-radius)*width;
+    for(unsigned int x=xa;x<xb;++x)
+        acc[x]=Accumulator(weights[k0]*tapPtr[x]);
+    for(int k=k0+1;k<=k1;++k)
+    {
+        tapPtr+=width;
+        Accumulator w=weights[k];
+        for(unsigned int x=xa;x<xb;++x)
+            acc[x]=Accumulator(acc[x]+w*tapPtr[x]);
+    }
+    
+    
+    /* Renormalize to the taps inside the frame: */
+    unsigned int weightSum=0;
+    for(int k=k0;k<=k1;++k)
+        weightSum+=weights[k];
+    for(unsigned int x=xa;x<xb;++x)
+        row[x]=RawDepth(acc[x]/weightSum);
+}
+
+void SpatialFilter::filterHorizontal(const RawDepth* row, unsigned int x0, unsigned int x1, RawDepth* dst) const
+{
+    /* Interior pixels, whose taps are all inside the row: */
+    int xi0=std::max(int(x0),radius);
+    int xi1=std::min(int(x1),int(width)-radius);
+    if(xi0<xi1)
+        filterTaps(row+xi0-radius,1,dst+xi0,xi1-xi0);
+    else
+        xi0=xi1=int(x1);
+    
+    /* Border pixels: renormalize to the taps inside the row: */
+    for(int x=int(x0);x<xi0;++x)
+        dst[x]=filterBorderPixel(row,x);
+    for(int x=xi1;x<int(x1);++x)
+        dst[x]=filterBorderPixel(row,x);
+}
+
+SpatialFilter::RawDepth SpatialFilter::filterBorderPixel(const RawDepth* row, int x) const
+{
+    int r=radius;
+    int w=int(width);
+    unsigned int sum=0,weightSum=0;
+    for(int k=std::max(0,r-x);k<=std::min(2*r,r+w-1-x);++k)
+    {
+        sum+=weights[k]*row[x+k-r];
+        weightSum+=weights[k];
+    }
+    return RawDepth(sum/weightSum);
+}
+
+void SpatialFilter::filterTaps(const RawDepth* base, size_t stride, RawDepth* dst, unsigned int n) const
+{
+    int numTaps=2*radius+1;
+    int shift=2*radius;
+    unsigned int x=0;
+    
+#if defined(SPATIALFILTER_SSE2)
+    /* Sixteen pixels at a time in 16-bit lanes: */
+    const __m128i zero=_mm_setzero_si128();
+    const __m128i shiftCount=_mm_cvtsi32_si128(shift);
+    for(;x+16<=n;x+=16)
+    {
+        __m128i lo=zero;
+        __m128i hi=zero;
+        const RawDepth* tapPtr=base+x;
+        for(int k=0;k<numTaps;++k,tapPtr+=stride)
+        {
+            __m128i v=_mm_loadu_si128(reinterpret_cast<const __m128i*>(tapPtr));
+            __m128i w=_mm_set1_epi16(short(weights[k]));
+            lo=_mm_add_epi16(lo,_mm_mullo_epi16(_mm_unpacklo_epi8(v,zero),w));
+            hi=_mm_add_epi16(hi,_mm_mullo_epi16(_mm_unpackhi_epi8(v,zero),w));
+        }
+        lo=_mm_srl_epi16(lo,shiftCount);
+        hi=_mm_srl_epi16(hi,shiftCount);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst+x),_mm_packus_epi16(lo,hi));
+    }
+#endif
+    
+    /* Remaining pixels: */
+    for(;x<n;++x)
+    {
+        unsigned int sum=0;
+        const RawDepth* tapPtr=base+x;
+        for(int k=0;k<numTaps;++k,tapPtr+=stride)
+            sum+=weights[k]**tapPtr;
+        dst[x]=RawDepth(sum>>shift);
+    }
+}
@@ -0,0 +1,59 @@
+/***********************************************************************
+ SpatialFilter - Separable binomial low-pass filter for depth frames
+ normalized to the clip range. Each pass filters rows in horizontal
+ strips: the vertical kernel is applied to a row of the source frame and
+ the horizontal kernel to the result, so every row is read from a cache
+ resident window of 2*radius+1 rows and written once. Near the frame
+ border the kernel is renormalized to the weights inside the frame; with
+ radius 1 the result matches the original 1-2-1 float filter exactly.
+ Given the tiles of the input that changed since the previous frame, only
+ the tiles within reach of the kernel are filtered again; the others keep
+ the previous output.
+ ***********************************************************************/
+
+#pragma once
+#include "WorkerPool.h"
+#include "DirtyTiles.h"
+#include <vector>
+
+class SpatialFilter {
+public:
+    typedef unsigned char RawDepth; // Data type for depth values normalized to the clip range
+    typedef unsigned short Accumulator; // Data type of weighted sums; 255*4^radius fits for radius<=maxRadius
+
+    static const int maxRadius=4; // Largest supported kernel radius
+
+    SpatialFilter();
+
+    void allocate(unsigned int swidth, unsigned int sheight); // Allocates the intermediate frame
+    void setNumPasses(int newNumPasses); // Sets the number of filter passes per frame
+    int getNumPasses(void) const;
+    void setRadius(int newRadius); // Sets the kernel radius, kernel width is 2*radius+1
+    int getRadius(void) const;
+    void apply(RawDepth* frame, WorkerPool& workerPool); // Filters the frame in place, in bands of rows
+    void apply(RawDepth* frame, WorkerPool& workerPool, const DirtyTiles& inputTiles); // Filters the frame in place, recomputing only the tiles reached by dirty input tiles
+    int getNumFilteredTiles(void) const; // Returns the number of tiles filtered by the last tile-restricted apply() (all tiles if it filtered the whole frame)
+    size_t getMemoryFootprint(void) const; // Returns the size of the filter's buffers in bytes
+
+private:
+    void filterRect(const RawDepth* src, RawDepth* dst, unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1, int band); // Filters [x0, x1) x [y0, y1) of src into dst
+    void filterVertical(const RawDepth* src, unsigned int y, unsigned int xa, unsigned int xb, Accumulator* acc, RawDepth* row) const; // Vertical kernel at row y, columns [xa, xb)
+    void filterHorizontal(const RawDepth* row, unsigned int x0, unsigned int x1, RawDepth* dst) const; // Horizontal kernel along columns [x0, x1) of a row
+    RawDepth filterBorderPixel(const RawDepth* row, int x) const; // Horizontal kernel renormalized to the taps inside the row
+    void filterTaps(const RawDepth* base, size_t stride, RawDepth* dst, unsigned int n) const; // Full kernel over n pixels, taps stride bytes apart
+
+    unsigned int width, height; // Width and height of processed frames
+    int numPasses; // Number of filter passes per frame
+    int radius; // Kernel radius
+    Accumulator weights[2*maxRadius+1]; // Binomial kernel weights, summing to 4^radius
+    void allocateRowBuffers(int numBands); // Allocates the per-band row buffers
+    
+    std::vector<RawDepth> spareFrame; // Destination of odd passes
+    std::vector<RawDepth> secondSpareFrame; // Destination of even intermediate passes of the tile-restricted filter
+    std::vector<RawDepth> outputCache; // Output of the last tile-restricted apply()
+    bool outputCacheValid; // Flag whether outputCache is the filtered version of the input last seen by the dirty tiles
+    int numFilteredTiles; // Number of tiles filtered by the last tile-restricted apply()
+    std::vector<unsigned char> passTiles; // Tiles filtered by the current pass
+    std::vector<std::vector<Accumulator> > bandAccumulators; // Per-band weighted sums of one border row
+    std::vector<std::vector<RawDepth> > bandRows; // Per-band vertically filtered row
+};
@@ -0,0 +1,358 @@
+/***********************************************************************
+ SyntheticDepthSource - Depth source generating a procedural sandbox
+ for load and soak tests without a kinect.
+ ***********************************************************************/
+
+#include "SyntheticDepthSource.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace {
+
+const float baseDepth=920.0f; // Depth of the bottom of the sandbox in millimeters
+
+/* Squared distance from a point to the segment from (ax, ay) to (bx, by): */
+inline float segmentDistance2(float px, float py, float ax, float ay, float bx, float by)
+{
+    float dx=bx-ax, dy=by-ay;
+    float len2=dx*dx+dy*dy;
+    float t=len2>0.0f?std::min(std::max(((px-ax)*dx+(py-ay)*dy)/len2,0.0f),1.0f):0.0f;
+    float ex=px-(ax+t*dx), ey=py-(ay+t*dy);
+    return ex*ex+ey*ey;
+}
+
+}
+
+SyntheticDepthSource::SyntheticDepthSource()
+:width(0), height(0), frameRate(0.0f), frameInterval(0), nextFrameTime(0), frameIndex(0), seed(1),
+ relief(140.0f), featureSize(0.25f), numHands(2), noise(1.5f), dropoutRate(0.01f),
+ focalLength(0.0f), baseline(75.0f), generationTime(0), depthPixelsValid(false)
+{
+    for(int i=0;i<maxHands;++i)
+        hands[i].visible=false;
+    workerPool.setNumThreads(1);
+}
+
+bool SyntheticDepthSource::open(unsigned int swidth, unsigned int sheight, float sFrameRate)
+{
+    width=swidth;
+    height=sheight;
+    frameRate=sFrameRate;
+    frameInterval=frameRate>0.0f?uint64_t(1.0e6f/frameRate):0;
+    nextFrameTime=ofGetElapsedTimeMicros();
+    frameIndex=0;
+    generationTime=0;
+    focalLength=getIntrinsics().fx;
+
+    buildTerrain();
+    setNoise(noise);
+
+    rawDepthPixels.allocate(width, height, 1);
+    depthPixels.allocate(width, height, 1);
+    colorPixels.allocate(width, height, 3);
+    colorPixels.set(0);
+    depthPixelsValid=false;
+    return true;
+}
+
+void SyntheticDepthSource::setSeed(uint32_t newSeed)
+{
+    seed=newSeed;
+}
+
+void SyntheticDepthSource::setTerrain(float newRelief, float newFeatureSize)
+{
+    relief=newRelief;
+    featureSize=newFeatureSize;
+}
+
+void SyntheticDepthSource::setNumHands(int newNumHands)
+{
+    numHands=std::min(std::max(newNumHands,0),int(maxHands));
+}
+
+void SyntheticDepthSource::setNoise(float newNoise)
+{
+    /* Draw the noise once; frames pick samples at random from the table: */
+    noise=newNoise;
+    std::minstd_rand rng(seed);
+    std::normal_distribution<float> distribution(0.0f,1.0f);
+    noiseTable.resize(65536);
+    for(size_t i=0;i<noiseTable.size();++i)
+        noiseTable[i]=distribution(rng);
+}
+
+void SyntheticDepthSource::setDropoutRate(float newDropoutRate)
+{
+    dropoutRate=newDropoutRate;
+}
+
+void SyntheticDepthSource::setNumThreads(int newNumThreads)
+{
+    workerPool.setNumThreads(newNumThreads);
+}
+
+float SyntheticDepthSource::getMeanGenerationTime(void) const
+{
+    return frameIndex!=0?float(generationTime)/float(frameIndex):0.0f;
+}
+
+std::string SyntheticDepthSource::getName(void) const
+{
+    return "synthetic";
+}
+
+bool SyntheticDepthSource::isOpen(void) const
+{
+    return !surface.empty();
+}
+
+void SyntheticDepthSource::close(void)
+{
+    surface.clear();
+    rawDepthPixels.clear();
+    depthPixels.clear();
+    colorPixels.clear();
+}
+
+unsigned int SyntheticDepthSource::getWidth(void) const
+{
+    return width;
+}
+
+unsigned int SyntheticDepthSource::getHeight(void) const
+{
+    return height;
+}
+
+bool SyntheticDepthSource::hasColor(void) const
+{
+    return false;
+}
+
+void SyntheticDepthSource::setDepthClipping(float snearclip, float sfarclip)
+{
+    DepthSource::setDepthClipping(snearclip, sfarclip);
+    depthPixelsValid=false;
+}
+
+bool SyntheticDepthSource::update(void)
+{
+    if(surface.empty())
+        return false;
+    if(frameInterval!=0)
+    {
+        uint64_t now=ofGetElapsedTimeMicros();
+        if(now<nextFrameTime)
+            return false;
+
+        /* Keep the pace, but do not catch up on frames missed while nobody asked: */
+        nextFrameTime+=frameInterval;
+        if(nextFrameTime<now)
+            nextFrameTime=now+frameInterval;
+    }
+
+    /* Generate the frame in horizontal bands: */
+    uint64_t startTime=ofGetElapsedTimeMicros();
+    moveHands();
+    int numBands=workerPool.getNumThreads();
+    workerPool.run(numBands,[&](int band){
+        generateRows(height*band/numBands, height*(band+1)/numBands);
+    });
+    ++frameIndex;
+    generationTime+=ofGetElapsedTimeMicros()-startTime;
+    depthPixelsValid=false;
+    return true;
+}
+
+uint64_t SyntheticDepthSource::getTimeToNextFrame(void) const
+{
+    if(frameInterval==0)
+        return 0;
+    uint64_t now=ofGetElapsedTimeMicros();
+    return nextFrameTime>now?nextFrameTime-now:0;
+}
+
+uint32_t SyntheticDepthSource::hash(uint32_t a, uint32_t b, uint32_t c)
+{
+    uint32_t h=a*0x9E3779B1U^(b+0x7F4A7C15U)*0x85EBCA77U^(c+0x165667B1U)*0xC2B2AE3DU;
+    h^=h>>16;
+    h*=0x7FEB352DU;
+    h^=h>>15;
+    h*=0x846CA68BU;
+    h^=h>>16;
+    return h;
+}
+
+float SyntheticDepthSource::valueNoise(float x, float y, uint32_t octave) const
+{
+    /* Bilinear interpolation of random lattice values with smoothstep weights: */
+    float fx=std::floor(x), fy=std::floor(y);
+    int ix=int(fx), iy=int(fy);
+    float tx=x-fx, ty=y-fy;
+    tx=tx*tx*(3.0f-2.0f*tx);
+    ty=ty*ty*(3.0f-2.0f*ty);
+    uint32_t s=seed*16U+octave;
+    float v00=float(hash(uint32_t(ix),uint32_t(iy),s))*(2.0f/4294967295.0f)-1.0f;
+    float v10=float(hash(uint32_t(ix+1),uint32_t(iy),s))*(2.0f/4294967295.0f)-1.0f;
+    float v01=float(hash(uint32_t(ix),uint32_t(iy+1),s))*(2.0f/4294967295.0f)-1.0f;
+    float v11=float(hash(uint32_t(ix+1),uint32_t(iy+1),s))*(2.0f/4294967295.0f)-1.0f;
+    return (v00*(1.0f-tx)+v10*tx)*(1.0f-ty)+(v01*(1.0f-tx)+v11*tx)*ty;
+}
+
+void SyntheticDepthSource::buildTerrain(void)
+{
+    surface.resize(size_t(width)*height);
+    float scale=1.0f/(featureSize*float(width));
+    float valleyPhase=float(hash(seed,0,1)%1000U)*0.001f*float(TWO_PI);
+    for(unsigned int y=0;y<height;++y)
+        for(unsigned int x=0;x<width;++x)
+        {
+            float u=float(x)*scale, v=float(y)*scale;
+
+            /* Fractal noise for the lumps, and dunes as warped ridges across the frame: */
+            float fbm=0.0f, amplitude=1.0f, frequency=1.0f;
+            for(uint32_t octave=0;octave<4;++octave,amplitude*=0.5f,frequency*=2.0f)
+                fbm+=valueNoise(u*frequency, v*frequency, octave)*amplitude;
+            fbm/=1.875f;
+            float warp=valueNoise(u*0.5f, v*0.5f, 8);
+            float ridge=0.5f+0.5f*std::sin(float(TWO_PI)*(u*1.5f+0.6f*warp));
+            float sand=0.45f+0.3f*fbm+0.3f*ridge*ridge;
+
+            /* A winding valley dug across the sandbox: */
+            float center=float(height)*(0.5f+0.25f*std::sin(float(TWO_PI)*1.3f*float(x)/float(width)+valleyPhase));
+            float d=(float(y)-center)/(0.08f*float(height));
+            sand*=1.0f-0.8f*std::exp(-d*d);
+
+            surface[y*width+x]=baseDepth-relief*ofClamp(sand, 0.0f, 1.0f);
+        }
+}
+
+void SyntheticDepthSource::moveHands(void)
+{
+    /* Hands follow the simulated time of the frame, not the wall clock: */
+    float t=float(frameIndex)/(frameRate>0.0f?frameRate:30.0f);
+    float cx=float(width)*0.5f, cy=float(height)*0.5f;
+    for(int i=0;i<maxHands;++i)
+    {
+        Hand& hand=hands[i];
+        float period=12.0f+3.0f*float(i);
+        float phase=std::fmod(t/period+0.37f*float(i)+float(hash(seed,uint32_t(i),2)%1000U)*0.001f, 1.0f);
+        hand.visible=i<numHands&&phase<0.6f;
+        if(!hand.visible)
+            continue;
+
+        /* Reach in from a border, sweep sideways and pull back out: */
+        float reach=std::sin(float(PI)*phase/0.6f);
+        float slide=0.5f+0.5f*std::sin(0.21f*t+float(i));
+        switch(i%3)
+        {
+            case 0: // bottom border
+                hand.entryX=float(width)*(0.25f+0.5f*slide);
+                hand.entryY=float(height)+10.0f;
+                break;
+            case 1: // right border
+                hand.entryX=float(width)+10.0f;
+                hand.entryY=float(height)*(0.25f+0.5f*slide);
+                break;
+            default: // left border
+                hand.entryX=-10.0f;
+                hand.entryY=float(height)*(0.25f+0.5f*slide);
+                break;
+        }
+        float sway=0.15f*float(width)*std::sin(0.9f*t+float(i))*reach;
+        hand.palmX=hand.entryX+(cx-hand.entryX)*0.8f*reach+sway;
+        hand.palmY=hand.entryY+(cy-hand.entryY)*0.8f*reach+sway*0.5f;
+
+        /* Hover 200 to 320 mm above the bottom of the sandbox, dipping towards the sand: */
+        hand.depth=baseDepth-260.0f-60.0f*std::sin(0.7f*t+float(i));
+        hand.radius=focalLength*45.0f/hand.depth;
+        hand.shadow=focalLength*baseline*(1.0f/hand.depth-1.0f/(baseDepth-relief*0.5f));
+    }
+}
+
+void SyntheticDepthSource::generateRows(unsigned int y0, unsigned int y1)
+{
+    uint16_t* rowPtr=rawDepthPixels.getData()+size_t(y0)*width;
+    uint32_t dropThreshold=uint32_t(double(dropoutRate)*4294967295.0);
+    float quantization=1.0f/(8.0f*focalLength*baseline); // kinect disparity steps are 1/8 pixel
+    float noiseScale=noise*1.0e-6f;
+    for(unsigned int y=y0;y<y1;++y,rowPtr+=width)
+    {
+        /* Hands reaching this row, including their shadows: */
+        const Hand* rowHands[maxHands];
+        int numRowHands=0;
+        for(int i=0;i<maxHands;++i)
+        {
+            const Hand& hand=hands[i];
+            if(hand.visible&&float(y)>=std::min(hand.entryY,hand.palmY)-hand.radius&&float(y)<=std::max(hand.entryY,hand.palmY)+hand.radius)
+                rowHands[numRowHands++]=&hand;
+        }
+
+        /* The noise of a row only depends on the seed, the frame and the row: */
+        uint32_t random=hash(seed,uint32_t(frameIndex),y)|1U;
+        const float* sPtr=surface.data()+size_t(y)*width;
+        float fy=float(y);
+        for(unsigned int x=0;x<width;++x)
+        {
+            random^=random<<13;
+            random^=random>>17;
+            random^=random<<5;
+
+            float z=sPtr[x];
+            bool inHand=false, edge=false, shadowed=false;
+            float fx=float(x);
+            for(int h=0;h<numRowHands;++h)
+            {
+                const Hand& hand=*rowHands[h];
+                float r2=hand.radius*hand.radius;
+                float d2=segmentDistance2(fx, fy, hand.entryX, hand.entryY, hand.palmX, hand.palmY);
+                if(d2<r2)
+                {
+                    /* Rounded back of the hand: */
+                    float zh=hand.depth+15.0f*d2/r2;
+                    if(zh<z)
+                    {
+                        z=zh;
+                        inHand=true;
+                        edge=std::sqrt(d2)>hand.radius-1.5f;
+                    }
+                }
+                else if(segmentDistance2(fx-hand.shadow, fy, hand.entryX, hand.entryY, hand.palmX, hand.palmY)<r2)
+                    shadowed=true; // the emitter, beside the camera, does not reach this sand
+            }
+            if((shadowed&&!inHand)||random<dropThreshold||(edge&&(random&0x100U)))
+            {
+                rowPtr[x]=0;
+                continue;
+            }
+
+            /* Noise growing with the square of the depth, then quantized to disparity steps: */
+            z+=noiseTable[random>>16]*noiseScale*z*z;
+            float step=z*z*quantization;
+            z=std::floor(z/step+0.5f)*step;
+            rowPtr[x]=uint16_t(ofClamp(z, 1.0f, 65535.0f));
+        }
+    }
+}
+
+const ofShortPixels& SyntheticDepthSource::getRawDepthPixels(void)
+{
+    return rawDepthPixels;
+}
+
+const ofPixels& SyntheticDepthSource::getDepthPixels(void)
+{
+    if(!depthPixelsValid)
+    {
+        mapDepth(rawDepthPixels.getData(), depthPixels.getData(), surface.size());
+        depthPixelsValid=true;
+    }
+    return depthPixels;
+}
+
+const ofPixels& SyntheticDepthSource::getColorPixels(void)
+{
+    return colorPixels;
+}
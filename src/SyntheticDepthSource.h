@@ -0,0 +1,88 @@
+/***********************************************************************
+ SyntheticDepthSource - Depth source generating a procedural sandbox
+ for load and soak tests without a kinect: fractal dunes and a winding
+ valley, hands moving over the sand with the shadows the kinect's
+ offset emitter casts beside them, depth-dependent sensor noise and
+ disparity quantization, and dropped samples at random and along edges.
+ Frames are generated into the source's own buffers at a set frame
+ rate, or one per update() at maximum speed. Everything is driven by
+ the frame number and the seed, not the wall clock, so a run produces
+ the same frames whatever the timing and number of threads.
+ ***********************************************************************/
+
+#pragma once
+#include "DepthSource.h"
+#include "WorkerPool.h"
+#include <stdint.h>
+#include <vector>
+
+class SyntheticDepthSource: public DepthSource {
+public:
+    SyntheticDepthSource();
+
+    bool open(unsigned int swidth, unsigned int sheight, float sFrameRate); // Builds the terrain and starts generating frames; a frame rate of 0 generates one per update()
+    void setSeed(uint32_t newSeed); // Selects the terrain, hand paths and noise; call before open() (default 1)
+    void setTerrain(float newRelief, float newFeatureSize); // Sets the height range of the sand in millimeters (default 140) and the dune size as a fraction of the frame width (default 0.25); call before open()
+    void setNumHands(int newNumHands); // Sets the number of hands moving over the sand (default 2, at most maxHands)
+    void setNoise(float newNoise); // Sets the standard deviation of the depth noise at 1 m in millimeters, growing with the square of the depth (default 1.5)
+    void setDropoutRate(float newDropoutRate); // Sets the fraction of samples dropped at random (default 0.01)
+    void setNumThreads(int newNumThreads); // Sets the number of threads generating each frame (default 1, 0 = one per core)
+    uint64_t getFrameIndex(void) const // Returns the number of frames generated since open()
+    {
+        return frameIndex;
+    }
+    float getMeanGenerationTime(void) const; // Returns the mean time spent generating a frame, in microseconds
+
+    virtual std::string getName(void) const;
+    virtual bool isOpen(void) const;
+    virtual void close(void);
+    virtual unsigned int getWidth(void) const;
+    virtual unsigned int getHeight(void) const;
+    virtual bool hasColor(void) const;
+    virtual void setDepthClipping(float snearclip, float sfarclip);
+    virtual bool update(void);
+    virtual uint64_t getTimeToNextFrame(void) const;
+    virtual const ofShortPixels& getRawDepthPixels(void);
+    virtual const ofPixels& getDepthPixels(void);
+    virtual const ofPixels& getColorPixels(void);
+
+    static const int maxHands=4;
+
+private:
+    struct Hand // Arm reaching in from the frame border, in pixels and millimeters
+    {
+        float entryX, entryY; // Point where the arm crosses the border
+        float palmX, palmY; // Center of the palm
+        float radius; // Half the width of the arm, and radius of the palm
+        float depth; // Depth of the back of the hand
+        float shadow; // Width of the emitter shadow beside the hand, in pixels
+        bool visible;
+    };
+
+    void buildTerrain(void); // Computes the noise-free sand surface from the seed
+    void moveHands(void); // Places the hands for the current frame index
+    void generateRows(unsigned int y0, unsigned int y1); // Draws rows [y0, y1) of the current frame
+    float valueNoise(float x, float y, uint32_t octave) const; // Smooth lattice noise in [-1, 1]
+    static uint32_t hash(uint32_t a, uint32_t b, uint32_t c); // Mixes three integers into a random 32-bit value
+
+    unsigned int width, height;
+    float frameRate; // Frames per second, 0 for one frame per update()
+    uint64_t frameInterval; // Time between frames in microseconds
+    uint64_t nextFrameTime; // Time the next frame is due, in microseconds
+    uint64_t frameIndex; // Number of the current frame, drives the hands and the noise
+    uint32_t seed;
+    float relief, featureSize;
+    int numHands;
+    float noise; // Standard deviation of the noise at 1 m in millimeters
+    float dropoutRate; // Fraction of samples dropped at random
+    float focalLength, baseline; // Depth camera focal length in pixels and emitter offset in millimeters, for shadows and quantization
+    std::vector<float> surface; // Noise-free sand depth in millimeters
+    std::vector<float> noiseTable; // Normally distributed noise of unit deviation, drawn from at random
+    Hand hands[maxHands];
+    WorkerPool workerPool; // Threads generating horizontal bands of each frame
+    uint64_t generationTime; // Total time spent generating frames, in microseconds
+    ofShortPixels rawDepthPixels; // Current frame in millimeters
+    ofPixels depthPixels; // Current frame's 8-bit depth
+    bool depthPixelsValid; // Flag whether depthPixels holds the current frame
+    ofPixels colorPixels; // Black color frame
+};
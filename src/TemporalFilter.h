@@ -0,0 +1,198 @@
+/***********************************************************************
+ TemporalFilter - Per-pixel averaging buffer and running statistics of a
+ stream of depth frames, templated on the raw depth type. Frames are
+ processed in horizontal bands by a WorkerPool using the kernels of
+ FrameFilterKernels.
+ ***********************************************************************/
+
+#pragma once
+#include "FrameFilterKernels.h"
+#include "WorkerPool.h"
+
+template <class RawDepthParam>
+class TemporalFilter {
+public:
+    typedef RawDepthParam RawDepth; // Data type for raw depth values
+    typedef FrameFilterKernels::DepthTraits<RawDepth> Traits;
+    typedef FrameFilterKernels::TemporalParams<RawDepth> Params;
+    typedef FrameFilterKernels::TemporalBuffers<RawDepth> Buffers;
+
+    TemporalFilter()
+    :width(0), height(0), numAveragingSlots(0), averagingSlotIndex(0),
+     averagingBuffer(0), countBuffer(0), sumBuffer(0), sumSqBuffer(0), validBuffer(0)
+    {
+    }
+    ~TemporalFilter()
+    {
+        release();
+    }
+
+    void allocate(unsigned int swidth, unsigned int sheight, int sNumAveragingSlots) // Allocates and clears all buffers
+    {
+        release();
+        width=swidth;
+        height=sheight;
+        numAveragingSlots=sNumAveragingSlots;
+        size_t numPixels=getNumPixels();
+
+        averagingBuffer=new RawDepth[numAveragingSlots*numPixels];
+        countBuffer=new typename Traits::SampleCount[numPixels];
+        sumBuffer=new typename Traits::SampleSum[numPixels];
+        sumSqBuffer=new typename Traits::SampleSumSq[numPixels];
+        validBuffer=new RawDepth[numPixels];
+        clear();
+    }
+    void release(void) // Releases all buffers
+    {
+        delete[] averagingBuffer;
+        delete[] countBuffer;
+        delete[] sumBuffer;
+        delete[] sumSqBuffer;
+        delete[] validBuffer;
+        averagingBuffer=0;
+        countBuffer=0;
+        sumBuffer=0;
+        sumSqBuffer=0;
+        validBuffer=0;
+    }
+    void clear(void) // Discards all samples and stable values
+    {
+        size_t numPixels=getNumPixels();
+        for(size_t i=0;i<numAveragingSlots*numPixels;++i)
+            averagingBuffer[i]=Traits::invalidSample; // Mark sample as invalid
+        for(size_t i=0;i<numPixels;++i)
+        {
+            countBuffer[i]=0;
+            sumBuffer[i]=0;
+            sumSqBuffer[i]=0;
+            validBuffer[i]=0;
+        }
+        averagingSlotIndex=0;
+    }
+    bool isAllocated(void) const
+    {
+        return averagingBuffer!=0;
+    }
+
+    /* Enters a new frame into the averaging buffer and writes the filtered frame: */
+    void process(const RawDepth* input, RawDepth* output, const Params& params, FrameFilterKernels::Isa isa, WorkerPool& workerPool)
+    {
+        Buffers buffers;
+        buffers.input=input;
+        buffers.averagingSlot=averagingBuffer+averagingSlotIndex*getNumPixels();
+        buffers.count=countBuffer;
+        buffers.sum=sumBuffer;
+        buffers.sumSq=sumSqBuffer;
+        buffers.valid=validBuffer;
+        buffers.output=output;
+
+        /* Process horizontal bands of the frame in parallel: */
+        int numBands=workerPool.getNumThreads();
+        workerPool.run(numBands,[&](int band){
+            unsigned int y0=band*height/numBands;
+            unsigned int y1=(band+1)*height/numBands;
+            FrameFilterKernels::temporal(isa,buffers.advance(size_t(y0)*width),size_t(y1-y0)*width,params);
+        });
+
+        /* Go to the next averaging slot: */
+        if(++averagingSlotIndex==numAveragingSlots)
+            averagingSlotIndex=0;
+    }
+
+    /* Maps all samples and stable values through a table indexed by raw depth, as when the units of the raw depth change; samples mapped to invalid values are discarded: */
+    void remap(const RawDepth* lookupTable, WorkerPool& workerPool)
+    {
+        size_t numPixels=getNumPixels();
+
+        /* Remap horizontal bands of the buffers in parallel: */
+        int numBands=workerPool.getNumThreads();
+        workerPool.run(numBands,[&](int band){
+            size_t i0=size_t(band*height/numBands)*width;
+            size_t i1=size_t((band+1)*height/numBands)*width;
+            for(size_t i=i0;i<i1;++i)
+            {
+                /* Remap the pixel's samples in all slots and recompute its statistics from them, so samples leaving the buffer subtract what they added: */
+                typename Traits::Accumulator count=0,sum=0,sumSq=0;
+                for(RawDepth* abPtr=averagingBuffer+i;abPtr<averagingBuffer+numAveragingSlots*numPixels;abPtr+=numPixels)
+                {
+                    if(*abPtr==Traits::invalidSample)
+                        continue;
+                    RawDepth newVal=lookupTable[*abPtr];
+                    if(Traits::isValid(newVal))
+                    {
+                        *abPtr=newVal;
+                        ++count;
+                        sum+=newVal;
+                        sumSq+=typename Traits::Accumulator(newVal)*newVal;
+                    }
+                    else
+                        *abPtr=Traits::invalidSample;
+                }
+                countBuffer[i]=typename Traits::SampleCount(count);
+                sumBuffer[i]=typename Traits::SampleSum(sum);
+                sumSqBuffer[i]=typename Traits::SampleSumSq(sumSq);
+
+                /* Remap the stable value, 0 if it falls outside the valid range: */
+                RawDepth newValid=lookupTable[validBuffer[i]];
+                validBuffer[i]=Traits::isValid(newValid)?newValid:0;
+            }
+        });
+    }
+
+    size_t getAveragingBufferSize(void) const // Returns the size of the averaging buffer in bytes, all slots
+    {
+        return isAllocated()?getNumPixels()*numAveragingSlots*sizeof(RawDepth):0;
+    }
+    size_t getStatisticsSize(void) const // Returns the size of the count, sum and sum of squares planes in bytes
+    {
+        return isAllocated()?getNumPixels()*(sizeof(typename Traits::SampleCount)+sizeof(typename Traits::SampleSum)+sizeof(typename Traits::SampleSumSq)):0;
+    }
+    size_t getValidBufferSize(void) const // Returns the size of the stable value plane in bytes
+    {
+        return isAllocated()?getNumPixels()*sizeof(RawDepth):0;
+    }
+    size_t getBytesPerFrame(void) const // Returns the number of bytes the kernels stream through the cache per frame
+    {
+        if(!isAllocated())
+            return 0;
+        return getNumPixels()*(3*sizeof(RawDepth)+sizeof(typename Traits::SampleCount)+sizeof(typename Traits::SampleSum)+sizeof(typename Traits::SampleSumSq)+sizeof(RawDepth));
+    }
+    const RawDepth* getValidBuffer(void) const // Returns the most recent stable value of each pixel
+    {
+        return validBuffer;
+    }
+    const RawDepth* getAveragingBuffer(void) const // Returns the averaging buffer, slot after slot
+    {
+        return averagingBuffer;
+    }
+    const typename Traits::SampleCount* getCountBuffer(void) const // Returns the number of valid samples of each pixel
+    {
+        return countBuffer;
+    }
+    const typename Traits::SampleSum* getSumBuffer(void) const // Returns the sum of the valid samples of each pixel
+    {
+        return sumBuffer;
+    }
+    const typename Traits::SampleSumSq* getSumSqBuffer(void) const // Returns the sum of squares of the valid samples of each pixel
+    {
+        return sumSqBuffer;
+    }
+
+private:
+    size_t getNumPixels(void) const
+    {
+        return size_t(width)*size_t(height);
+    }
+
+    TemporalFilter(const TemporalFilter&); // Prohibit copy constructor
+    TemporalFilter& operator=(const TemporalFilter&); // Prohibit assignment operator
+
+    unsigned int width, height; // Width and height of processed frames
+    int numAveragingSlots; // Number of slots in each pixel's averaging buffer
+    int averagingSlotIndex; // Index of averaging slot in which to store the next frame's depth values
+    RawDepth* averagingBuffer; // Buffer to calculate running averages of each pixel's depth value
+    typename Traits::SampleCount* countBuffer; // Number of valid samples of each pixel in the averaging buffer
+    typename Traits::SampleSum* sumBuffer; // Sum of the valid samples of each pixel in the averaging buffer
+    typename Traits::SampleSumSq* sumSqBuffer; // Sum of squares of the valid samples of each pixel in the averaging buffer
+    RawDepth* validBuffer; // Buffer holding the most recent stable depth value for each pixel
+};
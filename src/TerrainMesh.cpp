@@ -0,0 +1,355 @@
+/***********************************************************************
+ TerrainMesh - Persistent triangle mesh of the sand surface with
+ quadtree level of detail.
+ ***********************************************************************/
+
+#include "TerrainMesh.h"
+#include <algorithm>
+#include <cmath>
+
+/****************************
+ Methods of class TerrainMesh:
+ ****************************/
+
+TerrainMesh::TerrainMesh()
+:depthWidth(0), depthHeight(0), rootsX(0), rootsY(0), verticesX(0), verticesY(0), tolerance(2.0f), hasOutput(false),
+ lastNumUpdatedVertices(0), lastNumRebuiltRoots(0), lastUpdateTime(0)
+{
+    for(int v=0;v<256;++v)
+        depthToMillimeters[v]=0.0f;
+    workerPool.setNumThreads(1);
+}
+
+void TerrainMesh::setNumThreads(int newNumThreads)
+{
+    workerPool.setNumThreads(newNumThreads);
+}
+
+void TerrainMesh::setup(unsigned int newDepthWidth, unsigned int newDepthHeight, const DepthSource::Intrinsics& intrinsics, float nearclip, float farclip)
+{
+    depthWidth=newDepthWidth;
+    depthHeight=newDepthHeight;
+    rootsX=int((depthWidth+rootSize-1)/rootSize);
+    rootsY=int((depthHeight+rootSize-1)/rootSize);
+    verticesX=rootsX*rootSize+1;
+    verticesY=rootsY*rootSize+1;
+
+    /* 8-bit depth d covers the millimeters around farclip-(d+0.5)*step; invalid samples lie flat on the far clip: */
+    float step=(farclip-nearclip)/255.0f;
+    depthToMillimeters[0]=farclip;
+    for(int v=1;v<256;++v)
+        depthToMillimeters[v]=farclip-(float(v)+0.5f)*step;
+    rayX.resize(verticesX);
+    for(int x=0;x<verticesX;++x)
+        rayX[x]=(float(x)-intrinsics.cx)/intrinsics.fx;
+    rayY.resize(verticesY);
+    for(int y=0;y<verticesY;++y)
+        rayY[y]=(float(y)-intrinsics.cy)/intrinsics.fy;
+
+    /* The vertex grid never changes size, only its positions, normals and triangles: */
+    size_t numVertices=size_t(verticesX)*verticesY;
+    mesh.clear();
+    mesh.setMode(OF_PRIMITIVE_TRIANGLES);
+    mesh.getVertices().resize(numVertices);
+    mesh.getNormals().assign(numVertices,ofVec3f(0.0f,0.0f,-1.0f));
+    std::vector<ofVec2f>& texCoords=mesh.getTexCoords();
+    texCoords.resize(numVertices);
+    for(int y=0;y<verticesY;++y)
+        for(int x=0;x<verticesX;++x)
+        {
+            texCoords[size_t(y)*verticesX+x].x=float(x);
+            texCoords[size_t(y)*verticesX+x].y=float(y);
+        }
+    heights.assign(numVertices,farclip);
+    activeVertices.assign(numVertices,0);
+
+    int numRoots=rootsX*rootsY;
+    rootLeaves.assign(numRoots,std::vector<Leaf>());
+    rootTriangles.assign(numRoots,std::vector<ofIndexType>());
+    dirtyRoots.assign(numRoots,0);
+    changedRoots.assign(numRoots,0);
+    hasOutput=false;
+}
+
+void TerrainMesh::setTolerance(float newTolerance)
+{
+    tolerance=newTolerance;
+    hasOutput=false;
+}
+
+unsigned int TerrainMesh::getNumLeaves(void) const
+{
+    size_t numLeaves=0;
+    for(size_t root=0;root<rootLeaves.size();++root)
+        numLeaves+=rootLeaves[root].size();
+    return (unsigned int)(numLeaves);
+}
+
+void TerrainMesh::updatePositions(const unsigned char* depth, int root, ofPoint* vertices)
+{
+    /* A root node owns its vertices up to but excluding its right and bottom edges, except on the last column and row of root nodes: */
+    int rx=root%rootsX,ry=root/rootsX;
+    int x0=rx*rootSize,x1=rx==rootsX-1?verticesX:x0+rootSize;
+    int y0=ry*rootSize,y1=ry==rootsY-1?verticesY:y0+rootSize;
+    for(int y=y0;y<y1;++y)
+    {
+        const unsigned char* dRow=depth+size_t(std::min(y,int(depthHeight)-1))*depthWidth;
+        size_t index=size_t(y)*verticesX+x0;
+        for(int x=x0;x<x1;++x,++index)
+        {
+            float z=depthToMillimeters[dRow[std::min(x,int(depthWidth)-1)]];
+            heights[index]=z;
+            vertices[index].x=rayX[x]*z;
+            vertices[index].y=rayY[y]*z;
+            vertices[index].z=z;
+        }
+    }
+}
+
+void TerrainMesh::updateNormals(const ofPoint* vertices, ofVec3f* normals, int x0, int y0, int x1, int y1) const
+{
+    /* Central differences over the full resolution grid, facing the camera, whatever the level of detail: */
+    for(int y=y0;y<y1;++y)
+    {
+        const ofPoint* above=vertices+size_t(std::max(y-1,0))*verticesX;
+        const ofPoint* row=vertices+size_t(y)*verticesX;
+        const ofPoint* below=vertices+size_t(std::min(y+1,verticesY-1))*verticesX;
+        for(int x=x0;x<x1;++x)
+        {
+            const ofPoint& left=row[std::max(x-1,0)];
+            const ofPoint& right=row[std::min(x+1,verticesX-1)];
+            float dxx=right.x-left.x,dxy=right.y-left.y,dxz=right.z-left.z;
+            float dyx=below[x].x-above[x].x,dyy=below[x].y-above[x].y,dyz=below[x].z-above[x].z;
+            float nx=dyy*dxz-dyz*dxy;
+            float ny=dyz*dxx-dyx*dxz;
+            float nz=dyx*dxy-dyy*dxx;
+            float length=std::sqrt(nx*nx+ny*ny+nz*nz);
+            ofVec3f& n=normals[size_t(y)*verticesX+x];
+            if(length>0.0f)
+            {
+                n.x=nx/length;
+                n.y=ny/length;
+                n.z=nz/length;
+            }
+            else
+            {
+                n.x=n.y=0.0f;
+                n.z=-1.0f;
+            }
+        }
+    }
+}
+
+bool TerrainMesh::isFlat(int x, int y, int size) const
+{
+    const float* h=&heights[size_t(y)*verticesX+x];
+    float h00=h[0],h10=h[size];
+    float h01=h[size_t(size)*verticesX],h11=h[size_t(size)*verticesX+size];
+    float scale=1.0f/float(size);
+    for(int j=0;j<=size;++j,h+=verticesX)
+    {
+        float t=float(j)*scale;
+        float left=h00+(h01-h00)*t;
+        float slope=(h10+(h11-h10)*t-left)*scale;
+        for(int i=0;i<=size;++i)
+            if(std::abs(h[i]-(left+slope*float(i)))>tolerance)
+                return false;
+    }
+    return true;
+}
+
+void TerrainMesh::collectLeaves(int x, int y, int size, std::vector<Leaf>& leaves) const
+{
+    if(size<=leafSize||isFlat(x,y,size))
+    {
+        Leaf leaf;
+        leaf.x=uint16_t(x);
+        leaf.y=uint16_t(y);
+        leaf.size=uint16_t(size);
+        leaves.push_back(leaf);
+        return;
+    }
+    int half=size/2;
+    collectLeaves(x,y,half,leaves);
+    collectLeaves(x+half,y,half,leaves);
+    collectLeaves(x,y+half,half,leaves);
+    collectLeaves(x+half,y+half,half,leaves);
+}
+
+void TerrainMesh::buildTriangles(int root)
+{
+    std::vector<ofIndexType>& triangles=rootTriangles[root];
+    triangles.clear();
+    std::vector<ofIndexType> boundary;
+    boundary.reserve(4*rootSize);
+    const std::vector<Leaf>& leaves=rootLeaves[root];
+    for(size_t l=0;l<leaves.size();++l)
+    {
+        /* Walk the leaf's boundary around, keeping the corners of all leaves on it: */
+        int x0=leaves[l].x,y0=leaves[l].y,size=leaves[l].size;
+        int x1=x0+size,y1=y0+size;
+        boundary.clear();
+        for(int x=x0;x<x1;++x)
+            if(activeVertices[size_t(y0)*verticesX+x])
+                boundary.push_back(ofIndexType(size_t(y0)*verticesX+x));
+        for(int y=y0;y<y1;++y)
+            if(activeVertices[size_t(y)*verticesX+x1])
+                boundary.push_back(ofIndexType(size_t(y)*verticesX+x1));
+        for(int x=x1;x>x0;--x)
+            if(activeVertices[size_t(y1)*verticesX+x])
+                boundary.push_back(ofIndexType(size_t(y1)*verticesX+x));
+        for(int y=y1;y>y0;--y)
+            if(activeVertices[size_t(y)*verticesX+x0])
+                boundary.push_back(ofIndexType(size_t(y)*verticesX+x0));
+
+        /* Fan around the center vertex: */
+        ofIndexType center=ofIndexType(size_t(y0+size/2)*verticesX+x0+size/2);
+        size_t numBoundary=boundary.size();
+        for(size_t i=0;i<numBoundary;++i)
+        {
+            triangles.push_back(center);
+            triangles.push_back(boundary[i]);
+            triangles.push_back(boundary[i+1<numBoundary?i+1:0]);
+        }
+    }
+}
+
+void TerrainMesh::update(const ofPixels& depth, const std::vector<unsigned char>* dirtyTiles, unsigned int tileSize)
+{
+    uint64_t startTime=ofGetElapsedTimeMicros();
+    if(!isValid()||depth.getWidth()!=depthWidth||depth.getHeight()!=depthHeight)
+        return;
+
+    /* A root node depends on the pixels under its vertices, including its right and bottom edges: */
+    int tilesX=tileSize>0?int((depthWidth+tileSize-1)/tileSize):0;
+    int tilesY=tileSize>0?int((depthHeight+tileSize-1)/tileSize):0;
+    bool incremental=hasOutput&&dirtyTiles!=0&&int(dirtyTiles->size())==tilesX*tilesY;
+    int numRoots=rootsX*rootsY;
+    pendingRoots.clear();
+    unsigned int numVertices=0;
+    for(int root=0;root<numRoots;++root)
+    {
+        int rx=root%rootsX,ry=root/rootsX;
+        bool dirty=!incremental;
+        if(incremental)
+        {
+            int tx0=std::min(rx*rootSize,int(depthWidth)-1)/int(tileSize);
+            int tx1=std::min((rx+1)*rootSize,int(depthWidth)-1)/int(tileSize);
+            int ty0=std::min(ry*rootSize,int(depthHeight)-1)/int(tileSize);
+            int ty1=std::min((ry+1)*rootSize,int(depthHeight)-1)/int(tileSize);
+            for(int ty=ty0;ty<=ty1&&!dirty;++ty)
+                for(int tx=tx0;tx<=tx1&&!dirty;++tx)
+                    dirty=(*dirtyTiles)[ty*tilesX+tx]!=0;
+        }
+        dirtyRoots[root]=dirty?1:0;
+        changedRoots[root]=0;
+        if(dirty)
+        {
+            pendingRoots.push_back(root);
+            numVertices+=(rx==rootsX-1?rootSize+1:rootSize)*(ry==rootsY-1?rootSize+1:rootSize);
+        }
+    }
+    lastNumUpdatedVertices=numVertices;
+    lastNumRebuiltRoots=0;
+    if(pendingRoots.empty())
+    {
+        lastUpdateTime=ofGetElapsedTimeMicros()-startTime;
+        return;
+    }
+
+    /* Move the vertices; root nodes own disjoint vertices: */
+    const unsigned char* depthData=depth.getData();
+    ofPoint* vertices=&mesh.getVertices()[0];
+    ofVec3f* normals=&mesh.getNormals()[0];
+    int numThreads=workerPool.getNumThreads();
+    int numPending=int(pendingRoots.size());
+    workerPool.run(numThreads,[&](int thread){
+        for(int i=thread;i<numPending;i+=numThreads)
+            updatePositions(depthData,pendingRoots[i],vertices);
+    });
+
+    /* Recompute the normals of the moved vertices and of the edges of the root nodes beside them, and the leaves of the dirty root nodes: */
+    std::vector<int> normalRoots;
+    for(int root=0;root<numRoots;++root)
+    {
+        int rx=root%rootsX,ry=root/rootsX;
+        if(dirtyRoots[root]||(rx>0&&dirtyRoots[root-1])||(rx<rootsX-1&&dirtyRoots[root+1])||(ry>0&&dirtyRoots[root-rootsX])||(ry<rootsY-1&&dirtyRoots[root+rootsX]))
+            normalRoots.push_back(root);
+    }
+    int numNormalRoots=int(normalRoots.size());
+    workerPool.run(numThreads,[&](int thread){
+        std::vector<Leaf> leaves;
+        for(int i=thread;i<numNormalRoots;i+=numThreads)
+        {
+            int root=normalRoots[i];
+            int rx=root%rootsX,ry=root/rootsX;
+            int x0=rx*rootSize,x1=rx==rootsX-1?verticesX:x0+rootSize;
+            int y0=ry*rootSize,y1=ry==rootsY-1?verticesY:y0+rootSize;
+            if(dirtyRoots[root])
+            {
+                updateNormals(vertices,normals,x0,y0,x1,y1);
+                leaves.clear();
+                collectLeaves(rx*rootSize,ry*rootSize,rootSize,leaves);
+                if(leaves!=rootLeaves[root])
+                {
+                    rootLeaves[root].swap(leaves);
+                    changedRoots[root]=1;
+                }
+            }
+            else
+            {
+                if(rx>0&&dirtyRoots[root-1])
+                    updateNormals(vertices,normals,x0,y0,x0+1,y1);
+                if(rx<rootsX-1&&dirtyRoots[root+1])
+                    updateNormals(vertices,normals,x1-1,y0,x1,y1);
+                if(ry>0&&dirtyRoots[root-rootsX])
+                    updateNormals(vertices,normals,x0,y0,x1,y0+1);
+                if(ry<rootsY-1&&dirtyRoots[root+rootsX])
+                    updateNormals(vertices,normals,x0,y1-1,x1,y1);
+            }
+        }
+    });
+
+    /* Leaves that changed move the active vertices on the edges of the root nodes beside them too: */
+    bool anyChanged=false;
+    for(int root=0;root<numRoots;++root)
+        anyChanged=anyChanged||changedRoots[root];
+    if(anyChanged)
+    {
+        std::fill(activeVertices.begin(),activeVertices.end(),0);
+        for(int root=0;root<numRoots;++root)
+            for(std::vector<Leaf>::const_iterator lIt=rootLeaves[root].begin();lIt!=rootLeaves[root].end();++lIt)
+            {
+                size_t corner=size_t(lIt->y)*verticesX+lIt->x;
+                activeVertices[corner]=1;
+                activeVertices[corner+lIt->size]=1;
+                activeVertices[corner+size_t(lIt->size)*verticesX]=1;
+                activeVertices[corner+size_t(lIt->size)*verticesX+lIt->size]=1;
+            }
+        pendingRoots.clear();
+        for(int root=0;root<numRoots;++root)
+        {
+            int rx=root%rootsX,ry=root/rootsX;
+            if(changedRoots[root]||(rx>0&&changedRoots[root-1])||(rx<rootsX-1&&changedRoots[root+1])||(ry>0&&changedRoots[root-rootsX])||(ry<rootsY-1&&changedRoots[root+rootsX]))
+                pendingRoots.push_back(root);
+        }
+        numPending=int(pendingRoots.size());
+        workerPool.run(numThreads,[&](int thread){
+            for(int i=thread;i<numPending;i+=numThreads)
+                buildTriangles(pendingRoots[i]);
+        });
+        lastNumRebuiltRoots=(unsigned int)(numPending);
+
+        /* Gather the triangles of all root nodes: */
+        size_t numIndices=0;
+        for(int root=0;root<numRoots;++root)
+            numIndices+=rootTriangles[root].size();
+        std::vector<ofIndexType>& indices=mesh.getIndices();
+        indices.clear();
+        indices.reserve(numIndices);
+        for(int root=0;root<numRoots;++root)
+            indices.insert(indices.end(),rootTriangles[root].begin(),rootTriangles[root].end());
+    }
+    hasOutput=true;
+    lastUpdateTime=ofGetElapsedTimeMicros()-startTime;
+}
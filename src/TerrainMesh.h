@@ -0,0 +1,105 @@
+/***********************************************************************
+ TerrainMesh - Persistent triangle mesh of the sand surface, in the
+ depth camera's space in millimeters. The mesh has one vertex per depth
+ pixel, plus a last row and column repeating the frame's edge so it
+ splits evenly into square root nodes, and is allocated once: each
+ frame, only the vertices of the root nodes crossing the dirty tiles of
+ the depth frame are moved, and only their normals and those of the
+ vertices around them are recomputed. Each root node is a quadtree
+ whose nodes collapse where the surface does not stray from the
+ bilinear patch between the node's corners by more than a tolerance,
+ down to leaves of two by two cells. A leaf is drawn as a fan around
+ its center vertex through every vertex of its boundary that is a
+ corner of a neighboring leaf, so leaves of different sizes meet
+ without cracks. The triangles of a root node are only rebuilt when its
+ leaves or those of a root node beside it change.
+ ***********************************************************************/
+
+#pragma once
+#include "ofMain.h"
+#include "DepthSource.h"
+#include "WorkerPool.h"
+#include <stdint.h>
+#include <vector>
+
+class TerrainMesh {
+public:
+    TerrainMesh();
+
+    void setNumThreads(int newNumThreads); // Sets the number of threads updating root nodes (default 1, 0 = one per core)
+
+    /* Allocates the mesh for depth frames of the given size, camera model and clip range; the next update rebuilds everything: */
+    void setup(unsigned int depthWidth, unsigned int depthHeight, const DepthSource::Intrinsics& intrinsics, float nearclip, float farclip);
+    void setTolerance(float newTolerance); // Sets the largest height error of a collapsed node in millimeters (default 2); the next update rebuilds every quadtree
+    bool isValid(void) const // Returns true if the mesh was set up
+    {
+        return rootsX>0;
+    }
+
+    /* Updates the mesh from an 8-bit depth frame; given the dirty tiles of tileSize pixels since the previously updated frame, only the root nodes crossing them: */
+    void update(const ofPixels& depth, const std::vector<unsigned char>* dirtyTiles, unsigned int tileSize);
+    ofMesh& getMesh(void) // Returns the mesh, with vertices, normals, texture coordinates in depth pixels and triangles
+    {
+        return mesh;
+    }
+    unsigned int getNumTriangles(void) const
+    {
+        return (unsigned int)(mesh.getNumIndices()/3);
+    }
+    unsigned int getNumLeaves(void) const; // Returns the number of quadtree leaves drawn
+    unsigned int getLastNumUpdatedVertices(void) const // Returns the number of vertices moved by the last update
+    {
+        return lastNumUpdatedVertices;
+    }
+    unsigned int getLastNumRebuiltRoots(void) const // Returns the number of root nodes whose triangles the last update rebuilt
+    {
+        return lastNumRebuiltRoots;
+    }
+    uint64_t getLastUpdateTime(void) const // Returns the time spent on the last update, in microseconds
+    {
+        return lastUpdateTime;
+    }
+
+    static const int rootSize=32; // Width and height of the root nodes in cells
+    static const int leafSize=2; // Width and height of the smallest quadtree leaves in cells
+
+private:
+    struct Leaf // Quadtree leaf, in vertices of the mesh
+    {
+        uint16_t x, y, size;
+
+        bool operator==(const Leaf& other) const
+        {
+            return x==other.x&&y==other.y&&size==other.size;
+        }
+    };
+
+    TerrainMesh(const TerrainMesh&); // Prohibit copy constructor
+    TerrainMesh& operator=(const TerrainMesh&); // Prohibit assignment operator
+
+    void updatePositions(const unsigned char* depth, int root, ofPoint* vertices); // Moves the vertices owned by a root node
+    void updateNormals(const ofPoint* vertices, ofVec3f* normals, int x0, int y0, int x1, int y1) const; // Recomputes the normals of the vertices [x0, x1) x [y0, y1)
+    bool isFlat(int x, int y, int size) const; // Returns true if the node's vertices lie within the tolerance of the bilinear patch between its corners
+    void collectLeaves(int x, int y, int size, std::vector<Leaf>& leaves) const; // Appends the leaves of a node
+    void buildTriangles(int root); // Rebuilds the triangles of a root node from its leaves and the active vertices
+
+    unsigned int depthWidth, depthHeight; // Size of the depth frames
+    int rootsX, rootsY; // Number of root nodes
+    int verticesX, verticesY; // Size of the vertex grid
+    float depthToMillimeters[256]; // Depth of each 8-bit value, the far clip for invalid samples
+    std::vector<float> rayX, rayY; // Direction of each column and row of pixels per millimeter of depth
+    float tolerance; // Largest height error of a collapsed node in millimeters
+    ofMesh mesh;
+    std::vector<float> heights; // Depth of each vertex in millimeters
+    std::vector<std::vector<Leaf> > rootLeaves; // Leaves of each root node
+    std::vector<std::vector<ofIndexType> > rootTriangles; // Triangle indices of each root node
+    std::vector<unsigned char> activeVertices; // Flags whether each vertex is a corner of a leaf
+    std::vector<unsigned char> dirtyRoots; // Flags whether each root node crosses a dirty tile
+    std::vector<unsigned char> changedRoots; // Flags whether the leaves of each root node changed
+    std::vector<int> pendingRoots; // Root nodes to update in the current frame
+    bool hasOutput; // Flag whether the whole mesh was updated since it was set up
+    WorkerPool workerPool; // Threads updating root nodes
+    unsigned int lastNumUpdatedVertices; // Number of vertices moved by the last update
+    unsigned int lastNumRebuiltRoots; // Number of root nodes whose triangles the last update rebuilt
+    uint64_t lastUpdateTime; // Time spent on the last update, in microseconds
+};
@@ -0,0 +1,79 @@
+/***********************************************************************
+ TripleBuffer - Lock-free single-producer single-consumer mailbox with
+ latest-wins semantics. The producer fills a back buffer and publishes
+ it by swapping it with the middle buffer; the consumer swaps the middle
+ buffer with its front buffer when a new one was published. A published
+ buffer replaced before the consumer took it is dropped, and reused by
+ the producer without copying. Neither side ever waits for the other.
+ ***********************************************************************/
+
+#pragma once
+#include <atomic>
+#include <stdint.h>
+
+template <class ValueParam>
+class TripleBuffer {
+public:
+    typedef ValueParam Value; // Type of the exchanged values
+
+    TripleBuffer()
+    :middle(1), back(2), front(0), numProduced(0), numConsumed(0), numDropped(0)
+    {
+    }
+
+    /* Producer side: */
+    Value& getBackBuffer(void) // Returns the buffer to fill before publish()
+    {
+        return buffers[back];
+    }
+    void publish(void) // Makes the back buffer the newest value, dropping the previous one if it was not consumed
+    {
+        unsigned int previous=middle.exchange(back|freshFlag,std::memory_order_acq_rel);
+        if(previous&freshFlag)
+            numDropped.fetch_add(1,std::memory_order_relaxed);
+        back=previous&indexMask;
+        numProduced.fetch_add(1,std::memory_order_relaxed);
+    }
+
+    /* Consumer side: */
+    bool tryConsume(void) // Moves the newest published value to the front buffer; returns false if nothing new was published
+    {
+        if(!(middle.load(std::memory_order_relaxed)&freshFlag))
+            return false;
+        unsigned int previous=middle.exchange(front,std::memory_order_acq_rel);
+        front=previous&indexMask;
+        numConsumed.fetch_add(1,std::memory_order_relaxed);
+        return true;
+    }
+    Value& getFrontBuffer(void) // Returns the last consumed value
+    {
+        return buffers[front];
+    }
+
+    /* Counters, readable from any thread: */
+    uint64_t getNumProduced(void) const
+    {
+        return numProduced.load(std::memory_order_relaxed);
+    }
+    uint64_t getNumConsumed(void) const
+    {
+        return numConsumed.load(std::memory_order_relaxed);
+    }
+    uint64_t getNumDropped(void) const
+    {
+        return numDropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    static const unsigned int indexMask=0x3U; // Bits of middle holding the buffer index
+    static const unsigned int freshFlag=0x4U; // Bit of middle set while the middle buffer was not consumed
+
+    TripleBuffer(const TripleBuffer&); // Prohibit copy constructor
+    TripleBuffer& operator=(const TripleBuffer&); // Prohibit assignment operator
+
+    Value buffers[3];
+    std::atomic<unsigned int> middle; // Index of the middle buffer and fresh flag, shared by both sides
+    unsigned int back; // Index of the buffer owned by the producer
+    unsigned int front; // Index of the buffer owned by the consumer
+    std::atomic<uint64_t> numProduced, numConsumed, numDropped;
+};
@@ -0,0 +1,126 @@
+/***********************************************************************
+ WorkerPool - Persistent pool of worker threads running batches of
+ independent tasks (e.g. horizontal bands of a depth frame). The thread
+ calling run() takes part in the batch and returns once every task of
+ the batch is finished, so consecutive batches act as barriers.
+ ***********************************************************************/
+
+#include "WorkerPool.h"
+
+WorkerPool::WorkerPool()
+:batchTask(0), batchSize(0), nextTask(0), pendingTasks(0), activeRunners(0), generation(0), stopping(false)
+{
+}
+
+WorkerPool::~WorkerPool()
+{
+    stopWorkers();
+}
+
+void WorkerPool::setNumThreads(int newNumThreads)
+{
+    if(newNumThreads<=0)
+        newNumThreads=std::max(1,int(std::thread::hardware_concurrency()));
+    if(newNumThreads==getNumThreads())
+        return;
+
+    stopWorkers();
+    stopping=false;
+    for(int i=1;i<newNumThreads;++i)
+        workers.push_back(std::thread(&WorkerPool::workerLoop,this));
+}
+
+int WorkerPool::getNumThreads(void) const
+{
+    return int(workers.size())+1;
+}
+
+void WorkerPool::run(int numTasks, const Task& task)
+{
+    if(numTasks<=0)
+        return;
+
+    /* Run small batches on the calling thread: */
+    if(workers.empty()||numTasks==1)
+    {
+        for(int i=0;i<numTasks;++i)
+            task(i);
+        return;
+    }
+
+    /* Publish the batch: */
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        batchTask=&task;
+        batchSize=numTasks;
+        nextTask=0;
+        pendingTasks=numTasks;
+        ++generation;
+    }
+    startCond.notify_all();
+
+    /* Take part in the batch, then wait for the tasks still running on workers: */
+    runTasks();
+    std::unique_lock<std::mutex> lock(mutex);
+    doneCond.wait(lock,[this]{return pendingTasks==0&&activeRunners==0;});
+    batchTask=0;
+}
+
+void WorkerPool::stopWorkers(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping=true;
+    }
+    startCond.notify_all();
+    for(size_t i=0;i<workers.size();++i)
+        workers[i].join();
+    workers.clear();
+}
+
+void WorkerPool::workerLoop(void)
+{
+    unsigned int seenGeneration;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        seenGeneration=generation;
+    }
+    while(true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            startCond.wait(lock,[&]{return stopping||generation!=seenGeneration;});
+            if(stopping)
+                return;
+            seenGeneration=generation;
+        }
+        runTasks();
+    }
+}
+
+void WorkerPool::runTasks(void)
+{
+    const Task* task;
+    int size;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        task=batchTask;
+        size=batchSize;
+        if(task==0)
+            return;
+        ++activeRunners; // Keeps the batch alive until this thread lets go of task
+    }
+
+    int finished=0;
+    for(int i=nextTask++;i<size;i=nextTask++)
+    {
+        (*task)(i);
+        ++finished;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    pendingTasks-=finished;
+    --activeRunners;
+    if(pendingTasks==0&&activeRunners==0)
+        doneCond.notify_all();
+}
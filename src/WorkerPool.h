@@ -0,0 +1,44 @@
+/***********************************************************************
+ WorkerPool - Persistent pool of worker threads running batches of
+ independent tasks (e.g. horizontal bands of a depth frame). The thread
+ calling run() takes part in the batch and returns once every task of
+ the batch is finished, so consecutive batches act as barriers.
+ ***********************************************************************/
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkerPool {
+public:
+    typedef std::function<void(int)> Task; // Task body, called with the task index
+
+    WorkerPool();
+    ~WorkerPool();
+
+    void setNumThreads(int newNumThreads); // Sets the total number of threads, including the calling thread (0 = hardware concurrency)
+    int getNumThreads(void) const; // Returns the total number of threads taking part in a batch
+    void run(int numTasks, const Task& task); // Runs task(0)..task(numTasks-1) and waits for completion
+
+private:
+    void stopWorkers(void);
+    void workerLoop(void);
+    void runTasks(void);
+
+    std::vector<std::thread> workers; // Worker threads, in addition to the calling thread
+    std::mutex mutex; // Protects the batch state below
+    std::condition_variable startCond; // Signals workers that a new batch is available
+    std::condition_variable doneCond; // Signals the calling thread that the batch is finished
+    const Task* batchTask; // Task of the current batch
+    int batchSize; // Number of tasks in the current batch
+    std::atomic<int> nextTask; // Index of the next task to hand out
+    int pendingTasks; // Number of tasks of the current batch not finished yet
+    int activeRunners; // Number of threads currently holding the batch's task
+    unsigned int generation; // Batch counter, used by workers to detect a new batch
+    bool stopping; // Flag to shut the workers down
+};
@@ -1,9 +1,21 @@
 #include "ofMain.h"
 #include "ofApp.h"
 #include "ofAppGLFWWindow.h"
+#include "BenchmarkSuites.h"
 
 //========================================================================
-int main( ){
+int main(int argc, char* argv[]){
+	// --benchmark [filter|codec|render]... [--recording <file>] runs the benchmark suites instead of the application,
+	// in a small window providing the OpenGL context of the color map's texture
+	if (argc > 1 && std::string(argv[1]) == "--benchmark") {
+		ofGLFWWindowSettings settings;
+		settings.width = 320;
+		settings.height = 240;
+		settings.title = "Benchmark";
+		ofCreateWindow(settings);
+		return BenchmarkSuites::run(std::vector<std::string>(argv+2, argv+argc));
+	}
+	
 //	ofSetupOpenGL(1024,768,OF_WINDOW);			// <-------- setup the GL context
 
 	// this kicks off the running of my app
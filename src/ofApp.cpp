@@ -1,4 +1,5 @@
 #include "ofApp.h"
+#include "SyntheticDepthSource.h"
 
 using namespace ofxCv;
 using namespace cv;
@@ -20,10 +21,6 @@ void ofApp::setup(){
 	gotROI = 0;
 	kinectROI = ofRectangle(0, 0, 640, 480);
 	
-	//Mesh calib
-	meshwidth = 2;
-	meshheight = 2;
-	
     // contourFinder config
 	chessboardThreshold = 60;
 	lowThresh = 0.2;
@@ -43,12 +40,66 @@ void ofApp::setup(){
 	unsigned int maxVariance=2;
 	float hysteresis=0.1f;
 	bool spatialFilter=false;
+	bool fillHoles=true; // fill shadows and never-seen pixels from their surroundings
 	gradFieldresolution = 20;
+	int numFilterThreads=0; // 0 = one thread per core
+	bool useRawDepth=false; // filter raw depth in millimeters: stable across clip changes, maxVariance in mm^2
+	bool useExponentialFilter=false; // constant memory statistics, numAveragingSlots is then the window length
+	std::string playbackFile=""; // play back a depth recording from the data folder instead of the kinect, e.g. "recordings/sandbox.sbxd"
+	bool playbackRealTime=true; // false plays the recording as fast as the filter runs, to benchmark the pipeline
+	bool useSyntheticSource=false; // generate a procedural sandbox with moving hands instead of reading the kinect, for soak and load tests
+	int syntheticWidth=640, syntheticHeight=480; // larger frames load the filter beyond what the kinect delivers
+	float syntheticFrameRate=30.0f; // frames per second, above 30 to stress the pipeline, 0 = as fast as the grabber takes them
+	int syntheticNumHands=2;
+	uint32_t syntheticSeed=1; // the same seed gives the same frames, run after run
+	useCpuRenderer=false; // render the colormap and contour lines on the CPU, for GPUs too weak for the shader at the projector's resolution
+	numRemapIntervals=8; // planes of the depth-aware projector mapping, more follow the relief of a deep clip range more closely
+	rayMarchProjection=false; // march each projector pixel's ray into the terrain instead: hills cast their projection shadows, at a higher cost
+	int numSensors=1; // sensors fused into one heightmap for large tables, placed by the poses of "sensors.yml"; synthetic sensors each generate their own sandbox, for load tests only
     
     // kinectgrabber: setup
-	kinectgrabber.setup();
+	// a real time playback loops, a benchmark stops at the end of the recording and prints the grabber's statistics
+	bool sourceReady = false;
+	if (!playbackFile.empty())
+		sourceReady = kinectgrabber.setupPlayback(playbackFile, playbackRealTime, playbackRealTime);
+	if (!sourceReady && useSyntheticSource) {
+		SyntheticDepthSource* syntheticSource = new SyntheticDepthSource;
+		syntheticSource->setSeed(syntheticSeed);
+		syntheticSource->setNumHands(syntheticNumHands);
+		syntheticSource->open(syntheticWidth, syntheticHeight, syntheticFrameRate);
+		sourceReady = kinectgrabber.setup(syntheticSource);
+	}
+	if (!sourceReady)
+		kinectgrabber.setup();
+	if (numSensors > 1) {
+		std::vector<DepthFusion::Pose> poses;
+		if (DepthFusion::loadPoses("sensors.yml", poses)) {
+			std::vector<DepthSource*> otherSources;
+			for (int i = 1; i < numSensors; ++i) {
+				if (useSyntheticSource) {
+					SyntheticDepthSource* syntheticSource = new SyntheticDepthSource;
+					syntheticSource->setSeed(syntheticSeed+i);
+					syntheticSource->setNumHands(syntheticNumHands);
+					syntheticSource->open(syntheticWidth, syntheticHeight, syntheticFrameRate);
+					otherSources.push_back(syntheticSource);
+				} else {
+					KinectDepthSource* kinectSource = new KinectDepthSource;
+					kinectSource->open(i);
+					otherSources.push_back(kinectSource);
+				}
+			}
+			kinectgrabber.setupFusion(otherSources, poses, 0.5f*(nearclip+farclip));
+		}
+	}
 	//	kinectgrabber.setupClip(nearclip, farclip);
+	if (useRawDepth)
+		kinectgrabber.framefilter.setDepthMode(FrameFilter::RAW_DEPTH);
+	if (useExponentialFilter)
+		kinectgrabber.framefilter.setFilterMode(FrameFilter::EXPONENTIAL_FILTER);
 	kinectgrabber.setupFramefilter(numAveragingSlots, minNumSamples, maxVariance, hysteresis, spatialFilter, gradFieldresolution,nearclip, farclip);
+	kinectgrabber.framefilter.setNumThreads(numFilterThreads);
+	kinectgrabber.getFusion().setNumThreads(numFilterThreads);
+	kinectgrabber.framefilter.setFillHoles(fillHoles);
 	kinectgrabber.startThread();
 	
     // calibration config
@@ -64,7 +115,7 @@ void ofApp::setup(){
 	
 	// Calibration setup: make the wrapper (to make calibration independant of the drivers...)
     kinectWrapper = new RGBDCamCalibWrapperOfxKinect();
-    kinectWrapper->setup(&kinectgrabber.kinect);
+    kinectWrapper->setup(&kinectgrabber.getKinect());
     kinectProjectorCalibration.setup(kinectWrapper, projectorWidth, projectorHeight);
 	// some default config
     kinectProjectorCalibration.chessboardSize = chessboardSize;
@@ -79,14 +130,22 @@ void ofApp::setup(){
 	
 	// Load colormap
     colormap.load("HeightColorMap.yml");
+	colorMapRenderer.setColorMap(colormap);
+	colorMapRenderer.setNumThreads(numFilterThreads);
+	projectorRemap.setNumThreads(numFilterThreads);
+	projectorRayMarcher.setNumThreads(numFilterThreads);
+	remapStale = true;
+	lastMarchedSequence = 0;
 	
     // prepare shaders and fbo
 	contourlinefactor = 50;
     shader.load( "shaderVert.c", "shaderFrag.c" );
     fbo.allocate( projectorWidth, projectorHeight);
 	
-	FilteredDepthImage.allocate(640, 480);
-	FilteredDepthImage.setUseTexture(true);
+	filteredDepthTexture.allocate(640, 480, GL_LUMINANCE);
+	filteredTextureValid = false;
+	lastFilteredSequence = 0;
+	latencyPending = false;
 	
 	// setup the gui
     setupGui();
@@ -95,55 +154,68 @@ void ofApp::setup(){
 //--------------------------------------------------------------
 void ofApp::update(){
 	
-	// Get depth image from kinect grabber
-	ofPixels filteredframe;
-	if (kinectgrabber.filtered.tryReceive(filteredframe)) {
-		///		// If true, `filteredframe` can be used.
-		FilteredDepthImage.setFromPixels(filteredframe);
-		FilteredDepthImage.updateTexture();
+	// Get the newest depth image from kinect grabber; older unread ones were dropped
+	bool newGradient = false;
+	if (const KinectGrabber::FilteredFrame* message = kinectgrabber.receiveFilteredFrame()) {
+		// Keep a handle on the frame instead of copying it; the previous frame returns to the pool
+		filteredFrame = message->frame;
+		pendingLatency = message->trace;
+		pendingLatency.stamp(LatencyTrace::QUEUE, ofGetElapsedTimeMicros());
+		
+		// The dirty tiles are relative to the previous frame of the sequence; after a gap the whole texture is stale
+		bool consecutive = message->sequence == lastFilteredSequence+1;
+		lastFilteredSequence = message->sequence;
+		uploadFilteredDepth(filteredFrame.getPixels(), message->hasDirtyTiles && consecutive ? &message->dirtyTiles : NULL);
+		// the test mode maps the depth to the projector through the calibration, relief included;
+		// the tables are only rebuilt when the calibration, ROI or clip range changed
+		if (enableTestmode && remapStale) {
+			const ofPixels& depth = filteredFrame.getPixels();
+			ProjectorRemap::Projection project = [this](const ofPoint& p) -> ofPoint { return kinectProjectorOutput.projectFromDepthXYZ(p); };
+			if (rayMarchProjection) {
+				projectorRayMarcher.build(depth.getWidth(), depth.getHeight(), nearclip, farclip, projectorWidth, projectorHeight, project);
+				ofLog(OF_LOG_NOTICE, "Projector rays built in "+ofToString(projectorRayMarcher.getLastBuildTime())+" us, "+ofToString(projectorRayMarcher.getNumSteps())+" steps");
+			} else {
+				projectorRemap.build(depth.getWidth(), depth.getHeight(), kinectROI, nearclip, farclip, numRemapIntervals, projectorWidth, projectorHeight, project);
+				ofLog(OF_LOG_NOTICE, "Projector remap built in "+ofToString(projectorRemap.getLastBuildTime())+" us");
+			}
+			remapStale = false;
+		}
+		const ofPixels* projectedDepth = NULL;
+		if (enableTestmode && projectorRayMarcher.isValid()) {
+			// only the rays crossing tiles changed since the last marched frame are marched again
+			bool marchedPrevious = message->sequence == lastMarchedSequence+1;
+			projectorRayMarcher.march(filteredFrame.getPixels(), message->hasDirtyTiles && marchedPrevious ? &message->dirtyTiles : NULL, gradFieldresolution);
+			lastMarchedSequence = message->sequence;
+			projectedDepth = &projectorRayMarcher.getProjectedDepth();
+		} else if (enableTestmode && projectorRemap.isValid()) {
+			projectorRemap.remap(filteredFrame.getPixels(), projectedFrame);
+			projectedDepth = &projectedFrame;
+		}
+		if (projectedDepth != NULL)
+			projectedDepthTexture.loadData(*projectedDepth);
+		// the CPU renderer produces what the shader would draw, uploaded in place of the depth
+		if (useCpuRenderer && (enableTestmode || enableGame)) {
+			colorMapRenderer.render(projectedDepth != NULL ? *projectedDepth : filteredFrame.getPixels(), projectorWidth, projectorHeight, contourlinefactor, renderedFrame);
+			renderedTexture.loadData(renderedFrame);
+		}
+		pendingLatency.stamp(LatencyTrace::TEXTURE_UPLOAD, ofGetElapsedTimeMicros());
+		latencyPending = true;
 		
-		kinectgrabber.lock();
-		kinectgrabber.storedframes -= 1;
-		//		cout << kinectgrabber.storedframes << endl;
-		kinectgrabber.unlock();
+		// The snapshot is immutable and stays alive while we hold it, whatever the grabber does
+		if (message->gradient.isValid()) {
+			newGradient = message->gradient.getVersion() != (gradientField.isValid() ? gradientField.getVersion() : 0);
+			gradientField = message->gradient;
+		}
 		
-		thresholdedImage.setFromPixels(FilteredDepthImage.getPixels());
+		// the calibration view shows the frame thresholded, the test mode draws the texture only
+		if (enableCalibration)
+			thresholdedImage.setFromPixels(filteredFrame.getPixels());
 		
 		if (enableTestmode){
 			// find our contours in the label image
 			//			if (highThresh != 1.0) cvThreshold(thresholdedImage.getCvImage(), thresholdedImage.getCvImage(), highThresh * 255, 255, CV_THRESH_TOZERO_INV);
 			//			if (lowThresh != 0.0) cvThreshold(thresholdedImage.getCvImage(), thresholdedImage.getCvImage(), lowThresh * 255, 255, CV_THRESH_TOZERO);
 			//			contourFinder.findContours(thresholdedImage, 12, 640*480, 3, true);
-			
-			//Create mesh
-			//Set up vertices and colors
-			//			mesh.clear();
-			//			ofPoint wrld;
-			//			int indx, indy;
-			//			float indz;
-			//			for (int y=0; y<meshheight; y++) {
-			//				for (int x=0; x<meshwidth; x++) {
-			//					indx = 640/(meshwidth-1)*x;
-			//					indy = 480/(meshheight-1)*y;
-			//					indz = farclip;//(255.0-filteredframe.getData()[indy*640+indx])/255.0*(farclip-nearclip)+nearclip;
-			//					wrld = kinectgrabber.kinect.getWorldCoordinateAt(indx, indy, indz);
-			//					mesh.addVertex(wrld);
-			//					//mesh.addColor( ofColor( 0, 0, 0 ) );
-			//					mesh.addTexCoord( ofPoint( indx,indy ) );
-			//				}
-			//			}
-			//			//Set up triangles' indices
-			//			for (int y=0; y<meshheight-1; y++) {
-			//				for (int x=0; x<meshwidth-1; x++) {
-			//					int i1 = x + meshwidth * y;
-			//					int i2 = x+1 + meshwidth * y;
-			//					int i3 = x + meshwidth * (y+1);
-			//					int i4 = x+1 + meshwidth * (y+1);
-			//					mesh.addTriangle( i1, i2, i3 );
-			//					mesh.addTriangle( i2, i4, i3 );
-			//				}
-			//			}
-			//			setNormals( mesh );			//Set normals to the surface
 		}
 	}
 	
@@ -172,69 +244,34 @@ void ofApp::update(){
 					kinectgrabber.nearclipchannel.send(500);
 					kinectgrabber.farclipchannel.send(4000);
 					gotROI = 2;
-					
-					large = ofPolyline();
-					threshold = 220;
-				} else if (gotROI == 2) {
-					vector<ofVec2f> pointBufFastCheck = kinectProjectorCalibration.getFastCheckResults() ;
-					while (threshold < 255){
-						thresholdedImage.setFromPixels(FilteredDepthImage.getPixels());
-						thresholdedImage.mirror(verticalMirror, horizontalMirror);
-						//cvThreshold(thresholdedImage.getCvImage(), thresholdedImage.getCvImage(), highThresh+10, 255, CV_THRESH_TOZERO_INV);
-						cvThreshold(thresholdedImage.getCvImage(), thresholdedImage.getCvImage(), threshold, 255, CV_THRESH_TOZERO);
-						
-						contourFinder.findContours(thresholdedImage, 12, 640*480, 5, true);
-						//contourFinder.findContours(thresholdedImage);
-						//ofPoint cent = ofPoint(projectorWidth/2, projectorHeight/2);
-						
-						ofPolyline small = ofPolyline();
-						for (int i = 0; i < contourFinder.nBlobs; i++) {
-							ofxCvBlob blobContour = contourFinder.blobs[i];
-							if (blobContour.hole) {
-								//								if(!blobContour.isClosed())
-								//									blobContour.close();
-								bool ok = true;
-								ofPolyline poly = ofPolyline(blobContour.pts);//.getResampledByCount(50);
-								for (int j = 0; j < pointBufFastCheck.size(); j++){
-									if (!poly.inside(pointBufFastCheck[j].x, pointBufFastCheck[j].y)) {
-										ok = false;
-										break;
-									}
-								}
-								if (ok) {
-									if (small.size() == 0 || poly.getArea() > small.getArea())
-										small = poly;
-								}
-							}
-						}
-						if (large.getArea() < small.getArea())
-							large = small;
-						threshold+=1;
-					} //else {
-					kinectROI = large.getBoundingBox();
-					if (horizontalMirror) {
-						kinectROI.x = 640 -kinectROI.x;
-						kinectROI.width = -kinectROI.width;
-					}
-					if (verticalMirror) {
-						kinectROI.y = 480 -kinectROI.y;
-						kinectROI.height = -kinectROI.height;
-					}
-					kinectROI.standardize();
-					// We are finished, set back kinect depth range
-					gotROI = 3;
-					kinectgrabber.nearclipchannel.send(nearclip);
-					kinectgrabber.farclipchannel.send(farclip);
-					//}
+				} else if (gotROI == 2 && filteredFrame.isValid() && !roiDetector.isBusy()) {
+					// find the largest region enclosed by the box around the chessboard for all thresholds
+					// from 220 at once, off the UI thread; the result is collected below
+					roiDetector.start(filteredFrame.getPixels(), kinectProjectorCalibration.getFastCheckResults(), 220, horizontalMirror, verticalMirror);
 				}
 			}
 		}
 	}
 	
+	RoiDetector::Result roiResult;
+	if (gotROI == 2 && roiDetector.tryGetResult(roiResult)) {
+		if (roiResult.found) {
+			kinectROI = roiResult.roi;
+			remapStale = true;
+		}
+		else
+			ofLog(OF_LOG_WARNING, "ROI not found: the chessboard is not enclosed by the box");
+		ofLog(OF_LOG_NOTICE, "ROI detected in "+ofToString(roiResult.detectionTime)+" us at threshold "+ofToString(roiResult.threshold));
+		// We are finished, set back kinect depth range
+		gotROI = 3;
+		kinectgrabber.nearclipchannel.send(nearclip);
+		kinectgrabber.farclipchannel.send(farclip);
+	}
+	
 	if (enableGame) {
-		if (kinectgrabber.gradient.tryReceive(gradientField)) {
+		if (newGradient) {
 			for (auto & v : vehicles){
-				v.applyBehaviours(vehicles, gradientField);
+				v.applyBehaviours(vehicles, gradientField.getData());
 				//			v.borders();
 				v.update();
 			}
@@ -245,6 +282,47 @@ void ofApp::update(){
     guiUpdateLabels();
 }
 
+//--------------------------------------------------------------
+void ofApp::uploadFilteredDepth(const ofPixels& frame, const std::vector<unsigned char>* dirtyTiles){
+	// Upload the whole frame if the texture does not hold the previous filtered frame
+	int tileSize = gradFieldresolution;
+	int tilesX = (frame.getWidth()+tileSize-1)/tileSize;
+	int tilesY = (frame.getHeight()+tileSize-1)/tileSize;
+	if (dirtyTiles == NULL || !filteredTextureValid || int(dirtyTiles->size()) != tilesX*tilesY) {
+		filteredDepthTexture.loadData(frame);
+		filteredTextureValid = dirtyTiles != NULL;
+		return;
+	}
+	
+#ifndef TARGET_OPENGLES
+	// Upload each run of dirty tiles of a row of tiles in one call
+	const ofTextureData& texData = filteredDepthTexture.getTextureData();
+	int width = frame.getWidth(), height = frame.getHeight();
+	glBindTexture(texData.textureTarget, texData.textureID);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, width);
+	for (int ty = 0; ty < tilesY; ty++) {
+		int tx = 0;
+		while (tx < tilesX) {
+			if (!(*dirtyTiles)[ty*tilesX+tx]) {
+				tx++;
+				continue;
+			}
+			int tx0 = tx;
+			while (tx < tilesX && (*dirtyTiles)[ty*tilesX+tx])
+				tx++;
+			int x0 = tx0*tileSize, x1 = std::min(tx*tileSize, width);
+			int y0 = ty*tileSize, y1 = std::min(y0+tileSize, height);
+			glTexSubImage2D(texData.textureTarget, 0, x0, y0, x1-x0, y1-y0, ofGetGLFormatFromInternal(texData.glInternalFormat), GL_UNSIGNED_BYTE, frame.getData()+y0*width+x0);
+		}
+	}
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	glBindTexture(texData.textureTarget, 0);
+#else
+	filteredDepthTexture.loadData(frame);
+#endif
+}
+
 //--------------------------------------------------------------
 void ofApp::draw(){
 	ofBackground(0);
@@ -255,7 +333,7 @@ void ofApp::draw(){
 	if (enableCalibration) {
 		ofDrawBitmapString("Kinect Input",0,20);
 		kinectColorImage.draw(0,40,320,240);
-		FilteredDepthImage.draw(0,20+240+40+40,320,240);
+		filteredDepthTexture.draw(0,20+240+40+40,320,240);
 		//	kinectColoredDepth.draw(320+20,40,320,240);
 		
 		//ofCircle(160, 160, 5); // Kinect center
@@ -304,7 +382,7 @@ void ofApp::draw(){
 		//
 	} else if (enableTestmode) {
 		ofDrawBitmapString("Grayscale Image",0,20+240+20+40);
-		FilteredDepthImage.draw(0,20+240+40+40,320,240);
+		filteredDepthTexture.draw(0,20+240+40+40,320,240);
 		
 		if (gotROI == 3){
 			ofTranslate(0,20+240+40+40);
@@ -329,6 +407,7 @@ void ofApp::draw(){
 }
 //--------------------------------------------------------------
 void ofApp::drawProj(ofEventArgs & args){
+    uint64_t drawStartTime = ofGetElapsedTimeMicros();
     
 	//if calibrating, then we draw our fast check results here
 	if (enableCalibration) {
@@ -340,6 +419,19 @@ void ofApp::drawProj(ofEventArgs & args){
 		kinectProjectorCalibration.drawChessboard();
 		fbo.end();			//End drawing into buffer
 		fbo.draw( 0, 0 ,projectorWidth, projectorHeight);
+	} else if (enableTestmode && (projectorRemap.isValid() || projectorRayMarcher.isValid())) {
+		// the depth is already in projector space, no homography to apply
+		ofSetColor( 255, 255, 255 );
+		if (useCpuRenderer && renderedTexture.isAllocated()) {
+			renderedTexture.draw( 0, 0 );
+		} else {
+			shader.begin();
+			shader.setUniformTexture( "texture1", colormap.getTexture(), 1 ); //"1" means that it is texture 1
+			shader.setUniform1f("texsize", 255 );
+			shader.setUniform1f("contourLineFactor", contourlinefactor);
+			projectedDepthTexture.draw( 0, 0 );
+			shader.end();
+		}
 	} else if (enableTestmode) {
 		ofPoint des[4];
 		ofPoint src[]={kinectROI.getTopLeft(), kinectROI.getTopRight(), kinectROI.getBottomRight(),kinectROI.getBottomLeft()};
@@ -355,7 +447,7 @@ void ofApp::drawProj(ofEventArgs & args){
 			fbo.begin();		//Start drawing grayscale depth image into buffer
 			ofClear(0);
 			ofSetColor(255, 170, 170);
-			FilteredDepthImage.ofBaseDraws::draw(0, 0, projectorWidth, projectorHeight);
+			filteredDepthTexture.draw(0, 0, projectorWidth, projectorHeight);
 			fbo.end();			//End drawing into buffer
 			
 		glPushMatrix();
@@ -364,14 +456,18 @@ void ofApp::drawProj(ofEventArgs & args){
 			//		fbo.draw( 0, 0 );
 			//2. Drawing to screen through the shader
 			//		kinectProjectorOutput.loadCalibratedView();
+			if (useCpuRenderer && renderedTexture.isAllocated()) {
+				ofSetColor( 255, 255, 255 );
+				renderedTexture.draw( 0, 0 );
+			} else {
 			shader.begin();
 			shader.setUniformTexture( "texture1", colormap.getTexture(), 1 ); //"1" means that it is texture 1
 			shader.setUniform1f("texsize", 255 );
 			shader.setUniform1f("contourLineFactor", contourlinefactor);
 			ofSetColor( 255, 255, 255 );
 		fbo.draw( 0, 0 );//,projectorWidth, projectorHeight);
-			mesh.draw();
 			shader.end();
+			}
 			
 		glPopMatrix();
 		glPopMatrix();
@@ -411,11 +507,15 @@ void ofApp::drawProj(ofEventArgs & args){
 			fbo.begin();		//Start drawing grayscale depth image into buffer
 			ofClear(0);
 			ofSetColor(255, 170, 170);
-			FilteredDepthImage.ofBaseDraws::draw(0, 0, projectorWidth, projectorHeight);
+			filteredDepthTexture.draw(0, 0, projectorWidth, projectorHeight);
 			fbo.end();			//End drawing into buffer
 			
 			//		fbo.draw( 0, 0 ,projectorWidth, projectorHeight);
 			//2. Drawing to screen through the shader
+			if (useCpuRenderer && renderedTexture.isAllocated()) {
+				ofSetColor( 255, 255, 255 );
+				renderedTexture.draw( 0, 0 ,projectorWidth, projectorHeight);
+			} else {
 			shader.begin();
 			shader.setUniformTexture( "texture1", colormap.getTexture(), 1 ); //"1" means that it is texture 1
 			shader.setUniform1f("texsize", 255 );
@@ -423,14 +523,25 @@ void ofApp::drawProj(ofEventArgs & args){
 			ofSetColor( 255, 255, 255 );
 			fbo.draw( 0, 0 ,projectorWidth, projectorHeight);
 			shader.end();
+			}
 			
 			for (auto & v : vehicles){
 				v.draw();
 			}
-			kinectgrabber.framefilter.displayFlowField();
+			FrameFilter::displayFlowField(gradientField);
 		} else {
 			ofBackground(255);
 		}
+		
+		// the first projection of a frame completes its latency trace
+		if (latencyPending) {
+			uint64_t drawEndTime = ofGetElapsedTimeMicros();
+			pendingLatency.stamp(LatencyTrace::DRAW_WAIT, drawStartTime);
+			pendingLatency.stamp(LatencyTrace::DRAW_PROJ, drawEndTime);
+			pendingLatency.setStageTime(LatencyTrace::END_TO_END, drawEndTime-pendingLatency.getArrivalTime());
+			latencyTrace.add(pendingLatency);
+			latencyPending = false;
+		}
 	}
 	
 	//--------------------------------------------------------------
@@ -443,7 +554,31 @@ void ofApp::drawProj(ofEventArgs & args){
 	
 	//--------------------------------------------------------------
 	void ofApp::keyPressed(int key){
-		
+		if (key == 'r' || key == 'R') {
+			// record the raw depth ('R': with color) to the data folder, losslessly compressed on two encoder threads, or stop recording
+			if (kinectgrabber.isRecording()) {
+				kinectgrabber.stopRecording();
+			} else {
+				ofDirectory::createDirectory("recordings", true, true);
+				kinectgrabber.startRecording("recordings/depth-"+ofGetTimestampString()+".sbxd", key == 'R', true, 2);
+			}
+		}
+		if (key == 'm') {
+			// buffer sizes and frame pool allocations, which stop growing in steady state,
+			kinectgrabber.framefilter.printMemoryFootprint();
+			// grabber CPU usage and frame latency since the last press
+			kinectgrabber.printStatistics();
+			kinectgrabber.resetStatistics();
+		}
+		if (key == 'l') {
+			// per-stage latency percentiles of the last projected frames
+			latencyTrace.print();
+		}
+		if (key == 'L') {
+			// the same, with the timings of every frame, as CSV in the data folder
+			ofDirectory::createDirectory("traces", true, true);
+			latencyTrace.dump("traces/latency-"+ofGetTimestampString()+".csv");
+		}
 	}
 	
 	//--------------------------------------------------------------
@@ -633,6 +768,7 @@ void ofApp::drawProj(ofEventArgs & args){
 				kinectgrabber.unlock();
 				
 				kinectProjectorOutput.load("kinectProjector.yml");
+				remapStale = true;
 				guiImageSettings->setVisible(false);
 				guiMappingSettings->setVisible(true);
 				//			gui->setVisible(true);
@@ -661,6 +797,7 @@ void ofApp::drawProj(ofEventArgs & args){
 		} else if (name == "Kinect range") {
 			kinectgrabber.nearclipchannel.send(nearclip);
 			kinectgrabber.farclipchannel.send(farclip);
+			remapStale = true;
 		} else if (name == "Horizontal mirror" || name == "Vertical mirror") {
 			kinectProjectorCalibration.setMirrors(horizontalMirror, verticalMirror);
 			//		kinectProjectorOutput.setMirrors(horizontalMirror, verticalMirror);
@@ -770,48 +907,4 @@ void ofApp::gaussian_elimination(float *input, int n){
 		}  
 	}  
 }
-//--------------------------------------------------------------
-//Universal function which sets normals for the triangle mesh
-void ofApp::setNormals( ofMesh &mesh ){
-	
-	//The number of the vertices
-	int nV = mesh.getNumVertices();
-	
-	//The number of the triangles
-	int nT = mesh.getNumIndices() / 3;
-	
-	vector<ofPoint> norm( nV );			//Array for the normals
-	
-	//Scan all the triangles. For each triangle add its
-	//normal to norm's vectors of triangle's vertices
-	for (int t=0; t<nT; t++) {
-		
-		//Get indices of the triangle t
-		int i1 = mesh.getIndex( 3 * t );
-		int i2 = mesh.getIndex( 3 * t + 1 );
-		int i3 = mesh.getIndex( 3 * t + 2 );
-		
-		//Get vertices of the triangle
-		const ofPoint &v1 = mesh.getVertex( i1 );
-		const ofPoint &v2 = mesh.getVertex( i2 );
-		const ofPoint &v3 = mesh.getVertex( i3 );
-		
-		//Compute the triangle's normal
-		ofPoint dir = ( (v2 - v1).crossed( v3 - v1 ) ).normalized();
-		
-		//Accumulate it to norm array for i1, i2, i3
-		norm[ i1 ] += dir;
-		norm[ i2 ] += dir;
-		norm[ i3 ] += dir;
-	}
-	
-	//Normalize the normal's length
-	for (int i=0; i<nV; i++) {
-		norm[i].normalize();
-	}
-	
-	//Set the normals to mesh
-	mesh.clearNormals();
-	mesh.addNormals( norm );
-}
 
@@ -11,8 +11,13 @@
 #include "ofxXmlSettings.h"
 
 #include "ColorMap.h"
+#include "ColorMapRenderer.h"
 #include "FrameFilter.h"
 #include "KinectGrabber.h"
+#include "LatencyTrace.h"
+#include "ProjectorRayMarcher.h"
+#include "ProjectorRemap.h"
+#include "RoiDetector.h"
 #include "vehicle.h"
 #include "ofxHomographyHelper.h"
 
@@ -46,9 +51,9 @@ public:
     
     void findHomography(ofPoint src[4], ofPoint dst[4], float homography[16]);
     void gaussian_elimination(float *input, int n);
-        void setNormals( ofMesh &mesh );
 
     void createVehicles();
+    void uploadFilteredDepth(const ofPixels& frame, const std::vector<unsigned char>* dirtyTiles); // Uploads the dirty tiles of a filtered frame, or the whole frame
     void guiEvent(ofxUIEventArgs &e);
     void guiUpdateLabels();
     //ofxPanel gui;
@@ -59,6 +64,7 @@ private:
     bool                        enableTestmode, enableCalibration, enableGame;
     int                         gotROI;
     ofRectangle                 kinectROI;
+    RoiDetector                 roiDetector; // finds kinectROI off the UI thread during the calibration
     
     // calibration settings
     int                         projectorWidth;
@@ -71,8 +77,6 @@ private:
 	int mindepth;
 	int maxdepth;
     
-    int threshold;
-    ofPolyline large;
     
     float contourlinefactor;
     bool horizontalMirror, verticalMirror;
@@ -82,20 +86,35 @@ private:
     ofShader                    shader;            //Shader
     ofFbo                       fbo;			//Buffer for intermediate drawing
     ColorMap                    colormap;
+    bool                        useCpuRenderer; // Flag whether the colormap and contour lines are rendered on the CPU instead of the shader
+    ColorMapRenderer            colorMapRenderer;
+    ofPixels                    renderedFrame; // filteredFrame rendered at the projector size by colorMapRenderer
+    ofTexture                   renderedTexture; // Texture of renderedFrame
+    ProjectorRemap              projectorRemap; // Depth-aware mapping of the filtered depth to the projector in test mode
+    int                         numRemapIntervals; // Depth intervals between the planes of projectorRemap
+    bool                        remapStale; // Flag whether the calibration, ROI or clip range changed since projectorRemap was built
+    bool                        rayMarchProjection; // Flag whether the test mode marches the projector's rays into the terrain instead of warping the depth
+    ProjectorRayMarcher         projectorRayMarcher; // Terrain sample hit by each projector pixel in test mode
+    uint64_t                    lastMarchedSequence; // Sequence number of the last frame marched by projectorRayMarcher
+    ofPixels                    projectedFrame; // filteredFrame warped to the projector by projectorRemap
+    ofTexture                   projectedDepthTexture; // Texture of projectedFrame
     KinectGrabber               kinectgrabber;
 
     RGBDCamCalibWrapper*	kinectWrapper;
     KinectProjectorCalibration	kinectProjectorCalibration;
     KinectProjectorOutput	kinectProjectorOutput;
 
-    ofMesh mesh;
-    int meshwidth;          //Mesh size
-    int meshheight;
-    
     ofxCvContourFinder        contourFinder;
-    ofxCvGrayscaleImage     FilteredDepthImage, thresholdedImage;
+    ofxCvGrayscaleImage     thresholdedImage;
+    FramePool::Frame        filteredFrame; // Last depth frame received from the grabber, shared with its pool
+    ofTexture               filteredDepthTexture; // Texture of filteredFrame, updated only where tiles changed
+    bool                    filteredTextureValid; // Flag whether filteredDepthTexture holds the previous filtered frame
+    uint64_t                lastFilteredSequence; // Sequence number of filteredFrame
     ofxCvColorImage         kinectColorImage;
-    ofVec2f*                gradientField;
+    GradientFieldPool::Field gradientField; // Last gradient field snapshot received from the grabber
+    LatencyTrace            latencyTrace; // Stage latencies of the last projected frames
+    LatencyTrace::Record    pendingLatency; // Timings of filteredFrame, completed by its first projector draw
+    bool                    latencyPending; // Flag whether filteredFrame was not projected yet
     
     vector<vehicle> vehicles;
     
@@ -54,7 +54,7 @@ ofPoint vehicle::borders(){
 }
 
 //--------------------------------------------------------------
-ofPoint vehicle::slopes(ofVec2f* gradient){
+ofPoint vehicle::slopes(const ofVec2f* gradient){
     ofPoint desired;
     
     // Predict location 5 (arbitrary choice) frames ahead
@@ -136,7 +136,7 @@ ofPoint vehicle::separate(vector<vehicle> vehicles){
 }
 
 //--------------------------------------------------------------
-void vehicle::applyBehaviours(vector<vehicle> vehicles, ofVec2f* gradient){
+void vehicle::applyBehaviours(vector<vehicle> vehicles, const ofVec2f* gradient){
 
     ofPoint mouse(ofGetMouseX(), ofGetMouseY());
     
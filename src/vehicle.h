@@ -10,9 +10,9 @@ public:
     void applyForce(const ofPoint & force);
     ofPoint seek(const ofPoint & target);
     ofPoint separate(vector<vehicle> vehicles);
-    void applyBehaviours(vector<vehicle> vehicles, ofVec2f* gradient);
+    void applyBehaviours(vector<vehicle> vehicles, const ofVec2f* gradient);
     ofPoint borders();
-    ofPoint slopes(ofVec2f* gradient);
+    ofPoint slopes(const ofVec2f* gradient);
     void update();
     void draw();
 